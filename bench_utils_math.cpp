@@ -0,0 +1,342 @@
+/** \file bench_utils_math.cpp
+ *
+ *  `bench_utils_math' times the BLAS-bound kernels of `utils_math'.
+ *  Copyright (C) 2011-2014 Timothée Flutre
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Compile once per BLAS library, then run both binaries with the same
+ *  options to measure the speedup:
+ *  g++ -Wall -O3 -fopenmp -I.. utils_io.cpp utils_math.cpp bench_utils_math.cpp -lgsl -lgslcblas -lz -o bench_utils_math_ref
+ *  g++ -Wall -O3 -fopenmp -I.. -DUTILS_BLAS_OPENBLAS utils_io.cpp utils_math.cpp bench_utils_math.cpp -lgsl -lopenblas -lz -o bench_utils_math_openblas
+ *  g++ -Wall -O3 -fopenmp -I.. -DUTILS_BLAS_BLIS utils_io.cpp utils_math.cpp bench_utils_math.cpp -lgsl -lblis -lz -o bench_utils_math_blis
+ */
+
+#include <cmath>
+#include <ctime>
+#include <cstring>
+#include <getopt.h>
+#include <libgen.h>
+#include <sys/time.h>
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+using namespace std;
+
+#include <gsl/gsl_rng.h>
+#include <gsl/gsl_randist.h>
+#include <gsl/gsl_blas.h>
+
+#include "utils_io.hpp"
+#include "utils_math.hpp"
+using namespace utils;
+
+#ifndef VERSION
+#define VERSION "1.0.0" // http://semver.org/
+#endif
+
+/** \brief Display the help on stdout.
+ *  \note The format complies with help2man (http://www.gnu.org/s/help2man)
+ */
+void help(char ** argv)
+{
+  cout << "`" << argv[0] << "'"
+       << " times the BLAS-bound kernels of utils_math." << endl
+       << endl
+       << "Usage: " << argv[0] << " [OPTIONS] ..." << endl
+       << endl
+       << "Options:" << endl
+       << "  -h, --help\tdisplay the help and exit" << endl
+       << "  -V, --version\toutput version information and exit" << endl
+       << "  -v, --verbose\tverbosity level (0/default=1/2/3)" << endl
+       << "  -N, --nsamples\tnumber of samples (default=500)" << endl
+       << "  -S, --nsnps\tnumber of SNPs (default=5000)" << endl
+       << "  -G, --ngenes\tnumber of genes (default=1000)" << endl
+       << "  -Q, --ncovars\tnumber of covariates, intercept included (default=5)" << endl
+       << "  -r, --nrep\tnumber of replicates per kernel (default=3)" << endl
+       << "  -t, --threads\tnumber of threads (default=1)" << endl
+       << "  -s, --seed\tseed for the pseudo-random number generator (default=1859)" << endl
+       << endl
+       << "Kernels:" << endl
+       << "  cov\tcovariance of SNPs, G^T G (S x S)" << endl
+       << "  regr\tall gene-SNP regressions, G^T Y (S x G)" << endl
+       << "  errcov\tCalcMleErrorCovariance for one pair of genes" << endl
+       << "  fit\tFitSingleGeneWithSingleSnp for each SNP, timed only (Gflops NA)" << endl
+       << endl
+       << "Examples:" << endl
+       << "  " << argv[0] << " -N 1000 -S 20000 -t 8" << endl
+       << endl
+       << "Report bugs to <>." << endl
+    ;
+}
+
+/** \brief Display version and license information on stdout.
+ */
+void version(char ** argv)
+{
+  cout << argv[0] << " " << VERSION << endl
+       << endl
+       << "Copyright (C) 2011-2014 Timothée Flutre." << endl
+       << "License GPLv3+: GNU GPL version 3 or later <http://gnu.org/licenses/gpl.html>" << endl
+       << "This is free software; see the source for copying conditions.  There is NO" << endl
+       << "warranty; not even for MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE." << endl
+       << endl
+       << "Written by Timothée Flutre." << endl
+    ;
+}
+
+/** \brief Parse the command-line arguments and check the values of the
+ *  compulsory ones.
+ */
+void
+parseCmdLine(
+  int argc,
+  char ** argv,
+  size_t & nbSamples,
+  size_t & nbSnps,
+  size_t & nbGenes,
+  size_t & nbCovars,
+  size_t & nbReps,
+  int & nbThreads,
+  size_t & seed,
+  int & verbose)
+{
+  int c = 0;
+  while(true)
+  {
+    static struct option long_options[] =
+    {
+      {"help", no_argument, 0, 'h'},
+      {"version", no_argument, 0, 'V'},
+      {"verbose", required_argument, 0, 'v'},
+      {"nsamples", required_argument, 0, 'N'},
+      {"nsnps", required_argument, 0, 'S'},
+      {"ngenes", required_argument, 0, 'G'},
+      {"ncovars", required_argument, 0, 'Q'},
+      {"nrep", required_argument, 0, 'r'},
+      {"threads", required_argument, 0, 't'},
+      {"seed", required_argument, 0, 's'},
+      {0, 0, 0, 0}
+    };
+    int option_index = 0;
+    c = getopt_long(argc, argv, "hVv:N:S:G:Q:r:t:s:",
+                    long_options, &option_index);
+    if(c == -1)
+      break;
+    switch(c)
+    {
+    case 0:
+      break;
+    case 'h':
+      help (argv);
+      exit(0);
+    case 'V':
+      version(argv);
+      exit(0);
+    case 'v':
+      verbose = atoi(optarg);
+      break;
+    case 'N':
+      nbSamples = atol(optarg);
+      break;
+    case 'S':
+      nbSnps = atol(optarg);
+      break;
+    case 'G':
+      nbGenes = atol(optarg);
+      break;
+    case 'Q':
+      nbCovars = atol(optarg);
+      break;
+    case 'r':
+      nbReps = atol(optarg);
+      break;
+    case 't':
+      nbThreads = atoi(optarg);
+      break;
+    case 's':
+      seed = atol(optarg);
+      break;
+    case '?':
+      printf("\n"); help(argv);
+      abort();
+    default:
+      printf("\n"); help(argv);
+      abort();
+    }
+  }
+  if(nbCovars < 1 || nbSamples <= nbCovars + 1){
+    cerr << "cmd-line: " << getCmdLine(argc, argv) << endl << endl
+	 << "ERROR: --nsamples should be larger than --ncovars + 1,"
+	 << " and --ncovars should include the intercept" << endl << endl;
+    help(argv);
+    exit(1);
+  }
+  if(nbSnps == 0 || nbGenes < 2 || nbReps == 0){
+    cerr << "cmd-line: " << getCmdLine(argc, argv) << endl << endl
+	 << "ERROR: --nsnps and --nrep should be > 0, --ngenes > 1"
+	 << endl << endl;
+    help(argv);
+    exit(1);
+  }
+}
+
+/** \brief Return the wall-clock time in seconds.
+ *  \note clock() can't be used as it sums the time of all threads.
+ */
+double getWallTime(void)
+{
+  timeval t;
+  gettimeofday(&t, NULL);
+  return t.tv_sec + t.tv_usec / 1000000.0;
+}
+
+void fillMatrix(gsl_matrix * M, const gsl_rng * rng, const bool asGenotypes)
+{
+  for(size_t i = 0; i < M->size1; ++i)
+    for(size_t j = 0; j < M->size2; ++j)
+      gsl_matrix_set(M, i, j,
+		     asGenotypes ?
+		     (double) gsl_rng_uniform_int(rng, 3) :
+		     gsl_ran_gaussian(rng, 1.0));
+}
+
+void printTiming(const string & kernel, const double & seconds,
+		 const double & flops, const size_t & nbReps)
+{
+  double perRep = seconds / nbReps;
+  cout << kernel
+       << "\t" << fixed << setprecision(4) << perRep << "\t";
+  if(flops > 0)
+    cout << setprecision(2) << flops / perRep / 1e9 << endl;
+  else
+    cout << "NA" << endl;
+}
+
+void run(const size_t & nbSamples, const size_t & nbSnps,
+	 const size_t & nbGenes, const size_t & nbCovars,
+	 const size_t & nbReps, const int & nbThreads, const size_t & seed,
+	 const int & verbose)
+{
+  mygsl_blas_set_num_threads(nbThreads);
+  if(verbose > 0)
+    cout << "BLAS: " << mygsl_blas_backend()
+	 << " (threads=" << mygsl_blas_get_num_threads() << ")" << endl
+	 << "N=" << nbSamples << " S=" << nbSnps << " G=" << nbGenes
+	 << " Q=" << nbCovars << endl << flush;
+
+  gsl_rng_env_setup();
+  gsl_rng * rng = gsl_rng_alloc(gsl_rng_default);
+  gsl_rng_set(rng, seed);
+
+  gsl_matrix * G = gsl_matrix_alloc(nbSamples, nbSnps),
+    * Y = gsl_matrix_alloc(nbSamples, nbGenes),
+    * X = gsl_matrix_alloc(nbSamples, nbCovars + 1);
+  fillMatrix(G, rng, true);
+  fillMatrix(Y, rng, false);
+  fillMatrix(X, rng, false);
+  for(size_t i = 0; i < nbSamples; ++i)
+    gsl_matrix_set(X, i, 0, 1.0); // intercept, genotype in 2nd column
+
+  cout << "kernel\tsec_per_rep\tGflops" << endl;
+  double start;
+
+  // covariance kernel
+  gsl_matrix * GtG = gsl_matrix_alloc(nbSnps, nbSnps);
+  start = getWallTime();
+  for(size_t r = 0; r < nbReps; ++r)
+    gsl_blas_dgemm(CblasTrans, CblasNoTrans, 1.0, G, G, 0.0, GtG);
+  printTiming("cov", getWallTime() - start,
+	      2.0 * nbSamples * nbSnps * nbSnps, nbReps);
+  gsl_matrix_free(GtG);
+
+  // regression kernel, all pairs at once
+  gsl_matrix * GtY = gsl_matrix_alloc(nbSnps, nbGenes);
+  start = getWallTime();
+  for(size_t r = 0; r < nbReps; ++r)
+    gsl_blas_dgemm(CblasTrans, CblasNoTrans, 1.0, G, Y, 0.0, GtY);
+  printTiming("regr", getWallTime() - start,
+	      2.0 * nbSamples * nbSnps * nbGenes, nbReps);
+  gsl_matrix_free(GtY);
+
+  // error covariance for one pair of genes, dominated by the N x N
+  // products X (X'X)^-1 X' and (I - X (X'X)^-1 X') Y
+  gsl_matrix * Sigma_hat = gsl_matrix_alloc(2, 2);
+  gsl_matrix_const_view Y2 = gsl_matrix_const_submatrix(Y, 0, 0,
+							 nbSamples, 2);
+  double N = nbSamples, P = nbCovars + 1, K = 2;
+  start = getWallTime();
+  for(size_t r = 0; r < nbReps; ++r)
+    CalcMleErrorCovariance(&Y2.matrix, X, NULL, Sigma_hat);
+  printTiming("errcov", getWallTime() - start,
+	      2.0 * (2 * N * P * P + N * N * P + N * N * K + N * K * K),
+	      nbReps);
+  gsl_matrix_free(Sigma_hat);
+
+  // single-pair fitter, as called by the R wrappers
+  double pve, sigmahat, betahat, sebetahat, betapval;
+  gsl_vector_const_view y = gsl_matrix_const_column(Y, 0);
+  start = getWallTime();
+  for(size_t r = 0; r < nbReps; ++r){
+    for(size_t s = 0; s < nbSnps; ++s){
+      gsl_vector_const_view g = gsl_matrix_const_column(G, s);
+      gsl_vector_view x = gsl_matrix_column(X, 1);
+      gsl_vector_memcpy(&x.vector, &g.vector);
+      FitSingleGeneWithSingleSnp(X, &y.vector, pve, sigmahat, betahat,
+				 sebetahat, betapval);
+    }
+  }
+  printTiming("fit", getWallTime() - start, 0.0, nbReps);
+
+  gsl_matrix_free(G);
+  gsl_matrix_free(Y);
+  gsl_matrix_free(X);
+  gsl_rng_free(rng);
+}
+
+int main(int argc, char ** argv)
+{
+  size_t nbSamples = 500, nbSnps = 5000, nbGenes = 1000, nbCovars = 5,
+    nbReps = 3, seed = 1859;
+  int nbThreads = 1, verbose = 1;
+
+  parseCmdLine(argc, argv, nbSamples, nbSnps, nbGenes, nbCovars, nbReps,
+	       nbThreads, seed, verbose);
+
+  time_t startRawTime, endRawTime;
+  if(verbose > 0){
+    time(&startRawTime);
+    cout << "START " << basename(argv[0])
+         << " " << getDateTime(startRawTime) << endl
+         << "version " << VERSION << " compiled " << __DATE__
+         << " " << __TIME__ << endl
+         << "cmd-line: " << getCmdLine(argc, argv) << endl
+         << "cwd: " << getCurrentDirectory() << endl;
+    cout << flush;
+  }
+
+  run(nbSamples, nbSnps, nbGenes, nbCovars, nbReps, nbThreads, seed,
+      verbose);
+
+  if(verbose > 0){
+    time(&endRawTime);
+    cout << "END " << basename(argv[0])
+         << " " << getDateTime(endRawTime) << endl
+         << "elapsed -> " << getElapsedTime(startRawTime, endRawTime) << endl
+         << "max.mem -> " << getMaxMemUsedByProcess2Str() << endl;
+  }
+
+  return EXIT_SUCCESS;
+}
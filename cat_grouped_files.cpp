@@ -0,0 +1,399 @@
+/** \file cat_grouped_files.cpp
+ *
+ *  `cat_grouped_files' concatenates files per group, without recompression.
+ *  Copyright (C) 2011-2014 Timothée Flutre
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Compile with: g++ -Wall -O3 -fopenmp -I.. utils_io.cpp cat_grouped_files.cpp -lz -o cat_grouped_files
+ */
+
+#include <cmath>
+#include <ctime>
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
+#include <climits>
+#include <getopt.h>
+#include <libgen.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+using namespace std;
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "utils_io.hpp"
+using namespace utils;
+
+#ifndef VERSION
+#define VERSION "1.0.0" // http://semver.org/
+#endif
+
+struct CatParams
+{
+  string inFile;
+  string suffix;
+  string outDir;
+  bool useSymLink;
+  bool checkGzip;
+  int nbThreads;
+  int verbose;
+};
+
+/** \brief Display the help on stdout.
+ *  \note The format complies with help2man (http://www.gnu.org/s/help2man)
+ */
+void help(char ** argv)
+{
+  cout << "`" << argv[0] << "'"
+       << " concatenates files per group, without recompression." << endl
+       << endl
+       << "Usage: " << argv[0] << " [OPTIONS] ..." << endl
+       << endl
+       << "Options:" << endl
+       << "  -h, --help\tdisplay the help and exit" << endl
+       << "  -V, --version\toutput version information and exit" << endl
+       << "  -v, --verbose\tverbosity level (0/default=1/2/3)" << endl
+       << "  -i, --input\tpath to the input file (2 columns sep. by a tab)" << endl
+       << "\t\tall files (col 2) with same group (col 1) will be" << endl
+       << "\t\t concatenated to a file named <col1>.<suffix>" << endl
+       << "\t\texample from sequencing applications:" << endl
+       << "\t\t indA<tab>/data/run1/A.fastq.gz" << endl
+       << "\t\t indB<tab>/data/run1/B.fastq.gz" << endl
+       << "\t\t indA<tab>/data/run2/A.fastq.gz" << endl
+       << "  -s, --suffix\tsuffix for the output files (e.g. txt, fastq.gz, etc)" << endl
+       << "  -o, --outdir\toutput directory (default=.)" << endl
+       << "  -c, --copy\tcopy if group with single file (symlink otherwise)" << endl
+       << "      --check\tdecompress each gzipped input to check the CRC of its members" << endl
+       << "  -t, --threads\tnumber of groups handled in parallel (default=1)" << endl
+       << endl
+       << "Remarks:" << endl
+       << "  A gzip file can have several members, so that gzipped files are concatenated" << endl
+       << "  byte for byte, like uncompressed ones. The bytes are copied by the kernel" << endl
+       << "  (copy_file_range or sendfile on Linux), the speed being limited by the disk." << endl
+       << "  If the suffix ends with .gz, all input files have to be gzipped." << endl
+       << "  Relative paths in the input file are relative to the current directory," << endl
+       << "  symbolic links pointing to absolute paths." << endl
+       << "  Existing output files are replaced." << endl
+       << endl
+       << "Examples:" << endl
+       << "  " << argv[0] << " -i files_per_sample.txt -s fastq.gz -o inds -t 4" << endl
+       << endl
+       << "Report bugs to <timothee.flutre@supagro.inra.fr>." << endl
+    ;
+}
+
+/** \brief Display version and license information on stdout.
+ */
+void version(char ** argv)
+{
+  cout << argv[0] << " " << VERSION << endl
+       << endl
+       << "Copyright (C) 2011-2014 Timothée Flutre." << endl
+       << "License GPLv3+: GNU GPL version 3 or later <http://gnu.org/licenses/gpl.html>" << endl
+       << "This is free software; see the source for copying conditions.  There is NO" << endl
+       << "warranty; not even for MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE." << endl
+       << endl
+       << "Written by Timothée Flutre." << endl
+    ;
+}
+
+/** \brief Parse the command-line arguments and check the values of the
+ *  compulsory ones.
+ */
+void
+parseCmdLine(
+  int argc,
+  char ** argv,
+  CatParams & params)
+{
+  int c = 0;
+  while(true)
+  {
+    static struct option long_options[] =
+    {
+      {"help", no_argument, 0, 'h'},
+      {"version", no_argument, 0, 'V'},
+      {"verbose", required_argument, 0, 'v'},
+      {"input", required_argument, 0, 'i'},
+      {"suffix", required_argument, 0, 's'},
+      {"outdir", required_argument, 0, 'o'},
+      {"copy", no_argument, 0, 'c'},
+      {"check", no_argument, 0, 0},
+      {"threads", required_argument, 0, 't'},
+      {0, 0, 0, 0}
+    };
+    int option_index = 0;
+    c = getopt_long(argc, argv, "hVv:i:s:o:ct:",
+                    long_options, &option_index);
+    if(c == -1)
+      break;
+    switch(c)
+    {
+    case 0:
+      if(long_options[option_index].flag != 0)
+        break;
+      if(strcmp(long_options[option_index].name, "check") == 0)
+        params.checkGzip = true;
+      break;
+    case 'h':
+      help(argv);
+      exit(0);
+    case 'V':
+      version(argv);
+      exit(0);
+    case 'v':
+      params.verbose = atoi(optarg);
+      break;
+    case 'i':
+      params.inFile = optarg;
+      break;
+    case 's':
+      params.suffix = optarg;
+      break;
+    case 'o':
+      params.outDir = optarg;
+      break;
+    case 'c':
+      params.useSymLink = false;
+      break;
+    case 't':
+      params.nbThreads = atoi(optarg);
+      break;
+    case '?':
+      printf("\n"); help(argv);
+      abort();
+    default:
+      printf("\n"); help(argv);
+      abort();
+    }
+  }
+
+  if(! params.suffix.empty() && params.suffix[0] == '.')
+    params.suffix = params.suffix.substr(1);
+  string error;
+  if(params.inFile.empty())
+    error = "missing compulsory option --input";
+  else if(! doesFileExist(params.inFile))
+    error = "can't find file " + params.inFile;
+  else if(params.suffix.empty())
+    error = "missing compulsory option --suffix";
+  else if(params.outDir.empty() || ! isDirectory(params.outDir.c_str()))
+    error = "can't find directory " + params.outDir;
+  if(! error.empty()){
+    cerr << "cmd-line: " << getCmdLine(argc, argv) << endl << endl
+	 << "ERROR: " << error << endl << endl;
+    help(argv);
+    exit(1);
+  }
+  if(params.nbThreads < 1)
+    params.nbThreads = 1;
+}
+
+/** \brief Load the files of each group, keeping their order in the input
+ *  file.
+ */
+void
+loadInputFile(
+  const CatParams & params,
+  map<string, vector<string> > & group2files)
+{
+  if(params.verbose > 0)
+    cout << "load input file ..." << endl << flush;
+
+  BlockReader br;
+  openBlockReader(br, params.inFile);
+  StringView line;
+  vector<StringView> tokens;
+  size_t nbFiles = 0;
+  while(getline(br, line)){
+    if(line.size > 0 && line.data[line.size-1] == '\r')
+      --line.size;
+    if(tokenize(line, "\t", tokens) != 2 || tokens[0].size == 0
+       || tokens[1].size == 0){
+      cerr << "ERROR: line " << br.nbLines << " of " << params.inFile
+	   << " should be as <col1><tab><col2>" << endl;
+      exit(1);
+    }
+    string path = toString(tokens[1]);
+    if(! doesFileExist(path)){
+      cerr << "ERROR: can't find file " << path << " (line " << br.nbLines
+	   << " of " << params.inFile << ")" << endl;
+      exit(1);
+    }
+    group2files[toString(tokens[0])].push_back(path);
+    ++nbFiles;
+  }
+  closeBlockReader(br);
+
+  if(params.verbose > 0)
+    cout << group2files.size() << " groups ; " << nbFiles << " files" << endl;
+}
+
+/** \brief Return true if the file starts with the magic bytes of gzip.
+ *  \note An empty file is accepted, as it adds nothing to the output.
+ */
+bool
+isGzipped(
+  const string & path)
+{
+  FILE * stream = fopen(path.c_str(), "rb");
+  if(stream == NULL){
+    cerr << "ERROR: can't open file " << path
+	 << " (errno=" << errno << ")" << endl;
+    exit(1);
+  }
+  unsigned char magic[2];
+  size_t n = fread(magic, 1, 2, stream);
+  fclose(stream);
+  return n == 0 || (n == 2 && magic[0] == 0x1f && magic[1] == 0x8b);
+}
+
+/** \brief Write the output file of a group, and return the number of
+ *  bytes copied (0 for a symbolic link).
+ */
+size_t
+handleOneGroup(
+  const CatParams & params,
+  const string & group,
+  const vector<string> & files)
+{
+  string outPath = params.outDir + "/" + group + "." + params.suffix;
+  bool gzipSuffix = outPath.substr(outPath.size() - 3) == ".gz";
+
+  for(size_t i = 0; i < files.size(); ++i){
+    if(gzipSuffix && ! isGzipped(files[i])){
+      cerr << "ERROR: file " << files[i] << " of group " << group
+	   << " should be gzipped" << endl;
+      exit(1);
+    }
+    if(params.checkGzip && isGzipped(files[i]))
+      checkGzipMembers(files[i]);
+  }
+
+  // remove first, as writing through a symbolic link from a previous run
+  // would truncate its target
+  if(unlink(outPath.c_str()) != 0 && errno != ENOENT){
+    cerr << "ERROR: can't remove file " << outPath
+	 << " (errno=" << errno << ")" << endl;
+    exit(1);
+  }
+
+  if(files.size() == 1 && params.useSymLink){
+    char target[PATH_MAX];
+    if(realpath(files[0].c_str(), target) == NULL
+       || symlink(target, outPath.c_str()) != 0){
+      cerr << "ERROR: can't create symbolic link " << outPath
+	   << " (errno=" << errno << ")" << endl;
+      exit(1);
+    }
+    return 0;
+  }
+
+  int outFd = open(outPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if(outFd < 0){
+    cerr << "ERROR: can't open file " << outPath << " to write"
+	 << " (errno=" << errno << ")" << endl;
+    exit(1);
+  }
+  size_t nbBytes = 0;
+  for(size_t i = 0; i < files.size(); ++i)
+    nbBytes += appendFileContent(outFd, files[i]);
+  if(close(outFd) != 0){
+    cerr << "ERROR: can't close file " << outPath
+	 << " (errno=" << errno << ")" << endl;
+    exit(1);
+  }
+  return nbBytes;
+}
+
+void run(const CatParams & params)
+{
+  map<string, vector<string> > group2files;
+  loadInputFile(params, group2files);
+
+  if(params.verbose > 0)
+    cout << "handle all groups (threads=" << params.nbThreads << ") ..."
+	 << endl << flush;
+
+  vector<string> groups;
+  keys2vec(group2files, groups);
+  vector<size_t> nbBytes(groups.size(), 0);
+
+  // each group is mostly waiting for the disk, hence the dynamic schedule
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(params.nbThreads) schedule(dynamic)
+#endif
+  for(long g = 0; g < (long) groups.size(); ++g){
+    nbBytes[g] = handleOneGroup(params, groups[g],
+				group2files.find(groups[g])->second);
+    if(params.verbose > 1){
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+      cout << groups[g] << ": " << group2files.find(groups[g])->second.size()
+	   << " files, " << nbBytes[g] << " bytes" << endl << flush;
+    }
+  }
+
+  if(params.verbose > 0){
+    size_t total = 0;
+    for(size_t g = 0; g < nbBytes.size(); ++g)
+      total += nbBytes[g];
+    cout << "total nb of bytes copied: " << total << endl;
+  }
+}
+
+int main(int argc, char ** argv)
+{
+  CatParams params;
+  params.outDir = ".";
+  params.useSymLink = true;
+  params.checkGzip = false;
+  params.nbThreads = 1;
+  params.verbose = 1;
+
+  parseCmdLine(argc, argv, params);
+
+  time_t startRawTime, endRawTime;
+  if(params.verbose > 0){
+    time(&startRawTime);
+    cout << "START " << basename(argv[0])
+         << " " << getDateTime(startRawTime) << endl
+         << "version " << VERSION << " compiled " << __DATE__
+         << " " << __TIME__ << endl
+         << "cmd-line: " << getCmdLine(argc, argv) << endl
+         << "cwd: " << getCurrentDirectory() << endl;
+    cout << flush;
+  }
+
+  run(params);
+
+  if(params.verbose > 0){
+    time(&endRawTime);
+    cout << "END " << basename(argv[0])
+         << " " << getDateTime(endRawTime) << endl
+         << "elapsed -> " << getElapsedTime(startRawTime, endRawTime) << endl
+         << "max.mem -> " << getMaxMemUsedByProcess2Str() << endl;
+  }
+
+  return EXIT_SUCCESS;
+}
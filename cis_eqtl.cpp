@@ -0,0 +1,806 @@
+/** \file cis_eqtl.cpp
+ *
+ *  `cis_eqtl' tests the association between each gene and its cis SNPs.
+ *  Copyright (C) 2011-2014 Timothée Flutre
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Compile with: g++ -Wall -O3 -fopenmp -I.. utils_io.cpp utils_math.cpp cis_eqtl.cpp -lgsl -lgslcblas -lz -o cis_eqtl
+ *  (see utils_math.hpp to link with an optimized BLAS)
+ */
+
+#include <cmath>
+#include <ctime>
+#include <cstring>
+#include <cstdio>
+#include <getopt.h>
+#include <libgen.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <algorithm>
+using namespace std;
+
+#include <gsl/gsl_matrix.h>
+#include <gsl/gsl_blas.h>
+
+#include "utils_io.hpp"
+#include "utils_math.hpp"
+using namespace utils;
+
+#ifndef VERSION
+#define VERSION "1.0.0" // http://semver.org/
+#endif
+
+// number of SNPs residualized at once
+#define CIS_BLOCK_SIZE 256
+
+/** \brief Display the help on stdout.
+ *  \note The format complies with help2man (http://www.gnu.org/s/help2man)
+ */
+void help(char ** argv)
+{
+  cout << "`" << argv[0] << "'"
+       << " tests the association between each gene and its cis SNPs." << endl
+       << endl
+       << "Usage: " << argv[0] << " [OPTIONS] ..." << endl
+       << endl
+       << "Options:" << endl
+       << "  -h, --help\tdisplay the help and exit" << endl
+       << "  -V, --version\toutput version information and exit" << endl
+       << "  -v, --verbose\tverbosity level (0/default=1/2/3)" << endl
+       << "  -g, --geno\tpath to the genotype file in the MatrixEQTL format (can be gzipped)" << endl
+       << "\t\theader with sample names, 1 row per SNP sorted by chromosome and position" << endl
+       << "\t\tmissing values are '-1' or 'NA'" << endl
+       << "  -p, --pheno\tpath to the phenotype file in the MatrixEQTL format (can be gzipped)" << endl
+       << "\t\theader with sample names, 1 row per gene" << endl
+       << "  -c, --cvrt\tpath to the covariate file in the MatrixEQTL format (optional)" << endl
+       << "\t\theader with sample names, 1 row per covariate, no intercept" << endl
+       << "      --snppos\tpath to the SNP coordinates in the BED format" << endl
+       << "      --genepos\tpath to the gene coordinates in the BED format" << endl
+       << "  -o, --out\tpath to the output file (gzipped if ending with '.gz')" << endl
+       << "\t\tcolumns: SNP gene beta t-stat p-value" << endl
+       << "      --egenes\tpath to the output file with one row per gene (optional)" << endl
+       << "\t\tcolumns: gene nb.snps best.snp pvalue pval.beta [pval.perm nb.perms]" << endl
+       << "      --cis\tmaximum distance between a SNP and a gene (default=1000000)" << endl
+       << "      --only-tss\tuse the TSS (start) of each gene instead of its whole body" << endl
+       << "      --pv\tmaximum p-value to report a gene-SNP pair (default=1)" << endl
+       << "      --perms\tnumber of permutations per gene (default=0)" << endl
+       << "      --stop\tstop permuting a gene after as many successes (default=10, 0=never)" << endl
+       << "  -s, --seed\tseed for the permutations (default=1859)" << endl
+       << "  -t, --threads\tnumber of threads (default=1)" << endl
+       << endl
+       << "Remarks:" << endl
+       << "  The model is the one of MatrixEQTL (modelLINEAR): y = mu + g b + covariates + e." << endl
+       << "  Covariates are regressed out of phenotypes once per gene and of genotypes" << endl
+       << "  once per SNP, then each t-stat derives from a correlation." << endl
+       << "  Missing genotypes and phenotypes are replaced by the mean of their row." << endl
+       << "  pval.beta is the minimum p-value corrected as 1-(1-p)^nb.snps." << endl
+       << "  The FDR over all pairs can be obtained afterwards from the p-values." << endl
+       << endl
+       << "Examples:" << endl
+       << "  " << argv[0] << " -g genos.txt.gz -p phenos.txt.gz --snppos snps.bed.gz --genepos genes.bed.gz -o cis.txt.gz" << endl
+       << endl
+       << "Report bugs to <timothee.flutre@supagro.inra.fr>." << endl
+    ;
+}
+
+/** \brief Display version and license information on stdout.
+ */
+void version(char ** argv)
+{
+  cout << argv[0] << " " << VERSION << endl
+       << endl
+       << "Copyright (C) 2011-2014 Timothée Flutre." << endl
+       << "License GPLv3+: GNU GPL version 3 or later <http://gnu.org/licenses/gpl.html>" << endl
+       << "This is free software; see the source for copying conditions.  There is NO" << endl
+       << "warranty; not even for MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE." << endl
+       << endl
+       << "Written by Timothée Flutre." << endl
+    ;
+}
+
+struct CisParams
+{
+  string genoFile;
+  string phenoFile;
+  string cvrtFile;
+  string snpPosFile;
+  string genePosFile;
+  string outFile;
+  string egenesFile;
+  size_t cisDist;
+  bool onlyTss;
+  double maxPval;
+  size_t nbPerms;
+  size_t nbSuccessesToStop;
+  size_t seed;
+  int nbThreads;
+  int verbose;
+};
+
+void checkFile(int argc, char ** argv, const string & file,
+	       const string & option, const bool compulsory)
+{
+  if(file.empty() && compulsory){
+    cerr << "cmd-line: " << getCmdLine(argc, argv) << endl << endl
+	 << "ERROR: missing compulsory option --" << option << endl << endl;
+    help(argv);
+    exit(1);
+  }
+  if(! file.empty() && ! doesFileExist(file)){
+    cerr << "cmd-line: " << getCmdLine(argc, argv) << endl << endl
+	 << "ERROR: can't find file " << file << endl << endl;
+    help(argv);
+    exit(1);
+  }
+}
+
+/** \brief Parse the command-line arguments and check the values of the
+ *  compulsory ones.
+ */
+void
+parseCmdLine(
+  int argc,
+  char ** argv,
+  CisParams & par)
+{
+  int c = 0;
+  while(true)
+  {
+    static struct option long_options[] =
+    {
+      {"help", no_argument, 0, 'h'},
+      {"version", no_argument, 0, 'V'},
+      {"verbose", required_argument, 0, 'v'},
+      {"geno", required_argument, 0, 'g'},
+      {"pheno", required_argument, 0, 'p'},
+      {"cvrt", required_argument, 0, 'c'},
+      {"snppos", required_argument, 0, 0},
+      {"genepos", required_argument, 0, 0},
+      {"out", required_argument, 0, 'o'},
+      {"egenes", required_argument, 0, 0},
+      {"cis", required_argument, 0, 0},
+      {"only-tss", no_argument, 0, 0},
+      {"pv", required_argument, 0, 0},
+      {"perms", required_argument, 0, 0},
+      {"stop", required_argument, 0, 0},
+      {"seed", required_argument, 0, 's'},
+      {"threads", required_argument, 0, 't'},
+      {0, 0, 0, 0}
+    };
+    int option_index = 0;
+    c = getopt_long(argc, argv, "hVv:g:p:c:o:s:t:",
+                    long_options, &option_index);
+    if(c == -1)
+      break;
+    switch(c)
+    {
+    case 0:
+      if(long_options[option_index].flag != 0)
+        break;
+      if(strcmp(long_options[option_index].name, "snppos") == 0)
+        par.snpPosFile = optarg;
+      else if(strcmp(long_options[option_index].name, "genepos") == 0)
+        par.genePosFile = optarg;
+      else if(strcmp(long_options[option_index].name, "egenes") == 0)
+        par.egenesFile = optarg;
+      else if(strcmp(long_options[option_index].name, "cis") == 0)
+        par.cisDist = (size_t) atof(optarg);
+      else if(strcmp(long_options[option_index].name, "only-tss") == 0)
+        par.onlyTss = true;
+      else if(strcmp(long_options[option_index].name, "pv") == 0)
+        par.maxPval = atof(optarg);
+      else if(strcmp(long_options[option_index].name, "perms") == 0)
+        par.nbPerms = (size_t) atof(optarg);
+      else if(strcmp(long_options[option_index].name, "stop") == 0)
+        par.nbSuccessesToStop = atol(optarg);
+      break;
+    case 'h':
+      help(argv);
+      exit(0);
+    case 'V':
+      version(argv);
+      exit(0);
+    case 'v':
+      par.verbose = atoi(optarg);
+      break;
+    case 'g':
+      par.genoFile = optarg;
+      break;
+    case 'p':
+      par.phenoFile = optarg;
+      break;
+    case 'c':
+      par.cvrtFile = optarg;
+      break;
+    case 'o':
+      par.outFile = optarg;
+      break;
+    case 's':
+      par.seed = atol(optarg);
+      break;
+    case 't':
+      par.nbThreads = atoi(optarg);
+      break;
+    case '?':
+      printf("\n"); help(argv);
+      abort();
+    default:
+      printf("\n"); help(argv);
+      abort();
+    }
+  }
+  checkFile(argc, argv, par.genoFile, "geno", true);
+  checkFile(argc, argv, par.phenoFile, "pheno", true);
+  checkFile(argc, argv, par.cvrtFile, "cvrt", false);
+  checkFile(argc, argv, par.snpPosFile, "snppos", true);
+  checkFile(argc, argv, par.genePosFile, "genepos", true);
+  if(par.outFile.empty()){
+    cerr << "cmd-line: " << getCmdLine(argc, argv) << endl << endl
+	 << "ERROR: missing compulsory option --out" << endl << endl;
+    help(argv);
+    exit(1);
+  }
+  if(par.nbThreads < 1)
+    par.nbThreads = 1;
+}
+
+struct Gene
+{
+  string id;
+  size_t row; // in the phenotype matrix
+  size_t winStart;
+  size_t winEnd;
+};
+
+bool compareGenesByWinEnd(const Gene & a, const Gene & b)
+{
+  return a.winEnd < b.winEnd;
+}
+
+/** \brief Gene-level summary, see --egenes.
+ */
+struct GeneStats
+{
+  size_t nbSnps;
+  string bestSnp;
+  double minPval;
+  double permPval;
+  size_t nbPermsDone;
+};
+
+/** \brief Load a BED file (0-based start) into name -> (chr, start+1, end).
+ */
+void loadBedFile(const string & bedFile,
+		 map<string, pair<string, pair<size_t,size_t> > > & coords,
+		 const int & verbose)
+{
+  BlockReader br;
+  StringView line;
+  vector<StringView> tokens;
+  size_t start, end;
+  openBlockReader(br, bedFile);
+  while(getline(br, line)){
+    if(tokenize(line, " \t", tokens) == 0 || tokens[0] == "track")
+      continue;
+    if(tokens.size() < 4 || ! parseUnsigned(tokens[1], start)
+       || ! parseUnsigned(tokens[2], end)){
+      cerr << "ERROR: line " << br.nbLines << " of file " << bedFile
+	   << " should be 'chr start end name'" << endl;
+      exit(1);
+    }
+    coords[toString(tokens[3])] =
+      make_pair(toString(tokens[0]), make_pair(start + 1, end));
+  }
+  closeBlockReader(br);
+  if(verbose > 0)
+    cout << "nb of coordinates in " << bedFile << ": " << coords.size()
+	 << endl;
+}
+
+/** \brief Return, for each sample of 'to', its column in 'from'.
+ */
+vector<size_t> matchSamples(const vector<string> & from,
+			    const vector<string> & to,
+			    const string & fromFile)
+{
+  map<string, size_t> name2col;
+  for(size_t j = 0; j < from.size(); ++j)
+    name2col[from[j]] = j;
+  vector<size_t> cols(to.size());
+  for(size_t i = 0; i < to.size(); ++i){
+    map<string, size_t>::const_iterator it = name2col.find(to[i]);
+    if(it == name2col.end()){
+      cerr << "ERROR: sample " << to[i] << " is missing from file "
+	   << fromFile << endl;
+      exit(1);
+    }
+    cols[i] = it->second;
+  }
+  return cols;
+}
+
+/** \brief Fill rows with the values of file reordered as the samples,
+ *  missing values being replaced by the row mean.
+ */
+void loadRowsInSampleOrder(const string & file,
+			   const vector<string> & samples,
+			   vector<string> & rowNames, gsl_matrix *& rows)
+{
+  vector<string> colNames;
+  vector<double> values;
+  loadLabeledMatrix(file, rowNames, colNames, values);
+  vector<size_t> cols = matchSamples(colNames, samples, file);
+  size_t N = samples.size(), J = colNames.size();
+  rows = gsl_matrix_alloc(rowNames.size(), N);
+  for(size_t r = 0; r < rowNames.size(); ++r){
+    double sum = 0.0;
+    size_t nb = 0;
+    for(size_t i = 0; i < N; ++i){
+      double x = values[r * J + cols[i]];
+      gsl_matrix_set(rows, r, i, x);
+      if(! isNan(x)){
+	sum += x;
+	++nb;
+      }
+    }
+    for(size_t i = 0; i < N; ++i)
+      if(isNan(gsl_matrix_get(rows, r, i)))
+	gsl_matrix_set(rows, r, i, nb > 0 ? sum / nb : 0.0);
+  }
+}
+
+/** \brief Residualized SNPs of the current chromosome still in the cis
+ *  window of a gene to come, rows of unit norm.
+ */
+struct CisWindow
+{
+  size_t first;
+  vector<string> ids;
+  vector<size_t> pos;
+  vector<double> norms;
+  vector<double> rows;
+  vector<string> newIds; // read but not yet residualized
+  vector<size_t> newPos;
+  vector<double> newRows;
+};
+
+/** \brief Residualize the new SNPs on the covariates with two matrix
+ *  products and append them to the window.
+ */
+void flushNewSnps(CisWindow & win, const gsl_matrix * U, const size_t N)
+{
+  size_t nbNew = win.newIds.size();
+  if(nbNew == 0)
+    return;
+  gsl_matrix_view B = gsl_matrix_view_array(&win.newRows[0], nbNew, N);
+  vector<double> refNorms(nbNew), norms(nbNew);
+  CalcRowNorms(&B.matrix, &refNorms[0]);
+  ResidualizeOnBasis(U, &B.matrix, true);
+  ScaleRowsToUnitNorm(&B.matrix, &refNorms[0], &norms[0]);
+  for(size_t s = 0; s < nbNew; ++s){
+    if(norms[s] == 0.0) // monomorphic once covariates are regressed out
+      continue;
+    win.ids.push_back(win.newIds[s]);
+    win.pos.push_back(win.newPos[s]);
+    win.norms.push_back(norms[s]);
+    win.rows.insert(win.rows.end(), win.newRows.begin() + s * N,
+		    win.newRows.begin() + (s + 1) * N);
+  }
+  win.newIds.clear();
+  win.newPos.clear();
+  win.newRows.clear();
+}
+
+/** \brief Test the genes [gBegin,gEnd), all their cis SNPs being in the
+ *  window, with a single product between the window rows spanning their
+ *  cis regions and their phenotypes.
+ */
+void testGenes(const vector<Gene> & genes, const size_t gBegin,
+	       const size_t gEnd, CisWindow & win, const gsl_matrix * Y,
+	       const vector<double> & yNorms, const gsl_matrix * C,
+	       const size_t df, const CisParams & par, BlockWriter & bw,
+	       map<string, GeneStats> & gene2stats, size_t & nbTests)
+{
+  const size_t N = Y->size2, nbRows = win.ids.size();
+  vector<size_t> lo(gEnd - gBegin), hi(gEnd - gBegin);
+  size_t uLo = nbRows, uHi = 0;
+  for(size_t g = gBegin; g < gEnd; ++g){
+    lo[g-gBegin] = lower_bound(win.pos.begin() + win.first, win.pos.end(),
+			       genes[g].winStart) - win.pos.begin();
+    hi[g-gBegin] = upper_bound(win.pos.begin() + win.first, win.pos.end(),
+			       genes[g].winEnd) - win.pos.begin();
+    if(lo[g-gBegin] < hi[g-gBegin]){
+      uLo = min(uLo, lo[g-gBegin]);
+      uHi = max(uHi, hi[g-gBegin]);
+    }
+  }
+
+  gsl_matrix * R = NULL;
+  if(uLo < uHi){
+    gsl_matrix * Yg = gsl_matrix_alloc(gEnd - gBegin, N);
+    for(size_t g = gBegin; g < gEnd; ++g){
+      gsl_vector_const_view y = gsl_matrix_const_row(Y, genes[g].row);
+      gsl_matrix_set_row(Yg, g - gBegin, &y.vector);
+    }
+    gsl_matrix_view W = gsl_matrix_view_array(&win.rows[uLo * N],
+					      uHi - uLo, N);
+    R = gsl_matrix_alloc(uHi - uLo, gEnd - gBegin);
+    gsl_blas_dgemm(CblasNoTrans, CblasTrans, 1.0, &W.matrix, Yg, 0.0, R);
+    gsl_matrix_free(Yg);
+  }
+
+  char buf[1024];
+  for(size_t g = gBegin; g < gEnd; ++g){
+    GeneStats & st = gene2stats[genes[g].id];
+    st.nbSnps = hi[g-gBegin] - lo[g-gBegin];
+    st.minPval = NaN;
+    st.permPval = NaN;
+    st.nbPermsDone = 0;
+    for(size_t s = lo[g-gBegin]; s < hi[g-gBegin]; ++s){
+      double r = gsl_matrix_get(R, s - uLo, g - gBegin),
+	pval = CalcPvalFromCorrelation(r, df),
+	tstat = (r * r < 1.0) ? r * sqrt(df / (1 - r * r))
+	: (r > 0 ? INFINITY : -INFINITY),
+	beta = r * yNorms[genes[g].row] / win.norms[s];
+      if(isNan(st.minPval) || pval < st.minPval){
+	st.minPval = pval;
+	st.bestSnp = win.ids[s];
+      }
+      ++nbTests;
+      if(pval > par.maxPval)
+	continue;
+      int n = snprintf(buf, sizeof(buf), "%s\t%s\t%.8g\t%.8g\t%.8g\n",
+		       win.ids[s].c_str(), genes[g].id.c_str(), beta, tstat,
+		       pval);
+      bwrite(bw, buf, min((size_t) n, sizeof(buf) - 1));
+    }
+
+    if(par.nbPerms > 0 && st.nbSnps > 0){
+      // the rows are already residualized, redoing it is harmless
+      gsl_matrix * G = gsl_matrix_alloc(N, st.nbSnps);
+      for(size_t s = 0; s < st.nbSnps; ++s)
+	for(size_t i = 0; i < N; ++i)
+	  gsl_matrix_set(G, i, s, win.rows[(lo[g-gBegin] + s) * N + i]);
+      gsl_vector_const_view y = gsl_matrix_const_row(Y, genes[g].row);
+      double maxAbsCor;
+      st.permPval = PermuteSingleGeneWithManySnps(&y.vector, G, C,
+						  par.nbPerms,
+						  par.nbSuccessesToStop,
+						  par.seed, st.nbPermsDone,
+						  maxAbsCor);
+      gsl_matrix_free(G);
+    }
+  }
+  if(R != NULL)
+    gsl_matrix_free(R);
+}
+
+/** \brief Test all the genes of a chromosome whose cis region ends before
+ *  pos, then discard the SNPs before the cis region of the next genes.
+ */
+void testReadyGenes(const vector<Gene> & genes,
+		    const vector<size_t> & minWinStarts, size_t & nextGene,
+		    const size_t pos, CisWindow & win, const gsl_matrix * U,
+		    const gsl_matrix * Y, const vector<double> & yNorms,
+		    const gsl_matrix * C, const size_t df,
+		    const CisParams & par, BlockWriter & bw,
+		    map<string, GeneStats> & gene2stats, size_t & nbTests)
+{
+  size_t gEnd = nextGene;
+  while(gEnd < genes.size() && genes[gEnd].winEnd < pos)
+    ++gEnd;
+  if(gEnd == nextGene)
+    return;
+  const size_t N = Y->size2;
+  flushNewSnps(win, U, N);
+  testGenes(genes, nextGene, gEnd, win, Y, yNorms, C, df, par, bw,
+	    gene2stats, nbTests);
+  nextGene = gEnd;
+
+  size_t minStart = (nextGene < genes.size()) ? minWinStarts[nextGene]
+    : string::npos;
+  while(win.first < win.ids.size() && win.pos[win.first] < minStart)
+    ++win.first;
+  if(win.first > 0 && win.first >= win.ids.size() / 2){
+    size_t nbKept = win.ids.size() - win.first;
+    memmove(&win.rows[0], &win.rows[win.first * N],
+	    nbKept * N * sizeof(double));
+    win.rows.resize(nbKept * N);
+    win.ids.erase(win.ids.begin(), win.ids.begin() + win.first);
+    win.pos.erase(win.pos.begin(), win.pos.begin() + win.first);
+    win.norms.erase(win.norms.begin(), win.norms.begin() + win.first);
+    win.first = 0;
+  }
+}
+
+void run(const CisParams & par)
+{
+  if(par.nbThreads > 1)
+    mygsl_blas_set_num_threads(par.nbThreads);
+
+  // genotype header gives the sample order
+  BlockReader brGeno;
+  StringView line;
+  vector<StringView> tokens;
+  vector<string> samples, genoHeader;
+  openBlockReader(brGeno, par.genoFile);
+  if(! getline(brGeno, line)){
+    cerr << "ERROR: file " << par.genoFile << " is empty" << endl;
+    exit(1);
+  }
+  tokenize(line, " \t", tokens);
+  for(size_t j = 0; j < tokens.size(); ++j)
+    genoHeader.push_back(toString(tokens[j]));
+
+  if(par.verbose > 0)
+    cout << "load phenotypes and covariates ..." << endl << flush;
+  vector<string> phenoNames, phenoCols, cvrtNames;
+  vector<double> values;
+  loadLabeledMatrix(par.phenoFile, phenoNames, phenoCols, values);
+  values.clear();
+  size_t N = phenoCols.size();
+  if(genoHeader.size() == N + 1)
+    samples.assign(genoHeader.begin() + 1, genoHeader.end());
+  else if(genoHeader.size() == N){
+    samples = genoHeader;
+  }
+  else{
+    cerr << "ERROR: different numbers of samples in files " << par.genoFile
+	 << " and " << par.phenoFile << endl;
+    exit(1);
+  }
+  gsl_matrix * Y = NULL, * cvrt = NULL;
+  loadRowsInSampleOrder(par.phenoFile, samples, phenoNames, Y);
+  if(! par.cvrtFile.empty())
+    loadRowsInSampleOrder(par.cvrtFile, samples, cvrtNames, cvrt);
+
+  gsl_matrix * C = gsl_matrix_alloc(N, 1 + cvrtNames.size());
+  for(size_t i = 0; i < N; ++i){
+    gsl_matrix_set(C, i, 0, 1.0);
+    for(size_t q = 0; q < cvrtNames.size(); ++q)
+      gsl_matrix_set(C, i, 1 + q, gsl_matrix_get(cvrt, q, i));
+  }
+  size_t rank;
+  gsl_matrix * U = CalcCovariateBasis(C, rank);
+  if(N <= rank + 1){
+    cerr << "ERROR: not enough samples (" << N << ") for " << rank
+	 << " covariates" << endl;
+    exit(1);
+  }
+  const size_t df = N - rank - 1;
+  vector<double> yRefNorms(Y->size1), yNorms(Y->size1);
+  CalcRowNorms(Y, &yRefNorms[0]);
+  ResidualizeOnBasis(U, Y, true);
+  ScaleRowsToUnitNorm(Y, &yRefNorms[0], &yNorms[0]);
+  if(par.verbose > 0)
+    cout << "nb of samples: " << N << endl
+	 << "nb of genes: " << Y->size1 << endl
+	 << "nb of covariates: " << cvrtNames.size()
+	 << " (rank with intercept=" << rank << ")" << endl;
+
+  // genes per chromosome, sorted by end of cis region
+  map<string, pair<string, pair<size_t,size_t> > > snp2coord, gene2coord;
+  loadBedFile(par.genePosFile, gene2coord, par.verbose);
+  map<string, vector<Gene> > chr2genes;
+  for(size_t r = 0; r < phenoNames.size(); ++r){
+    map<string, pair<string, pair<size_t,size_t> > >::const_iterator it =
+      gene2coord.find(phenoNames[r]);
+    if(it == gene2coord.end() || yNorms[r] == 0.0)
+      continue;
+    Gene gene;
+    gene.id = phenoNames[r];
+    gene.row = r;
+    size_t start = it->second.second.first,
+      end = par.onlyTss ? start : it->second.second.second;
+    gene.winStart = (start > par.cisDist) ? start - par.cisDist : 0;
+    gene.winEnd = end + par.cisDist;
+    chr2genes[it->second.first].push_back(gene);
+  }
+  map<string, vector<size_t> > chr2minWinStarts;
+  for(map<string, vector<Gene> >::iterator it = chr2genes.begin();
+      it != chr2genes.end(); ++it){
+    sort(it->second.begin(), it->second.end(), compareGenesByWinEnd);
+    vector<size_t> & mins = chr2minWinStarts[it->first];
+    mins.resize(it->second.size());
+    for(size_t g = it->second.size(); g-- > 0; )
+      mins[g] = (g + 1 < it->second.size()) ?
+	min(it->second[g].winStart, mins[g+1]) : it->second[g].winStart;
+  }
+  loadBedFile(par.snpPosFile, snp2coord, par.verbose);
+
+  if(par.verbose > 0)
+    cout << "test gene-SNP pairs in cis ..." << endl << flush;
+  BlockWriter bw;
+  openBlockWriter(bw, par.outFile, par.nbThreads);
+  bwrite(bw, "SNP\tgene\tbeta\tt-stat\tp-value\n");
+
+  map<string, GeneStats> gene2stats;
+  set<string> chrsDone;
+  string chr;
+  vector<Gene> noGenes;
+  vector<size_t> noMins;
+  const vector<Gene> * genes = &noGenes;
+  const vector<size_t> * minWinStarts = &noMins;
+  size_t nextGene = 0, nbSnps = 0, nbNoCoord = 0, nbTests = 0;
+  CisWindow win;
+  win.first = 0;
+  while(getline(brGeno, line)){
+    if(tokenize(line, " \t", tokens) == 0)
+      continue;
+    if(tokens.size() != N + 1){
+      cerr << "ERROR: line " << brGeno.nbLines << " of file " << par.genoFile
+	   << " has " << tokens.size() << " columns instead of " << N + 1
+	   << endl;
+      exit(1);
+    }
+    ++nbSnps;
+    string id = toString(tokens[0]);
+    map<string, pair<string, pair<size_t,size_t> > >::const_iterator it =
+      snp2coord.find(id);
+    if(it == snp2coord.end()){
+      ++nbNoCoord;
+      continue;
+    }
+    const string & snpChr = it->second.first;
+    size_t pos = it->second.second.second;
+
+    if(snpChr != chr){ // test the remaining genes of the previous chromosome
+      testReadyGenes(*genes, *minWinStarts, nextGene, string::npos, win, U,
+		     Y, yNorms, C, df, par, bw, gene2stats, nbTests);
+      if(! chr.empty())
+	chrsDone.insert(chr);
+      if(chrsDone.find(snpChr) != chrsDone.end()){
+	cerr << "ERROR: SNPs of chromosome " << snpChr << " aren't contiguous"
+	     << " in file " << par.genoFile << " (line " << brGeno.nbLines
+	     << ")" << endl;
+	exit(1);
+      }
+      chr = snpChr;
+      genes = chr2genes.count(chr) ? &chr2genes[chr] : &noGenes;
+      minWinStarts = chr2genes.count(chr) ? &chr2minWinStarts[chr] : &noMins;
+      nextGene = 0;
+      win.first = 0;
+      win.ids.clear();
+      win.pos.clear();
+      win.norms.clear();
+      win.rows.clear();
+    }
+    else if(! win.newPos.empty() ? pos < win.newPos.back()
+	    : (! win.pos.empty() && pos < win.pos.back())){
+      cerr << "ERROR: SNP " << id << " isn't sorted by position in file "
+	   << par.genoFile << " (line " << brGeno.nbLines << ")" << endl;
+      exit(1);
+    }
+    if(genes->empty())
+      continue;
+    testReadyGenes(*genes, *minWinStarts, nextGene, pos, win, U, Y, yNorms,
+		   C, df, par, bw, gene2stats, nbTests);
+    if(nextGene == genes->size() || pos < (*minWinStarts)[nextGene])
+      continue; // in no cis region
+
+    size_t nbMissing = 0;
+    double sum = 0.0;
+    size_t offset = win.newRows.size();
+    win.newRows.resize(offset + N);
+    double * x = &win.newRows[offset];
+    for(size_t i = 0; i < N; ++i){
+      if(parseDouble(tokens[1+i], x[i]) && ! isNan(x[i]) && x[i] != -1)
+	sum += x[i];
+      else{
+	x[i] = NaN;
+	++nbMissing;
+      }
+    }
+    double mean = (nbMissing < N) ? sum / (N - nbMissing) : 0.0;
+    for(size_t i = 0; i < N; ++i)
+      if(isNan(x[i]))
+	x[i] = mean;
+    win.newIds.push_back(id);
+    win.newPos.push_back(pos);
+    if(win.newIds.size() == CIS_BLOCK_SIZE)
+      flushNewSnps(win, U, N);
+  }
+  testReadyGenes(*genes, *minWinStarts, nextGene, string::npos, win, U, Y,
+		 yNorms, C, df, par, bw, gene2stats, nbTests);
+  closeBlockReader(brGeno);
+  closeBlockWriter(bw);
+
+  if(! par.egenesFile.empty()){
+    BlockWriter bwGenes;
+    openBlockWriter(bwGenes, par.egenesFile, 1);
+    bwrite(bwGenes, string("gene\tnb.snps\tbest.snp\tpvalue\tpval.beta")
+	   + (par.nbPerms > 0 ? "\tpval.perm\tnb.perms\n" : "\n"));
+    char buf[1024];
+    for(map<string, GeneStats>::const_iterator it = gene2stats.begin();
+	it != gene2stats.end(); ++it){
+      const GeneStats & st = it->second;
+      if(st.nbSnps == 0)
+	continue;
+      double pBeta = - expm1(st.nbSnps * log1p(- st.minPval));
+      int n = snprintf(buf, sizeof(buf), "%s\t%lu\t%s\t%.8g\t%.8g",
+		       it->first.c_str(), (unsigned long) st.nbSnps,
+		       st.bestSnp.c_str(), st.minPval, pBeta);
+      bwrite(bwGenes, buf, min((size_t) n, sizeof(buf) - 1));
+      if(par.nbPerms > 0){
+	n = snprintf(buf, sizeof(buf), "\t%.8g\t%lu", st.permPval,
+		     (unsigned long) st.nbPermsDone);
+	bwrite(bwGenes, buf, min((size_t) n, sizeof(buf) - 1));
+      }
+      bwrite(bwGenes, "\n", 1);
+    }
+    closeBlockWriter(bwGenes);
+  }
+
+  if(par.verbose > 0){
+    size_t nbGenesTested = 0;
+    for(map<string, GeneStats>::const_iterator it = gene2stats.begin();
+	it != gene2stats.end(); ++it)
+      nbGenesTested += (it->second.nbSnps > 0);
+    cout << "nb of SNPs: " << nbSnps << endl
+	 << "nb of SNPs without coordinates: " << nbNoCoord << endl
+	 << "nb of genes with cis SNPs: " << nbGenesTested << endl
+	 << "nb of tests: " << nbTests << endl;
+  }
+
+  gsl_matrix_free(Y);
+  gsl_matrix_free(C);
+  if(cvrt != NULL)
+    gsl_matrix_free(cvrt);
+  if(U != NULL)
+    gsl_matrix_free(U);
+}
+
+int main(int argc, char ** argv)
+{
+  CisParams par;
+  par.cisDist = 1000000;
+  par.onlyTss = false;
+  par.maxPval = 1.0;
+  par.nbPerms = 0;
+  par.nbSuccessesToStop = 10;
+  par.seed = 1859;
+  par.nbThreads = 1;
+  par.verbose = 1;
+
+  parseCmdLine(argc, argv, par);
+
+  time_t startRawTime, endRawTime;
+  if(par.verbose > 0){
+    time(&startRawTime);
+    cout << "START " << basename(argv[0])
+         << " " << getDateTime(startRawTime) << endl
+         << "version " << VERSION << " compiled " << __DATE__
+         << " " << __TIME__ << endl
+         << "cmd-line: " << getCmdLine(argc, argv) << endl
+         << "cwd: " << getCurrentDirectory() << endl;
+    cout << flush;
+  }
+
+  run(par);
+
+  if(par.verbose > 0){
+    time(&endRawTime);
+    cout << "END " << basename(argv[0])
+         << " " << getDateTime(endRawTime) << endl
+         << "elapsed -> " << getElapsedTime(startRawTime, endRawTime) << endl
+         << "max.mem -> " << getMaxMemUsedByProcess2Str() << endl;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,1384 @@
+/** \file convert_genos.cpp
+ *
+ *  `convert_genos' converts genotype files between several formats.
+ *  Copyright (C) 2011-2014 Timothée Flutre
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Compile with: g++ -Wall -O3 -fopenmp -I.. utils_io.cpp utils_geno.cpp convert_genos.cpp -lz -o convert_genos
+ */
+
+#include <cmath>
+#include <ctime>
+#include <cstring>
+#include <cstdio>
+#include <getopt.h>
+#include <libgen.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <limits>
+#include <algorithm>
+using namespace std;
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "utils_io.hpp"
+#include "utils_geno.hpp"
+using namespace utils;
+
+#ifndef VERSION
+#define VERSION "1.0.0" // http://semver.org/
+#endif
+
+// names of the formats, in the order of GenoFormat
+static const char * formatNames[] = {"impute", "bimbam", "tped", "hapmap",
+				     "eigenstrat", "vcf"};
+
+// VCF can only be read
+enum GenoFormat { FMT_IMPUTE = 0, FMT_BIMBAM, FMT_TPED, FMT_HAPMAP,
+		  FMT_EIGENSTRAT, FMT_VCF, FMT_UNKNOWN };
+
+GenoFormat getGenoFormat(const string & name)
+{
+  for(int f = 0; f < FMT_UNKNOWN; ++f)
+    if(name == formatNames[f])
+      return (GenoFormat) f;
+  return FMT_UNKNOWN;
+}
+
+/** \brief Display the help on stdout.
+ *  \note The format complies with help2man (http://www.gnu.org/s/help2man)
+ */
+void help(char ** argv)
+{
+  cout << "`" << argv[0] << "'"
+       << " converts genotype files between several formats." << endl
+       << endl
+       << "Usage: " << argv[0] << " [OPTIONS] ..." << endl
+       << endl
+       << "Options:" << endl
+       << "  -h, --help\tdisplay the help and exit" << endl
+       << "  -V, --version\toutput version information and exit" << endl
+       << "  -v, --verbose\tverbosity level (0/default=1/2/3)" << endl
+       << "  -i, --in\tpath to the input file (can be gzipped, '-' for stdin)" << endl
+       << "\t\tprefix of the .geno, .snp and .ind files for eigenstrat" << endl
+       << "      --from\tformat of the input: impute, bimbam, tped, hapmap, eigenstrat or vcf" << endl
+       << "  -o, --out\tprefix of the output files" << endl
+       << "      --to\tformat of the output: impute, bimbam, tped, hapmap or eigenstrat" << endl
+       << "      --field\tFORMAT subfield of the VCF input: GP, DS or GT" << endl
+       << "\t\tby default, the first present among GP, DS and GT (missing if absent)" << endl
+       << "  -H, --head\tthe IMPUTE input has a header line, and write one in the IMPUTE output" << endl
+       << "      --annot\tSNP annotation of the BIMBAM input (id coord chr, eg. from impute2bimbam)" << endl
+       << "\t\tsame SNPs in the same order, otherwise chr and coord are 0" << endl
+       << "      --samples\tnames of the input samples, one per line or as a FAM/TFAM file" << endl
+       << "\t\tfor impute (without header) or bimbam, otherwise 'ind1', 'ind2'..." << endl
+       << "\t\tby default, <input>.tfam for tped" << endl
+       << "      --keep\tfile with the samples to keep, one per line, in the output order" << endl
+       << "      --rmv\tfile with the markers to remove, one per line" << endl
+       << "      --coord\tBED file with new marker coordinates (eg. from liftOver)" << endl
+       << "\t\tthe 3rd column is the new coordinate, the 4th the marker" << endl
+       << "      --only-mapped\tskip the markers absent from --coord" << endl
+       << "      --chr\tchromosomes to keep, separated by commas (eg. '1,2,X', all by default)" << endl
+       << "      --mprob\tmin probability of the most likely genotype for hard calls (default=0)" << endl
+       << "\t\tbelow which the genotype is missing, for tped, hapmap and eigenstrat" << endl
+       << "      --label\tlabel of the samples in the EIGENSTRAT .ind file (default=Unknown)" << endl
+       << "  -b, --binary\talso write dosages in binary, encoded as f32, u16 or u8" << endl
+       << "\t\tgives <prefix>.dosage.bin (see impute2bimbam)" << endl
+       << "  -z, --gz\tgzip the genotype output (except eigenstrat)" << endl
+       << "      --block\tnumber of markers converted at once (default=4096)" << endl
+       << "  -t, --threads\tnumber of threads (default=1)" << endl
+       << endl
+       << "Remarks:" << endl
+       << "  The output files are:" << endl
+       << "  - impute: <prefix>.impute, as IMPUTE (chr id coord A B pAA pAB pBB ...);" << endl
+       << "  - bimbam: <prefix>.bimbam and <prefix>_snpAnnot.txt, as impute2bimbam;" << endl
+       << "  - tped: <prefix>.tped and <prefix>.tfam, as PLINK --transpose --recode;" << endl
+       << "  - hapmap: <prefix>.hapmap, as the HapMap genotype files (with header);" << endl
+       << "  - eigenstrat: <prefix>.geno, <prefix>.snp and <prefix>.ind." << endl
+       << "  The first allele (A in IMPUTE, the first of TPED, the reference of" << endl
+       << "  EIGENSTRAT) is the one whose copies are counted in the BIMBAM dosages." << endl
+       << "  A marker of a TPED or HapMap file which is not bi-allelic is skipped." << endl
+       << "  In IMPUTE, '0 0 0' is a missing genotype. From BIMBAM, the probabilities" << endl
+       << "  are the closest to the hard calls having the same dosage." << endl
+       << "  From VCF (bi-allelic only, can be bgzipped), A is ALT and B is REF so that" << endl
+       << "  the BIMBAM dosages are those of DS; the id is chr:pos when missing." << endl
+       << "  Lines are parsed and formatted in parallel by blocks, with -t threads." << endl
+       << "  This replaces plink2impute.py, hapmap2impute.py and impute2eigenstrat.py." << endl
+       << endl
+       << "Examples:" << endl
+       << "  " << argv[0] << " -i genos.tped.gz --from tped -o genos --to impute --keep inds.txt" << endl
+       << "  " << argv[0] << " -i genos_chr1.txt.gz --from hapmap -o genos --to bimbam --coord b37.bed" << endl
+       << "  " << argv[0] << " -i chr1.dose.vcf.gz --from vcf -o chr1 --to bimbam -b u16 -t 4" << endl
+       << endl
+       << "Report bugs to <timothee.flutre@supagro.inra.fr>." << endl
+    ;
+}
+
+/** \brief Display version and license information on stdout.
+ */
+void version(char ** argv)
+{
+  cout << argv[0] << " " << VERSION << endl
+       << endl
+       << "Copyright (C) 2011-2014 Timothée Flutre." << endl
+       << "License GPLv3+: GNU GPL version 3 or later <http://gnu.org/licenses/gpl.html>" << endl
+       << "This is free software; see the source for copying conditions.  There is NO" << endl
+       << "warranty; not even for MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE." << endl
+       << endl
+       << "Written by Timothée Flutre." << endl
+    ;
+}
+
+struct ConvParams
+{
+  string inFile;
+  GenoFormat inFormat;
+  string outPrefix;
+  GenoFormat outFormat;
+  bool hasHeader;
+  string vcfField;
+  string annotFile;
+  string samplesFile;
+  string keepFile;
+  string rmvFile;
+  string coordFile;
+  bool onlyMapped;
+  vector<string> chrs;
+  double minProb;
+  string label;
+  string binaryEncoding;
+  bool gzip;
+  size_t blockSize;
+  int nbThreads;
+  int verbose;
+};
+
+/** \brief Parse the command-line arguments and check the values of the
+ *  compulsory ones.
+ */
+void
+parseCmdLine(
+  int argc,
+  char ** argv,
+  ConvParams & par)
+{
+  string inFormat, outFormat;
+  int c = 0;
+  while(true)
+  {
+    static struct option long_options[] =
+    {
+      {"help", no_argument, 0, 'h'},
+      {"version", no_argument, 0, 'V'},
+      {"verbose", required_argument, 0, 'v'},
+      {"in", required_argument, 0, 'i'},
+      {"from", required_argument, 0, 0},
+      {"out", required_argument, 0, 'o'},
+      {"to", required_argument, 0, 0},
+      {"field", required_argument, 0, 0},
+      {"head", no_argument, 0, 'H'},
+      {"annot", required_argument, 0, 0},
+      {"samples", required_argument, 0, 0},
+      {"keep", required_argument, 0, 0},
+      {"rmv", required_argument, 0, 0},
+      {"coord", required_argument, 0, 0},
+      {"only-mapped", no_argument, 0, 0},
+      {"chr", required_argument, 0, 0},
+      {"mprob", required_argument, 0, 0},
+      {"label", required_argument, 0, 0},
+      {"binary", required_argument, 0, 'b'},
+      {"gz", no_argument, 0, 'z'},
+      {"block", required_argument, 0, 0},
+      {"threads", required_argument, 0, 't'},
+      {0, 0, 0, 0}
+    };
+    int option_index = 0;
+    c = getopt_long(argc, argv, "hVv:i:o:Hb:zt:",
+                    long_options, &option_index);
+    if(c == -1)
+      break;
+    switch(c)
+    {
+    case 0:
+      if(long_options[option_index].flag != 0)
+        break;
+      if(strcmp(long_options[option_index].name, "from") == 0)
+        inFormat = optarg;
+      else if(strcmp(long_options[option_index].name, "to") == 0)
+        outFormat = optarg;
+      else if(strcmp(long_options[option_index].name, "field") == 0)
+        par.vcfField = optarg;
+      else if(strcmp(long_options[option_index].name, "annot") == 0)
+        par.annotFile = optarg;
+      else if(strcmp(long_options[option_index].name, "samples") == 0)
+        par.samplesFile = optarg;
+      else if(strcmp(long_options[option_index].name, "keep") == 0)
+        par.keepFile = optarg;
+      else if(strcmp(long_options[option_index].name, "rmv") == 0)
+        par.rmvFile = optarg;
+      else if(strcmp(long_options[option_index].name, "coord") == 0)
+        par.coordFile = optarg;
+      else if(strcmp(long_options[option_index].name, "only-mapped") == 0)
+        par.onlyMapped = true;
+      else if(strcmp(long_options[option_index].name, "chr") == 0)
+        par.chrs = split(optarg, ',');
+      else if(strcmp(long_options[option_index].name, "mprob") == 0)
+        par.minProb = atof(optarg);
+      else if(strcmp(long_options[option_index].name, "label") == 0)
+        par.label = optarg;
+      else if(strcmp(long_options[option_index].name, "block") == 0)
+        par.blockSize = (size_t) atof(optarg);
+      break;
+    case 'h':
+      help(argv);
+      exit(0);
+    case 'V':
+      version(argv);
+      exit(0);
+    case 'v':
+      par.verbose = atoi(optarg);
+      break;
+    case 'i':
+      par.inFile = optarg;
+      break;
+    case 'o':
+      par.outPrefix = optarg;
+      break;
+    case 'H':
+      par.hasHeader = true;
+      break;
+    case 'b':
+      par.binaryEncoding = optarg;
+      break;
+    case 'z':
+      par.gzip = true;
+      break;
+    case 't':
+      par.nbThreads = atoi(optarg);
+      break;
+    case '?':
+      printf("\n"); help(argv);
+      abort();
+    default:
+      printf("\n"); help(argv);
+      abort();
+    }
+  }
+  if(par.inFile.empty()){
+    cerr << "cmd-line: " << getCmdLine(argc, argv) << endl << endl
+	 << "ERROR: missing compulsory option --in" << endl << endl;
+    help(argv);
+    exit(1);
+  }
+  par.inFormat = getGenoFormat(inFormat);
+  par.outFormat = getGenoFormat(outFormat);
+  if(par.inFormat == FMT_UNKNOWN || par.outFormat == FMT_UNKNOWN){
+    cerr << "cmd-line: " << getCmdLine(argc, argv) << endl << endl
+	 << "ERROR: --from and --to should be impute, bimbam, tped, hapmap"
+	 << " or eigenstrat (vcf for --from only)" << endl << endl;
+    help(argv);
+    exit(1);
+  }
+  if(par.outFormat == FMT_VCF){
+    cerr << "cmd-line: " << getCmdLine(argc, argv) << endl << endl
+	 << "ERROR: --to can't be vcf" << endl << endl;
+    help(argv);
+    exit(1);
+  }
+  if(! par.vcfField.empty() && par.vcfField != "GP" && par.vcfField != "DS"
+     && par.vcfField != "GT"){
+    cerr << "cmd-line: " << getCmdLine(argc, argv) << endl << endl
+	 << "ERROR: --field should be GP, DS or GT" << endl << endl;
+    help(argv);
+    exit(1);
+  }
+  vector<string> inFiles(1, par.inFile);
+  if(par.inFormat == FMT_EIGENSTRAT){
+    inFiles[0] = par.inFile + ".geno";
+    inFiles.push_back(par.inFile + ".snp");
+    inFiles.push_back(par.inFile + ".ind");
+  }
+  if(par.inFormat == FMT_TPED && par.samplesFile.empty()){
+    par.samplesFile = par.inFile;
+    if(par.samplesFile.size() > 3 &&
+       par.samplesFile.substr(par.samplesFile.size() - 3) == ".gz")
+      par.samplesFile.resize(par.samplesFile.size() - 3);
+    if(par.samplesFile.size() > 5 &&
+       par.samplesFile.substr(par.samplesFile.size() - 5) == ".tped")
+      par.samplesFile.resize(par.samplesFile.size() - 5);
+    par.samplesFile += ".tfam";
+  }
+  inFiles.push_back(par.annotFile);
+  inFiles.push_back(par.samplesFile);
+  inFiles.push_back(par.keepFile);
+  inFiles.push_back(par.rmvFile);
+  inFiles.push_back(par.coordFile);
+  for(size_t f = 0; f < inFiles.size(); ++f)
+    if(! inFiles[f].empty() && inFiles[f] != "-" &&
+       ! doesFileExist(inFiles[f])){
+      cerr << "cmd-line: " << getCmdLine(argc, argv) << endl << endl
+	   << "ERROR: can't find file " << inFiles[f] << endl << endl;
+      help(argv);
+      exit(1);
+    }
+  if(par.outPrefix.empty()){
+    cerr << "cmd-line: " << getCmdLine(argc, argv) << endl << endl
+	 << "ERROR: missing compulsory option --out" << endl << endl;
+    help(argv);
+    exit(1);
+  }
+  if(par.minProb < 0 || par.minProb > 1){
+    cerr << "cmd-line: " << getCmdLine(argc, argv) << endl << endl
+	 << "ERROR: --mprob should be between 0 and 1" << endl << endl;
+    help(argv);
+    exit(1);
+  }
+  if(! par.binaryEncoding.empty())
+    getDosageEncoding(par.binaryEncoding); // exit if unknown
+  for(size_t i = 0; i < par.chrs.size(); ++i)
+    if(par.chrs[i].compare(0, 3, "chr") == 0)
+      par.chrs[i] = par.chrs[i].substr(3);
+  if(par.blockSize == 0)
+    par.blockSize = 1;
+  if(par.nbThreads < 1)
+    par.nbThreads = 1;
+}
+
+/** \brief Load a file with one item in its first column per line, the
+ *  empty ones and those starting with '#' being skipped.
+ */
+void loadFirstColumn(const string & path, vector<string> & items)
+{
+  BlockReader br;
+  StringView line;
+  vector<StringView> tokens;
+  openBlockReader(br, path);
+  while(getline(br, line))
+    if(tokenize(line, " \t", tokens) > 0 && tokens[0].data[0] != '#')
+      items.push_back(toString(tokens[0]));
+  closeBlockReader(br);
+}
+
+/** \brief Load the names of the samples, in the 2nd column of a FAM/TFAM
+ *  file (6 columns), otherwise in the 1st one.
+ */
+void loadSampleNames(const string & path, vector<string> & names)
+{
+  BlockReader br;
+  StringView line;
+  vector<StringView> tokens;
+  openBlockReader(br, path);
+  while(getline(br, line)){
+    size_t nbTokens = tokenize(line, " \t", tokens);
+    if(nbTokens > 0)
+      names.push_back(toString(tokens[nbTokens >= 6 ? 1 : 0]));
+  }
+  closeBlockReader(br);
+}
+
+/** \brief Filters and remapping applied to every marker.
+ */
+struct MarkerFilters
+{
+  set<string> toRemove;
+  map<string, string> newCoords;
+  bool onlyMapped;
+  set<string> chrs;
+};
+
+void loadMarkerFilters(const ConvParams & par, MarkerFilters & filters)
+{
+  filters.onlyMapped = par.onlyMapped;
+  filters.chrs.insert(par.chrs.begin(), par.chrs.end());
+
+  if(! par.rmvFile.empty()){
+    vector<string> ids;
+    loadFirstColumn(par.rmvFile, ids);
+    filters.toRemove.insert(ids.begin(), ids.end());
+    if(par.verbose > 0)
+      cout << "nb of markers to remove: " << filters.toRemove.size() << endl;
+  }
+
+  if(! par.coordFile.empty()){
+    BlockReader br;
+    StringView line;
+    vector<StringView> tokens;
+    openBlockReader(br, par.coordFile);
+    while(getline(br, line)){
+      if(tokenize(line, " \t", tokens) == 0)
+	continue;
+      if(tokens.size() < 4){
+	cerr << "ERROR: line " << br.nbLines << " of file " << par.coordFile
+	     << " should have at least 4 columns" << endl;
+	exit(1);
+      }
+      string id = toString(tokens[3]);
+      if(filters.newCoords.find(id) != filters.newCoords.end()){
+	cerr << "ERROR: marker " << id << " is redundant in file "
+	     << par.coordFile << endl;
+	exit(1);
+      }
+      filters.newCoords[id] = toString(tokens[2]);
+    }
+    closeBlockReader(br);
+    if(par.verbose > 0)
+      cout << "nb of markers with new coordinates: "
+	   << filters.newCoords.size() << endl;
+  }
+}
+
+/** \brief Marker being converted. The strings are views on its line or on
+ *  the new coordinates. For each output sample, the probabilities of the
+ *  genotypes a1a1, a1a2 and a2a2, all NaN if missing.
+ */
+struct Marker
+{
+  StringView chr;
+  StringView id;
+  StringView coord;
+  StringView a1;
+  StringView a2;
+  string name; // made-up id
+  vector<double> probs;
+};
+
+enum MarkerStatus { MARKER_OK = 0, MARKER_ERROR, MARKER_NOT_BIALLELIC,
+		    MARKER_REMOVED, MARKER_OTHER_CHR, MARKER_UNMAPPED };
+
+static const double missingProb = numeric_limits<double>::quiet_NaN();
+
+static const StringView unknownField = {"0", 1};
+
+inline bool sameView(const StringView & a, const StringView & b)
+{
+  return a.size == b.size && memcmp(a.data, b.data, a.size) == 0;
+}
+
+inline void setGenotype(double * p, const double pAA, const double pAB,
+			const double pBB)
+{
+  p[0] = pAA;
+  p[1] = pAB;
+  p[2] = pBB;
+}
+
+/** \brief Genotype made of the alleles x then y.
+ */
+inline bool isGenotype(const StringView & g, const StringView & x,
+		       const StringView & y)
+{
+  return g.size == x.size + y.size && memcmp(g.data, x.data, x.size) == 0
+    && memcmp(g.data + x.size, y.data, y.size) == 0;
+}
+
+/** \brief Input being read, eventually with a second file read side by
+ *  side (BIMBAM annotation or EIGENSTRAT .snp), and the columns of the
+ *  samples to keep.
+ */
+struct GenoInput
+{
+  GenoFormat format;
+  string path;
+  BlockReader br;
+  bool hasSnpFile;
+  string snpPath;
+  BlockReader brSnp;
+  string pending; // first line, read to count the samples
+  bool hasPending;
+  vector<string> samples;
+  vector<size_t> idxKept;
+  vector<long> idxOut; // output index of each input sample, -1 if dropped
+  vector<string> vcfFields; // FORMAT subfields to look for, in order
+};
+
+/** \brief Read the next marker. With a second file, its line is put first,
+ *  separated by a tab.
+ */
+bool readMarkerLine(GenoInput & in, string & out)
+{
+  StringView line;
+  if(in.hasPending){
+    in.hasPending = false;
+    line.data = in.pending.data();
+    line.size = in.pending.size();
+  }
+  else{
+    do{
+      if(! getline(in.br, line))
+	return false;
+    } while(line.size == 0);
+  }
+  out.clear();
+  if(in.hasSnpFile){
+    StringView snpLine;
+    do{
+      if(! getline(in.brSnp, snpLine)){
+	cerr << "ERROR: file " << in.snpPath << " has less markers than file "
+	     << in.path << endl;
+	exit(1);
+      }
+    } while(snpLine.size == 0);
+    out.append(snpLine.data, snpLine.size);
+    out += '\t';
+  }
+  out.append(line.data, line.size);
+  return true;
+}
+
+void openGenoInput(const ConvParams & par, GenoInput & in)
+{
+  in.format = par.inFormat;
+  in.path = (par.inFormat == FMT_EIGENSTRAT) ? par.inFile + ".geno"
+    : par.inFile;
+  in.hasSnpFile = false;
+  in.hasPending = false;
+  if(par.inFormat == FMT_EIGENSTRAT){
+    in.hasSnpFile = true;
+    in.snpPath = par.inFile + ".snp";
+  }
+  else if(par.inFormat == FMT_BIMBAM && ! par.annotFile.empty()){
+    in.hasSnpFile = true;
+    in.snpPath = par.annotFile;
+  }
+  openBlockReader(in.br, in.path);
+  if(in.hasSnpFile)
+    openBlockReader(in.brSnp, in.snpPath);
+
+  StringView line;
+  vector<StringView> tokens;
+  if((par.inFormat == FMT_IMPUTE && par.hasHeader)
+     || par.inFormat == FMT_HAPMAP){
+    if(! getline(in.br, line)){
+      cerr << "ERROR: file " << in.path << " is empty" << endl;
+      exit(1);
+    }
+    tokenize(line, " \t", tokens);
+    size_t first = (par.inFormat == FMT_IMPUTE) ? 5 : 11;
+    for(size_t i = first; i < tokens.size(); ++i)
+      in.samples.push_back(toString(tokens[i]));
+  }
+  else if(par.inFormat == FMT_VCF){
+    while(getline(in.br, line) && line.size > 1 && line.data[1] == '#');
+    if(line.size < 6 || memcmp(line.data, "#CHROM", 6) != 0){
+      cerr << "ERROR: file " << in.path << " has no '#CHROM' header line"
+	   << endl;
+      exit(1);
+    }
+    tokenize(line, "\t", tokens);
+    for(size_t i = 9; i < tokens.size(); ++i)
+      in.samples.push_back(toString(tokens[i]));
+    if(par.vcfField.empty()){
+      in.vcfFields.push_back("GP");
+      in.vcfFields.push_back("DS");
+      in.vcfFields.push_back("GT");
+    }
+    else
+      in.vcfFields.push_back(par.vcfField);
+  }
+  else if(par.inFormat == FMT_EIGENSTRAT)
+    loadSampleNames(par.inFile + ".ind", in.samples);
+  else if(! par.samplesFile.empty())
+    loadSampleNames(par.samplesFile, in.samples);
+
+  // IMPUTE and BIMBAM files don't always give the samples
+  if(par.inFormat == FMT_IMPUTE || par.inFormat == FMT_BIMBAM){
+    while(getline(in.br, line) && line.size == 0);
+    if(line.size > 0){
+      in.pending = toString(line);
+      in.hasPending = true;
+      StringView sv = {in.pending.data(), in.pending.size()};
+      size_t nbTokens = tokenize(sv, " \t", tokens);
+      size_t nbSamples = (par.inFormat == FMT_IMPUTE) ?
+	(nbTokens - 5) / 3 : nbTokens - 3;
+      if(par.inFormat == FMT_IMPUTE && in.samples.size() == 3 * nbSamples){
+	// header from impute2bimbam, eg. 'ind1_a1a1 ind1_a1a2 ind1_a2a2'
+	vector<string> names;
+	for(size_t i = 0; i < nbSamples; ++i)
+	  names.push_back(in.samples[3*i].substr(0,
+						 in.samples[3*i].rfind('_')));
+	in.samples.swap(names);
+      }
+      if(in.samples.empty())
+	for(size_t i = 0; i < nbSamples; ++i)
+	  in.samples.push_back("ind" + toString(i+1));
+    }
+  }
+
+  if(par.keepFile.empty())
+    for(size_t i = 0; i < in.samples.size(); ++i)
+      in.idxKept.push_back(i);
+  else{
+    vector<string> toKeep;
+    loadFirstColumn(par.keepFile, toKeep);
+    map<string, size_t> sample2idx;
+    for(size_t i = 0; i < in.samples.size(); ++i)
+      sample2idx[in.samples[i]] = i;
+    set<string> seen;
+    for(size_t i = 0; i < toKeep.size(); ++i){
+      if(! seen.insert(toKeep[i]).second){
+	cerr << "ERROR: sample " << toKeep[i] << " is redundant in file "
+	     << par.keepFile << endl;
+	exit(1);
+      }
+      map<string, size_t>::const_iterator it = sample2idx.find(toKeep[i]);
+      if(it == sample2idx.end()){
+	cerr << "ERROR: sample " << toKeep[i] << " to keep is absent from the"
+	     << " input" << endl;
+	exit(1);
+      }
+      in.idxKept.push_back(it->second);
+    }
+  }
+  in.idxOut.assign(in.samples.size(), -1);
+  for(size_t i = 0; i < in.idxKept.size(); ++i)
+    in.idxOut[in.idxKept[i]] = i;
+  if(par.verbose > 0)
+    cout << "nb of input samples: " << in.samples.size() << endl
+	 << "nb of samples to keep: " << in.idxKept.size() << endl;
+}
+
+void closeGenoInput(GenoInput & in)
+{
+  closeBlockReader(in.br);
+  if(in.hasSnpFile){
+    StringView line;
+    while(getline(in.brSnp, line))
+      if(line.size > 0){
+	cerr << "ERROR: file " << in.snpPath << " has more markers than file "
+	     << in.path << endl;
+	exit(1);
+      }
+    closeBlockReader(in.brSnp);
+  }
+}
+
+/** \brief IMPUTE: chr id coord A B, then pAA pAB pBB per sample.
+ */
+int parseImputeLine(const StringView & line, const GenoInput & in,
+		    vector<StringView> & tokens, Marker & m)
+{
+  if(tokenize(line, " \t", tokens) != 5 + 3 * in.samples.size())
+    return MARKER_ERROR;
+  m.chr = tokens[0];
+  m.id = tokens[1];
+  m.coord = tokens[2];
+  m.a1 = tokens[3];
+  m.a2 = tokens[4];
+  for(size_t i = 0; i < in.idxKept.size(); ++i){
+    double * p = &m.probs[3*i];
+    const StringView * t = &tokens[5 + 3 * in.idxKept[i]];
+    if(! parseDouble(t[0], p[0]) || ! parseDouble(t[1], p[1])
+       || ! parseDouble(t[2], p[2]))
+      return MARKER_ERROR;
+    if(p[0] + p[1] + p[2] == 0)
+      setGenotype(p, missingProb, missingProb, missingProb);
+  }
+  return MARKER_OK;
+}
+
+/** \brief BIMBAM: id A B, then the dosage of A per sample, eventually
+ *  preceded by the annotation (id coord chr).
+ */
+int parseBimbamLine(const StringView & line, const GenoInput & in,
+		    vector<StringView> & tokens, Marker & m)
+{
+  size_t offset = in.hasSnpFile ? 3 : 0;
+  if(tokenize(line, " \t,", tokens) != offset + 3 + in.samples.size())
+    return MARKER_ERROR;
+  m.id = tokens[offset];
+  m.a1 = tokens[offset+1];
+  m.a2 = tokens[offset+2];
+  if(in.hasSnpFile){
+    if(! sameView(tokens[0], m.id))
+      return MARKER_ERROR;
+    m.coord = tokens[1];
+    m.chr = tokens[2];
+  }
+  else
+    m.chr = m.coord = unknownField;
+  for(size_t i = 0; i < in.idxKept.size(); ++i){
+    double * p = &m.probs[3*i], d;
+    if(! parseDouble(tokens[offset + 3 + in.idxKept[i]], d))
+      setGenotype(p, missingProb, missingProb, missingProb);
+    else if(d >= 1)
+      setGenotype(p, min(d, 2.0) - 1, 2 - min(d, 2.0), 0);
+    else
+      setGenotype(p, 0, max(d, 0.0), 1 - max(d, 0.0));
+  }
+  return MARKER_OK;
+}
+
+/** \brief TPED: chr id cM coord, then two alleles per sample ('0' or 'N'
+ *  if missing), A being the first allele seen.
+ */
+int parseTpedLine(const StringView & line, const GenoInput & in,
+		  vector<StringView> & tokens, Marker & m)
+{
+  const size_t N = in.samples.size();
+  if(tokenize(line, " \t", tokens) != 4 + 2 * N)
+    return MARKER_ERROR;
+  m.chr = tokens[0];
+  m.id = tokens[1];
+  m.coord = tokens[3];
+  size_t nbAlleles = 0;
+  for(size_t j = 4; j < 4 + 2 * N; ++j){
+    if(tokens[j] == "0" || tokens[j] == "N")
+      continue;
+    if(nbAlleles > 0 && sameView(tokens[j], m.a1))
+      continue;
+    if(nbAlleles > 1 && sameView(tokens[j], m.a2))
+      continue;
+    if(nbAlleles == 2)
+      return MARKER_NOT_BIALLELIC;
+    (nbAlleles == 0 ? m.a1 : m.a2) = tokens[j];
+    ++nbAlleles;
+  }
+  if(nbAlleles != 2)
+    return MARKER_NOT_BIALLELIC;
+  for(size_t i = 0; i < in.idxKept.size(); ++i){
+    double * p = &m.probs[3*i];
+    const StringView * t = &tokens[4 + 2 * in.idxKept[i]];
+    int nbA1 = 0, nbA2 = 0;
+    for(int k = 0; k < 2; ++k){
+      if(sameView(t[k], m.a1))
+	++nbA1;
+      else if(sameView(t[k], m.a2))
+	++nbA2;
+    }
+    if(nbA1 + nbA2 != 2)
+      setGenotype(p, missingProb, missingProb, missingProb);
+    else
+      setGenotype(p, nbA1 == 2, nbA1 == 1, nbA2 == 2);
+  }
+  return MARKER_OK;
+}
+
+/** \brief HapMap: rs# alleles(A/B) chrom pos and 7 other columns, then one
+ *  genotype per sample (eg. 'AG', 'NN' if missing).
+ */
+int parseHapmapLine(const StringView & line, const GenoInput & in,
+		    vector<StringView> & tokens, Marker & m)
+{
+  if(tokenize(line, " \t", tokens) != 11 + in.samples.size())
+    return MARKER_ERROR;
+  m.id = tokens[0];
+  m.chr = tokens[2];
+  m.coord = tokens[3];
+  const char * slash = (const char *) memchr(tokens[1].data, '/',
+					     tokens[1].size);
+  if(slash == NULL)
+    return MARKER_ERROR;
+  m.a1.data = tokens[1].data;
+  m.a1.size = slash - tokens[1].data;
+  m.a2.data = slash + 1;
+  m.a2.size = tokens[1].size - m.a1.size - 1;
+  if(memchr(m.a2.data, '/', m.a2.size) != NULL)
+    return MARKER_NOT_BIALLELIC;
+  for(size_t i = 0; i < in.idxKept.size(); ++i){
+    double * p = &m.probs[3*i];
+    const StringView & g = tokens[11 + in.idxKept[i]];
+    if(isGenotype(g, m.a1, m.a1))
+      setGenotype(p, 1, 0, 0);
+    else if(isGenotype(g, m.a1, m.a2) || isGenotype(g, m.a2, m.a1))
+      setGenotype(p, 0, 1, 0);
+    else if(isGenotype(g, m.a2, m.a2))
+      setGenotype(p, 0, 0, 1);
+    else
+      setGenotype(p, missingProb, missingProb, missingProb);
+  }
+  return MARKER_OK;
+}
+
+/** \brief EIGENSTRAT: the .snp line (id chr cM coord ref var) then the
+ *  .geno line, one character per sample (copies of ref, 9 if missing).
+ */
+int parseEigenstratLine(const StringView & line, const GenoInput & in,
+			vector<StringView> & tokens, Marker & m)
+{
+  if(tokenize(line, " \t", tokens) != 7
+     || tokens[6].size != in.samples.size())
+    return MARKER_ERROR;
+  m.id = tokens[0];
+  m.chr = tokens[1];
+  m.coord = tokens[3];
+  m.a1 = tokens[4];
+  m.a2 = tokens[5];
+  const char * g = tokens[6].data;
+  for(size_t i = 0; i < in.idxKept.size(); ++i){
+    double * p = &m.probs[3*i];
+    switch(g[in.idxKept[i]]){
+    case '2': setGenotype(p, 1, 0, 0); break;
+    case '1': setGenotype(p, 0, 1, 0); break;
+    case '0': setGenotype(p, 0, 0, 1); break;
+    case '9': setGenotype(p, missingProb, missingProb, missingProb); break;
+    default: return MARKER_ERROR;
+    }
+  }
+  return MARKER_OK;
+}
+
+/** \brief Next field of a line, ending at sep or at the end of the line.
+ */
+inline bool nextField(const char * & p, const char * end, const char sep,
+		      StringView & field)
+{
+  if(p > end)
+    return false;
+  const char * q = (const char *) memchr(p, sep, end - p);
+  if(q == NULL)
+    q = end;
+  field.data = p;
+  field.size = q - p;
+  p = q + 1;
+  return true;
+}
+
+/** \brief Decode the VCF subfield (GP, DS or GT) of a sample, REF being B.
+ */
+void decodeVcfGenotype(const StringView & sub, const char kind, double * p)
+{
+  setGenotype(p, missingProb, missingProb, missingProb);
+  if(sub.size == 0 || sub.data[0] == '.')
+    return;
+  if(kind == 'P'){ // GP: P(REF/REF), P(REF/ALT), P(ALT/ALT)
+    const char * q = sub.data, * end = sub.data + sub.size;
+    StringView v;
+    double gp[3];
+    for(int k = 0; k < 3; ++k)
+      if(! nextField(q, end, ',', v) || ! parseDouble(v, gp[k]))
+	return;
+    if(gp[0] + gp[1] + gp[2] > 0)
+      setGenotype(p, gp[2], gp[1], gp[0]);
+  }
+  else if(kind == 'S'){ // DS: expected nb of ALT
+    double d;
+    if(! parseDouble(sub, d))
+      return;
+    d = max(0.0, min(d, 2.0));
+    if(d >= 1)
+      setGenotype(p, d - 1, 2 - d, 0);
+    else
+      setGenotype(p, 0, d, 1 - d);
+  }
+  else{ // GT, eg. 0/1 or 1|1, haploid calls being taken as homozygous
+    int nbAlt = 0;
+    if(sub.data[0] != '0' && sub.data[0] != '1')
+      return;
+    nbAlt += sub.data[0] - '0';
+    if(sub.size >= 3 && (sub.data[1] == '/' || sub.data[1] == '|')){
+      if(sub.data[2] != '0' && sub.data[2] != '1')
+	return;
+      nbAlt += sub.data[2] - '0';
+    }
+    else
+      nbAlt *= 2;
+    setGenotype(p, nbAlt == 2, nbAlt == 1, nbAlt == 0);
+  }
+}
+
+/** \brief VCF: CHROM POS ID REF ALT QUAL FILTER INFO FORMAT, then one
+ *  column per sample. The subfield is located by its index in FORMAT,
+ *  each column being scanned only up to it.
+ */
+int parseVcfLine(const StringView & line, const GenoInput & in,
+		 vector<StringView> & tokens, Marker & m)
+{
+  const char * p = line.data, * end = line.data + line.size;
+  StringView f[9];
+  for(int k = 0; k < 9; ++k)
+    if(! nextField(p, end, '\t', f[k]))
+      return MARKER_ERROR;
+  m.chr = f[0];
+  m.coord = f[1];
+  m.a1 = f[4];
+  m.a2 = f[3];
+  if(memchr(m.a1.data, ',', m.a1.size) != NULL)
+    return MARKER_NOT_BIALLELIC;
+  if(f[2] == "."){
+    m.name.assign(m.chr.data, m.chr.size);
+    m.name += ':';
+    m.name.append(m.coord.data, m.coord.size);
+    m.id.data = m.name.data();
+    m.id.size = m.name.size();
+  }
+  else
+    m.id = f[2];
+
+  // index of the subfield in FORMAT
+  tokenize(f[8], ":", tokens);
+  long idx = -1;
+  char kind = 0;
+  for(size_t j = 0; j < in.vcfFields.size() && idx < 0; ++j)
+    for(size_t k = 0; k < tokens.size(); ++k)
+      if(tokens[k] == in.vcfFields[j].c_str()){
+	idx = k;
+	kind = in.vcfFields[j][1]; // 'P', 'S' or 'T'
+	break;
+      }
+  if(idx < 0){ // absent subfield, hence missing genotypes
+    fill(m.probs.begin(), m.probs.end(), missingProb);
+    return MARKER_OK;
+  }
+
+  StringView col, sub;
+  for(size_t i = 0; i < in.samples.size(); ++i){
+    if(! nextField(p, end, '\t', col))
+      return MARKER_ERROR;
+    if(in.idxOut[i] < 0)
+      continue;
+    const char * q = col.data, * colEnd = col.data + col.size;
+    sub.size = 0;
+    for(long k = 0; k <= idx; ++k)
+      if(! nextField(q, colEnd, ':', sub)){
+	sub.size = 0; // trailing subfields can be dropped
+	break;
+      }
+    decodeVcfGenotype(sub, kind, &m.probs[3*in.idxOut[i]]);
+  }
+  if(p <= end)
+    return MARKER_ERROR; // more columns than samples
+  return MARKER_OK;
+}
+
+typedef int (*MarkerParser)(const StringView & line, const GenoInput & in,
+			    vector<StringView> & tokens, Marker & m);
+
+static const MarkerParser markerParsers[] = {parseImputeLine,
+					     parseBimbamLine,
+					     parseTpedLine,
+					     parseHapmapLine,
+					     parseEigenstratLine,
+					     parseVcfLine};
+
+/** \brief Remove or remap the marker, the filters being only read hence
+ *  shared by the threads.
+ */
+int filterMarker(const MarkerFilters & filters, Marker & m)
+{
+  if(! filters.toRemove.empty() &&
+     filters.toRemove.find(toString(m.id)) != filters.toRemove.end())
+    return MARKER_REMOVED;
+  if(! filters.chrs.empty()){
+    StringView chr = m.chr;
+    if(chr.size > 3 && memcmp(chr.data, "chr", 3) == 0){
+      chr.data += 3;
+      chr.size -= 3;
+    }
+    if(filters.chrs.find(toString(chr)) == filters.chrs.end())
+      return MARKER_OTHER_CHR;
+  }
+  if(! filters.newCoords.empty()){
+    map<string, string>::const_iterator it =
+      filters.newCoords.find(toString(m.id));
+    if(it != filters.newCoords.end()){
+      m.coord.data = it->second.data();
+      m.coord.size = it->second.size();
+    }
+    else if(filters.onlyMapped)
+      return MARKER_UNMAPPED;
+  }
+  return MARKER_OK;
+}
+
+/** \brief Output files, the first one getting the genotypes.
+ */
+struct GenoOutput
+{
+  GenoFormat format;
+  double minProb;
+  vector<BlockWriter> files;
+  bool hasDosageFile;
+  DosageWriter dosageWriter;
+};
+
+inline void appendView(string & out, const StringView & sv)
+{
+  out.append(sv.data, sv.size);
+}
+
+/** \brief Append a number, without snprintf for the usual hard calls.
+ */
+inline void appendNumber(string & out, const double x)
+{
+  if(x == 0)
+    out += '0';
+  else if(x == 1)
+    out += '1';
+  else if(x == 2)
+    out += '2';
+  else{
+    char buf[32];
+    int n = snprintf(buf, sizeof(buf), "%g", x);
+    out.append(buf, n);
+  }
+}
+
+inline uint8_t getCall(const double * p, const double minProb)
+{
+  return isnan(p[0]) ? (uint8_t) GENO_MISSING
+    : getHardCall(p[0], p[1], p[2], minProb);
+}
+
+/** \brief Chromosome as an EIGENSOFT number.
+ */
+string getEigenstratChr(const StringView & chr)
+{
+  string c = toString(chr);
+  if(c.compare(0, 3, "chr") == 0)
+    c = c.substr(3);
+  if(c == "X")
+    c = "23";
+  else if(c == "Y")
+    c = "24";
+  else if(c == "MT" || c == "mtDNA")
+    c = "90";
+  else if(c == "XY" || c == "YX")
+    c = "91";
+  return c;
+}
+
+void formatImputeLine(const Marker & m, const GenoOutput & /* out */,
+		      string * lines)
+{
+  string & l = lines[0];
+  appendView(l, m.chr); l += ' ';
+  appendView(l, m.id); l += ' ';
+  appendView(l, m.coord); l += ' ';
+  appendView(l, m.a1); l += ' ';
+  appendView(l, m.a2);
+  for(size_t i = 0; i < m.probs.size(); ++i){
+    l += ' ';
+    appendNumber(l, isnan(m.probs[i]) ? 0 : m.probs[i]);
+  }
+  l += '\n';
+}
+
+void formatBimbamLine(const Marker & m, const GenoOutput & /* out */,
+		      string * lines)
+{
+  string & l = lines[0];
+  appendView(l, m.id); l += ' ';
+  appendView(l, m.a1); l += ' ';
+  appendView(l, m.a2);
+  for(size_t i = 0; i < m.probs.size(); i += 3){
+    l += ' ';
+    if(isnan(m.probs[i]))
+      l += "NA";
+    else
+      appendNumber(l, 2 * m.probs[i] + m.probs[i+1]);
+  }
+  l += '\n';
+
+  string & a = lines[1];
+  appendView(a, m.id); a += ' ';
+  appendView(a, m.coord); a += ' ';
+  appendView(a, m.chr); a += '\n';
+}
+
+void formatTpedLine(const Marker & m, const GenoOutput & out,
+		    string * lines)
+{
+  string & l = lines[0];
+  appendView(l, m.chr); l += ' ';
+  appendView(l, m.id); l += " 0 ";
+  appendView(l, m.coord);
+  for(size_t i = 0; i < m.probs.size(); i += 3){
+    switch(getCall(&m.probs[i], out.minProb)){
+    case GENO_HOM_A1:
+      l += ' '; appendView(l, m.a1); l += ' '; appendView(l, m.a1); break;
+    case GENO_HET:
+      l += ' '; appendView(l, m.a1); l += ' '; appendView(l, m.a2); break;
+    case GENO_HOM_A2:
+      l += ' '; appendView(l, m.a2); l += ' '; appendView(l, m.a2); break;
+    default:
+      l += " 0 0";
+    }
+  }
+  l += '\n';
+}
+
+void formatHapmapLine(const Marker & m, const GenoOutput & out,
+		      string * lines)
+{
+  string & l = lines[0];
+  appendView(l, m.id); l += ' ';
+  appendView(l, m.a1); l += '/'; appendView(l, m.a2); l += ' ';
+  appendView(l, m.chr); l += ' ';
+  appendView(l, m.coord);
+  l += " + NA NA NA NA NA NA";
+  for(size_t i = 0; i < m.probs.size(); i += 3){
+    l += ' ';
+    switch(getCall(&m.probs[i], out.minProb)){
+    case GENO_HOM_A1: appendView(l, m.a1); appendView(l, m.a1); break;
+    case GENO_HET: appendView(l, m.a1); appendView(l, m.a2); break;
+    case GENO_HOM_A2: appendView(l, m.a2); appendView(l, m.a2); break;
+    default: l += "NN";
+    }
+  }
+  l += '\n';
+}
+
+void formatEigenstratLine(const Marker & m, const GenoOutput & out,
+			  string * lines)
+{
+  string & g = lines[0];
+  for(size_t i = 0; i < m.probs.size(); i += 3){
+    switch(getCall(&m.probs[i], out.minProb)){
+    case GENO_HOM_A1: g += '2'; break;
+    case GENO_HET: g += '1'; break;
+    case GENO_HOM_A2: g += '0'; break;
+    default: g += '9';
+    }
+  }
+  g += '\n';
+
+  string & s = lines[1];
+  appendView(s, m.id); s += '\t';
+  s += getEigenstratChr(m.chr); s += "\t0.0\t";
+  appendView(s, m.coord); s += '\t';
+  appendView(s, m.a1); s += '\t';
+  appendView(s, m.a2); s += '\n';
+}
+
+typedef void (*MarkerFormatter)(const Marker & m, const GenoOutput & out,
+				string * lines);
+
+static const MarkerFormatter markerFormatters[] = {formatImputeLine,
+						   formatBimbamLine,
+						   formatTpedLine,
+						   formatHapmapLine,
+						   formatEigenstratLine};
+
+/** \brief Open the output files and write the headers and sample files.
+ */
+void openGenoOutput(const ConvParams & par, const GenoInput & in,
+		    GenoOutput & out)
+{
+  const string & pre = par.outPrefix;
+  const string gz = par.gzip ? ".gz" : "";
+  vector<string> paths, kept;
+  for(size_t i = 0; i < in.idxKept.size(); ++i)
+    kept.push_back(in.samples[in.idxKept[i]]);
+
+  out.format = par.outFormat;
+  out.minProb = par.minProb;
+  string header, samples;
+  if(par.outFormat == FMT_IMPUTE){
+    paths.push_back(pre + ".impute" + gz);
+    if(par.hasHeader){
+      header = "chr id coord a1 a2";
+      for(size_t i = 0; i < kept.size(); ++i)
+	header += " " + kept[i];
+      header += '\n';
+    }
+  }
+  else if(par.outFormat == FMT_BIMBAM){
+    paths.push_back(pre + ".bimbam" + gz);
+    paths.push_back(pre + "_snpAnnot.txt");
+  }
+  else if(par.outFormat == FMT_TPED){
+    paths.push_back(pre + ".tped" + gz);
+    for(size_t i = 0; i < kept.size(); ++i)
+      samples += kept[i] + " " + kept[i] + " 0 0 0 -9\n";
+  }
+  else if(par.outFormat == FMT_HAPMAP){
+    paths.push_back(pre + ".hapmap" + gz);
+    header = "rs# alleles chrom pos strand assembly# center protLSID"
+      " assayLSID panelLSID QCcode";
+    for(size_t i = 0; i < kept.size(); ++i)
+      header += " " + kept[i];
+    header += '\n';
+  }
+  else if(par.outFormat == FMT_EIGENSTRAT){
+    paths.push_back(pre + ".geno");
+    paths.push_back(pre + ".snp");
+    for(size_t i = 0; i < kept.size(); ++i){
+      if(kept[i].size() > 39){
+	cerr << "ERROR: sample " << kept[i] << " has more than 39 characters,"
+	     << " the EIGENSOFT limit" << endl;
+	exit(1);
+      }
+      samples += kept[i] + "\tU\t" + par.label + "\n";
+    }
+  }
+
+  out.files.resize(paths.size());
+  for(size_t f = 0; f < paths.size(); ++f)
+    openBlockWriter(out.files[f], paths[f], par.nbThreads);
+  if(! header.empty())
+    bwrite(out.files[0], header);
+
+  if(par.outFormat == FMT_TPED || par.outFormat == FMT_EIGENSTRAT){
+    BlockWriter bw;
+    openBlockWriter(bw, pre + (par.outFormat == FMT_TPED ? ".tfam" : ".ind"));
+    bwrite(bw, samples);
+    closeBlockWriter(bw);
+  }
+
+  out.hasDosageFile = ! par.binaryEncoding.empty();
+  if(out.hasDosageFile)
+    openDosageWriter(out.dosageWriter, pre + ".dosage.bin",
+		     getDosageEncoding(par.binaryEncoding), kept.size());
+}
+
+void closeGenoOutput(GenoOutput & out)
+{
+  for(size_t f = 0; f < out.files.size(); ++f)
+    closeBlockWriter(out.files[f]);
+  if(out.hasDosageFile)
+    closeDosageWriter(out.dosageWriter);
+}
+
+void run(const ConvParams & par)
+{
+#ifdef _OPENMP
+  omp_set_num_threads(par.nbThreads);
+#endif
+
+  MarkerFilters filters;
+  loadMarkerFilters(par, filters);
+
+  GenoInput in;
+  openGenoInput(par, in);
+  GenoOutput out;
+  openGenoOutput(par, in, out);
+  const MarkerParser parse = markerParsers[par.inFormat];
+  const MarkerFormatter format = markerFormatters[par.outFormat];
+  const size_t nbFiles = out.files.size(), N = in.idxKept.size();
+
+  vector<string> lines(par.blockSize), outLines(par.blockSize * nbFiles);
+  vector<Marker> markers(par.blockSize);
+  for(size_t s = 0; s < par.blockSize; ++s)
+    markers[s].probs.resize(3 * N);
+  vector<int> status(par.blockSize);
+  vector<double> dosages(N);
+  size_t counts[MARKER_UNMAPPED+1] = {0}, nbMarkers = 0;
+
+  if(par.verbose > 0)
+    cout << "convert the markers from " << formatNames[par.inFormat]
+	 << " to " << formatNames[par.outFormat] << " ..." << endl << flush;
+  while(true){
+    size_t nb = 0;
+    while(nb < par.blockSize && readMarkerLine(in, lines[nb]))
+      ++nb;
+    if(nb == 0)
+      break;
+
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+    {
+      vector<StringView> tokens;
+#ifdef _OPENMP
+#pragma omp for
+#endif
+      for(long s = 0; s < (long) nb; ++s){
+	StringView line = {lines[s].data(), lines[s].size()};
+	status[s] = parse(line, in, tokens, markers[s]);
+	if(status[s] == MARKER_OK)
+	  status[s] = filterMarker(filters, markers[s]);
+	for(size_t f = 0; f < nbFiles; ++f)
+	  outLines[s*nbFiles+f].clear();
+	if(status[s] == MARKER_OK)
+	  format(markers[s], out, &outLines[s*nbFiles]);
+      }
+    }
+
+    for(size_t s = 0; s < nb; ++s){
+      if(status[s] == MARKER_ERROR){
+	cerr << "ERROR: can't parse marker " << nbMarkers + s + 1
+	     << " of file " << in.path;
+	if(in.hasSnpFile)
+	  cerr << " with file " << in.snpPath;
+	cerr << " (" << in.samples.size() << " samples)" << endl;
+	exit(1);
+      }
+      ++counts[status[s]];
+      if(status[s] != MARKER_OK)
+	continue;
+      for(size_t f = 0; f < nbFiles; ++f)
+	bwrite(out.files[f], outLines[s*nbFiles+f]);
+      if(out.hasDosageFile){
+	const double * p = &markers[s].probs[0];
+	for(size_t i = 0; i < N; ++i)
+	  dosages[i] = 2 * p[3*i] + p[3*i+1];
+	writeDosageRow(out.dosageWriter, &dosages[0]);
+      }
+    }
+    nbMarkers += nb;
+    if(par.verbose > 1)
+      cout << "nb of markers converted so far: " << counts[MARKER_OK] << endl
+	   << flush;
+  }
+
+  closeGenoInput(in);
+  closeGenoOutput(out);
+  if(par.verbose > 0)
+    cout << "nb of input markers: " << nbMarkers << endl
+	 << "nb of markers not bi-allelic: " << counts[MARKER_NOT_BIALLELIC]
+	 << endl
+	 << "nb of markers removed: " << counts[MARKER_REMOVED] << endl
+	 << "nb of markers on other chromosomes: " << counts[MARKER_OTHER_CHR]
+	 << endl
+	 << "nb of markers without new coordinate: " << counts[MARKER_UNMAPPED]
+	 << endl
+	 << "nb of output markers: " << counts[MARKER_OK] << endl;
+}
+
+int main(int argc, char ** argv)
+{
+  ConvParams par;
+  par.inFormat = FMT_UNKNOWN;
+  par.outFormat = FMT_UNKNOWN;
+  par.hasHeader = false;
+  par.onlyMapped = false;
+  par.minProb = 0.0;
+  par.label = "Unknown";
+  par.gzip = false;
+  par.blockSize = 4096;
+  par.nbThreads = 1;
+  par.verbose = 1;
+
+  parseCmdLine(argc, argv, par);
+
+  time_t startRawTime, endRawTime;
+  if(par.verbose > 0){
+    time(&startRawTime);
+    cout << "START " << basename(argv[0])
+         << " " << getDateTime(startRawTime) << endl
+         << "version " << VERSION << " compiled " << __DATE__
+         << " " << __TIME__ << endl
+         << "cmd-line: " << getCmdLine(argc, argv) << endl
+         << "cwd: " << getCurrentDirectory() << endl;
+    cout << flush;
+  }
+
+  run(par);
+
+  if(par.verbose > 0){
+    time(&endRawTime);
+    cout << "END " << basename(argv[0])
+         << " " << getDateTime(endRawTime) << endl
+         << "elapsed -> " << getElapsedTime(startRawTime, endRawTime) << endl
+         << "max.mem -> " << getMaxMemUsedByProcess2Str() << endl;
+  }
+
+  return EXIT_SUCCESS;
+}
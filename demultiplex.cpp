@@ -0,0 +1,1327 @@
+/** \file demultiplex.cpp
+ *
+ *  `demultiplex' assigns (pairs of) reads to individuals via their tags.
+ *  Copyright (C) 2011-2014 Timothée Flutre
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Compile with: g++ -Wall -O3 -fopenmp -I.. utils_io.cpp demultiplex.cpp -lz -o demultiplex
+ */
+
+#include <cmath>
+#include <ctime>
+#include <cstring>
+#include <cstdio>
+#include <getopt.h>
+#include <libgen.h>
+#include <stdint.h>
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+using namespace std;
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "utils_io.hpp"
+using namespace utils;
+
+#ifndef VERSION
+#define VERSION "1.0.0" // http://semver.org/
+#endif
+
+// longest pattern (tag + remaining of the cut site) fitting in the 2-bit
+// code of a key of the neighbourhood table, the top byte holding its length
+#define MAX_HASHED_PATTERN_LENGTH 28
+
+// above this number of neighbours, patterns are compared one by one
+#define MAX_NEIGHBOURHOOD_SIZE 4194304
+
+// size of the buffer of each output file
+#define OUT_BLOCK_SIZE 131072
+
+enum DemuxMethod {MET_1, MET_2, MET_3, MET_4A, MET_4B, MET_4C, MET_4D,
+		  MET_UNKNOWN};
+
+static const char * methodNames[] = {"1", "2", "3", "4a", "4b", "4c", "4d"};
+
+/** \brief Restriction enzyme, the cut on the sense strand being before
+ *  site[cut], as "^" in Biopython's elucidate().
+ */
+struct Enzyme
+{
+  const char * name;
+  const char * site;
+  size_t cut;
+};
+
+static const Enzyme enzymes[] = {
+  {"ApeKI", "GCWGC", 1},
+  {"PstI", "CTGCAG", 5},
+  {"MspI", "CCGG", 1},
+  {"HpaII", "CCGG", 1},
+  {"EcoRI", "GAATTC", 1},
+  {"MseI", "TTAA", 1},
+  {"HindIII", "AAGCTT", 1},
+  {"NsiI", "ATGCAT", 5},
+  {"SbfI", "CCTGCAGG", 6},
+  {"BamHI", "GGATCC", 1},
+  {"NlaIII", "CATG", 4},
+  {"Csp6I", "GTAC", 1},
+  {"SphI", "GCATGC", 5},
+  {"ApoI", "RAATTY", 1},
+  {"BglII", "AGATCT", 1},
+  {"HaeIII", "GGCC", 2},
+  {"TaqI", "TCGA", 1},
+  {"PvuII", "CAGCTG", 3},
+  {"Sau3AI", "GATC", 0},
+  {"MboI", "GATC", 0},
+  {"DpnII", "GATC", 0},
+  {"MluCI", "AATT", 0},
+  {NULL, NULL, 0}
+};
+
+struct DemuxParams
+{
+  string inDir;
+  string inFq1;
+  string inFq2;
+  string tagFile;
+  string outPrefix;
+  DemuxMethod method;
+  int nbSubst;
+  string enforceSubst;
+  int dist;
+  string enzyme;
+  char findChimeras;
+  bool clipIdx;
+  bool onlyComparePatterns;
+  bool qc;
+  size_t batchSize;
+  size_t maxNbOpenFiles;
+  int nbThreads;
+  int verbose;
+};
+
+/** \brief Display the help on stdout.
+ *  \note The format complies with help2man (http://www.gnu.org/s/help2man)
+ */
+void help(char ** argv)
+{
+  cout << "`" << argv[0] << "'"
+       << " assigns (pairs of) reads to individuals via their tags." << endl
+       << endl
+       << "Usage: " << argv[0] << " [OPTIONS] ..." << endl
+       << endl
+       << "Options:" << endl
+       << "  -h, --help\tdisplay the help and exit" << endl
+       << "  -V, --version\toutput version information and exit" << endl
+       << "  -v, --verbose\tverbosity level (0/default=1/2/3)" << endl
+       << "      --idir\tpath to the input directory with the fastq files (default=.)" << endl
+       << "      --ifq1\tpath to the first input fastq file (can be gzipped)" << endl
+       << "      --ifq2\tpath to the second input fastq file (can be gzipped)" << endl
+       << "\t\tabsent means single reads, present means paired-end reads" << endl
+       << "\t\terror raised if reads not in same order as --ifq1" << endl
+       << "      --it\tpath to the tag file (only A, T, G and C)" << endl
+       << "\t\tfasta: sample names in the fasta headers" << endl
+       << "\t\ttable: 2 columns, header line should be 'id\\ttag'" << endl
+       << "\t\ta sample can have several tags" << endl
+       << "      --ofqp\tprefix for the output files" << endl
+       << "\t\t<ofqp>_<sample>_R1.fastq.gz (and R2) for the assigned reads" << endl
+       << "\t\t<ofqp>_unassigned_R1.fastq.gz (and R2)" << endl
+       << "\t\t<ofqp>_chimeras_R1.fastq.gz (and R2)" << endl
+       << "\t\t<ofqp>_stats-demultiplex.txt.gz with the counts per sample" << endl
+       << "      --met\tmethod to assign pairs of reads to individuals via tags" << endl
+       << "\t\t1: assign pair if both reads start with the tag (requires --ifq2)" << endl
+       << "\t\t2: assign pair if at least one read starts with the tag (requires --ifq2)" << endl
+       << "\t\t3: same as 2, and also count if one or both reads start with the tag" << endl
+       << "\t\t4a: assign pair if first read starts with tag" << endl
+       << "\t\t4b: assign pair if first read has tag in its first N bases (see --dist)" << endl
+       << "\t\t4c: assign pair if first read has tag and remaining cut site" << endl
+       << "\t\t    in its first N bases (see --dist and --re)" << endl
+       << "\t\t4d: assign pair if first and/or second read has tag and" << endl
+       << "\t\t    remaining cut site in its first N bases (requires --ifq2)" << endl
+       << "\t\t    PCR chimeras (R1 tag is different than R2 tag) are detected" << endl
+       << "      --subst\tnumber of substitutions allowed (default=0)" << endl
+       << "      --ensubst\tenforce the nb of substitutions allowed (default=lenient/strict)" << endl
+       << "\t\t'lenient' starts from the value given via '--subst'" << endl
+       << "\t\tand decreases it until all tags are distinguishable" << endl
+       << "      --dist\tdistance from the read start to search for the tag (in bp)" << endl
+       << "\t\tany value > 0 is incompatible with --met 1/2/3/4a" << endl
+       << "\t\tany value <= 0 disables it for --met 4b/4c/4d" << endl
+       << "      --re\tname of the restriction enzyme (e.g. 'ApeKI')" << endl
+       << "\t\tor its site with the cut on the sense strand (e.g. 'G^CWGC')" << endl
+       << "      --chim\tsearch if full restriction site found in R1 and/or R2" << endl
+       << "\t\tdefault=1, see --re" << endl
+       << "\t\t0: don't search (some chimeras may still be detected if --met 4d)" << endl
+       << "\t\t1: if chimera, count as such, try to assign, and save in same files as others" << endl
+       << "\t\t2: if chimera, don't even try to assign and save in distinct files" << endl
+       << "      --nci\tdo not clip the tag when saving the assigned reads" << endl
+       << "      --compp\tonly compare patterns to be searched" << endl
+       << "      --qc\tcompute quality control statistics of the input reads" << endl
+       << "\t\tsaved in <ofqp>_R1_qc.txt (and R2), see qc_fastq" << endl
+       << "      --batch\tmaximum number of reads (or pairs) processed at once (default=100000)" << endl
+       << "      --maxopen\tmaximum number of output files open at once (default=256)" << endl
+       << "  -t, --threads\tnumber of threads (default=1)" << endl
+       << endl
+       << "Remarks:" << endl
+       << "  The tag (and remaining cut site) of each sample, as well as all sequences" << endl
+       << "  within --subst substitutions of it, are stored in a hash table, so that a" << endl
+       << "  read is assigned by one lookup per position and pattern length." << endl
+       << "  At a given position, the pattern with the fewest substitutions is kept," << endl
+       << "  then the longest one; a read matching equally well the tags of two" << endl
+       << "  samples is left unassigned." << endl
+       << "  Each batch of reads is assigned in parallel, then the full buffers of the" << endl
+       << "  output files are compressed in parallel, each as a gzip member." << endl
+       << "  Only the --maxopen most recently written files are kept open, the others" << endl
+       << "  being reopened in append mode, so that thousands of samples can be" << endl
+       << "  demultiplexed without exhausting file descriptors." << endl
+       << endl
+       << "Examples:" << endl
+       << "  " << argv[0] << " --ifq1 reads1.fastq.gz --ifq2 reads2.fastq.gz --it tags.fa --ofqp test --met 3 --chim 0" << endl
+       << "  " << argv[0] << " --ifq1 reads1.fastq.gz --it tags.txt --ofqp test --met 4c --dist 12 --re ApeKI --subst 1 -t 4" << endl
+       << endl
+       << "Report bugs to <timothee.flutre@supagro.inra.fr>." << endl
+    ;
+}
+
+/** \brief Display version and license information on stdout.
+ */
+void version(char ** argv)
+{
+  cout << argv[0] << " " << VERSION << endl
+       << endl
+       << "Copyright (C) 2011-2014 Timothée Flutre." << endl
+       << "License GPLv3+: GNU GPL version 3 or later <http://gnu.org/licenses/gpl.html>" << endl
+       << "This is free software; see the source for copying conditions.  There is NO" << endl
+       << "warranty; not even for MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE." << endl
+       << endl
+       << "Written by Timothée Flutre." << endl
+    ;
+}
+
+/** \brief Parse the command-line arguments and check the values of the
+ *  compulsory ones.
+ */
+void
+parseCmdLine(
+  int argc,
+  char ** argv,
+  DemuxParams & params)
+{
+  int c = 0;
+  string method, findChimeras = "1";
+  while(true)
+  {
+    static struct option long_options[] =
+    {
+      {"help", no_argument, 0, 'h'},
+      {"version", no_argument, 0, 'V'},
+      {"verbose", required_argument, 0, 'v'},
+      {"idir", required_argument, 0, 0},
+      {"ifq1", required_argument, 0, 0},
+      {"ifq2", required_argument, 0, 0},
+      {"it", required_argument, 0, 0},
+      {"ofqp", required_argument, 0, 0},
+      {"met", required_argument, 0, 0},
+      {"subst", required_argument, 0, 0},
+      {"ensubst", required_argument, 0, 0},
+      {"dist", required_argument, 0, 0},
+      {"re", required_argument, 0, 0},
+      {"chim", required_argument, 0, 0},
+      {"nci", no_argument, 0, 0},
+      {"compp", no_argument, 0, 0},
+      {"qc", no_argument, 0, 0},
+      {"batch", required_argument, 0, 0},
+      {"maxopen", required_argument, 0, 0},
+      {"threads", required_argument, 0, 't'},
+      {0, 0, 0, 0}
+    };
+    int option_index = 0;
+    c = getopt_long(argc, argv, "hVv:t:",
+                    long_options, &option_index);
+    if(c == -1)
+      break;
+    switch(c)
+    {
+    case 0:
+      if(long_options[option_index].flag != 0)
+        break;
+      if(strcmp(long_options[option_index].name, "idir") == 0)
+        params.inDir = optarg;
+      else if(strcmp(long_options[option_index].name, "ifq1") == 0)
+        params.inFq1 = optarg;
+      else if(strcmp(long_options[option_index].name, "ifq2") == 0)
+        params.inFq2 = optarg;
+      else if(strcmp(long_options[option_index].name, "it") == 0)
+        params.tagFile = optarg;
+      else if(strcmp(long_options[option_index].name, "ofqp") == 0)
+        params.outPrefix = optarg;
+      else if(strcmp(long_options[option_index].name, "met") == 0)
+        method = optarg;
+      else if(strcmp(long_options[option_index].name, "subst") == 0)
+        params.nbSubst = atoi(optarg);
+      else if(strcmp(long_options[option_index].name, "ensubst") == 0)
+        params.enforceSubst = optarg;
+      else if(strcmp(long_options[option_index].name, "dist") == 0)
+        params.dist = atoi(optarg);
+      else if(strcmp(long_options[option_index].name, "re") == 0)
+        params.enzyme = optarg;
+      else if(strcmp(long_options[option_index].name, "chim") == 0)
+        findChimeras = optarg;
+      else if(strcmp(long_options[option_index].name, "nci") == 0)
+        params.clipIdx = false;
+      else if(strcmp(long_options[option_index].name, "compp") == 0)
+        params.onlyComparePatterns = true;
+      else if(strcmp(long_options[option_index].name, "qc") == 0)
+        params.qc = true;
+      else if(strcmp(long_options[option_index].name, "batch") == 0)
+        params.batchSize = atol(optarg);
+      else if(strcmp(long_options[option_index].name, "maxopen") == 0)
+        params.maxNbOpenFiles = atol(optarg);
+      break;
+    case 'h':
+      help(argv);
+      exit(0);
+    case 'V':
+      version(argv);
+      exit(0);
+    case 'v':
+      params.verbose = atoi(optarg);
+      break;
+    case 't':
+      params.nbThreads = atoi(optarg);
+      break;
+    case '?':
+      printf("\n"); help(argv);
+      abort();
+    default:
+      printf("\n"); help(argv);
+      abort();
+    }
+  }
+
+  string error;
+  if(! params.onlyComparePatterns){
+    if(params.inDir.empty() || ! isDirectory(params.inDir.c_str()))
+      error = "can't find directory " + params.inDir;
+    else if(params.inFq1.empty())
+      error = "missing compulsory option --ifq1";
+    else if(! doesFileExist(params.inDir + "/" + params.inFq1))
+      error = "can't find file " + params.inDir + "/" + params.inFq1;
+    else if(! params.inFq2.empty()
+	    && ! doesFileExist(params.inDir + "/" + params.inFq2))
+      error = "can't find file " + params.inDir + "/" + params.inFq2;
+    else if(params.outPrefix.empty())
+      error = "missing compulsory option --ofqp";
+  }
+  params.method = MET_UNKNOWN;
+  for(int m = 0; m < MET_UNKNOWN; ++m)
+    if(method == methodNames[m])
+      params.method = (DemuxMethod) m;
+  if(params.dist <= 0)
+    params.dist = -1;
+  if(! error.empty())
+    ;
+  else if(params.tagFile.empty())
+    error = "missing compulsory option --it";
+  else if(! doesFileExist(params.tagFile))
+    error = "can't find file " + params.tagFile;
+  else if(method.empty())
+    error = "missing compulsory option --met";
+  else if(params.method == MET_UNKNOWN)
+    error = "unknown option --met " + method;
+  else if((params.method == MET_1 || params.method == MET_2
+	   || params.method == MET_3 || params.method == MET_4D)
+	  && params.inFq2.empty() && ! params.onlyComparePatterns)
+    error = "missing compulsory option --ifq2";
+  else if(findChimeras != "0" && findChimeras != "1" && findChimeras != "2")
+    error = "--chim " + findChimeras + " is unknown";
+  else if((params.method == MET_4C || params.method == MET_4D
+	   || findChimeras != "0") && params.enzyme.empty())
+    error = "missing compulsory option --re";
+  else if((params.method == MET_1 || params.method == MET_2
+	   || params.method == MET_3 || params.method == MET_4A)
+	  && params.dist > 0)
+    error = "--dist " + toString(params.dist) + " is incompatible with --met "
+      + method;
+  else if(params.nbSubst < 0)
+    error = "--subst should be >= 0";
+  else if(params.enforceSubst != "lenient" && params.enforceSubst != "strict")
+    error = "--ensubst " + params.enforceSubst + " is unknown";
+  if(! error.empty()){
+    cerr << "cmd-line: " << getCmdLine(argc, argv) << endl << endl
+	 << "ERROR: " << error << endl << endl;
+    help(argv);
+    exit(1);
+  }
+  params.findChimeras = findChimeras[0];
+  if(params.batchSize == 0)
+    params.batchSize = 1;
+  if(params.maxNbOpenFiles == 0)
+    params.maxNbOpenFiles = 1;
+  if(params.nbThreads < 1)
+    params.nbThreads = 1;
+}
+
+/** \brief Return the IUPAC code of a nucleotide as a mask of its possible
+ *  bases (A=1, C=2, G=4, T=8), 0 if unknown.
+ */
+uint8_t getIupacMask(const char nt)
+{
+  switch(toupper(nt)){
+  case 'A': return 1;
+  case 'C': return 2;
+  case 'G': return 4;
+  case 'T': return 8;
+  case 'R': return 1|4;
+  case 'Y': return 2|8;
+  case 'S': return 2|4;
+  case 'W': return 1|8;
+  case 'K': return 4|8;
+  case 'M': return 1|2;
+  case 'B': return 2|4|8;
+  case 'D': return 1|4|8;
+  case 'H': return 1|2|8;
+  case 'V': return 1|2|4;
+  case 'N': return 1|2|4|8;
+  default: return 0;
+  }
+}
+
+// mask of a base of a read, N and unknown letters matching nothing
+static uint8_t baseMasks[256];
+
+// 2-bit code of a base of a read, 4 for N and unknown letters
+static uint8_t baseCodes[256];
+
+void initBaseTables(void)
+{
+  for(int i = 0; i < 256; ++i){
+    baseMasks[i] = 0;
+    baseCodes[i] = 4;
+  }
+  const char * bases = "ACGT";
+  for(int b = 0; b < 4; ++b){
+    baseMasks[(unsigned char) bases[b]] = (uint8_t) (1 << b);
+    baseMasks[(unsigned char) tolower(bases[b])] = (uint8_t) (1 << b);
+    baseCodes[(unsigned char) bases[b]] = (uint8_t) b;
+    baseCodes[(unsigned char) tolower(bases[b])] = (uint8_t) b;
+  }
+}
+
+string masksToString(const vector<uint8_t> & masks)
+{
+  string s;
+  const char * bases = "ACGT";
+  for(size_t i = 0; i < masks.size(); ++i){
+    if(masks[i] == 1 || masks[i] == 2 || masks[i] == 4 || masks[i] == 8){
+      for(int b = 0; b < 4; ++b)
+	if(masks[i] & (1 << b))
+	  s += bases[b];
+    }
+    else{
+      s += '[';
+      for(int b = 0; b < 4; ++b)
+	if(masks[i] & (1 << b))
+	  s += bases[b];
+      s += ']';
+    }
+  }
+  return s;
+}
+
+/** \brief Retrieve the site of the restriction enzyme, as a mask per
+ *  position, and the position of the cut on the sense strand.
+ */
+void getRestrictionSite(const string & enzyme, vector<uint8_t> & site,
+			size_t & cut, const int & verbose)
+{
+  string seq;
+  cut = string::npos;
+  if(enzyme.find('^') != string::npos){ // e.g. G^CWGC
+    for(size_t i = 0; i < enzyme.size(); ++i){
+      if(enzyme[i] == '^')
+	cut = seq.size();
+      else if(enzyme[i] != '_')
+	seq += enzyme[i];
+    }
+  }
+  else
+    for(size_t e = 0; enzymes[e].name != NULL; ++e)
+      if(strcasecmp(enzyme.c_str(), enzymes[e].name) == 0){
+	seq = enzymes[e].site;
+	cut = enzymes[e].cut;
+      }
+  if(cut == string::npos){
+    cerr << "ERROR: restriction enzyme " << enzyme << " not recognized"
+	 << endl;
+    exit(1);
+  }
+  site.clear();
+  for(size_t i = 0; i < seq.size(); ++i){
+    site.push_back(getIupacMask(seq[i]));
+    if(site.back() == 0){
+      cerr << "ERROR: restriction site " << seq << " has an unknown letter"
+	   << endl;
+      exit(1);
+    }
+  }
+  if(verbose > 0)
+    cout << "enzyme " << enzyme << ": motif=" << seq.substr(0, cut) << "^"
+	 << seq.substr(cut) << endl
+	 << "full motif: " << masksToString(site) << endl
+	 << "remaining motif: "
+	 << masksToString(vector<uint8_t>(site.begin() + cut, site.end()))
+	 << endl;
+}
+
+struct Tag
+{
+  string seq;
+  size_t sample;
+};
+
+/** \brief Load the tags, in the fasta or table format, the samples being
+ *  numbered in their order of appearance.
+ */
+void loadTags(const string & tagFile, vector<Tag> & tags,
+	      vector<string> & samples, const int & verbose)
+{
+  BlockReader br;
+  StringView line;
+  vector<StringView> tokens;
+  openBlockReader(br, tagFile);
+  if(! getline(br, line)){
+    cerr << "ERROR: tag file " << tagFile << " is empty" << endl;
+    exit(1);
+  }
+  bool isFasta = (line.size > 0 && line.data[0] == '>'), hasLine = isFasta;
+  if(! isFasta){
+    tokenize(line, " \t", tokens);
+    if(tokens.size() == 2 && tokens[0] == "id" && tokens[1] == "tag")
+      ;
+    else if(tokens.size() == 2){
+      cerr << "WARNING: tag file should have a header line 'id\\ttag'" << endl;
+      hasLine = true; // the first line is a tag
+    }
+    else{
+      cerr << "ERROR: tag file seems to be neither in 'fasta' nor 'table'"
+	   << " format" << endl << toString(line) << endl;
+      exit(1);
+    }
+  }
+  if(verbose > 0)
+    cout << "load tag file (format=" << (isFasta ? "fasta" : "table")
+	 << ")..." << endl << flush;
+
+  map<string, size_t> sample2idx;
+  map<string, size_t> seq2tag;
+  string sample, seq;
+  StringView header;
+  while(true){
+    if(! hasLine && ! getline(br, line))
+      break;
+    hasLine = false;
+    if(line.size == 0)
+      continue;
+    if(isFasta){
+      if(line.data[0] != '>'){
+	cerr << "ERROR: line " << br.nbLines << " of tag file " << tagFile
+	     << " should start with '>'" << endl;
+	exit(1);
+      }
+      header.data = line.data + 1;
+      header.size = line.size - 1;
+      tokenize(header, " \t", tokens);
+      sample = tokens.empty() ? "" : toString(tokens[0]);
+      seq.clear();
+      while(getline(br, line) && (line.size == 0 || line.data[0] != '>'))
+	seq.append(line.data, line.size);
+      hasLine = (line.size > 0 && line.data[0] == '>');
+    }
+    else{
+      tokenize(line, " \t", tokens);
+      if(tokens.size() < 2){
+	cerr << "ERROR: line " << br.nbLines << " of tag file " << tagFile
+	     << " should have 2 columns" << endl;
+	exit(1);
+      }
+      sample = toString(tokens[0]);
+      seq = toString(tokens[1]);
+    }
+    transform(seq.begin(), seq.end(), seq.begin(), ::toupper);
+    if(sample.empty() || seq.empty()){
+      cerr << "ERROR: tag file " << tagFile << " has an empty sample or tag"
+	   << " before line " << br.nbLines << endl;
+      exit(1);
+    }
+    if(seq.find_first_not_of("ACGT") != string::npos){
+      cerr << "ERROR: tag sequence '" << seq << "' has ambiguous DNA letters"
+	   << endl;
+      exit(1);
+    }
+    if(seq2tag.find(seq) != seq2tag.end()){
+      cerr << "ERROR: tag sequence '" << seq << "' is present several times"
+	   << endl;
+      exit(1);
+    }
+    if(sample2idx.find(sample) == sample2idx.end()){
+      sample2idx[sample] = samples.size();
+      samples.push_back(sample);
+    }
+    seq2tag[seq] = tags.size();
+    Tag tag;
+    tag.seq = seq;
+    tag.sample = sample2idx[sample];
+    tags.push_back(tag);
+  }
+  closeBlockReader(br);
+
+  if(verbose > 0)
+    cout << "nb of tag sequences: " << tags.size() << endl
+	 << "nb of samples: " << samples.size() << endl << flush;
+}
+
+/** \brief Best occurrence of a pattern in a read.
+ */
+struct Match
+{
+  int pattern; // -1 if none, or if the best ones belong to several samples
+  size_t start;
+  size_t end;
+  int nbSubst;
+};
+
+/** \brief Patterns (tag followed, for --met 4c/4d, by the remaining of the
+ *  cut site) searched at the start or in the first bases of the reads, with
+ *  up to nbSubst substitutions.
+ *  \note All the sequences within nbSubst substitutions of a pattern are
+ *  stored in an open-addressing table whose key is the 2-bit code of the
+ *  sequence with its length in the top byte, and whose value is the pattern
+ *  with the fewest substitutions, or -1 if two samples are tied.
+ */
+struct TagMatcher
+{
+  vector<vector<uint8_t> > masks; // per pattern
+  vector<size_t> samples; // per pattern
+  vector<bool> isLength; // per length, whether a pattern has it
+  size_t maxLength;
+  int nbSubst;
+  bool anchored;
+  int dist;
+  bool useTable;
+  vector<uint64_t> keys;
+  vector<int32_t> values;
+  vector<uint8_t> costs;
+  int shift;
+};
+
+void setPatterns(TagMatcher & tm, const vector<Tag> & tags,
+		 const vector<uint8_t> & remain, const bool anchored,
+		 const int dist)
+{
+  tm.masks.assign(tags.size(), vector<uint8_t>());
+  tm.samples.resize(tags.size());
+  tm.maxLength = 0;
+  for(size_t t = 0; t < tags.size(); ++t){
+    for(size_t i = 0; i < tags[t].seq.size(); ++i)
+      tm.masks[t].push_back(getIupacMask(tags[t].seq[i]));
+    tm.masks[t].insert(tm.masks[t].end(), remain.begin(), remain.end());
+    tm.samples[t] = tags[t].sample;
+    tm.maxLength = max(tm.maxLength, tm.masks[t].size());
+  }
+  tm.isLength.assign(tm.maxLength + 1, false);
+  for(size_t t = 0; t < tags.size(); ++t)
+    tm.isLength[tm.masks[t].size()] = true;
+  tm.anchored = anchored;
+  tm.dist = dist;
+}
+
+/** \brief Return the number of sequences within nbSubst substitutions of
+ *  a pattern.
+ */
+double countNeighbours(const vector<uint8_t> & masks, const int nbSubst)
+{
+  vector<double> counts(nbSubst + 1, 0.0); // per nb of substitutions
+  counts[0] = 1.0;
+  for(size_t i = 0; i < masks.size(); ++i){
+    int nbIn = 0;
+    for(int b = 0; b < 4; ++b)
+      nbIn += (masks[i] >> b) & 1;
+    for(int s = nbSubst; s >= 0; --s)
+      counts[s] = counts[s] * nbIn + (s > 0 ? counts[s-1] * (4 - nbIn) : 0.0);
+  }
+  double total = 0.0;
+  for(int s = 0; s <= nbSubst; ++s)
+    total += counts[s];
+  return total;
+}
+
+static inline size_t hashKey(const uint64_t key, const int shift)
+{
+  return (size_t) ((key * 0x9E3779B97F4A7C15ULL) >> shift);
+}
+
+void insertNeighbour(TagMatcher & tm, const uint64_t key, const int32_t pat,
+		     const uint8_t cost)
+{
+  size_t mask = tm.keys.size() - 1, slot = hashKey(key, tm.shift);
+  while(tm.keys[slot] != ~0ULL && tm.keys[slot] != key)
+    slot = (slot + 1) & mask;
+  if(tm.keys[slot] == ~0ULL){
+    tm.keys[slot] = key;
+    tm.values[slot] = pat;
+    tm.costs[slot] = cost;
+  }
+  else if(cost < tm.costs[slot]){
+    tm.values[slot] = pat;
+    tm.costs[slot] = cost;
+  }
+  else if(cost == tm.costs[slot] && tm.values[slot] != -1
+	  && tm.samples[tm.values[slot]] != tm.samples[pat])
+    tm.values[slot] = -1;
+}
+
+void insertNeighbours(TagMatcher & tm, const int32_t pat, const size_t pos,
+		      const uint64_t code, const int cost)
+{
+  const vector<uint8_t> & masks = tm.masks[pat];
+  if(pos == masks.size()){
+    insertNeighbour(tm, ((uint64_t) masks.size() << 56) | code, pat,
+		    (uint8_t) cost);
+    return;
+  }
+  for(int b = 0; b < 4; ++b){
+    int c = cost + ((masks[pos] & (1 << b)) ? 0 : 1);
+    if(c <= tm.nbSubst)
+      insertNeighbours(tm, pat, pos + 1, (code << 2) | b, c);
+  }
+}
+
+/** \brief Fill the table of neighbours if the patterns are short enough
+ *  and their neighbourhoods small enough, otherwise the patterns will be
+ *  compared one by one to the reads.
+ */
+void buildNeighbourhoodTable(TagMatcher & tm, const int nbSubst,
+			     const int & verbose)
+{
+  tm.nbSubst = nbSubst;
+  tm.keys.clear();
+  tm.values.clear();
+  tm.costs.clear();
+  double nbNeighbours = 0.0;
+  for(size_t p = 0; p < tm.masks.size(); ++p)
+    nbNeighbours += countNeighbours(tm.masks[p], nbSubst);
+  tm.useTable = (tm.maxLength <= MAX_HASHED_PATTERN_LENGTH
+		 && nbNeighbours <= MAX_NEIGHBOURHOOD_SIZE);
+  if(! tm.useTable){
+    if(verbose > 0)
+      cout << "patterns compared one by one to the reads ("
+	   << nbNeighbours << " neighbours)" << endl;
+    return;
+  }
+  size_t size = 16;
+  tm.shift = 60;
+  while(size < 2 * nbNeighbours){
+    size *= 2;
+    --tm.shift;
+  }
+  tm.keys.assign(size, ~0ULL);
+  tm.values.assign(size, -1);
+  tm.costs.assign(size, 0);
+  for(size_t p = 0; p < tm.masks.size(); ++p)
+    insertNeighbours(tm, (int32_t) p, 0, 0, 0);
+  if(verbose > 0)
+    cout << "nb of sequences in the neighbourhood table: " << nbNeighbours
+	 << endl;
+}
+
+/** \brief Return the number of substitutions between a pattern and a
+ *  sequence of the same length, stopping above maxSubst.
+ */
+static inline int countSubst(const vector<uint8_t> & masks, const char * seq,
+			     const int maxSubst)
+{
+  int nbSubst = 0;
+  for(size_t i = 0; i < masks.size(); ++i)
+    if((baseMasks[(unsigned char) seq[i]] & masks[i]) == 0
+       && ++nbSubst > maxSubst)
+      break;
+  return nbSubst;
+}
+
+/** \brief Update the best match at a given position, the fewest
+ *  substitutions winning, then the longest pattern.
+ */
+static inline void updateMatch(const TagMatcher & tm, Match & best,
+			       const int pat, const size_t len,
+			       const int nbSubst)
+{
+  size_t bestLen = best.end - best.start;
+  if(best.nbSubst < 0 || nbSubst < best.nbSubst
+     || (nbSubst == best.nbSubst && len > bestLen)){
+    best.pattern = pat;
+    best.end = best.start + len;
+    best.nbSubst = nbSubst;
+  }
+  else if(nbSubst == best.nbSubst && len == bestLen && best.pattern != -1
+	  && (pat == -1 || tm.samples[pat] != tm.samples[best.pattern]))
+    best.pattern = -1;
+}
+
+/** \brief Find the leftmost position at which a pattern occurs in the
+ *  read, with the fewest substitutions, then the longest pattern.
+ *  \return false if none, or if the best ones belong to several samples
+ */
+bool findBestMatch(const TagMatcher & tm, const char * seq, const size_t len,
+		   Match & best)
+{
+  size_t window = len;
+  if(! tm.anchored && (size_t) tm.dist < window)
+    window = tm.dist;
+  size_t lastStart = tm.anchored ? 0 : window;
+  for(size_t start = 0; start <= lastStart; ++start){
+    best.pattern = -1;
+    best.start = best.end = start;
+    best.nbSubst = -1;
+    uint64_t code = 0;
+    bool hasUnknown = false;
+    for(size_t l = 1; l <= tm.maxLength && start + l <= window; ++l){
+      uint8_t c = baseCodes[(unsigned char) seq[start + l - 1]];
+      hasUnknown = hasUnknown || c == 4;
+      code = (code << 2) | (c & 3);
+      if(! tm.isLength[l])
+	continue;
+      if(tm.useTable && ! hasUnknown){
+	uint64_t key = ((uint64_t) l << 56) | code;
+	size_t mask = tm.keys.size() - 1, slot = hashKey(key, tm.shift);
+	while(tm.keys[slot] != ~0ULL && tm.keys[slot] != key)
+	  slot = (slot + 1) & mask;
+	if(tm.keys[slot] == key)
+	  updateMatch(tm, best, tm.values[slot], l, tm.costs[slot]);
+      }
+      else
+	for(size_t p = 0; p < tm.masks.size(); ++p)
+	  if(tm.masks[p].size() == l){
+	    int nbSubst = countSubst(tm.masks[p], seq + start, tm.nbSubst);
+	    if(nbSubst <= tm.nbSubst)
+	      updateMatch(tm, best, (int) p, l, nbSubst);
+	  }
+    }
+    if(best.nbSubst >= 0)
+      return best.pattern != -1;
+  }
+  return false;
+}
+
+/** \brief Find the leftmost occurrence of a given pattern in the read.
+ */
+bool findPattern(const TagMatcher & tm, const int pat, const char * seq,
+		 const size_t len, Match & match)
+{
+  const vector<uint8_t> & masks = tm.masks[pat];
+  size_t window = len;
+  if(! tm.anchored && (size_t) tm.dist < window)
+    window = tm.dist;
+  if(masks.size() > window)
+    return false;
+  size_t lastStart = tm.anchored ? 0 : window - masks.size();
+  for(size_t start = 0; start <= lastStart; ++start){
+    int nbSubst = countSubst(masks, seq + start, tm.nbSubst);
+    if(nbSubst <= tm.nbSubst){
+      match.pattern = pat;
+      match.start = start;
+      match.end = start + masks.size();
+      match.nbSubst = nbSubst;
+      return true;
+    }
+  }
+  return false;
+}
+
+/** \brief Return true if, for all tags of different samples, the pattern
+ *  of the shortest doesn't occur in the sequences of the other.
+ */
+bool comparePatterns(const TagMatcher & tm, const vector<Tag> & tags,
+		     const vector<string> & samples)
+{
+  for(size_t i = 0; i < tm.masks.size(); ++i)
+    for(size_t j = 0; j < tm.masks.size(); ++j){
+      if(j == i || tm.samples[j] == tm.samples[i]
+	 || tm.masks[i].size() > tm.masks[j].size())
+	continue;
+
+      // enumerate the sequences of pattern j, e.g. AAACAGC and AAACTGC
+      const vector<uint8_t> & masks = tm.masks[j];
+      vector<int> bases(masks.size(), -1);
+      string seq(masks.size(), 'N');
+      size_t pos = 0;
+      while(true){
+	int b = bases[pos] + 1;
+	while(b < 4 && ! (masks[pos] & (1 << b)))
+	  ++b;
+	if(b == 4){
+	  bases[pos] = -1;
+	  if(pos == 0)
+	    break;
+	  --pos;
+	  continue;
+	}
+	bases[pos] = b;
+	seq[pos] = "ACGT"[b];
+	if(pos + 1 < masks.size()){
+	  ++pos;
+	  continue;
+	}
+	Match match;
+	if(findPattern(tm, (int) i, seq.data(), seq.size(), match)){
+	  cout << "with " << tm.nbSubst << " allowed substitution"
+	       << (tm.nbSubst > 1 ? "s" : "") << ", tag " << tags[i].seq
+	       << " corresponding to " << samples[tm.samples[i]] << endl
+	       << "is indistinguishable from tag " << tags[j].seq
+	       << " corresponding to " << samples[tm.samples[j]] << endl
+	       << "pattern: " << masksToString(tm.masks[i]) << endl
+	       << "string: " << seq << endl
+	       << "start-end: " << match.start << "-" << match.end << endl;
+	  return false;
+	}
+      }
+    }
+  return true;
+}
+
+/** \brief Return true if the full restriction site occurs in the read.
+ */
+bool hasSite(const vector<uint8_t> & site, const char * seq,
+	     const size_t len)
+{
+  for(size_t start = 0; start + site.size() <= len; ++start)
+    if(countSubst(site, seq + start, 0) == 0)
+      return true;
+  return false;
+}
+
+struct Assignment
+{
+  int sample; // -1 if unassigned
+  size_t idx1; // clipping positions
+  size_t idx2;
+  int nbTags; // 1 or 2 for --met 3/4d
+  bool chimeraSite;
+  bool chimeraTags;
+};
+
+/** \brief Try to assign a read (pair) to a sample as identifyIndividual_*
+ *  in demultiplex.py.
+ */
+void assignReads(const DemuxParams & params, const TagMatcher & tm,
+		 const vector<uint8_t> & site, const size_t lenRemain,
+		 const StringView & seq1, const StringView & seq2,
+		 Assignment & a)
+{
+  a.sample = -1;
+  a.idx1 = a.idx2 = 0;
+  a.nbTags = 0;
+  a.chimeraTags = false;
+  a.chimeraSite = (params.findChimeras != '0'
+		   && (hasSite(site, seq1.data, seq1.size)
+		       || hasSite(site, seq2.data, seq2.size)));
+  if(a.chimeraSite && params.findChimeras != '1')
+    return;
+
+  Match m1, m2;
+  bool has1 = findBestMatch(tm, seq1.data, seq1.size, m1), has2 = false;
+  switch(params.method){
+  case MET_1:
+    if(has1 && findPattern(tm, m1.pattern, seq2.data, seq2.size, m2)){
+      a.sample = tm.samples[m1.pattern];
+      a.idx1 = m1.end;
+      a.idx2 = m2.end;
+    }
+    break;
+  case MET_2:
+  case MET_3:
+    if(has1){
+      a.sample = tm.samples[m1.pattern];
+      a.idx1 = m1.end;
+      a.nbTags = 1;
+      if(findPattern(tm, m1.pattern, seq2.data, seq2.size, m2)){
+	a.idx2 = m2.end;
+	a.nbTags = 2;
+      }
+    }
+    else if(findBestMatch(tm, seq2.data, seq2.size, m2)){
+      a.sample = tm.samples[m2.pattern];
+      a.idx2 = m2.end;
+      a.nbTags = 1;
+    }
+    break;
+  case MET_4A:
+  case MET_4B:
+  case MET_4C:
+    if(has1){
+      a.sample = tm.samples[m1.pattern];
+      a.idx1 = m1.end - lenRemain;
+    }
+    break;
+  case MET_4D:
+    if(has1){
+      if(findPattern(tm, m1.pattern, seq2.data, seq2.size, m2))
+	has2 = true;
+      else if(findBestMatch(tm, seq2.data, seq2.size, m2)){
+	if(tm.samples[m2.pattern] != tm.samples[m1.pattern]){
+	  a.chimeraTags = true;
+	  break;
+	}
+	has2 = true; // another tag of the same sample
+      }
+      a.sample = tm.samples[m1.pattern];
+      a.idx1 = m1.end - lenRemain;
+      a.idx2 = has2 ? m2.end - lenRemain : a.idx1;
+      a.nbTags = has2 ? 2 : 1;
+    }
+    else if(findBestMatch(tm, seq2.data, seq2.size, m2)){
+      a.sample = tm.samples[m2.pattern];
+      a.idx2 = m2.end - lenRemain;
+      a.idx1 = a.idx2;
+      a.nbTags = 1;
+    }
+    break;
+  default:
+    break;
+  }
+  if(! params.clipIdx)
+    a.idx1 = a.idx2 = 0;
+}
+
+struct DemuxStats
+{
+  size_t nbPairs;
+  size_t nbAssignedPairs;
+  size_t nbAssignedPairsTwoTags;
+  size_t nbAssignedPairsOneTag;
+  size_t nbChimeras;
+  size_t nbChimerasSite;
+  size_t nbChimerasTags;
+  size_t nbUnassignedPairs;
+  size_t nbUnassignedPairsChimeras;
+  vector<size_t> nbAssignedPerSample;
+};
+
+void saveStatsPerInd(const string & outPrefix, const vector<Tag> & tags,
+		     const vector<string> & samples, const DemuxStats & stats)
+{
+  vector<pair<string, size_t> > sorted;
+  for(size_t s = 0; s < samples.size(); ++s)
+    sorted.push_back(make_pair(samples[s], s));
+  sort(sorted.begin(), sorted.end());
+
+  BlockWriter bw;
+  openBlockWriter(bw, outPrefix + "_stats-demultiplex.txt.gz");
+  bwrite(bw, "ind\tbarcode\tassigned\n");
+  for(size_t i = 0; i < sorted.size(); ++i){
+    string barcodes;
+    for(size_t t = 0; t < tags.size(); ++t)
+      if(tags[t].sample == sorted[i].second)
+	barcodes += (barcodes.empty() ? "" : "_") + tags[t].seq;
+    bwrite(bw, sorted[i].first + "\t" + barcodes + "\t"
+	   + toString(stats.nbAssignedPerSample[sorted[i].second]) + "\n");
+  }
+  closeBlockWriter(bw);
+}
+
+void printSummary(const DemuxParams & params, const DemuxStats & stats,
+		  const size_t nbSamplesWithReads)
+{
+  double nbPairs = max(stats.nbPairs, (size_t) 1);
+  cout << fixed << setprecision(2)
+       << "total nb of read pairs: " << stats.nbPairs << endl
+       << "nb of assigned read pairs: " << stats.nbAssignedPairs;
+  if(params.method == MET_3 || params.method == MET_4D)
+    cout << "; 2tags=" << stats.nbAssignedPairsTwoTags
+	 << " 1tags=" << stats.nbAssignedPairsOneTag;
+  cout << endl;
+  if(params.findChimeras != '0' || params.method == MET_4D){
+    cout << "nb of chimeric read pairs: " << stats.nbChimeras
+	 << " (" << 100 * stats.nbChimeras / nbPairs << "%";
+    if(params.findChimeras != '0' && params.method == MET_4D)
+      cout << "; site=" << stats.nbChimerasSite
+	   << " tags=" << stats.nbChimerasTags;
+    cout << ")" << endl;
+  }
+  cout << "nb of unassigned read pairs: " << stats.nbUnassignedPairs
+       << " (" << 100 * stats.nbUnassignedPairs / nbPairs << "%)" << endl;
+  if(params.findChimeras == '2' || params.method == MET_4D){
+    size_t nb = stats.nbUnassignedPairs - stats.nbUnassignedPairsChimeras;
+    cout << "nb of unassigned read pairs (excluding chimeras): " << nb
+	 << " (" << 100 * nb / nbPairs << "%)" << endl;
+  }
+  cout << "nb of individuals with assigned reads: " << nbSamplesWithReads
+       << endl;
+}
+
+void run(const DemuxParams & params)
+{
+  initBaseTables();
+
+  vector<Tag> tags;
+  vector<string> samples;
+  loadTags(params.tagFile, tags, samples, params.verbose);
+
+  vector<uint8_t> site, remain;
+  size_t cut = 0;
+  if(params.method == MET_4C || params.method == MET_4D
+     || params.findChimeras != '0'){
+    getRestrictionSite(params.enzyme, site, cut, params.verbose);
+    if(params.method == MET_4C || params.method == MET_4D)
+      remain.assign(site.begin() + cut, site.end());
+  }
+
+  TagMatcher tm;
+  bool anchored = (params.method == MET_1 || params.method == MET_2
+		   || params.method == MET_3 || params.method == MET_4A
+		   || params.dist <= 0);
+  setPatterns(tm, tags, remain, anchored, params.dist);
+  for(size_t t = 0; t < tags.size(); ++t)
+    if(params.dist > 0 && tm.masks[t].size() > (size_t) params.dist){
+      cerr << "ERROR: --dist " << params.dist << " is too short for sample "
+	   << samples[tags[t].sample] << endl
+	   << "with tag " << tags[t].seq << " and method "
+	   << methodNames[params.method] << endl
+	   << "because the whole sequence " << masksToString(tm.masks[t])
+	   << endl << "has length " << tm.masks[t].size() << endl;
+      exit(1);
+    }
+
+  int nbSubst = params.nbSubst;
+  tm.nbSubst = nbSubst;
+  if(nbSubst > 0 && params.verbose > 0)
+    cout << "check that searched patterns are distinguishable" << endl
+	 << "with " << nbSubst << " substitution" << (nbSubst > 1 ? "s" : "")
+	 << " allowed..." << endl << flush;
+  while(nbSubst > 0 && ! comparePatterns(tm, tags, samples)){
+    if(params.enforceSubst == "strict"){
+      cerr << "ERROR: some tags are indistinguishable with " << nbSubst
+	   << " substitution" << (nbSubst > 1 ? "s" : "") << endl;
+      exit(1);
+    }
+    tm.nbSubst = --nbSubst;
+  }
+  if(params.verbose > 0)
+    cout << "nb of substitutions allowed: " << nbSubst << endl << flush;
+  if(params.onlyComparePatterns)
+    return;
+  buildNeighbourhoodTable(tm, nbSubst, params.verbose);
+
+  bool paired = ! params.inFq2.empty();
+  if(params.verbose > 0)
+    cout << "demultiplex " << (paired ? "paired" : "single")
+	 << "-end reads (method=" << methodNames[params.method]
+	 << ", subst=" << nbSubst << ", threads=" << params.nbThreads
+	 << ")..." << endl << flush;
+
+  FastqReader fr1, fr2;
+  openFastqReader(fr1, params.inDir + "/" + params.inFq1);
+  if(paired)
+    openFastqReader(fr2, params.inDir + "/" + params.inFq2);
+
+  // output files: samples, then unassigned, then chimeras
+  size_t nbDests = samples.size() + 2,
+    unassigned = samples.size(), chimeras = samples.size() + 1;
+  FileMultiplexer fm;
+  openFileMultiplexer(fm, params.nbThreads, 6, params.maxNbOpenFiles,
+		      OUT_BLOCK_SIZE);
+  vector<size_t> files(2 * nbDests);
+  vector<bool> hasFiles(nbDests, false);
+
+  DemuxStats stats;
+  stats.nbPairs = stats.nbAssignedPairs = stats.nbAssignedPairsTwoTags
+    = stats.nbAssignedPairsOneTag = stats.nbChimeras = stats.nbChimerasSite
+    = stats.nbChimerasTags = stats.nbUnassignedPairs
+    = stats.nbUnassignedPairsChimeras = 0;
+  stats.nbAssignedPerSample.assign(samples.size(), 0);
+
+  // statistics of the input reads, one per thread
+  vector<FastqStats> qc1(params.qc ? params.nbThreads : 0),
+    qc2(params.qc ? params.nbThreads : 0);
+  for(size_t s = 0; s < qc1.size(); ++s){
+    initFastqStats(qc1[s]);
+    initFastqStats(qc2[s]);
+  }
+
+  vector<FastqRecord> reads1, reads2;
+  vector<Assignment> assignments;
+  StringView empty;
+  empty.data = "";
+  empty.size = 0;
+  while(true){
+    size_t nbReads = paired ?
+      readFastqBatch(fr1, fr2, params.batchSize, reads1, reads2)
+      : readFastqBatch(fr1, params.batchSize, reads1);
+    if(nbReads == 0)
+      break;
+
+    // assign the reads in parallel
+    assignments.resize(nbReads);
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(params.nbThreads) schedule(static)
+#endif
+    for(long r = 0; r < (long) nbReads; ++r)
+      assignReads(params, tm, site, remain.size(), reads1[r].seq,
+		  paired ? reads2[r].seq : empty,
+		  assignments[r]);
+
+    if(params.qc){
+      size_t sliceSize = (nbReads + params.nbThreads - 1) / params.nbThreads;
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(params.nbThreads)
+#endif
+      for(int s = 0; s < params.nbThreads; ++s){
+	size_t last = min(nbReads, (s + 1) * sliceSize);
+	for(size_t r = s * sliceSize; r < last; ++r){
+	  addToFastqStats(qc1[s], reads1[r]);
+	  if(paired)
+	    addToFastqStats(qc2[s], reads2[r]);
+	}
+      }
+    }
+
+    // count and write them in order, full buffers being compressed in
+    // parallel
+    for(size_t r = 0; r < nbReads; ++r){
+      const Assignment & a = assignments[r];
+      ++stats.nbPairs;
+      if(a.chimeraSite)
+	++stats.nbChimerasSite;
+      if(a.chimeraTags)
+	++stats.nbChimerasTags;
+      bool chimera = a.chimeraSite || a.chimeraTags;
+      if(chimera)
+	++stats.nbChimeras;
+      size_t dest;
+      if(a.sample != -1){
+	dest = a.sample;
+	++stats.nbAssignedPairs;
+	++stats.nbAssignedPerSample[dest];
+	if(a.nbTags == 2)
+	  ++stats.nbAssignedPairsTwoTags;
+	else if(a.nbTags == 1)
+	  ++stats.nbAssignedPairsOneTag;
+      }
+      else{
+	++stats.nbUnassignedPairs;
+	if(chimera && params.findChimeras != '1'){
+	  ++stats.nbUnassignedPairsChimeras;
+	  dest = chimeras;
+	}
+	else
+	  dest = unassigned;
+      }
+      if(params.verbose > 1)
+	cout << (paired ? "pair=" : "read=") << stats.nbPairs
+	     << " id=" << toString(reads1[r].id)
+	     << " assigned=" << (a.sample != -1 ? samples[a.sample] : "NA")
+	     << endl;
+      if(! hasFiles[dest]){
+	string name = (dest == unassigned ? "unassigned" :
+		       (dest == chimeras ? "chimeras" : samples[dest]));
+	files[2*dest] = addFile(fm, params.outPrefix + "_" + name
+				+ "_R1.fastq.gz");
+	if(paired)
+	  files[2*dest+1] = addFile(fm, params.outPrefix + "_" + name
+				    + "_R2.fastq.gz");
+	hasFiles[dest] = true;
+      }
+      bool clip = (dest < samples.size());
+      writeFastqRecord(fm, files[2*dest], reads1[r], clip ? a.idx1 : 0);
+      if(paired)
+	writeFastqRecord(fm, files[2*dest+1], reads2[r], clip ? a.idx2 : 0);
+    }
+  }
+  closeFastqReader(fr1);
+  if(paired)
+    closeFastqReader(fr2);
+
+  closeFileMultiplexer(fm);
+
+  if(params.qc){
+    for(int s = 1; s < params.nbThreads; ++s){
+      mergeFastqStats(qc1[0], qc1[s]);
+      mergeFastqStats(qc2[0], qc2[s]);
+    }
+    writeFastqStats(qc1[0], params.outPrefix + "_R1_qc.txt", params.inFq1);
+    if(paired)
+      writeFastqStats(qc2[0], params.outPrefix + "_R2_qc.txt", params.inFq2);
+  }
+
+  size_t nbSamplesWithReads = 0;
+  for(size_t s = 0; s < samples.size(); ++s)
+    if(hasFiles[s])
+      ++nbSamplesWithReads;
+
+  saveStatsPerInd(params.outPrefix, tags, samples, stats);
+
+  if(params.verbose > 0)
+    printSummary(params, stats, nbSamplesWithReads);
+}
+
+int main(int argc, char ** argv)
+{
+  DemuxParams params;
+  params.inDir = ".";
+  params.method = MET_UNKNOWN;
+  params.nbSubst = 0;
+  params.enforceSubst = "lenient";
+  params.dist = -1;
+  params.findChimeras = '1';
+  params.clipIdx = true;
+  params.onlyComparePatterns = false;
+  params.qc = false;
+  params.batchSize = 100000;
+  params.maxNbOpenFiles = 256;
+  params.nbThreads = 1;
+  params.verbose = 1;
+
+  parseCmdLine(argc, argv, params);
+
+  time_t startRawTime, endRawTime;
+  if(params.verbose > 0){
+    time(&startRawTime);
+    cout << "START " << basename(argv[0])
+         << " " << getDateTime(startRawTime) << endl
+         << "version " << VERSION << " compiled " << __DATE__
+         << " " << __TIME__ << endl
+         << "cmd-line: " << getCmdLine(argc, argv) << endl
+         << "cwd: " << getCurrentDirectory() << endl;
+    cout << flush;
+  }
+
+  run(params);
+
+  if(params.verbose > 0){
+    time(&endRawTime);
+    cout << "END " << basename(argv[0])
+         << " " << getDateTime(endRawTime) << endl
+         << "elapsed -> " << getElapsedTime(startRawTime, endRawTime) << endl
+         << "max.mem -> " << getMaxMemUsedByProcess2Str() << endl;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,471 @@
+/** \file estim_kinship.cpp
+ *
+ *  `estim_kinship' estimates additive genomic relationships from markers.
+ *  Copyright (C) 2011-2014 Timothée Flutre
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Compile with: g++ -Wall -O3 -fopenmp -I.. utils_io.cpp utils_math.cpp utils_geno.cpp estim_kinship.cpp -lgsl -lgslcblas -lz -o estim_kinship
+ *  (see utils_math.hpp to link with an optimized BLAS)
+ */
+
+#include <cmath>
+#include <ctime>
+#include <cstring>
+#include <cstdio>
+#include <getopt.h>
+#include <libgen.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+using namespace std;
+
+#include <gsl/gsl_matrix.h>
+#include <gsl/gsl_blas.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "utils_io.hpp"
+#include "utils_math.hpp"
+#include "utils_geno.hpp"
+using namespace utils;
+
+#ifndef VERSION
+#define VERSION "1.0.0" // http://semver.org/
+#endif
+
+// number of rows of the relationship matrix formatted at once
+#define KIN_OUT_BLOCK_SIZE 256
+
+/** \brief Display the help on stdout.
+ *  \note The format complies with help2man (http://www.gnu.org/s/help2man)
+ */
+void help(char ** argv)
+{
+  cout << "`" << argv[0] << "'"
+       << " estimates additive genomic relationships from markers." << endl
+       << endl
+       << "Usage: " << argv[0] << " [OPTIONS] ..." << endl
+       << endl
+       << "Options:" << endl
+       << "  -h, --help\tdisplay the help and exit" << endl
+       << "  -V, --version\toutput version information and exit" << endl
+       << "  -v, --verbose\tverbosity level (0/default=1/2/3)" << endl
+       << "  -g, --genos\tpath(s) to the genotype file(s) in the BIMBAM format (can be gzipped)" << endl
+       << "\t\t1 row per SNP (eg. from impute2bimbam), missing values are 'NA'" << endl
+       << "\t\tseveral files can be given, separated by commas" << endl
+       << "      --dose\tpath to a binary dosage file instead of --genos (see impute2bimbam)" << endl
+       << "  -o, --out\tpath to the output file (gzipped if ending with '.gz')" << endl
+       << "\t\tN x N matrix, samples in the order of the genotype file(s)" << endl
+       << "  -m, --method\tvanraden (default) or centered" << endl
+       << "      --mmaf\tminimum minor allele frequency (default=0)" << endl
+       << "      --block\tnumber of SNPs added to the matrix at once (default=1024)" << endl
+       << "  -t, --threads\tnumber of threads (default=1)" << endl
+       << endl
+       << "Remarks:" << endl
+       << "  With Z the N x P matrix of genotypes centered by marker (missing ones set to" << endl
+       << "  the mean) and p the allele frequencies, the relationships are:" << endl
+       << "  - vanraden: Z Z' / (2 sum_j p_j (1 - p_j)), VanRaden (2008) method 1;" << endl
+       << "  - centered: Z Z' / P, as GEMMA -gk 1." << endl
+       << "  Markers are read by blocks whose product is added with a BLAS syrk," << endl
+       << "  hence the memory is about (N + block) x N doubles." << endl
+       << "  The output can be given to estim_ld --kin." << endl
+       << endl
+       << "Examples:" << endl
+       << "  " << argv[0] << " -g genos.bimbam.gz -o kinship.txt.gz -t 8" << endl
+       << endl
+       << "Report bugs to <timothee.flutre@supagro.inra.fr>." << endl
+    ;
+}
+
+/** \brief Display version and license information on stdout.
+ */
+void version(char ** argv)
+{
+  cout << argv[0] << " " << VERSION << endl
+       << endl
+       << "Copyright (C) 2011-2014 Timothée Flutre." << endl
+       << "License GPLv3+: GNU GPL version 3 or later <http://gnu.org/licenses/gpl.html>" << endl
+       << "This is free software; see the source for copying conditions.  There is NO" << endl
+       << "warranty; not even for MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE." << endl
+       << endl
+       << "Written by Timothée Flutre." << endl
+    ;
+}
+
+/** \brief Parse the command-line arguments and check the values of the
+ *  compulsory ones.
+ */
+void
+parseCmdLine(
+  int argc,
+  char ** argv,
+  vector<string> & genoFiles,
+  string & doseFile,
+  string & outFile,
+  string & method,
+  double & minMaf,
+  size_t & blockSize,
+  int & nbThreads,
+  int & verbose)
+{
+  int c = 0;
+  while(true)
+  {
+    static struct option long_options[] =
+    {
+      {"help", no_argument, 0, 'h'},
+      {"version", no_argument, 0, 'V'},
+      {"verbose", required_argument, 0, 'v'},
+      {"genos", required_argument, 0, 'g'},
+      {"dose", required_argument, 0, 0},
+      {"out", required_argument, 0, 'o'},
+      {"method", required_argument, 0, 'm'},
+      {"mmaf", required_argument, 0, 0},
+      {"block", required_argument, 0, 0},
+      {"threads", required_argument, 0, 't'},
+      {0, 0, 0, 0}
+    };
+    int option_index = 0;
+    c = getopt_long(argc, argv, "hVv:g:o:m:t:",
+                    long_options, &option_index);
+    if(c == -1)
+      break;
+    switch(c)
+    {
+    case 0:
+      if(long_options[option_index].flag != 0)
+        break;
+      if(strcmp(long_options[option_index].name, "dose") == 0)
+        doseFile = optarg;
+      else if(strcmp(long_options[option_index].name, "mmaf") == 0)
+        minMaf = atof(optarg);
+      else if(strcmp(long_options[option_index].name, "block") == 0)
+        blockSize = (size_t) atof(optarg);
+      break;
+    case 'h':
+      help(argv);
+      exit(0);
+    case 'V':
+      version(argv);
+      exit(0);
+    case 'v':
+      verbose = atoi(optarg);
+      break;
+    case 'g':
+      genoFiles = split(optarg, ',');
+      break;
+    case 'o':
+      outFile = optarg;
+      break;
+    case 'm':
+      method = optarg;
+      break;
+    case 't':
+      nbThreads = atoi(optarg);
+      break;
+    case '?':
+      printf("\n"); help(argv);
+      abort();
+    default:
+      printf("\n"); help(argv);
+      abort();
+    }
+  }
+  if(genoFiles.empty() == doseFile.empty()){
+    cerr << "cmd-line: " << getCmdLine(argc, argv) << endl << endl
+	 << "ERROR: give either --genos or --dose" << endl << endl;
+    help(argv);
+    exit(1);
+  }
+  if(! doseFile.empty())
+    genoFiles.push_back(doseFile);
+  for(size_t f = 0; f < genoFiles.size(); ++f)
+    if(! doesFileExist(genoFiles[f])){
+      cerr << "cmd-line: " << getCmdLine(argc, argv) << endl << endl
+	   << "ERROR: can't find file " << genoFiles[f] << endl << endl;
+      help(argv);
+      exit(1);
+    }
+  if(outFile.empty()){
+    cerr << "cmd-line: " << getCmdLine(argc, argv) << endl << endl
+	 << "ERROR: missing compulsory option --out" << endl << endl;
+    help(argv);
+    exit(1);
+  }
+  if(method != "vanraden" && method != "centered"){
+    cerr << "cmd-line: " << getCmdLine(argc, argv) << endl << endl
+	 << "ERROR: --method should be vanraden or centered" << endl << endl;
+    help(argv);
+    exit(1);
+  }
+  if(blockSize == 0)
+    blockSize = 1;
+  if(nbThreads < 1)
+    nbThreads = 1;
+}
+
+/** \brief Relationships being accumulated, only the upper triangle of
+ *  ZtZ being up to date.
+ */
+struct Kinship
+{
+  size_t N;
+  gsl_matrix * ZtZ;
+  double sumVar; // sum of 2 p (1 - p) over the markers kept
+  size_t nbSnps;
+  size_t nbLowMaf;
+};
+
+/** \brief Center the block of markers (nb x N, NaN for missing), drop the
+ *  ones below minMaf and add the others to the relationships.
+ */
+void addMarkers(double * rows, const size_t nb, const double minMaf,
+		Kinship & kin)
+{
+  const size_t N = kin.N;
+  vector<double> freqs(nb);
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+  for(long s = 0; s < (long) nb; ++s){
+    double * x = rows + s * N, sum = 0.0;
+    size_t nbMissing = 0;
+    for(size_t i = 0; i < N; ++i){
+      if(isNan(x[i]))
+	++nbMissing;
+      else
+	sum += x[i];
+    }
+    double mean = (nbMissing < N) ? sum / (N - nbMissing) : 0.0;
+    freqs[s] = mean / 2;
+    for(size_t i = 0; i < N; ++i)
+      x[i] = isNan(x[i]) ? 0.0 : x[i] - mean;
+  }
+
+  size_t nbKept = 0;
+  for(size_t s = 0; s < nb; ++s){
+    double maf = min(freqs[s], 1 - freqs[s]);
+    if(maf <= 0 || maf < minMaf){
+      ++kin.nbLowMaf;
+      continue;
+    }
+    if(nbKept != s)
+      memcpy(rows + nbKept * N, rows + s * N, N * sizeof(double));
+    kin.sumVar += 2 * freqs[s] * (1 - freqs[s]);
+    ++nbKept;
+  }
+  if(nbKept == 0)
+    return;
+  gsl_matrix_view Z = gsl_matrix_view_array(rows, nbKept, N);
+  gsl_blas_dsyrk(CblasUpper, CblasTrans, 1.0, &Z.matrix, 1.0, kin.ZtZ);
+  kin.nbSnps += nbKept;
+}
+
+/** \brief Read the markers of a BIMBAM file by blocks, the lines being
+ *  parsed in parallel.
+ */
+void addBimbamFile(const string & genoFile, const double minMaf,
+		   const size_t blockSize, Kinship & kin, const int & verbose)
+{
+  BlockReader br;
+  StringView line;
+  vector<StringView> tokens;
+  vector<string> lines;
+  vector<double> rows;
+  openBlockReader(br, genoFile);
+  while(true){
+    lines.clear();
+    while(lines.size() < blockSize && getline(br, line)){
+      if(tokenize(line, " \t,", tokens) == 0)
+	continue;
+      if(kin.N == 0){
+	if(tokens.size() < 4){
+	  cerr << "ERROR: line " << br.nbLines << " of file " << genoFile
+	       << " should have at least 4 columns" << endl;
+	  exit(1);
+	}
+	kin.N = tokens.size() - 3;
+	kin.ZtZ = gsl_matrix_calloc(kin.N, kin.N);
+      }
+      lines.push_back(toString(line));
+    }
+    if(lines.empty())
+      break;
+    const size_t N = kin.N;
+    rows.resize(lines.size() * N);
+    bool ok = true;
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for(long s = 0; s < (long) lines.size(); ++s){
+      StringView sv = {lines[s].data(), lines[s].size()};
+      vector<StringView> toks;
+      if(tokenize(sv, " \t,", toks) != N + 3){
+	ok = false;
+	continue;
+      }
+      for(size_t i = 0; i < N; ++i)
+	if(! parseDouble(toks[3+i], rows[s*N+i]))
+	  rows[s*N+i] = NaN;
+    }
+    if(! ok){
+      cerr << "ERROR: some SNPs of file " << genoFile << " don't have " << N
+	   << " samples (before line " << br.nbLines << ")" << endl;
+      exit(1);
+    }
+    addMarkers(&rows[0], lines.size(), minMaf, kin);
+    if(verbose > 1)
+      cout << "nb of SNPs kept so far: " << kin.nbSnps << endl << flush;
+  }
+  closeBlockReader(br);
+}
+
+void addDosageFile(const string & doseFile, const double minMaf,
+		   const size_t blockSize, Kinship & kin, const int & verbose)
+{
+  DosageReader dr;
+  DosageMatrix dm;
+  openDosageReader(dr, doseFile);
+  kin.N = dr.nbSamples;
+  kin.ZtZ = gsl_matrix_calloc(kin.N, kin.N);
+  vector<double> rows;
+  size_t nb;
+  while((nb = readDosageRows(dr, blockSize, dm)) > 0){
+    rows.resize(nb * kin.N);
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for(long s = 0; s < (long) nb; ++s)
+      getDosageRow(dm, s, &rows[s * kin.N]);
+    addMarkers(&rows[0], nb, minMaf, kin);
+    if(verbose > 1)
+      cout << "nb of SNPs kept so far: " << kin.nbSnps << endl << flush;
+  }
+  closeDosageReader(dr);
+}
+
+/** \brief Write the symmetric matrix, rows being formatted in parallel.
+ */
+void writeKinship(const gsl_matrix * A, const string & outFile,
+		  const int & nbThreads)
+{
+  const size_t N = A->size1;
+  BlockWriter bw;
+  openBlockWriter(bw, outFile, nbThreads);
+  vector<string> outs(KIN_OUT_BLOCK_SIZE);
+  for(size_t i0 = 0; i0 < N; i0 += KIN_OUT_BLOCK_SIZE){
+    size_t i1 = min(N, i0 + KIN_OUT_BLOCK_SIZE);
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for(long i = (long) i0; i < (long) i1; ++i){
+      string & out = outs[i-i0];
+      out.clear();
+      char buf[32];
+      for(size_t j = 0; j < N; ++j){
+	// only the upper triangle is filled
+	double x = (j >= (size_t) i) ? gsl_matrix_get(A, i, j)
+	  : gsl_matrix_get(A, j, i);
+	int n = snprintf(buf, sizeof(buf), "%s%.8g", j == 0 ? "" : "\t", x);
+	out.append(buf, n);
+      }
+      out += '\n';
+    }
+    for(size_t i = i0; i < i1; ++i)
+      bwrite(bw, outs[i-i0]);
+  }
+  closeBlockWriter(bw);
+}
+
+void run(const vector<string> & genoFiles, const bool isDose,
+	 const string & outFile, const string & method, const double minMaf,
+	 const size_t blockSize, const int & nbThreads, const int & verbose)
+{
+  mygsl_blas_set_num_threads(nbThreads);
+#ifdef _OPENMP
+  omp_set_num_threads(nbThreads);
+#endif
+
+  Kinship kin;
+  kin.N = 0;
+  kin.ZtZ = NULL;
+  kin.sumVar = 0.0;
+  kin.nbSnps = 0;
+  kin.nbLowMaf = 0;
+  for(size_t f = 0; f < genoFiles.size(); ++f){
+    if(verbose > 0)
+      cout << "add the markers of " << genoFiles[f] << " ..." << endl
+	   << flush;
+    if(isDose)
+      addDosageFile(genoFiles[f], minMaf, blockSize, kin, verbose);
+    else
+      addBimbamFile(genoFiles[f], minMaf, blockSize, kin, verbose);
+  }
+  if(kin.nbSnps == 0){
+    cerr << "ERROR: no marker passed the filters" << endl;
+    exit(1);
+  }
+
+  double denom = (method == "vanraden") ? kin.sumVar : kin.nbSnps;
+  gsl_matrix_scale(kin.ZtZ, 1 / denom);
+  if(verbose > 0)
+    cout << "nb of samples: " << kin.N << endl
+	 << "nb of SNPs kept: " << kin.nbSnps << endl
+	 << "nb of SNPs with low MAF: " << kin.nbLowMaf << endl
+	 << "write the relationships ..." << endl << flush;
+  writeKinship(kin.ZtZ, outFile, nbThreads);
+  gsl_matrix_free(kin.ZtZ);
+}
+
+int main(int argc, char ** argv)
+{
+  vector<string> genoFiles;
+  string doseFile, outFile, method = "vanraden";
+  double minMaf = 0.0;
+  size_t blockSize = 1024;
+  int nbThreads = 1, verbose = 1;
+
+  parseCmdLine(argc, argv, genoFiles, doseFile, outFile, method, minMaf,
+	       blockSize, nbThreads, verbose);
+
+  time_t startRawTime, endRawTime;
+  if(verbose > 0){
+    time(&startRawTime);
+    cout << "START " << basename(argv[0])
+         << " " << getDateTime(startRawTime) << endl
+         << "version " << VERSION << " compiled " << __DATE__
+         << " " << __TIME__ << endl
+         << "cmd-line: " << getCmdLine(argc, argv) << endl
+         << "cwd: " << getCurrentDirectory() << endl;
+    cout << flush;
+  }
+
+  run(genoFiles, ! doseFile.empty(), outFile, method, minMaf, blockSize,
+      nbThreads, verbose);
+
+  if(verbose > 0){
+    time(&endRawTime);
+    cout << "END " << basename(argv[0])
+         << " " << getDateTime(endRawTime) << endl
+         << "elapsed -> " << getElapsedTime(startRawTime, endRawTime) << endl
+         << "max.mem -> " << getMaxMemUsedByProcess2Str() << endl;
+  }
+
+  return EXIT_SUCCESS;
+}
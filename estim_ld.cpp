@@ -0,0 +1,711 @@
+/** \file estim_ld.cpp
+ *
+ *  `estim_ld' estimates pairwise linkage disequilibrium within windows.
+ *  Copyright (C) 2011-2014 Timothée Flutre
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Compile with: g++ -Wall -O3 -fopenmp -I.. utils_io.cpp utils_math.cpp estim_ld.cpp -lgsl -lgslcblas -lz -o estim_ld
+ *  (see utils_math.hpp to link with an optimized BLAS)
+ */
+
+#include <cmath>
+#include <ctime>
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
+#include <getopt.h>
+#include <libgen.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <limits>
+using namespace std;
+
+#include <gsl/gsl_matrix.h>
+#include <gsl/gsl_blas.h>
+
+#include "utils_io.hpp"
+#include "utils_math.hpp"
+using namespace utils;
+
+#ifndef VERSION
+#define VERSION "1.0.0" // http://semver.org/
+#endif
+
+// number of SNPs whose correlations are computed at once
+#define LD_BLOCK_SIZE 256
+
+/** \brief Display the help on stdout.
+ *  \note The format complies with help2man (http://www.gnu.org/s/help2man)
+ */
+void help(char ** argv)
+{
+  cout << "`" << argv[0] << "'"
+       << " estimates pairwise linkage disequilibrium within windows." << endl
+       << endl
+       << "Usage: " << argv[0] << " [OPTIONS] ..." << endl
+       << endl
+       << "Options:" << endl
+       << "  -h, --help\tdisplay the help and exit" << endl
+       << "  -V, --version\toutput version information and exit" << endl
+       << "  -v, --verbose\tverbosity level (0/default=1/2/3)" << endl
+       << "  -g, --genos\tpath(s) to the genotype file(s) in the BIMBAM format (can be gzipped)" << endl
+       << "\t\t1 row per SNP (eg. from impute2bimbam), sorted by chromosome and position" << endl
+       << "\t\tseveral files separated by commas (eg. one per chromosome)" << endl
+       << "\t\tare processed in parallel" << endl
+       << "  -s, --snps\tpath to the file with SNP coordinates (can be gzipped)" << endl
+       << "\t\tno header, 1 row per SNP, 3 columns: snp pos chr (as in GEMMA)" << endl
+       << "  -o, --out\tpath to the output file (gzipped if ending with '.gz')" << endl
+       << "\t\tcolumns: loc1 loc2 cor2 chr dist" << endl
+       << "      --mmaf\tminimum for the minor allele frequency (default=0.01)" << endl
+       << "      --wbp\tmaximum distance in bp between two SNPs (default=whole chromosome)" << endl
+       << "      --wsnp\tmaximum distance in number of SNPs (default=whole chromosome)" << endl
+       << "      --mr2\tminimum r2 to report a pair (default=0)" << endl
+       << "      --kin\tpath to the kinship matrix to correct LD estimates with" << endl
+       << "\t\tN rows and N columns in the order of the genotype file, no header" << endl
+       << "      --chr\tonly chromosome to analyze" << endl
+       << "  -t, --threads\tnumber of threads (default=1)" << endl
+       << endl
+       << "Remarks:" << endl
+       << "  Missing genotypes (eg. 'NA') are replaced by the mean of the SNP." << endl
+       << "  With --kin, the genotypes are centered and multiplied by K^(-1/2)" << endl
+       << "  before computing the correlations, as r2_V in Mangin et al (2012)." << endl
+       << endl
+       << "Examples:" << endl
+       << "  " << argv[0] << " -g genos.bimbam.gz -s snp_coords.txt.gz -o ld.txt.gz --wbp 500000" << endl
+       << endl
+       << "Report bugs to <timothee.flutre@supagro.inra.fr>." << endl
+    ;
+}
+
+/** \brief Display version and license information on stdout.
+ */
+void version(char ** argv)
+{
+  cout << argv[0] << " " << VERSION << endl
+       << endl
+       << "Copyright (C) 2011-2014 Timothée Flutre." << endl
+       << "License GPLv3+: GNU GPL version 3 or later <http://gnu.org/licenses/gpl.html>" << endl
+       << "This is free software; see the source for copying conditions.  There is NO" << endl
+       << "warranty; not even for MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE." << endl
+       << endl
+       << "Written by Timothée Flutre." << endl
+    ;
+}
+
+/** \brief Parse the command-line arguments and check the values of the
+ *  compulsory ones.
+ */
+void
+parseCmdLine(
+  int argc,
+  char ** argv,
+  vector<string> & genoFiles,
+  string & snpFile,
+  string & outFile,
+  double & minMaf,
+  size_t & winBp,
+  size_t & winSnp,
+  double & minR2,
+  string & kinFile,
+  string & onlyChr,
+  int & nbThreads,
+  int & verbose)
+{
+  int c = 0;
+  while(true)
+  {
+    static struct option long_options[] =
+    {
+      {"help", no_argument, 0, 'h'},
+      {"version", no_argument, 0, 'V'},
+      {"verbose", required_argument, 0, 'v'},
+      {"genos", required_argument, 0, 'g'},
+      {"snps", required_argument, 0, 's'},
+      {"out", required_argument, 0, 'o'},
+      {"mmaf", required_argument, 0, 0},
+      {"wbp", required_argument, 0, 0},
+      {"wsnp", required_argument, 0, 0},
+      {"mr2", required_argument, 0, 0},
+      {"kin", required_argument, 0, 0},
+      {"chr", required_argument, 0, 0},
+      {"threads", required_argument, 0, 't'},
+      {0, 0, 0, 0}
+    };
+    int option_index = 0;
+    c = getopt_long(argc, argv, "hVv:g:s:o:t:",
+                    long_options, &option_index);
+    if(c == -1)
+      break;
+    switch(c)
+    {
+    case 0:
+      if(long_options[option_index].flag != 0)
+        break;
+      if(strcmp(long_options[option_index].name, "mmaf") == 0)
+        minMaf = atof(optarg);
+      else if(strcmp(long_options[option_index].name, "wbp") == 0)
+        winBp = (size_t) atof(optarg);
+      else if(strcmp(long_options[option_index].name, "wsnp") == 0)
+        winSnp = (size_t) atof(optarg);
+      else if(strcmp(long_options[option_index].name, "mr2") == 0)
+        minR2 = atof(optarg);
+      else if(strcmp(long_options[option_index].name, "kin") == 0)
+        kinFile = optarg;
+      else if(strcmp(long_options[option_index].name, "chr") == 0)
+        onlyChr = optarg;
+      break;
+    case 'h':
+      help(argv);
+      exit(0);
+    case 'V':
+      version(argv);
+      exit(0);
+    case 'v':
+      verbose = atoi(optarg);
+      break;
+    case 'g':
+      split(optarg, ',', genoFiles);
+      break;
+    case 's':
+      snpFile = optarg;
+      break;
+    case 'o':
+      outFile = optarg;
+      break;
+    case 't':
+      nbThreads = atoi(optarg);
+      break;
+    case '?':
+      printf("\n"); help(argv);
+      abort();
+    default:
+      printf("\n"); help(argv);
+      abort();
+    }
+  }
+  if(genoFiles.empty()){
+    cerr << "cmd-line: " << getCmdLine(argc, argv) << endl << endl
+	 << "ERROR: missing compulsory option --genos" << endl << endl;
+    help(argv);
+    exit(1);
+  }
+  for(size_t f = 0; f < genoFiles.size(); ++f)
+    if(! doesFileExist(genoFiles[f])){
+      cerr << "cmd-line: " << getCmdLine(argc, argv) << endl << endl
+	   << "ERROR: can't find file " << genoFiles[f] << endl << endl;
+      help(argv);
+      exit(1);
+    }
+  if(snpFile.empty()){
+    cerr << "cmd-line: " << getCmdLine(argc, argv) << endl << endl
+	 << "ERROR: missing compulsory option --snps" << endl << endl;
+    help(argv);
+    exit(1);
+  }
+  if(! doesFileExist(snpFile)){
+    cerr << "cmd-line: " << getCmdLine(argc, argv) << endl << endl
+	 << "ERROR: can't find file " << snpFile << endl << endl;
+    help(argv);
+    exit(1);
+  }
+  if(outFile.empty()){
+    cerr << "cmd-line: " << getCmdLine(argc, argv) << endl << endl
+	 << "ERROR: missing compulsory option --out" << endl << endl;
+    help(argv);
+    exit(1);
+  }
+  if(! kinFile.empty() && ! doesFileExist(kinFile)){
+    cerr << "cmd-line: " << getCmdLine(argc, argv) << endl << endl
+	 << "ERROR: can't find file " << kinFile << endl << endl;
+    help(argv);
+    exit(1);
+  }
+  if(minMaf < 0 || minMaf > 0.5){
+    cerr << "cmd-line: " << getCmdLine(argc, argv) << endl << endl
+	 << "ERROR: --mmaf should be between 0 and 0.5" << endl << endl;
+    help(argv);
+    exit(1);
+  }
+  if(nbThreads < 1)
+    nbThreads = 1;
+}
+
+struct SnpCoord
+{
+  string chr;
+  size_t pos;
+};
+
+void loadSnpCoordinates(const string & snpFile,
+			map<string, SnpCoord> & snp2coord,
+			const int & verbose)
+{
+  if(verbose > 0)
+    cout << "load SNP coordinates ..." << endl << flush;
+
+  BlockReader br;
+  StringView line;
+  vector<StringView> tokens;
+  openBlockReader(br, snpFile);
+  while(getline(br, line)){
+    if(tokenize(line, " \t,", tokens) == 0)
+      continue;
+    SnpCoord coord;
+    if(tokens.size() != 3 || ! parseUnsigned(tokens[1], coord.pos)){
+      cerr << "ERROR: line " << br.nbLines << " of file " << snpFile
+	   << " should be 'snp pos chr'" << endl;
+      exit(1);
+    }
+    coord.chr = toString(tokens[2]);
+    snp2coord[toString(tokens[0])] = coord;
+  }
+  closeBlockReader(br);
+
+  if(verbose > 0)
+    cout << "nb of SNPs: " << snp2coord.size() << endl;
+}
+
+void loadKinship(const string & kinFile, gsl_matrix *& K_invsqrt,
+		 const int & verbose)
+{
+  if(verbose > 0)
+    cout << "load kinship matrix and compute K^(-1/2) ..." << endl << flush;
+
+  BlockReader br;
+  StringView line;
+  vector<StringView> tokens;
+  vector<double> values;
+  size_t N = 0;
+  openBlockReader(br, kinFile);
+  while(getline(br, line)){
+    if(tokenize(line, " \t,", tokens) == 0)
+      continue;
+    if(N == 0)
+      N = tokens.size();
+    if(tokens.size() != N){
+      cerr << "ERROR: line " << br.nbLines << " of file " << kinFile
+	   << " has " << tokens.size() << " columns instead of " << N << endl;
+      exit(1);
+    }
+    for(size_t j = 0; j < N; ++j){
+      double x;
+      if(! parseDouble(tokens[j], x)){
+	cerr << "ERROR: line " << br.nbLines << " of file " << kinFile
+	     << " has a non-numeric value" << endl;
+	exit(1);
+      }
+      values.push_back(x);
+    }
+  }
+  closeBlockReader(br);
+  if(N == 0 || values.size() != N * N){
+    cerr << "ERROR: file " << kinFile << " should have as many rows as columns"
+	 << endl;
+    exit(1);
+  }
+
+  gsl_matrix_view K = gsl_matrix_view_array(&values[0], N, N);
+  K_invsqrt = gsl_matrix_alloc(N, N);
+  mygsl_linalg_invsqrt(&K.matrix, K_invsqrt, 1e-10);
+
+  if(verbose > 0)
+    cout << "nb of samples: " << N << endl;
+}
+
+/** \brief SNPs of the current chromosome which can still be paired with
+ *  the next ones, the rows of genotypes being standardized to unit norm.
+ */
+struct LdWindow
+{
+  string chr;
+  size_t N;
+  size_t first;
+  vector<string> ids;
+  vector<size_t> pos;
+  vector<size_t> ranks; // among the kept SNPs of the chromosome
+  vector<double> rows;
+  size_t nbNew; // last rows not yet paired
+};
+
+struct LdStats
+{
+  size_t nbSnps;
+  size_t nbNoCoord;
+  size_t nbLowMaf;
+  size_t nbPairs;
+  set<string> chrs;
+};
+
+void initLdStats(LdStats & stats)
+{
+  stats.nbSnps = 0;
+  stats.nbNoCoord = 0;
+  stats.nbLowMaf = 0;
+  stats.nbPairs = 0;
+  stats.chrs.clear();
+}
+
+/** \brief Compute the correlations between the new SNPs and all the SNPs
+ *  of the window with one matrix product, write the pairs passing the
+ *  thresholds, then discard the SNPs too far from the last one to be paired
+ *  with any next SNP.
+ */
+void processNewSnps(LdWindow & win, const gsl_matrix * K_invsqrt,
+		    const size_t & winBp, const size_t & winSnp,
+		    const double & minR2, BlockWriter & bw, LdStats & stats)
+{
+  const size_t N = win.N, nbRows = win.ids.size(),
+    firstNew = nbRows - win.nbNew;
+  if(win.nbNew == 0)
+    return;
+
+  if(K_invsqrt != NULL){ // rows are only centered, whiten and scale them
+    gsl_matrix_view newRows = gsl_matrix_view_array(&win.rows[firstNew * N],
+						    win.nbNew, N);
+    gsl_matrix * tmp = gsl_matrix_alloc(win.nbNew, N);
+    gsl_blas_dgemm(CblasNoTrans, CblasNoTrans, 1.0, &newRows.matrix,
+		   K_invsqrt, 0.0, tmp);
+    gsl_matrix_memcpy(&newRows.matrix, tmp);
+    gsl_matrix_free(tmp);
+    for(size_t s = firstNew; s < nbRows; ++s){
+      double * row = &win.rows[s * N], ss = 0.0;
+      for(size_t i = 0; i < N; ++i)
+	ss += row[i] * row[i];
+      double scale = (ss > 0) ? 1 / sqrt(ss) : 0.0;
+      for(size_t i = 0; i < N; ++i)
+	row[i] *= scale;
+    }
+  }
+
+  // first SNP of the window which can be paired with a new one
+  size_t firstCand = win.first;
+  while(firstCand < firstNew &&
+	((winBp != string::npos && win.pos[firstNew] - win.pos[firstCand] > winBp)
+	 || (winSnp != string::npos
+	     && win.ranks[firstNew] - win.ranks[firstCand] > winSnp)))
+    ++firstCand;
+
+  // R = New Cand^T, the candidates including the new SNPs themselves
+  size_t nbCand = nbRows - firstCand;
+  gsl_matrix_view newRows = gsl_matrix_view_array(&win.rows[firstNew * N],
+						  win.nbNew, N),
+    candRows = gsl_matrix_view_array(&win.rows[firstCand * N], nbCand, N);
+  gsl_matrix * R = gsl_matrix_alloc(win.nbNew, nbCand);
+  gsl_blas_dgemm(CblasNoTrans, CblasTrans, 1.0, &newRows.matrix,
+		 &candRows.matrix, 0.0, R);
+
+  char buf[1024];
+  for(size_t j = firstNew; j < nbRows; ++j){
+    const double * r = R->data + (j - firstNew) * R->tda;
+    for(size_t i = firstCand; i < j; ++i){
+      size_t dist = win.pos[j] - win.pos[i];
+      if((winBp != string::npos && dist > winBp)
+	 || (winSnp != string::npos && win.ranks[j] - win.ranks[i] > winSnp))
+	continue;
+      double r2 = r[i - firstCand] * r[i - firstCand];
+      if(r2 > 1.0)
+	r2 = 1.0;
+      if(r2 < minR2)
+	continue;
+      int n = snprintf(buf, sizeof(buf), "%s\t%s\t%.6g\t%s\t%lu\n",
+		       win.ids[i].c_str(), win.ids[j].c_str(), r2,
+		       win.chr.c_str(), (unsigned long) dist);
+      bwrite(bw, buf, min((size_t) n, sizeof(buf) - 1));
+      ++stats.nbPairs;
+    }
+  }
+  gsl_matrix_free(R);
+  win.nbNew = 0;
+
+  // discard the SNPs which can't be paired with the next ones
+  while(win.first < nbRows &&
+	((winBp != string::npos && win.pos[nbRows-1] - win.pos[win.first] > winBp)
+	 || (winSnp != string::npos
+	     && win.ranks[nbRows-1] - win.ranks[win.first] >= winSnp)))
+    ++win.first;
+  if(win.first > 0 && win.first >= nbRows / 2){
+    size_t nbKept = nbRows - win.first;
+    memmove(&win.rows[0], &win.rows[win.first * N], nbKept * N * sizeof(double));
+    win.rows.resize(nbKept * N);
+    win.ids.erase(win.ids.begin(), win.ids.begin() + win.first);
+    win.pos.erase(win.pos.begin(), win.pos.begin() + win.first);
+    win.ranks.erase(win.ranks.begin(), win.ranks.begin() + win.first);
+    win.first = 0;
+  }
+}
+
+/** \brief Stream the SNPs of one genotype file, filter them on MAF, and
+ *  compute LD by blocks of LD_BLOCK_SIZE SNPs.
+ */
+void estimLdInFile(const string & genoFile,
+		   const map<string, SnpCoord> & snp2coord,
+		   const double & minMaf, const size_t & winBp,
+		   const size_t & winSnp, const double & minR2,
+		   const gsl_matrix * K_invsqrt, const string & onlyChr,
+		   BlockWriter & bw, LdStats & stats)
+{
+  BlockReader br;
+  StringView line;
+  vector<StringView> tokens;
+  LdWindow win;
+  win.N = 0;
+  win.first = 0;
+  win.nbNew = 0;
+  size_t rank = 0;
+  set<string> chrsDone;
+  vector<double> x;
+
+  openBlockReader(br, genoFile);
+  while(getline(br, line)){
+    if(tokenize(line, " \t,", tokens) == 0)
+      continue;
+    if(tokens.size() < 4){
+      cerr << "ERROR: line " << br.nbLines << " of file " << genoFile
+	   << " should have at least 4 columns" << endl;
+      exit(1);
+    }
+    ++stats.nbSnps;
+    string id = toString(tokens[0]);
+    map<string, SnpCoord>::const_iterator it = snp2coord.find(id);
+    if(it == snp2coord.end()){
+      ++stats.nbNoCoord;
+      continue;
+    }
+    const SnpCoord & coord = it->second;
+    if(! onlyChr.empty() && coord.chr != onlyChr)
+      continue;
+
+    // new chromosome: finish the current one
+    if(coord.chr != win.chr){
+      processNewSnps(win, K_invsqrt, winBp, winSnp, minR2, bw, stats);
+      if(! win.chr.empty())
+	chrsDone.insert(win.chr);
+      if(chrsDone.find(coord.chr) != chrsDone.end()){
+	cerr << "ERROR: SNPs of chromosome " << coord.chr << " aren't contiguous"
+	     << " in file " << genoFile << " (line " << br.nbLines << ")" << endl;
+	exit(1);
+      }
+      win.chr = coord.chr;
+      win.first = 0;
+      win.ids.clear();
+      win.pos.clear();
+      win.ranks.clear();
+      win.rows.clear();
+      rank = 0;
+    }
+    else if(! win.pos.empty() && coord.pos < win.pos.back()){
+      cerr << "ERROR: SNP " << id << " isn't sorted by position in file "
+	   << genoFile << " (line " << br.nbLines << ")" << endl;
+      exit(1);
+    }
+
+    // parse, impute missing values with the mean, and filter on MAF
+    size_t N = tokens.size() - 3, nbMissing = 0;
+    if(win.N == 0)
+      win.N = N;
+    if(N != win.N || (K_invsqrt != NULL && N != K_invsqrt->size1)){
+      cerr << "ERROR: SNP " << id << " has " << N << " samples instead of "
+	   << (win.N != N ? win.N : K_invsqrt->size1) << endl;
+      exit(1);
+    }
+    x.resize(N);
+    double sum = 0.0;
+    for(size_t i = 0; i < N; ++i){
+      if(parseDouble(tokens[3+i], x[i]) && ! isNan(x[i]))
+	sum += x[i];
+      else{
+	x[i] = NaN;
+	++nbMissing;
+      }
+    }
+    double mean = (nbMissing < N) ? sum / (N - nbMissing) : 0.0,
+      maf = min(mean / 2, 1 - mean / 2);
+    if(nbMissing == N || maf < minMaf || maf <= 0){
+      ++stats.nbLowMaf;
+      continue;
+    }
+    double ss = 0.0;
+    for(size_t i = 0; i < N; ++i){
+      x[i] = isNan(x[i]) ? 0.0 : x[i] - mean;
+      ss += x[i] * x[i];
+    }
+    if(ss <= 0){
+      ++stats.nbLowMaf;
+      continue;
+    }
+    if(K_invsqrt == NULL){
+      double scale = 1 / sqrt(ss);
+      for(size_t i = 0; i < N; ++i)
+	x[i] *= scale;
+    }
+
+    win.ids.push_back(id);
+    win.pos.push_back(coord.pos);
+    win.ranks.push_back(rank++);
+    win.rows.insert(win.rows.end(), x.begin(), x.end());
+    ++win.nbNew;
+    if(win.nbNew == LD_BLOCK_SIZE)
+      processNewSnps(win, K_invsqrt, winBp, winSnp, minR2, bw, stats);
+  }
+  processNewSnps(win, K_invsqrt, winBp, winSnp, minR2, bw, stats);
+  if(! win.chr.empty())
+    chrsDone.insert(win.chr);
+  closeBlockReader(br);
+
+  stats.chrs = chrsDone;
+}
+
+void appendFile(const string & srcFile, BlockWriter & bw)
+{
+  FILE * src = fopen(srcFile.c_str(), "rb");
+  if(src == NULL){
+    cerr << "ERROR: can't open file " << srcFile << " to read"
+	 << " (errno=" << errno << ")" << endl;
+    exit(1);
+  }
+  vector<char> buf(1048576);
+  size_t n;
+  while((n = fread(&buf[0], 1, buf.size(), src)) > 0)
+    if(fwrite(&buf[0], 1, n, bw.stream) != n){
+      cerr << "ERROR: can't write in file " << bw.path
+	   << " (errno=" << errno << ")" << endl;
+      exit(1);
+    }
+  fclose(src);
+}
+
+void run(const vector<string> & genoFiles, const string & snpFile,
+	 const string & outFile, const double & minMaf, const size_t & winBp,
+	 const size_t & winSnp, const double & minR2, const string & kinFile,
+	 const string & onlyChr, const int & nbThreads, const int & verbose)
+{
+  map<string, SnpCoord> snp2coord;
+  loadSnpCoordinates(snpFile, snp2coord, verbose);
+
+  gsl_matrix * K_invsqrt = NULL;
+  if(! kinFile.empty())
+    loadKinship(kinFile, K_invsqrt, verbose);
+
+  if(verbose > 0)
+    cout << "estimate LD in " << genoFiles.size() << " file(s) ..."
+	 << endl << flush;
+
+  BlockWriter bw;
+  openBlockWriter(bw, outFile, genoFiles.size() == 1 ? nbThreads : 1);
+  bwrite(bw, "loc1\tloc2\tcor2\tchr\tdist\n");
+
+  vector<LdStats> stats(genoFiles.size());
+  if(genoFiles.size() == 1){
+    initLdStats(stats[0]);
+    estimLdInFile(genoFiles[0], snp2coord, minMaf, winBp, winSnp, minR2,
+		  K_invsqrt, onlyChr, bw, stats[0]);
+  }
+  else{
+    // one temporary output per file, then concatenated as is since
+    // gzip members can be concatenated
+    flushBlockWriter(bw);
+    vector<string> tmpFiles(genoFiles.size());
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(nbThreads) schedule(dynamic)
+#endif
+    for(long f = 0; f < (long) genoFiles.size(); ++f){
+      tmpFiles[f] = outFile + "_tmp" + toString(f)
+	+ (bw.compress ? ".gz" : "");
+      BlockWriter bwTmp;
+      openBlockWriter(bwTmp, tmpFiles[f], 1);
+      initLdStats(stats[f]);
+      estimLdInFile(genoFiles[f], snp2coord, minMaf, winBp, winSnp, minR2,
+		    K_invsqrt, onlyChr, bwTmp, stats[f]);
+      closeBlockWriter(bwTmp);
+    }
+    for(size_t f = 0; f < genoFiles.size(); ++f)
+      appendFile(tmpFiles[f], bw);
+    removeFiles(tmpFiles);
+  }
+  closeBlockWriter(bw);
+
+  // pairs across files would have been missed
+  map<string, size_t> chr2file;
+  for(size_t f = 0; f < genoFiles.size(); ++f)
+    for(set<string>::const_iterator it = stats[f].chrs.begin();
+	it != stats[f].chrs.end(); ++it){
+      if(chr2file.find(*it) != chr2file.end()){
+	cerr << "ERROR: chromosome " << *it << " is in files "
+	     << genoFiles[chr2file[*it]] << " and " << genoFiles[f] << endl;
+	exit(1);
+      }
+      chr2file[*it] = f;
+    }
+
+  if(verbose > 0){
+    size_t nbSnps = 0, nbNoCoord = 0, nbLowMaf = 0, nbPairs = 0;
+    for(size_t f = 0; f < genoFiles.size(); ++f){
+      nbSnps += stats[f].nbSnps;
+      nbNoCoord += stats[f].nbNoCoord;
+      nbLowMaf += stats[f].nbLowMaf;
+      nbPairs += stats[f].nbPairs;
+    }
+    cout << "nb of SNPs: " << nbSnps << endl
+	 << "nb of SNPs without coordinates: " << nbNoCoord << endl
+	 << "nb of SNPs with MAF < " << minMaf << " (or monomorphic): "
+	 << nbLowMaf << endl
+	 << "nb of chromosomes: " << chr2file.size() << endl
+	 << "nb of pairs: " << nbPairs << endl;
+  }
+
+  if(K_invsqrt != NULL)
+    gsl_matrix_free(K_invsqrt);
+}
+
+int main(int argc, char ** argv)
+{
+  vector<string> genoFiles;
+  string snpFile, outFile, kinFile, onlyChr;
+  double minMaf = 0.01, minR2 = 0.0;
+  size_t winBp = string::npos, winSnp = string::npos;
+  int nbThreads = 1, verbose = 1;
+
+  parseCmdLine(argc, argv, genoFiles, snpFile, outFile, minMaf, winBp,
+	       winSnp, minR2, kinFile, onlyChr, nbThreads, verbose);
+
+  time_t startRawTime, endRawTime;
+  if(verbose > 0){
+    time(&startRawTime);
+    cout << "START " << basename(argv[0])
+         << " " << getDateTime(startRawTime) << endl
+         << "version " << VERSION << " compiled " << __DATE__
+         << " " << __TIME__ << endl
+         << "cmd-line: " << getCmdLine(argc, argv) << endl
+         << "cwd: " << getCurrentDirectory() << endl;
+    cout << flush;
+  }
+
+  run(genoFiles, snpFile, outFile, minMaf, winBp, winSnp, minR2, kinFile,
+      onlyChr, nbThreads, verbose);
+
+  if(verbose > 0){
+    time(&endRawTime);
+    cout << "END " << basename(argv[0])
+         << " " << getDateTime(endRawTime) << endl
+         << "elapsed -> " << getElapsedTime(startRawTime, endRawTime) << endl
+         << "max.mem -> " << getMaxMemUsedByProcess2Str() << endl;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,511 @@
+/** \file exp_levels_per_gene.cpp
+ *
+ *  `exp_levels_per_gene' sums read counts from exons per gene and computes
+ *  their RPKM and TPM.
+ *  Copyright (C) 2011-2014 Timothée Flutre
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Compile with: g++ -Wall -O3 -fopenmp -I.. utils_io.cpp exp_levels_per_gene.cpp -lz -o exp_levels_per_gene
+ */
+
+#include <cmath>
+#include <ctime>
+#include <cstring>
+#include <cstdio>
+#include <getopt.h>
+#include <libgen.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <set>
+#include <algorithm>
+using namespace std;
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "utils_io.hpp"
+using namespace utils;
+
+#ifndef VERSION
+#define VERSION "1.0.0" // http://semver.org/
+#endif
+
+struct ExpParams
+{
+  string inFile;
+  string outFile;
+  string expLevels;
+  string format;
+  size_t batchSize;
+  int nbThreads;
+  int verbose;
+};
+
+/** \brief Genes in the order of the input file, with their read counts
+ *  in a genes x samples row-major matrix.
+ */
+struct GeneCounts
+{
+  vector<string> sampleNames;
+  vector<string> names;
+  vector<string> chrs;
+  vector<size_t> starts;
+  vector<size_t> ends;
+  vector<double> lengths; // sum of exon lengths
+  vector<double> counts;
+};
+
+/** \brief Display the help on stdout.
+ *  \note The format complies with help2man (http://www.gnu.org/s/help2man)
+ */
+void help(char ** argv)
+{
+  cout << "`" << argv[0] << "'"
+       << " sums read counts from exons per gene and computes their RPKM and TPM." << endl
+       << endl
+       << "Usage: " << argv[0] << " [OPTIONS] ..." << endl
+       << endl
+       << "Options:" << endl
+       << "  -h, --help\tdisplay the help and exit" << endl
+       << "  -V, --version\toutput version information and exit" << endl
+       << "  -v, --verbose\tverbosity level (0/default=1/2/3)" << endl
+       << "  -i, --input\tinput file in BED-like format (can be gzipped)" << endl
+       << "\t\tcolumns: chr exonStart exonEnd geneName readCountSample1 readCountSample2..." << endl
+       << "\t\tthe exons of a gene should be on consecutive lines" << endl
+       << "\t\tshould have a header line with the identifiers of the samples" << endl
+       << "  -o, --output\toutput file (gzipped if ending with .gz, except for 'bin')" << endl
+       << "  -e, --exp\texpression levels as 'rpkm' (default), 'tpm' or 'readcount'" << endl
+       << "  -f, --format\toutput format (default=txt)" << endl
+       << "\t\ttxt: columns chr most5'exon most3'exon geneName Sample1 Sample2..." << endl
+       << "\t\tgct: GCT format, with 'chr:start-end' as description" << endl
+       << "\t\tbin: binary matrix, see below" << endl
+       << "      --batch\tmaximum number of lines parsed at once (default=10000)" << endl
+       << "  -t, --threads\tnumber of threads (default=1)" << endl
+       << endl
+       << "Remarks:" << endl
+       << "  RPKM = 10^9 * C / ( N * L ) and TPM = 10^6 * (C / L) / sum_genes(C / L)" << endl
+       << "  C=read count for transcript, N=total read count, L=sum of exon lengths in bp" << endl
+       << "  The values are computed for all samples at once, over the counts of all" << endl
+       << "  genes stored in a single genes x samples matrix. Lines are parsed in" << endl
+       << "  parallel by batches, with -t threads." << endl
+       << "  The binary matrix has a 32-byte header (magic \"QGMATRIX\", version, 0, nb" << endl
+       << "  of genes, nb of samples as uint64), the sample names then the gene names," << endl
+       << "  each followed by a newline, then the values as row-major doubles." << endl
+       << "  This replaces GetExpLevelsPerGene.py." << endl
+       << endl
+       << "Examples:" << endl
+       << "  " << argv[0] << " -i read_counts_per_exon.txt -o rpkm_per_gene.txt" << endl
+       << "  " << argv[0] << " -i read_counts_per_exon.txt.gz -e tpm -f gct -o tpm_per_gene.gct.gz -t 4" << endl
+       << endl
+       << "Report bugs to <timothee.flutre@supagro.inra.fr>." << endl
+    ;
+}
+
+/** \brief Display version and license information on stdout.
+ */
+void version(char ** argv)
+{
+  cout << argv[0] << " " << VERSION << endl
+       << endl
+       << "Copyright (C) 2011-2014 Timothée Flutre." << endl
+       << "License GPLv3+: GNU GPL version 3 or later <http://gnu.org/licenses/gpl.html>" << endl
+       << "This is free software; see the source for copying conditions.  There is NO" << endl
+       << "warranty; not even for MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE." << endl
+       << endl
+       << "Written by Timothée Flutre." << endl
+    ;
+}
+
+/** \brief Parse the command-line arguments and check the values of the
+ *  compulsory ones.
+ */
+void
+parseCmdLine(
+  int argc,
+  char ** argv,
+  ExpParams & params)
+{
+  int c = 0;
+  while(true)
+  {
+    static struct option long_options[] =
+    {
+      {"help", no_argument, 0, 'h'},
+      {"version", no_argument, 0, 'V'},
+      {"verbose", required_argument, 0, 'v'},
+      {"input", required_argument, 0, 'i'},
+      {"output", required_argument, 0, 'o'},
+      {"exp", required_argument, 0, 'e'},
+      {"format", required_argument, 0, 'f'},
+      {"batch", required_argument, 0, 0},
+      {"threads", required_argument, 0, 't'},
+      {0, 0, 0, 0}
+    };
+    int option_index = 0;
+    c = getopt_long(argc, argv, "hVv:i:o:e:f:t:",
+                    long_options, &option_index);
+    if(c == -1)
+      break;
+    switch(c)
+    {
+    case 0:
+      if(long_options[option_index].flag != 0)
+        break;
+      if(strcmp(long_options[option_index].name, "batch") == 0)
+        params.batchSize = atol(optarg);
+      break;
+    case 'h':
+      help(argv);
+      exit(0);
+    case 'V':
+      version(argv);
+      exit(0);
+    case 'v':
+      params.verbose = atoi(optarg);
+      break;
+    case 'i':
+      params.inFile = optarg;
+      break;
+    case 'o':
+      params.outFile = optarg;
+      break;
+    case 'e':
+      params.expLevels = optarg;
+      break;
+    case 'f':
+      params.format = optarg;
+      break;
+    case 't':
+      params.nbThreads = atoi(optarg);
+      break;
+    case '?':
+      printf("\n"); help(argv);
+      abort();
+    default:
+      printf("\n"); help(argv);
+      abort();
+    }
+  }
+
+  string error;
+  if(params.inFile.empty())
+    error = "missing compulsory option --input";
+  else if(! doesFileExist(params.inFile))
+    error = "can't find file " + params.inFile;
+  else if(params.outFile.empty())
+    error = "missing compulsory option --output";
+  else if(params.expLevels != "rpkm" && params.expLevels != "tpm"
+	  && params.expLevels != "readcount")
+    error = "unknown expression level " + params.expLevels;
+  else if(params.format != "txt" && params.format != "gct"
+	  && params.format != "bin")
+    error = "unknown output format " + params.format;
+  if(! error.empty()){
+    cerr << "cmd-line: " << getCmdLine(argc, argv) << endl << endl
+	 << "ERROR: " << error << endl << endl;
+    help(argv);
+    exit(1);
+  }
+  if(params.batchSize == 0)
+    params.batchSize = 1;
+  if(params.nbThreads < 1)
+    params.nbThreads = 1;
+}
+
+/** \brief Load the exon counts, those of consecutive lines with the same
+ *  gene name being summed.
+ *  \note Each batch of lines is parsed in parallel into a lines x samples
+ *  matrix, then added row by row to the matrix of the genes.
+ */
+void
+loadExonCounts(
+  const ExpParams & params,
+  GeneCounts & gc)
+{
+  if(params.verbose > 0)
+    cout << "load file '" << params.inFile << "' ..." << endl << flush;
+
+  BlockReader br;
+  openBlockReader(br, params.inFile);
+  StringView line;
+  vector<StringView> tokens;
+  if(! getline(br, line) || tokenize(line, " \t", tokens) < 5){
+    cerr << "ERROR: the header of file " << params.inFile
+	 << " should have at least 5 columns" << endl;
+    exit(1);
+  }
+  for(size_t j = 4; j < tokens.size(); ++j)
+    gc.sampleNames.push_back(toString(tokens[j]));
+  const size_t S = gc.sampleNames.size();
+
+  vector<StringView> lines, lineNames, lineChrs;
+  vector<size_t> lineStarts, lineEnds, lineErrors;
+  vector<double> lineCounts;
+  set<string> seenNames;
+  string name;
+  while(true){
+    size_t n = readLineBatch(br, params.batchSize, lines);
+    if(n == 0)
+      break;
+    size_t firstLine = br.nbLines - n + 1;
+    lineNames.resize(n);
+    lineChrs.resize(n);
+    lineStarts.resize(n);
+    lineEnds.resize(n);
+    lineErrors.assign(params.nbThreads, 0);
+    lineCounts.resize(n * S);
+
+    size_t sliceSize = (n + params.nbThreads - 1) / params.nbThreads;
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(params.nbThreads)
+#endif
+    for(int s = 0; s < params.nbThreads; ++s){
+      vector<StringView> toks;
+      size_t last = min(n, (s + 1) * sliceSize);
+      for(size_t l = s * sliceSize; l < last && lineErrors[s] == 0; ++l){
+	bool ok = tokenize(lines[l], " \t", toks) == S + 4
+	  && parseUnsigned(toks[1], lineStarts[l])
+	  && parseUnsigned(toks[2], lineEnds[l])
+	  && lineStarts[l] <= lineEnds[l];
+	double * counts = &lineCounts[l * S];
+	for(size_t j = 0; ok && j < S; ++j)
+	  ok = parseDouble(toks[4 + j], counts[j]);
+	if(! ok)
+	  lineErrors[s] = firstLine + l;
+	else{
+	  lineChrs[l] = toks[0];
+	  lineNames[l] = toks[3];
+	}
+      }
+    }
+    for(int s = 0; s < params.nbThreads; ++s)
+      if(lineErrors[s] != 0){
+	cerr << "ERROR: line " << lineErrors[s] << " of file "
+	     << params.inFile << " should have " << S + 4 << " columns,"
+	     << " with start <= end and numeric counts" << endl;
+	exit(1);
+      }
+
+    for(size_t l = 0; l < n; ++l){
+      if(gc.names.empty() || ! (lineNames[l] == gc.names.back().c_str())){
+	name = toString(lineNames[l]);
+	if(! seenNames.insert(name).second){
+	  cerr << "ERROR: the exons of gene " << name << " are not on"
+	       << " consecutive lines of file " << params.inFile
+	       << ", see the help" << endl;
+	  exit(1);
+	}
+	gc.names.push_back(name);
+	gc.chrs.push_back(toString(lineChrs[l]));
+	gc.starts.push_back(lineStarts[l]);
+	gc.ends.push_back(lineEnds[l]);
+	gc.lengths.push_back(0);
+	gc.counts.resize(gc.counts.size() + S, 0);
+      }
+      size_t g = gc.names.size() - 1;
+      gc.starts[g] = min(gc.starts[g], lineStarts[l]);
+      gc.ends[g] = max(gc.ends[g], lineEnds[l]);
+      gc.lengths[g] += lineEnds[l] - lineStarts[l];
+      double * geneCounts = &gc.counts[g * S];
+      const double * counts = &lineCounts[l * S];
+      for(size_t j = 0; j < S; ++j)
+	geneCounts[j] += counts[j];
+    }
+  }
+  closeBlockReader(br);
+
+  if(params.verbose > 0){
+    double nbReads = 0;
+    for(size_t i = 0; i < gc.counts.size(); ++i)
+      nbReads += gc.counts[i];
+    cout << "nb of genes: " << gc.names.size() << endl
+	 << "nb of samples: " << S << endl
+	 << "nb of reads: " << (size_t) nbReads << endl << flush;
+  }
+}
+
+/** \brief Replace the read counts by RPKM or TPM, for all genes and
+ *  samples at once.
+ */
+void
+computeExpLevels(
+  const ExpParams & params,
+  GeneCounts & gc)
+{
+  const size_t G = gc.names.size(), S = gc.sampleNames.size();
+  for(size_t g = 0; g < G; ++g)
+    if(gc.lengths[g] == 0){
+      cerr << "ERROR: the exons of gene " << gc.names[g]
+	   << " have a total length of 0" << endl;
+      exit(1);
+    }
+
+  // per-sample totals: N for RPKM, sum_genes(C / L) for TPM
+  vector<double> totals(S, 0);
+  for(size_t g = 0; g < G; ++g){
+    const double * counts = &gc.counts[g * S];
+    double w = (params.expLevels == "tpm") ? 1.0 / gc.lengths[g] : 1.0;
+    for(size_t j = 0; j < S; ++j)
+      totals[j] += w * counts[j];
+  }
+  double factor = (params.expLevels == "tpm") ? 1e6 : 1e9;
+  vector<double> scales(S, 0);
+  for(size_t j = 0; j < S; ++j)
+    if(totals[j] != 0)
+      scales[j] = factor / totals[j];
+
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(params.nbThreads)
+#endif
+  for(long g = 0; g < (long) G; ++g){
+    double * values = &gc.counts[g * S];
+    double invLength = 1.0 / gc.lengths[g];
+    for(size_t j = 0; j < S; ++j)
+      values[j] *= scales[j] * invLength;
+  }
+}
+
+/** \brief Format the genes first to last-1, as in GetExpLevelsPerGene.py
+ *  for the txt format.
+ */
+void
+formatGenes(
+  const ExpParams & params,
+  const GeneCounts & gc,
+  const size_t first,
+  const size_t last,
+  string & out)
+{
+  const size_t S = gc.sampleNames.size();
+  const char * valueFormat = (params.expLevels == "readcount") ?
+    "%.15g" : "%.2f";
+  char sep = (params.format == "gct") ? '\t' : ' ';
+  char buf[64];
+  for(size_t g = first; g < last; ++g){
+    if(params.format == "gct"){
+      snprintf(buf, sizeof(buf), ":%lu-%lu", (unsigned long) gc.starts[g],
+	       (unsigned long) gc.ends[g]);
+      out += gc.names[g] + "\t" + gc.chrs[g] + buf;
+    }
+    else{
+      snprintf(buf, sizeof(buf), " %lu %lu ", (unsigned long) gc.starts[g],
+	       (unsigned long) gc.ends[g]);
+      out += gc.chrs[g] + buf + gc.names[g];
+    }
+    const double * values = &gc.counts[g * S];
+    for(size_t j = 0; j < S; ++j){
+      int n = snprintf(buf, sizeof(buf), valueFormat, values[j]);
+      out += sep;
+      out.append(buf, n);
+    }
+    out += '\n';
+  }
+}
+
+void
+writeExpLevels(
+  const ExpParams & params,
+  const GeneCounts & gc)
+{
+  if(params.verbose > 0)
+    cout << "write file '" << params.outFile << "' ..." << endl << flush;
+
+  if(params.format == "bin"){
+    writeBinaryMatrix(params.outFile, gc.names, gc.sampleNames,
+		      gc.counts.empty() ? NULL : &gc.counts[0]);
+    return;
+  }
+
+  BlockWriter bw;
+  openBlockWriter(bw, params.outFile, params.nbThreads);
+  string header;
+  if(params.format == "gct")
+    header = "#1.2\n" + toString(gc.names.size()) + "\t"
+      + toString(gc.sampleNames.size()) + "\nName\tDescription";
+  else
+    header = "chr start end gene";
+  for(size_t j = 0; j < gc.sampleNames.size(); ++j)
+    header += (params.format == "gct" ? "\t" : " ") + gc.sampleNames[j];
+  header += "\n";
+  bwrite(bw, header);
+
+  // each thread formats a slice of the genes, written in order
+  const size_t G = gc.names.size(), batchSize = 10000;
+  vector<string> outs(params.nbThreads);
+  for(size_t first = 0; first < G; first += params.nbThreads * batchSize){
+    size_t sliceSize = min(batchSize, (G - first + params.nbThreads - 1)
+			   / params.nbThreads);
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(params.nbThreads)
+#endif
+    for(int s = 0; s < params.nbThreads; ++s){
+      outs[s].clear();
+      size_t begin = min(G, first + s * sliceSize),
+	end = min(G, first + (s + 1) * sliceSize);
+      formatGenes(params, gc, begin, end, outs[s]);
+    }
+    for(int s = 0; s < params.nbThreads; ++s)
+      bwrite(bw, outs[s]);
+  }
+  closeBlockWriter(bw);
+}
+
+void run(const ExpParams & params)
+{
+  GeneCounts gc;
+  loadExonCounts(params, gc);
+  if(params.expLevels != "readcount")
+    computeExpLevels(params, gc);
+  writeExpLevels(params, gc);
+}
+
+int main(int argc, char ** argv)
+{
+  ExpParams params;
+  params.expLevels = "rpkm";
+  params.format = "txt";
+  params.batchSize = 10000;
+  params.nbThreads = 1;
+  params.verbose = 1;
+
+  parseCmdLine(argc, argv, params);
+
+  time_t startRawTime, endRawTime;
+  if(params.verbose > 0){
+    time(&startRawTime);
+    cout << "START " << basename(argv[0])
+         << " " << getDateTime(startRawTime) << endl
+         << "version " << VERSION << " compiled " << __DATE__
+         << " " << __TIME__ << endl
+         << "cmd-line: " << getCmdLine(argc, argv) << endl
+         << "cwd: " << getCurrentDirectory() << endl;
+    cout << flush;
+  }
+
+  run(params);
+
+  if(params.verbose > 0){
+    time(&endRawTime);
+    cout << "END " << basename(argv[0])
+         << " " << getDateTime(endRawTime) << endl
+         << "elapsed -> " << getElapsedTime(startRawTime, endRawTime) << endl
+         << "max.mem -> " << getMaxMemUsedByProcess2Str() << endl;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -16,7 +16,7 @@
  *  You should have received a copy of the GNU General Public License
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
  *
- *  gcc -Wall impute2bimbam.cpp -lstdc++ -o impute2bimbam
+ *  g++ -Wall utils_geno.cpp impute2bimbam.cpp -lgsl -lgslcblas -lz -o impute2bimbam
  *  help2man -o impute2bimbam.man ./impute2bimbam
  *  groff -mandoc impute2bimbam.man > impute2bimbam.ps
 */
@@ -34,6 +34,7 @@
 using namespace std;
 
 #include "utils.cpp"
+#include "utils_geno.hpp"
 
 /** \brief Display the usage on stdout.
 */
@@ -54,7 +55,16 @@ void help (char ** argv)
        << "\t\tgives <prefix>.bimbam and <prefix>_snpAnnot.txt" << endl
        << "  -d, --discard\tfile with a list of individuals to discard" << endl
        << "\t\tone number per line, for the index of the column to skip" << endl
-       << "  -H, --head\tindicate if input file has a header line\n" << endl
+       << "  -H, --head\tindicate if input file has a header line" << endl
+       << "  -b, --binary\talso write dosages in binary, encoded as f32, u16 or u8" << endl
+       << "\t\tgives <prefix>.dosage.bin, 4, 2 or 1 byte(s) per dosage" << endl
+       << "\t\twith a max error of 1.2e-7, 1.5e-5 or 3.9e-3" << endl
+       << "\t\ta genotype \"0 0 0\" is encoded as missing (NaN or max code)" << endl
+       << "  -p, --plink\talso write hard calls in the PLINK binary format" << endl
+       << "\t\tgives <prefix>.bed, <prefix>.bim and <prefix>.fam" << endl
+       << "\t\tthe argument is the min probability of the most likely genotype" << endl
+       << "\t\tbelow which the genotype is missing, eg. 0.9" << endl
+       << "\t\t(a genotype \"0 0 0\" is always missing)" << endl
        << endl
        << "Examples:" << endl
        << "$ " << argv[0] << " -i ~/data/genotypes.impute -o genotypes" << endl
@@ -88,6 +98,8 @@ void parse_args (
   string & output,
   string & indsFile,
   bool & hasHeader,
+  string & binaryEncoding,
+  double & minProbHardCall,
   int & verbose)
 {
   int c = 0;
@@ -102,10 +114,12 @@ void parse_args (
 	{"output", required_argument, 0, 'o'},
 	{"discard", required_argument, 0, 'd'},
 	{"head", no_argument, 0, 'H'},
+	{"binary", required_argument, 0, 'b'},
+	{"plink", required_argument, 0, 'p'},
 	{0, 0, 0, 0}
       };
     int option_index = 0;
-    c = getopt_long (argc, argv, "hVv:i:o:d:H",
+    c = getopt_long (argc, argv, "hVv:i:o:d:Hb:p:",
 		     long_options, &option_index);
     if (c == -1)
       break;
@@ -140,6 +154,12 @@ void parse_args (
     case 'H':
       hasHeader = true;
       break;
+    case 'b':
+      binaryEncoding = optarg;
+      break;
+    case 'p':
+      minProbHardCall = atof(optarg);
+      break;
     case '?':
       break;
     default:
@@ -158,6 +178,45 @@ void parse_args (
     help (argv);
     exit (1);
   }
+  if (! binaryEncoding.empty())
+    utils::getDosageEncoding (binaryEncoding); // exit if unknown
+  if (! isnan (minProbHardCall) &&
+      (minProbHardCall < 0 || minProbHardCall > 1))
+  {
+    fprintf (stderr, "ERROR: -p should be between 0 and 1.\n\n");
+    help (argv);
+    exit (1);
+  }
+}
+
+/** \brief Write the FAM file, individuals being named after the header
+ *  (eg. 'ind1' for 'ind1_a1a1') or by their rank.
+ */
+void writePlinkFamFile (
+  const string & famFile,
+  const vector<string> & vHeaderTokens,
+  const vector<size_t> & vIdxIndsToSkip,
+  const size_t nbSamples)
+{
+  ofstream famStream (famFile.c_str());
+  if (! famStream.is_open())
+  {
+    cerr << "ERROR: can't open file " << famFile << endl;
+    exit (1);
+  }
+  for (size_t i = 0; i < nbSamples; ++i)
+  {
+    if (find(vIdxIndsToSkip.begin(), vIdxIndsToSkip.end(), i) !=
+	vIdxIndsToSkip.end())
+      continue;
+    stringstream ss;
+    if (vHeaderTokens.size() > 5+3*i)
+      ss << vHeaderTokens[5+3*i].substr (0, vHeaderTokens[5+3*i].rfind('_'));
+    else
+      ss << "ind" << i+1;
+    famStream << ss.str() << " " << ss.str() << " 0 0 0 -9" << endl;
+  }
+  famStream.close();
 }
 
 void convertImputeFileToBimbamFiles (
@@ -165,14 +224,22 @@ void convertImputeFileToBimbamFiles (
   const string output,
   const vector<size_t> vIdxIndsToSkip,
   const bool hasHeader,
+  const string binaryEncoding,
+  const double minProbHardCall,
   const int verbose)
 {
   string line;
   ifstream inStream;
-  vector<string> tokens;
-  ofstream outStream1, outStream2;
+  vector<string> tokens, headerTokens;
+  ofstream outStream1, outStream2, bimStream;
   size_t nbSamples = 0;
   stringstream ss;
+  utils::DosageWriter dosageWriter;
+  vector<double> vDosages;
+  double pAA, pAB, pBB;
+  utils::PackedGenoWriter bedWriter;
+  vector<uint8_t> vHardCalls;
+  bool writePlink = ! isnan (minProbHardCall);
   
   if (verbose > 0)
   {
@@ -209,7 +276,10 @@ void convertImputeFileToBimbamFiles (
   }
   
   if (hasHeader)
+  {
     getline (inStream, line);
+    split (line, line.find('\t') != string::npos ? '\t' : ' ', headerTokens);
+  }
   
   while (inStream.good())
   {
@@ -226,17 +296,65 @@ void convertImputeFileToBimbamFiles (
 	       << " " << tokens[3]    // allele A (minor allele for BimBam)
 	       << " " << tokens[4];   // allele B (major allele for BimBam)
     nbSamples = (size_t) floor ((tokens.size() - 5) / 3);
+    vDosages.clear();
+    vHardCalls.clear();
     for (size_t i = 0; i < nbSamples; ++i)
     {
       if (vIdxIndsToSkip.size() > 0 &
 	  find(vIdxIndsToSkip.begin(), vIdxIndsToSkip.end(), i) !=
 	  vIdxIndsToSkip.end())
 	continue;
-      outStream1 << " " << 2 * atof(tokens[5+3*i].c_str())
-	+ 1 * atof(tokens[5+3*i+1].c_str())
-	+ 0 * atof(tokens[5+3*i+2].c_str());
+      pAA = atof(tokens[5+3*i].c_str());
+      pAB = atof(tokens[5+3*i+1].c_str());
+      pBB = atof(tokens[5+3*i+2].c_str());
+      outStream1 << " " << 2 * pAA + 1 * pAB + 0 * pBB;
+      // "0 0 0" is a missing genotype, NaN gives the missing code of -b
+      vDosages.push_back ((pAA + pAB + pBB <= 0) ? NAN
+			  : 2 * pAA + 1 * pAB + 0 * pBB);
+      if (writePlink) // allele A is A1, as the dosages count its copies
+	vHardCalls.push_back (utils::getHardCall (pAA, pAB, pBB,
+						  minProbHardCall));
     }
     outStream1 << endl;
+    if (! binaryEncoding.empty())
+    {
+      if (dosageWriter.path.empty())
+	utils::openDosageWriter (dosageWriter, output + ".dosage.bin",
+				 utils::getDosageEncoding (binaryEncoding),
+				 vDosages.size());
+      if (vDosages.size() != dosageWriter.nbSamples)
+      {
+	cerr << "ERROR: SNP " << tokens[1] << " has " << vDosages.size()
+	     << " samples instead of " << dosageWriter.nbSamples << endl;
+	exit (1);
+      }
+      utils::writeDosageRow (dosageWriter, &vDosages[0]);
+    }
+    if (writePlink)
+    {
+      if (bedWriter.path.empty())
+      {
+	utils::openPackedGenoWriter (bedWriter, output + ".bed",
+				     vHardCalls.size());
+	bimStream.open ((output + ".bim").c_str());
+	if (! bimStream.is_open())
+	{
+	  cerr << "ERROR: can't open file " << output << ".bim" << endl;
+	  exit (1);
+	}
+	writePlinkFamFile (output + ".fam", headerTokens, vIdxIndsToSkip,
+			   nbSamples);
+      }
+      if (vHardCalls.size() != bedWriter.nbSamples)
+      {
+	cerr << "ERROR: SNP " << tokens[1] << " has " << vHardCalls.size()
+	     << " samples instead of " << bedWriter.nbSamples << endl;
+	exit (1);
+      }
+      utils::writePackedGenoRow (bedWriter, &vHardCalls[0]);
+      bimStream << tokens[0] << "\t" << tokens[1] << "\t0\t" << tokens[2]
+		<< "\t" << tokens[3] << "\t" << tokens[4] << endl;
+    }
     outStream2 << tokens[1]          // SNP id
 	       << " " << tokens[2]   // SNP coordinate
 	       << " " << tokens[0]   // chromosome
@@ -246,14 +364,23 @@ void convertImputeFileToBimbamFiles (
   inStream.close();
   outStream1.close();
   outStream2.close();
+  if (! dosageWriter.path.empty())
+    utils::closeDosageWriter (dosageWriter);
+  if (! bedWriter.path.empty())
+  {
+    utils::closePackedGenoWriter (bedWriter);
+    bimStream.close();
+  }
 }
 
 int main (int argc, char ** argv)
 {
-  string inFile, output, indsFile;
+  string inFile, output, indsFile, binaryEncoding;
   bool hasHeader = false;
+  double minProbHardCall = NAN;
   int verbose = 1;
-  parse_args (argc, argv, inFile, output, indsFile, hasHeader, verbose);
+  parse_args (argc, argv, inFile, output, indsFile, hasHeader,
+	      binaryEncoding, minProbHardCall, verbose);
   
   time_t startRawTime, endRawTime;
   if (verbose > 0)
@@ -267,7 +394,7 @@ int main (int argc, char ** argv)
 							      verbose);
   
   convertImputeFileToBimbamFiles (inFile, output, vIdxIndsToSkip, hasHeader,
-				  verbose);
+				  binaryEncoding, minProbHardCall, verbose);
   
   if (verbose > 0)
   {
@@ -0,0 +1,755 @@
+/** \file launch_impute.cpp
+ *
+ *  `launch_impute' launches IMPUTE2 on whole chromosomes by chunks.
+ *  Copyright (C) 2011-2014 Timothée Flutre
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Compile with: g++ -Wall -O3 -fopenmp -I.. utils_io.cpp launch_impute.cpp -lz -o launch_impute
+ */
+
+#include <cmath>
+#include <ctime>
+#include <cstring>
+#include <cstdio>
+#include <csignal>
+#include <getopt.h>
+#include <libgen.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+using namespace std;
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "utils_io.hpp"
+using namespace utils;
+
+#ifndef VERSION
+#define VERSION "1.0.0" // http://semver.org/
+#endif
+
+struct ImputeParams
+{
+  string refDir;
+  vector<string> refFileStemPatterns;
+  string gmapDir;
+  string studyDir;
+  bool fixStrand;
+  size_t Ne;
+  size_t chunkLength;
+  string planFile;
+  size_t buffer; // in kb
+  vector<string> chrNames;
+  bool force;
+  bool clean;
+  string impute2;
+  int nbJobs;
+  int nbRetries;
+  int verbose;
+};
+
+/** \brief One coordinate range of a chromosome, imputed in its own
+ *  directory.
+ */
+struct Chunk
+{
+  string chrName;
+  size_t chr; // index of its ChrMerger
+  size_t id; // 1-based, in coordinate order
+  size_t start;
+  size_t end;
+  string dir;
+  int status; // 0: pending, 1: done, -1: failed
+};
+
+/** \brief Concatenation of the chunk outputs of a chromosome, in
+ *  coordinate order, as soon as they are available.
+ */
+struct ChrMerger
+{
+  string chrName;
+  vector<size_t> chunks;
+  size_t nbMerged;
+  bool merging; // a job is appending chunks, the others leave it alone
+  BlockWriter bw;
+  FILE * idxStream;
+};
+
+/** \brief Display the help on stdout.
+ *  \note The format complies with help2man (http://www.gnu.org/s/help2man)
+ */
+void help(char ** argv)
+{
+  cout << "`" << argv[0] << "'"
+       << " launches IMPUTE2 on whole chromosomes by chunks." << endl
+       << endl
+       << "Usage: " << argv[0] << " [OPTIONS] ..." << endl
+       << endl
+       << "Options:" << endl
+       << "  -h, --help\tdisplay the help and exit" << endl
+       << "  -V, --version\toutput version information and exit" << endl
+       << "  -v, --verbose\tverbosity level (0/default=1/2/3)" << endl
+       << "  -r\t\tpath to the directory with the reference data" << endl
+       << "      --rfsp\treference file stem pattern (in the dir given by '-r')" << endl
+       << "\t\te.g. 'AFR.CHR.impute.hap' or '<rfsp1>,<rfsp2>'" << endl
+       << "\t\tthe '.legend' files should also be there" << endl
+       << "  -g\t\tpath to the directory with the genetic maps" << endl
+       << "\t\tdefault is directory given by '-r'" << endl
+       << "  -s\t\tpath to the directory with the study data (default=.)" << endl
+       << "\t\tshould contain files named 'chr1.study.gens', ..." << endl
+       << "      --fix-strand\tstrand argument '-fix_strand_g' for IMPUTE2," << endl
+       << "\t\totherwise assume files 'chr1.study.strand', ... exist" << endl
+       << "      --Ne\teffective population size (default=20000)" << endl
+       << "  -l\t\tchunk length (default=5000000)" << endl
+       << "      --plan\tpath to the chunks planned by plan_impute_chunks, instead of -l" << endl
+       << "      --buffer\tbuffer on each side of a chunk, in kb (default=250)" << endl
+       << "  -c\t\tchromosome (e.g. '12', all autosomes by default," << endl
+       << "\t\tor all chromosomes of --plan)" << endl
+       << "      --force\tforce to recompute each chunk" << endl
+       << "      --clean\tremove the chunk directories once merged" << endl
+       << "      --impute2\tpath to the IMPUTE2 executable (default=impute2)" << endl
+       << "  -j, --jobs\tmaximum number of chunks imputed at once (default=1)" << endl
+       << "      --retries\tnumber of times a failed chunk is relaunched (default=2)" << endl
+       << endl
+       << "Remarks:" << endl
+       << "  Each chunk of <chr> is imputed in <chr>_chunks/chunk<i>_<start>_<end>/, the" << endl
+       << "  chunks of all chromosomes being dispatched to the jobs as these become" << endl
+       << "  free. A chunk already imputed is skipped, unless --force is given." << endl
+       << "  As soon as the chunks preceding it are done, a chunk is appended to" << endl
+       << "  <chr>_chunkAll.impute2.gz, each chunk starting a new gzip member, and a line" << endl
+       << "  is added to <chr>_chunkAll.impute2.gz.idx with its coordinates, its number" << endl
+       << "  of SNPs, and its offset and size in bytes in the gzipped file." << endl
+       << "  If a chunk still fails after the retries, the other ones are completed," << endl
+       << "  but no output is kept for its chromosome." << endl
+       << endl
+       << "Examples:" << endl
+       << "  " << argv[0] << " -r 1000Genomes.Dec2010.haplotypes_b37/ --rfsp EUR.CHR.impute.hap -g genetic_maps_b37/ -s CEU_b37_impute2/ -j 8" << endl
+       << endl
+       << "Report bugs to <timothee.flutre@supagro.inra.fr>." << endl
+    ;
+}
+
+/** \brief Display version and license information on stdout.
+ */
+void version(char ** argv)
+{
+  cout << argv[0] << " " << VERSION << endl
+       << endl
+       << "Copyright (C) 2011-2014 Timothée Flutre." << endl
+       << "License GPLv3+: GNU GPL version 3 or later <http://gnu.org/licenses/gpl.html>" << endl
+       << "This is free software; see the source for copying conditions.  There is NO" << endl
+       << "warranty; not even for MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE." << endl
+       << endl
+       << "Written by Timothée Flutre." << endl
+    ;
+}
+
+/** \brief Return true if the program is an executable file, looking for it
+ *  in the PATH if its name has no '/'.
+ */
+bool
+isExecutable(
+  const string & program)
+{
+  if(program.find('/') != string::npos)
+    return access(program.c_str(), X_OK) == 0;
+  const char * path = getenv("PATH");
+  if(path == NULL)
+    return false;
+  vector<string> dirs = split(path, ':');
+  for(size_t i = 0; i < dirs.size(); ++i)
+    if(access((dirs[i] + "/" + program).c_str(), X_OK) == 0)
+      return true;
+  return false;
+}
+
+/** \brief Parse the command-line arguments and check the values of the
+ *  compulsory ones.
+ */
+void
+parseCmdLine(
+  int argc,
+  char ** argv,
+  ImputeParams & params)
+{
+  int c = 0;
+  while(true)
+  {
+    static struct option long_options[] =
+    {
+      {"help", no_argument, 0, 'h'},
+      {"version", no_argument, 0, 'V'},
+      {"verbose", required_argument, 0, 'v'},
+      {"rfsp", required_argument, 0, 0},
+      {"fix-strand", no_argument, 0, 0},
+      {"Ne", required_argument, 0, 0},
+      {"plan", required_argument, 0, 0},
+      {"buffer", required_argument, 0, 0},
+      {"force", no_argument, 0, 0},
+      {"clean", no_argument, 0, 0},
+      {"impute2", required_argument, 0, 0},
+      {"jobs", required_argument, 0, 'j'},
+      {"retries", required_argument, 0, 0},
+      {0, 0, 0, 0}
+    };
+    int option_index = 0;
+    c = getopt_long(argc, argv, "hVv:r:g:s:l:c:j:",
+                    long_options, &option_index);
+    if(c == -1)
+      break;
+    switch(c)
+    {
+    case 0:
+      if(long_options[option_index].flag != 0)
+        break;
+      if(strcmp(long_options[option_index].name, "rfsp") == 0)
+        split(optarg, ',', params.refFileStemPatterns);
+      else if(strcmp(long_options[option_index].name, "fix-strand") == 0)
+        params.fixStrand = true;
+      else if(strcmp(long_options[option_index].name, "Ne") == 0)
+        params.Ne = atol(optarg);
+      else if(strcmp(long_options[option_index].name, "plan") == 0)
+        params.planFile = optarg;
+      else if(strcmp(long_options[option_index].name, "buffer") == 0)
+        params.buffer = atol(optarg);
+      else if(strcmp(long_options[option_index].name, "force") == 0)
+        params.force = true;
+      else if(strcmp(long_options[option_index].name, "clean") == 0)
+        params.clean = true;
+      else if(strcmp(long_options[option_index].name, "impute2") == 0)
+        params.impute2 = optarg;
+      else if(strcmp(long_options[option_index].name, "retries") == 0)
+        params.nbRetries = atoi(optarg);
+      break;
+    case 'h':
+      help(argv);
+      exit(0);
+    case 'V':
+      version(argv);
+      exit(0);
+    case 'v':
+      params.verbose = atoi(optarg);
+      break;
+    case 'r':
+      params.refDir = optarg;
+      break;
+    case 'g':
+      params.gmapDir = optarg;
+      break;
+    case 's':
+      params.studyDir = optarg;
+      break;
+    case 'l':
+      params.chunkLength = atol(optarg);
+      break;
+    case 'c':
+      params.chrNames.assign(1, string("chr") + optarg);
+      break;
+    case 'j':
+      params.nbJobs = atoi(optarg);
+      break;
+    case '?':
+      printf("\n"); help(argv);
+      abort();
+    default:
+      printf("\n"); help(argv);
+      abort();
+    }
+  }
+
+  if(params.gmapDir.empty())
+    params.gmapDir = params.refDir;
+  string error;
+  if(! isExecutable(params.impute2))
+    error = "'" + params.impute2 + "' is not in your PATH";
+  else if(params.refDir.empty() || ! isDirectory(params.refDir.c_str()))
+    error = "can't find reference directory " + params.refDir;
+  else if(params.refFileStemPatterns.empty())
+    error = "missing compulsory option --rfsp";
+  else if(! isDirectory(params.gmapDir.c_str()))
+    error = "can't find directory " + params.gmapDir;
+  else if(params.studyDir.empty() || ! isDirectory(params.studyDir.c_str()))
+    error = "can't find directory " + params.studyDir;
+  else if(params.chunkLength == 0)
+    error = "chunk length should be positive";
+  else if(! params.planFile.empty() && ! doesFileExist(params.planFile))
+    error = "can't find file " + params.planFile;
+  if(! error.empty()){
+    cerr << "cmd-line: " << getCmdLine(argc, argv) << endl << endl
+	 << "ERROR: " << error << endl << endl;
+    help(argv);
+    exit(1);
+  }
+  if(params.chrNames.empty() && params.planFile.empty())
+    for(int i = 1; i <= 22; ++i)
+      params.chrNames.push_back("chr" + toString(i));
+  if(params.nbJobs < 1)
+    params.nbJobs = 1;
+  if(params.nbRetries < 0)
+    params.nbRetries = 0;
+}
+
+/** \brief Return the name of the genetic map files, "CHR" standing for
+ *  the chromosome.
+ */
+string
+getTemplateGmapFile(
+  const ImputeParams & params)
+{
+  vector<string> gmapFiles = glob(params.gmapDir + "/genetic_map*.txt");
+  if(gmapFiles.empty()){
+    cerr << "ERROR: can't find genetic map files" << endl;
+    exit(1);
+  }
+  if(gmapFiles[0].find("b36") != string::npos)
+    return "genetic_map_CHR_combined_b36.txt";
+  else if(gmapFiles[0].find("b37") != string::npos)
+    return "genetic_map_CHR_combined_b37.txt";
+  cerr << "ERROR: check the names of the genetic map files" << endl;
+  exit(1);
+}
+
+void
+setChunkDir(
+  Chunk & chunk)
+{
+  chunk.dir = chunk.chrName + "_chunks/chunk" + toString(chunk.id) + "_"
+    + toString(chunk.start) + "_" + toString(chunk.end);
+}
+
+/** \brief Cut a chromosome into chunks, each starting at a SNP of the study
+ *  and spanning the chunk length, like LaunchImpute.py.
+ */
+void
+addChunksOfChr(
+  const ImputeParams & params,
+  const string & chrName,
+  const size_t chr,
+  vector<Chunk> & chunks)
+{
+  string studyFile = params.studyDir + "/" + chrName + ".study.gens";
+  BlockReader br;
+  openBlockReader(br, studyFile);
+  StringView line;
+  vector<StringView> tokens;
+  size_t coord, prevCoord = 0, nbChunks = 0;
+  Chunk chunk;
+  chunk.chrName = chrName;
+  chunk.chr = chr;
+  chunk.status = 0;
+  while(getline(br, line)){
+    if(tokenize(line, " ", tokens) < 3 || ! parseUnsigned(tokens[2], coord)){
+      cerr << "ERROR: can't read the coordinate at line " << br.nbLines
+	   << " of file " << studyFile << endl;
+      exit(1);
+    }
+    if(nbChunks > 0 && coord < prevCoord){
+      cerr << "ERROR: input file '" << studyFile << "' is not sorted" << endl
+	   << "use 'for i in {1..22}; do sort -t \" \" -k3,3n chr${i}.study.gens"
+	   << " -o chr${i}.study.gens; done'" << endl;
+      exit(1);
+    }
+    else if(nbChunks > 0 && coord == prevCoord){
+      if(params.verbose > 0)
+	cerr << "warning: '" << toString(tokens[0]) << "' with redundant"
+	     << " coordinate '" << coord << "', skip it" << endl;
+    }
+    else if(nbChunks == 0 || coord > chunk.end){
+      chunk.id = ++nbChunks;
+      chunk.start = coord;
+      chunk.end = coord + params.chunkLength;
+      setChunkDir(chunk);
+      chunks.push_back(chunk);
+    }
+    prevCoord = coord;
+  }
+  closeBlockReader(br);
+  if(nbChunks == 0){
+    cerr << "ERROR: no SNP in file " << studyFile << endl;
+    exit(1);
+  }
+}
+
+/** \brief Load the chunks planned by plan_impute_chunks, "chr" being
+ *  prepended to chromosome names without it. Only the chunks of chrNames
+ *  are kept, unless it is empty, in which case it is filled with all
+ *  chromosomes in the order of the plan.
+ */
+void
+loadPlannedChunks(
+  const ImputeParams & params,
+  vector<string> & chrNames,
+  vector<Chunk> & chunks)
+{
+  bool allChrs = chrNames.empty();
+  BlockReader br;
+  openBlockReader(br, params.planFile);
+  StringView line;
+  vector<StringView> tokens;
+  Chunk chunk;
+  chunk.status = 0;
+  while(getline(br, line)){
+    if(br.nbLines == 1 && line.size >= 9
+       && strncmp(line.data, "chr\tchunk", 9) == 0)
+      continue; // header
+    if(tokenize(line, "\t", tokens) < 4 || ! parseUnsigned(tokens[1], chunk.id)
+       || ! parseUnsigned(tokens[2], chunk.start)
+       || ! parseUnsigned(tokens[3], chunk.end) || chunk.start > chunk.end){
+      cerr << "ERROR: line " << br.nbLines << " of file " << params.planFile
+	   << " should be as <chr><tab><chunk><tab><start><tab><end>" << endl;
+      exit(1);
+    }
+    chunk.chrName = toString(tokens[0]);
+    if(chunk.chrName.compare(0, 3, "chr") != 0)
+      chunk.chrName = "chr" + chunk.chrName;
+    chunk.chr = find(chrNames.begin(), chrNames.end(), chunk.chrName)
+      - chrNames.begin();
+    if(chunk.chr == chrNames.size()){
+      if(! allChrs)
+	continue;
+      chrNames.push_back(chunk.chrName);
+    }
+    setChunkDir(chunk);
+    chunks.push_back(chunk);
+  }
+  closeBlockReader(br);
+}
+
+string
+getChunkCommand(
+  const ImputeParams & params,
+  const string & templateGmapFile,
+  const Chunk & chunk)
+{
+  const string & chrName = chunk.chrName;
+  string gmapFile = templateGmapFile, rfsp;
+  replaceAll(gmapFile, "CHR", chrName);
+  string cmd = params.impute2;
+  cmd += " -m " + params.gmapDir + "/" + gmapFile;
+  cmd += " -h";
+  for(size_t i = 0; i < params.refFileStemPatterns.size(); ++i){
+    rfsp = params.refFileStemPatterns[i];
+    replaceAll(rfsp, "CHR", chrName);
+    cmd += " " + params.refDir + "/" + rfsp;
+  }
+  cmd += " -l";
+  for(size_t i = 0; i < params.refFileStemPatterns.size(); ++i){
+    rfsp = params.refFileStemPatterns[i];
+    replaceAll(rfsp, "CHR", chrName);
+    size_t pos = rfsp.rfind(".hap");
+    cmd += " " + params.refDir + "/"
+      + rfsp.substr(0, pos == string::npos ? 0 : pos) + ".legend";
+  }
+  cmd += " -g " + params.studyDir + "/" + chrName + ".study.gens";
+  if(params.fixStrand)
+    cmd += " -fix_strand_g";
+  else
+    cmd += " -strand_g " + params.studyDir + "/" + chrName + ".study.strand";
+  cmd += " -Ne " + toString(params.Ne);
+  cmd += " -buffer " + toString(params.buffer);
+  cmd += " -int " + toString(chunk.start) + " " + toString(chunk.end);
+  cmd += " -o " + chunk.dir + "/chunk.impute2";
+  cmd += " > " + chunk.dir + "/log.txt 2>&1";
+  return cmd;
+}
+
+/** \brief Impute a chunk in a fresh directory, relaunching it if it fails,
+ *  and return true if it succeeded.
+ *  \note A file "done" is created in the directory on success.
+ */
+bool
+imputeChunk(
+  const ImputeParams & params,
+  const string & templateGmapFile,
+  const Chunk & chunk)
+{
+  if(! params.force && doesFileExist(chunk.dir + "/done"))
+    return true;
+  string cmd = getChunkCommand(params, templateGmapFile, chunk);
+  if(params.verbose > 2){
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+    cout << cmd << endl << flush;
+  }
+  for(int attempt = 0; attempt <= params.nbRetries; ++attempt){
+    removeDir(chunk.dir);
+    createDirectory(chunk.dir);
+    int status = system(cmd.c_str());
+    if(status != -1 && WIFSIGNALED(status)
+       && (WTERMSIG(status) == SIGINT || WTERMSIG(status) == SIGQUIT)){
+      cerr << "ERROR: " << params.impute2 << " was interrupted" << endl;
+      exit(1);
+    }
+    if(status != -1 && WIFEXITED(status) && WEXITSTATUS(status) == 0){
+      FILE * stream = fopen((chunk.dir + "/done").c_str(), "w");
+      if(stream == NULL || fclose(stream) != 0){
+	cerr << "ERROR: can't create file " << chunk.dir << "/done" << endl;
+	exit(1);
+      }
+      return true;
+    }
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+    cerr << "warning: " << params.impute2 << " failed on "
+	 << chunk.chrName << " chunk " << chunk.id
+	 << " (attempt " << attempt + 1 << "), see " << chunk.dir
+	 << "/log.txt" << endl;
+  }
+  return false;
+}
+
+void
+openChrMerger(
+  const string & chrName,
+  ChrMerger & merger)
+{
+  string outFile = chrName + "_chunkAll.impute2.gz";
+  merger.chrName = chrName;
+  merger.nbMerged = 0;
+  merger.merging = false;
+  openBlockWriter(merger.bw, outFile);
+  merger.idxStream = fopen((outFile + ".idx").c_str(), "w");
+  if(merger.idxStream == NULL){
+    cerr << "ERROR: can't open file " << outFile << ".idx to write" << endl;
+    exit(1);
+  }
+  fprintf(merger.idxStream, "chunk\tstart\tend\tnb.snps\toffset\tsize\n");
+}
+
+/** \brief Claim the merge of the next chunk of a chromosome if it is done,
+ *  and release the merger otherwise.
+ *  \note To be called in a critical section, by the job holding the merger
+ *  or when no job holds it.
+ */
+bool
+claimNextChunk(
+  const vector<Chunk> & chunks,
+  ChrMerger & merger)
+{
+  merger.merging = merger.nbMerged < merger.chunks.size()
+    && chunks[merger.chunks[merger.nbMerged]].status == 1;
+  return merger.merging;
+}
+
+/** \brief Append a chunk to the output of its chromosome.
+ *  \note Called outside any critical section by the job holding the merger,
+ *  so that the other jobs can go on with their next chunks meanwhile.
+ */
+void
+mergeChunk(
+  const ImputeParams & params,
+  const Chunk & chunk,
+  ChrMerger & merger)
+{
+  string chunkFile = chunk.dir + "/chunk.impute2";
+  if(! doesFileExist(chunkFile)){
+    cerr << "ERROR: chunk output '" << chunkFile << "' is missing" << endl;
+    exit(1);
+  }
+
+  // a chunk starts a new gzip member, hence its offset in the index
+  long offset = ftell(merger.bw.stream);
+  size_t nbSnps = 0;
+  BlockReader br;
+  openBlockReader(br, chunkFile);
+  StringView line;
+  while(getline(br, line)){
+    bwrite(merger.bw, line.data, line.size);
+    bwrite(merger.bw, "\n", 1);
+    ++nbSnps;
+  }
+  closeBlockReader(br);
+  flushBlockWriter(merger.bw);
+  fprintf(merger.idxStream, "%lu\t%lu\t%lu\t%lu\t%ld\t%ld\n",
+	  (unsigned long) chunk.id, (unsigned long) chunk.start,
+	  (unsigned long) chunk.end, (unsigned long) nbSnps, offset,
+	  ftell(merger.bw.stream) - offset);
+  if(params.clean)
+    removeDir(chunk.dir);
+}
+
+/** \brief Close the output of a chromosome once all its chunks are merged.
+ */
+void
+closeChrMerger(
+  const ImputeParams & params,
+  ChrMerger & merger)
+{
+  closeBlockWriter(merger.bw);
+  fclose(merger.idxStream);
+  merger.idxStream = NULL;
+  const string & chrName = merger.chrName;
+  if(params.clean)
+    removeDir(chrName + "_chunks");
+  if(params.verbose > 0){
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+    cout << "chunks of '" << chrName << "' merged into '" << chrName
+	 << "_chunkAll.impute2.gz'" << endl << flush;
+  }
+}
+
+void run(const ImputeParams & params)
+{
+  string templateGmapFile = getTemplateGmapFile(params);
+
+  vector<string> chrNames = params.chrNames;
+  vector<Chunk> chunks;
+  if(params.planFile.empty())
+    for(size_t chr = 0; chr < chrNames.size(); ++chr)
+      addChunksOfChr(params, chrNames[chr], chr, chunks);
+  else
+    loadPlannedChunks(params, chrNames, chunks);
+
+  vector<ChrMerger> mergers(chrNames.size());
+  for(size_t c = 0; c < chunks.size(); ++c)
+    mergers[chunks[c].chr].chunks.push_back(c);
+  for(size_t chr = 0; chr < chrNames.size(); ++chr){
+    const vector<size_t> & chrChunks = mergers[chr].chunks;
+    if(chrChunks.empty()){
+      cerr << "ERROR: no chunk for " << chrNames[chr] << " in file "
+	   << params.planFile << endl;
+      exit(1);
+    }
+    if(! doesFileExist(chrNames[chr] + "_chunks"))
+      createDirectory(chrNames[chr] + "_chunks");
+    if(params.verbose > 0)
+      cout << "impute '" << chrNames[chr] << "' ("
+	   << chunks[chrChunks[0]].start << "->"
+	   << chunks[chrChunks.back()].end << ", " << chrChunks.size()
+	   << " chunks)" << endl;
+    openChrMerger(chrNames[chr], mergers[chr]);
+  }
+  if(params.verbose > 0)
+    cout << "launch " << chunks.size() << " chunks (jobs="
+	 << params.nbJobs << ", retries=" << params.nbRetries << ") ..."
+	 << endl << flush;
+
+  // a job takes the next pending chunk whatever its chromosome, so that
+  // no job is idle until the very last chunks
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(params.nbJobs) schedule(dynamic, 1)
+#endif
+  for(long c = 0; c < (long) chunks.size(); ++c){
+    time_t startRawTime, endRawTime;
+    time(&startRawTime);
+    bool success = imputeChunk(params, templateGmapFile, chunks[c]);
+    time(&endRawTime);
+    ChrMerger & merger = mergers[chunks[c].chr];
+    bool merge = false;
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+    {
+      chunks[c].status = success ? 1 : -1;
+      if(params.verbose > 0)
+	cout << chunks[c].chrName << " chunk " << chunks[c].id
+	     << " (" << chunks[c].start << "->" << chunks[c].end << ") "
+	     << (success ? "done" : "failed") << " ("
+	     << getElapsedTime(startRawTime, endRawTime) << ")" << endl
+	     << flush;
+      merge = ! merger.merging && claimNextChunk(chunks, merger);
+    }
+
+    // only the claim is serialized, the copy of the chunks being done
+    // outside the lock while the other jobs keep imputing
+    while(merge){
+      mergeChunk(params, chunks[merger.chunks[merger.nbMerged]], merger);
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+      {
+	++merger.nbMerged;
+	merge = claimNextChunk(chunks, merger);
+      }
+      if(! merge && merger.nbMerged == merger.chunks.size())
+	closeChrMerger(params, merger);
+    }
+  }
+
+  size_t nbFailed = 0;
+  for(size_t chr = 0; chr < mergers.size(); ++chr){
+    if(mergers[chr].idxStream == NULL)
+      continue;
+    // incomplete output, removed so that it is not mistaken for a full one
+    string outFile = chrNames[chr] + "_chunkAll.impute2.gz";
+    closeBlockWriter(mergers[chr].bw);
+    fclose(mergers[chr].idxStream);
+    remove(outFile.c_str());
+    remove((outFile + ".idx").c_str());
+    for(size_t i = 0; i < mergers[chr].chunks.size(); ++i)
+      if(chunks[mergers[chr].chunks[i]].status == -1){
+	cerr << "ERROR: chunk " << chunks[mergers[chr].chunks[i]].dir
+	     << " failed" << endl;
+	++nbFailed;
+      }
+  }
+  if(nbFailed > 0){
+    cerr << "ERROR: " << nbFailed << " chunk(s) failed, relaunch to impute"
+	 << " only these" << endl;
+    exit(1);
+  }
+}
+
+int main(int argc, char ** argv)
+{
+  ImputeParams params;
+  params.studyDir = ".";
+  params.fixStrand = false;
+  params.Ne = 20000;
+  params.chunkLength = 5000000;
+  params.buffer = 250;
+  params.force = false;
+  params.clean = false;
+  params.impute2 = "impute2";
+  params.nbJobs = 1;
+  params.nbRetries = 2;
+  params.verbose = 1;
+
+  parseCmdLine(argc, argv, params);
+
+  time_t startRawTime, endRawTime;
+  if(params.verbose > 0){
+    time(&startRawTime);
+    cout << "START " << basename(argv[0])
+         << " " << getDateTime(startRawTime) << endl
+         << "version " << VERSION << " compiled " << __DATE__
+         << " " << __TIME__ << endl
+         << "cmd-line: " << getCmdLine(argc, argv) << endl
+         << "cwd: " << getCurrentDirectory() << endl;
+    cout << flush;
+  }
+
+  run(params);
+
+  if(params.verbose > 0){
+    time(&endRawTime);
+    cout << "END " << basename(argv[0])
+         << " " << getDateTime(endRawTime) << endl
+         << "elapsed -> " << getElapsedTime(startRawTime, endRawTime) << endl
+         << "max.mem -> " << getMaxMemUsedByProcess2Str() << endl;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,560 @@
+/** \file plan_impute_chunks.cpp
+ *
+ *  `plan_impute_chunks' cuts chromosomes into chunks of balanced cost for
+ *  IMPUTE2.
+ *  Copyright (C) 2011-2014 Timothée Flutre
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Compile with: g++ -Wall -O3 -fopenmp -I.. utils_io.cpp utils_geno.cpp plan_impute_chunks.cpp -lz -o plan_impute_chunks
+ */
+
+#include <cmath>
+#include <ctime>
+#include <cstring>
+#include <cstdio>
+#include <getopt.h>
+#include <libgen.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+using namespace std;
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "utils_io.hpp"
+#include "utils_geno.hpp"
+using namespace utils;
+
+#ifndef VERSION
+#define VERSION "1.0.0" // http://semver.org/
+#endif
+
+// relative increase of the smallest maximum cost allowed when balancing
+// the numbers of SNPs per chunk
+#define COST_TOLERANCE 0.02
+
+struct PlanParams
+{
+  vector<string> inSnpAnnots;
+  string inCoordsFile;
+  string outCoordsFile;
+  string outPrefix;
+  size_t nbSnpsPerChunk;
+  size_t flank; // in bp
+  double costPerKb;
+  size_t maxLength;
+  int nbThreads;
+  int verbose;
+};
+
+/** \brief A chunk covers the SNPs first to last-1 of its chromosome.
+ */
+struct PlannedChunk
+{
+  size_t first;
+  size_t last;
+  size_t nbSnpsWithFlanks;
+  double cost;
+};
+
+/** \brief Display the help on stdout.
+ *  \note The format complies with help2man (http://www.gnu.org/s/help2man)
+ */
+void help(char ** argv)
+{
+  cout << "`" << argv[0] << "'"
+       << " cuts chromosomes into chunks of balanced cost for IMPUTE2." << endl
+       << endl
+       << "Usage: " << argv[0] << " [OPTIONS] ..." << endl
+       << endl
+       << "Options:" << endl
+       << "  -h, --help\tdisplay the help and exit" << endl
+       << "  -V, --version\toutput version information and exit" << endl
+       << "  -v, --verbose\tverbosity level (0/default=1/2/3)" << endl
+       << "      --isa\tpath(s) to <prefix>_snpAnnot.txt files from impute2bimbam" << endl
+       << "\t\t(can be gzipped), separated by a comma" << endl
+       << "      --ibin\tpath to a binary coordinate file, instead of --isa" << endl
+       << "      --obin\tpath to a binary coordinate file to write, for later runs" << endl
+       << "      --op\tprefix for the output file <op>_chunks.txt" << endl
+       << "      --snps\ttarget number of SNPs per chunk (default=2000)" << endl
+       << "      --flank\tbuffer on each side of a chunk, in kb (default=250)" << endl
+       << "\t\tas given to IMPUTE2 via '-buffer'" << endl
+       << "      --wkb\tcost of one kb of a chunk with its flanks, in SNPs (default=0)" << endl
+       << "      --maxlen\tmaximum chunk length, in bp (default=0, no maximum)" << endl
+       << "  -t, --threads\tnumber of threads (default=1)" << endl
+       << endl
+       << "Remarks:" << endl
+       << "  The cost of a chunk is the number of SNPs within it and its flanks, plus" << endl
+       << "  --wkb times its length with flanks in kb. Each chromosome of n SNPs is cut" << endl
+       << "  into ceil(n / --snps) consecutive chunks, the maximum cost being minimized" << endl
+       << "  by bisection, so that SNP-dense regions get shorter chunks. Chunks longer" << endl
+       << "  than --maxlen are then split, and the costs balanced again. Last, the" << endl
+       << "  maximum number of SNPs per chunk is minimized, the cost being allowed to" << endl
+       << "  exceed its minimum by 2%, as otherwise a region whose flanks alone cost" << endl
+       << "  nearly the maximum (eg. denser over less than 2 x --flank) gets chunks of" << endl
+       << "  a few SNPs, and the other regions chunks of many more than --snps." << endl
+       << "  Chunks start at a SNP and end right before the first SNP of the next one," << endl
+       << "  the last one ending at the last SNP, so that they tile the chromosome." << endl
+       << "  The output file has one line per chunk with columns 'chr', 'chunk'," << endl
+       << "  'start', 'end', 'nb.snps', 'nb.snps.flanks' and 'cost', and can be given" << endl
+       << "  to launch_impute via --plan." << endl
+       << "  Redundant coordinates are counted once." << endl
+       << endl
+       << "Examples:" << endl
+       << "  " << argv[0] << " --isa study_snpAnnot.txt.gz --obin study.coords --op study" << endl
+       << "  " << argv[0] << " --ibin study.coords --snps 5000 --op study" << endl
+       << endl
+       << "Report bugs to <timothee.flutre@supagro.inra.fr>." << endl
+    ;
+}
+
+/** \brief Display version and license information on stdout.
+ */
+void version(char ** argv)
+{
+  cout << argv[0] << " " << VERSION << endl
+       << endl
+       << "Copyright (C) 2011-2014 Timothée Flutre." << endl
+       << "License GPLv3+: GNU GPL version 3 or later <http://gnu.org/licenses/gpl.html>" << endl
+       << "This is free software; see the source for copying conditions.  There is NO" << endl
+       << "warranty; not even for MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE." << endl
+       << endl
+       << "Written by Timothée Flutre." << endl
+    ;
+}
+
+/** \brief Parse the command-line arguments and check the values of the
+ *  compulsory ones.
+ */
+void
+parseCmdLine(
+  int argc,
+  char ** argv,
+  PlanParams & params)
+{
+  int c = 0;
+  while(true)
+  {
+    static struct option long_options[] =
+    {
+      {"help", no_argument, 0, 'h'},
+      {"version", no_argument, 0, 'V'},
+      {"verbose", required_argument, 0, 'v'},
+      {"isa", required_argument, 0, 0},
+      {"ibin", required_argument, 0, 0},
+      {"obin", required_argument, 0, 0},
+      {"op", required_argument, 0, 0},
+      {"snps", required_argument, 0, 0},
+      {"flank", required_argument, 0, 0},
+      {"wkb", required_argument, 0, 0},
+      {"maxlen", required_argument, 0, 0},
+      {"threads", required_argument, 0, 't'},
+      {0, 0, 0, 0}
+    };
+    int option_index = 0;
+    c = getopt_long(argc, argv, "hVv:t:",
+                    long_options, &option_index);
+    if(c == -1)
+      break;
+    switch(c)
+    {
+    case 0:
+      if(long_options[option_index].flag != 0)
+        break;
+      if(strcmp(long_options[option_index].name, "isa") == 0)
+        split(optarg, ',', params.inSnpAnnots);
+      else if(strcmp(long_options[option_index].name, "ibin") == 0)
+        params.inCoordsFile = optarg;
+      else if(strcmp(long_options[option_index].name, "obin") == 0)
+        params.outCoordsFile = optarg;
+      else if(strcmp(long_options[option_index].name, "op") == 0)
+        params.outPrefix = optarg;
+      else if(strcmp(long_options[option_index].name, "snps") == 0)
+        params.nbSnpsPerChunk = atol(optarg);
+      else if(strcmp(long_options[option_index].name, "flank") == 0)
+        params.flank = 1000 * atol(optarg);
+      else if(strcmp(long_options[option_index].name, "wkb") == 0)
+        params.costPerKb = atof(optarg);
+      else if(strcmp(long_options[option_index].name, "maxlen") == 0)
+        params.maxLength = atol(optarg);
+      break;
+    case 'h':
+      help(argv);
+      exit(0);
+    case 'V':
+      version(argv);
+      exit(0);
+    case 'v':
+      params.verbose = atoi(optarg);
+      break;
+    case 't':
+      params.nbThreads = atoi(optarg);
+      break;
+    case '?':
+      printf("\n"); help(argv);
+      abort();
+    default:
+      printf("\n"); help(argv);
+      abort();
+    }
+  }
+
+  string error;
+  if(params.inSnpAnnots.empty() && params.inCoordsFile.empty())
+    error = "missing compulsory option --isa or --ibin";
+  else if(! params.inSnpAnnots.empty() && ! params.inCoordsFile.empty())
+    error = "options --isa and --ibin are exclusive";
+  else if(! params.inCoordsFile.empty()
+	  && ! doesFileExist(params.inCoordsFile))
+    error = "can't find file " + params.inCoordsFile;
+  else if(params.outPrefix.empty() && params.outCoordsFile.empty())
+    error = "missing compulsory option --op";
+  else if(params.nbSnpsPerChunk == 0)
+    error = "--snps should be positive";
+  else if(params.costPerKb < 0)
+    error = "--wkb should be non-negative";
+  for(size_t i = 0; error.empty() && i < params.inSnpAnnots.size(); ++i)
+    if(! doesFileExist(params.inSnpAnnots[i]))
+      error = "can't find file " + params.inSnpAnnots[i];
+  if(! error.empty()){
+    cerr << "cmd-line: " << getCmdLine(argc, argv) << endl << endl
+	 << "ERROR: " << error << endl << endl;
+    help(argv);
+    exit(1);
+  }
+  if(params.nbThreads < 1)
+    params.nbThreads = 1;
+}
+
+/** \brief Load the SNP coordinates ("id coord chr" per line), the
+ *  chromosomes keeping their order of appearance.
+ */
+void
+loadSnpAnnots(
+  const vector<string> & paths,
+  SnpCoords & sc)
+{
+  map<string, size_t> chr2idx;
+  map<string, size_t>::iterator it;
+  vector<StringView> tokens;
+  StringView line;
+  size_t coord, chr = 0;
+  string chrName;
+  for(size_t p = 0; p < paths.size(); ++p){
+    BlockReader br;
+    openBlockReader(br, paths[p]);
+    while(getline(br, line)){
+      if(tokenize(line, " \t", tokens) < 3 || ! parseUnsigned(tokens[1], coord)
+	 || coord > 4294967295UL){
+	cerr << "ERROR: line " << br.nbLines << " of file " << paths[p]
+	     << " should be as <id> <coord> <chr>" << endl;
+	exit(1);
+      }
+      if(chrName.size() != tokens[2].size
+	 || chrName.compare(0, chrName.size(), tokens[2].data,
+			    tokens[2].size) != 0){
+	chrName = toString(tokens[2]);
+	it = chr2idx.find(chrName);
+	if(it == chr2idx.end()){
+	  chr = sc.chrNames.size();
+	  chr2idx[chrName] = chr;
+	  sc.chrNames.push_back(chrName);
+	  sc.coords.push_back(vector<uint32_t>());
+	}
+	else
+	  chr = it->second;
+      }
+      sc.coords[chr].push_back(coord);
+    }
+    closeBlockReader(br);
+  }
+  for(chr = 0; chr < sc.coords.size(); ++chr){
+    vector<uint32_t> & coords = sc.coords[chr];
+    sort(coords.begin(), coords.end());
+    coords.erase(unique(coords.begin(), coords.end()), coords.end());
+  }
+}
+
+/** \brief Cost of the chunk made of SNPs first to last-1, lo[first] being
+ *  the first SNP of its left flank and hi[last-1] the end of its right one.
+ */
+static inline double
+getChunkCost(
+  const PlanParams & params,
+  const vector<uint32_t> & coords,
+  const vector<size_t> & lo,
+  const vector<size_t> & hi,
+  const size_t first,
+  const size_t last)
+{
+  return (hi[last-1] - lo[first])
+    + params.costPerKb * (coords[last-1] - coords[first] + 2 * params.flank)
+    / 1000.0;
+}
+
+/** \brief Make the longest chunks whose cost is at most maxCost, whose
+ *  length is below maxLength and with at most maxSnps SNPs, if not 0 (each
+ *  having at least one SNP), and return their number.
+ */
+size_t
+makeChunks(
+  const PlanParams & params,
+  const vector<uint32_t> & coords,
+  const vector<size_t> & lo,
+  const vector<size_t> & hi,
+  const double maxCost,
+  const size_t maxLength,
+  const size_t maxSnps,
+  vector<PlannedChunk> * chunks)
+{
+  size_t nbChunks = 0, first = 0, last;
+  while(first < coords.size()){
+    last = first + 1;
+    while(last < coords.size()
+	  && getChunkCost(params, coords, lo, hi, first, last + 1) <= maxCost
+	  && (maxLength == 0 || coords[last] - coords[first] < maxLength)
+	  && (maxSnps == 0 || last - first < maxSnps))
+      ++last;
+    if(chunks != NULL){
+      PlannedChunk chunk;
+      chunk.first = first;
+      chunk.last = last;
+      chunk.nbSnpsWithFlanks = hi[last-1] - lo[first];
+      chunk.cost = getChunkCost(params, coords, lo, hi, first, last);
+      chunks->push_back(chunk);
+    }
+    ++nbChunks;
+    first = last;
+  }
+  return nbChunks;
+}
+
+/** \brief Return the smallest maximum cost (up to 0.5) with which
+ *  makeChunks() gives at most nbChunks chunks.
+ *  \note The cost of a chunk only grows when a SNP is added to it, hence
+ *  the greedy packing and the bisection on its bound.
+ */
+double
+getMinMaxCost(
+  const PlanParams & params,
+  const vector<uint32_t> & coords,
+  const vector<size_t> & lo,
+  const vector<size_t> & hi,
+  const size_t nbChunks,
+  const size_t maxLength)
+{
+  double minCost = 0,
+    maxCost = getChunkCost(params, coords, lo, hi, 0, coords.size());
+  while(maxCost - minCost > 0.5){
+    double cost = (minCost + maxCost) / 2;
+    if(makeChunks(params, coords, lo, hi, cost, maxLength, 0, NULL)
+       <= nbChunks)
+      maxCost = cost;
+    else
+      minCost = cost;
+  }
+  return maxCost;
+}
+
+/** \brief Return the smallest maximum number of SNPs per chunk with which
+ *  makeChunks() still gives at most nbChunks chunks of cost at most maxCost.
+ *  \note In a region denser than the rest, the flanks alone cost nearly the
+ *  maximum, so that the plan minimizing it only is degenerate: chunks of a
+ *  few SNPs there, and chunks of many more than --snps elsewhere. Among the
+ *  plans with this maximum cost, this balances the numbers of SNPs.
+ */
+size_t
+getMinMaxSnps(
+  const PlanParams & params,
+  const vector<uint32_t> & coords,
+  const vector<size_t> & lo,
+  const vector<size_t> & hi,
+  const size_t nbChunks,
+  const double maxCost,
+  const size_t maxLength)
+{
+  size_t minSnps = (coords.size() + nbChunks - 1) / nbChunks - 1,
+    maxSnps = coords.size();
+  while(maxSnps - minSnps > 1){
+    size_t nbSnps = (minSnps + maxSnps) / 2;
+    if(makeChunks(params, coords, lo, hi, maxCost, maxLength, nbSnps, NULL)
+       <= nbChunks)
+      maxSnps = nbSnps;
+    else
+      minSnps = nbSnps;
+  }
+  return maxSnps;
+}
+
+/** \brief Cut a chromosome into ceil(n / --snps) chunks with the smallest
+ *  maximum cost, then split those longer than --maxlen and balance again
+ *  with this number of chunks, and finally balance their numbers of SNPs
+ *  within COST_TOLERANCE of this cost.
+ */
+void
+planChunksOfChr(
+  const PlanParams & params,
+  const vector<uint32_t> & coords,
+  vector<PlannedChunk> & chunks)
+{
+  size_t n = coords.size();
+  chunks.clear();
+  if(n == 0)
+    return;
+
+  // lo[i]: first SNP at most flank bp before SNP i
+  // hi[i]: one past the last SNP at most flank bp after SNP i
+  vector<size_t> lo(n), hi(n);
+  for(size_t i = 0, k = 0; i < n; ++i){
+    while(coords[k] + params.flank < coords[i])
+      ++k;
+    lo[i] = k;
+  }
+  for(size_t i = 0, k = 0; i < n; ++i){
+    while(k < n && coords[k] <= (size_t) coords[i] + params.flank)
+      ++k;
+    hi[i] = k;
+  }
+
+  size_t nbChunks = (n + params.nbSnpsPerChunk - 1) / params.nbSnpsPerChunk;
+  double maxCost = getMinMaxCost(params, coords, lo, hi, nbChunks, 0);
+  if(params.maxLength > 0){
+    nbChunks = makeChunks(params, coords, lo, hi, maxCost, params.maxLength,
+			  0, NULL);
+    maxCost = getMinMaxCost(params, coords, lo, hi, nbChunks,
+			    params.maxLength);
+  }
+  maxCost *= 1 + COST_TOLERANCE;
+  size_t maxSnps = getMinMaxSnps(params, coords, lo, hi, nbChunks, maxCost,
+				 params.maxLength);
+  makeChunks(params, coords, lo, hi, maxCost, params.maxLength, maxSnps,
+	     &chunks);
+}
+
+void
+writeChunks(
+  const string & path,
+  const SnpCoords & sc,
+  const vector<vector<PlannedChunk> > & chunks)
+{
+  BlockWriter bw;
+  openBlockWriter(bw, path);
+  bwrite(bw, "chr\tchunk\tstart\tend\tnb.snps\tnb.snps.flanks\tcost\n");
+  char buf[256];
+  for(size_t chr = 0; chr < chunks.size(); ++chr){
+    const vector<uint32_t> & coords = sc.coords[chr];
+    for(size_t c = 0; c < chunks[chr].size(); ++c){
+      const PlannedChunk & chunk = chunks[chr][c];
+      size_t end = chunk.last < coords.size() ?
+	coords[chunk.last] - 1 : coords.back();
+      int n = snprintf(buf, sizeof(buf), "\t%lu\t%lu\t%lu\t%lu\t%lu\t%.1f\n",
+		       (unsigned long) c + 1,
+		       (unsigned long) coords[chunk.first],
+		       (unsigned long) end,
+		       (unsigned long) (chunk.last - chunk.first),
+		       (unsigned long) chunk.nbSnpsWithFlanks, chunk.cost);
+      bwrite(bw, sc.chrNames[chr]);
+      bwrite(bw, buf, n);
+    }
+  }
+  closeBlockWriter(bw);
+}
+
+void run(const PlanParams & params)
+{
+  SnpCoords sc;
+  if(params.verbose > 0)
+    cout << "load coordinates ..." << endl << flush;
+  if(! params.inCoordsFile.empty())
+    loadSnpCoordsFile(params.inCoordsFile, sc);
+  else
+    loadSnpAnnots(params.inSnpAnnots, sc);
+  if(params.verbose > 0)
+    cout << "nb of chromosomes: " << sc.chrNames.size() << endl
+	 << "nb of SNPs: " << getNbSnps(sc) << endl << flush;
+  if(! params.outCoordsFile.empty())
+    writeSnpCoordsFile(params.outCoordsFile, sc);
+  if(params.outPrefix.empty())
+    return;
+
+  if(params.verbose > 0)
+    cout << "plan chunks (threads=" << params.nbThreads << ") ..." << endl
+	 << flush;
+  vector<vector<PlannedChunk> > chunks(sc.chrNames.size());
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(params.nbThreads) schedule(dynamic)
+#endif
+  for(long chr = 0; chr < (long) sc.chrNames.size(); ++chr)
+    planChunksOfChr(params, sc.coords[chr], chunks[chr]);
+
+  writeChunks(params.outPrefix + "_chunks.txt", sc, chunks);
+
+  if(params.verbose > 0){
+    size_t nbChunks = 0;
+    double sumCost = 0, maxCost = 0;
+    for(size_t chr = 0; chr < chunks.size(); ++chr)
+      for(size_t c = 0; c < chunks[chr].size(); ++c){
+	++nbChunks;
+	sumCost += chunks[chr][c].cost;
+	maxCost = max(maxCost, chunks[chr][c].cost);
+      }
+    cout << "nb of chunks: " << nbChunks << endl;
+    if(nbChunks > 0)
+      cout << "cost: mean=" << sumCost / nbChunks << " max=" << maxCost
+	   << endl;
+  }
+}
+
+int main(int argc, char ** argv)
+{
+  PlanParams params;
+  params.nbSnpsPerChunk = 2000;
+  params.flank = 250000;
+  params.costPerKb = 0;
+  params.maxLength = 0;
+  params.nbThreads = 1;
+  params.verbose = 1;
+
+  parseCmdLine(argc, argv, params);
+
+  time_t startRawTime, endRawTime;
+  if(params.verbose > 0){
+    time(&startRawTime);
+    cout << "START " << basename(argv[0])
+         << " " << getDateTime(startRawTime) << endl
+         << "version " << VERSION << " compiled " << __DATE__
+         << " " << __TIME__ << endl
+         << "cmd-line: " << getCmdLine(argc, argv) << endl
+         << "cwd: " << getCurrentDirectory() << endl;
+    cout << flush;
+  }
+
+  run(params);
+
+  if(params.verbose > 0){
+    time(&endRawTime);
+    cout << "END " << basename(argv[0])
+         << " " << getDateTime(endRawTime) << endl
+         << "elapsed -> " << getElapsedTime(startRawTime, endRawTime) << endl
+         << "max.mem -> " << getMaxMemUsedByProcess2Str() << endl;
+  }
+
+  return EXIT_SUCCESS;
+}
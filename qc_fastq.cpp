@@ -0,0 +1,292 @@
+/** \file qc_fastq.cpp
+ *
+ *  `qc_fastq' computes quality control statistics of reads in fastq files.
+ *  Copyright (C) 2011-2014 Timothée Flutre
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Compile with: g++ -Wall -O3 -fopenmp -I.. utils_io.cpp qc_fastq.cpp -lz -o qc_fastq
+ */
+
+#include <cmath>
+#include <ctime>
+#include <cstring>
+#include <cstdio>
+#include <getopt.h>
+#include <libgen.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+using namespace std;
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "utils_io.hpp"
+using namespace utils;
+
+#ifndef VERSION
+#define VERSION "1.0.0" // http://semver.org/
+#endif
+
+struct QcParams
+{
+  string inDir;
+  string inFq1;
+  string inFq2;
+  string outPrefix;
+  size_t batchSize;
+  int nbThreads;
+  int verbose;
+};
+
+/** \brief Display the help on stdout.
+ *  \note The format complies with help2man (http://www.gnu.org/s/help2man)
+ */
+void help(char ** argv)
+{
+  cout << "`" << argv[0] << "'"
+       << " computes quality control statistics of reads in fastq files." << endl
+       << endl
+       << "Usage: " << argv[0] << " [OPTIONS] ..." << endl
+       << endl
+       << "Options:" << endl
+       << "  -h, --help\tdisplay the help and exit" << endl
+       << "  -V, --version\toutput version information and exit" << endl
+       << "  -v, --verbose\tverbosity level (0/default=1/2/3)" << endl
+       << "      --idir\tpath to the input directory with the fastq files (default=.)" << endl
+       << "      --ifq1\tpath to the first input fastq file (can be gzipped)" << endl
+       << "      --ifq2\tpath to the second input fastq file, optional (can be gzipped)" << endl
+       << "\t\terror raised if reads not in same order as --ifq1" << endl
+       << "      --op\tprefix for the output files" << endl
+       << "\t\t<op>_R1_qc.txt (and R2)" << endl
+       << "      --batch\tmaximum number of reads (or pairs) processed at once (default=100000)" << endl
+       << "  -t, --threads\tnumber of threads (default=1)" << endl
+       << endl
+       << "Remarks:" << endl
+       << "  The files are read once, each batch of reads being split between threads." << endl
+       << "  The output files have the format of fastqc_data.txt from FastQC, with the" << endl
+       << "  modules 'Basic Statistics', 'Per base sequence quality', 'Per sequence" << endl
+       << "  quality scores', 'Per base sequence content', 'Per base N content'," << endl
+       << "  'Sequence Length Distribution' and 'Adapter Content', so that they can be" << endl
+       << "  loaded with read.fastqc.txt() from utils_fastqc.R." << endl
+       << "  The same statistics can be computed by demultiplex and trimfilter with --qc." << endl
+       << endl
+       << "Examples:" << endl
+       << "  " << argv[0] << " --ifq1 reads1.fastq.gz --ifq2 reads2.fastq.gz --op test -t 4" << endl
+       << endl
+       << "Report bugs to <timothee.flutre@supagro.inra.fr>." << endl
+    ;
+}
+
+/** \brief Display version and license information on stdout.
+ */
+void version(char ** argv)
+{
+  cout << argv[0] << " " << VERSION << endl
+       << endl
+       << "Copyright (C) 2011-2014 Timothée Flutre." << endl
+       << "License GPLv3+: GNU GPL version 3 or later <http://gnu.org/licenses/gpl.html>" << endl
+       << "This is free software; see the source for copying conditions.  There is NO" << endl
+       << "warranty; not even for MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE." << endl
+       << endl
+       << "Written by Timothée Flutre." << endl
+    ;
+}
+
+/** \brief Parse the command-line arguments and check the values of the
+ *  compulsory ones.
+ */
+void
+parseCmdLine(
+  int argc,
+  char ** argv,
+  QcParams & params)
+{
+  int c = 0;
+  while(true)
+  {
+    static struct option long_options[] =
+    {
+      {"help", no_argument, 0, 'h'},
+      {"version", no_argument, 0, 'V'},
+      {"verbose", required_argument, 0, 'v'},
+      {"idir", required_argument, 0, 0},
+      {"ifq1", required_argument, 0, 0},
+      {"ifq2", required_argument, 0, 0},
+      {"op", required_argument, 0, 0},
+      {"batch", required_argument, 0, 0},
+      {"threads", required_argument, 0, 't'},
+      {0, 0, 0, 0}
+    };
+    int option_index = 0;
+    c = getopt_long(argc, argv, "hVv:t:",
+                    long_options, &option_index);
+    if(c == -1)
+      break;
+    switch(c)
+    {
+    case 0:
+      if(long_options[option_index].flag != 0)
+        break;
+      if(strcmp(long_options[option_index].name, "idir") == 0)
+        params.inDir = optarg;
+      else if(strcmp(long_options[option_index].name, "ifq1") == 0)
+        params.inFq1 = optarg;
+      else if(strcmp(long_options[option_index].name, "ifq2") == 0)
+        params.inFq2 = optarg;
+      else if(strcmp(long_options[option_index].name, "op") == 0)
+        params.outPrefix = optarg;
+      else if(strcmp(long_options[option_index].name, "batch") == 0)
+        params.batchSize = atol(optarg);
+      break;
+    case 'h':
+      help(argv);
+      exit(0);
+    case 'V':
+      version(argv);
+      exit(0);
+    case 'v':
+      params.verbose = atoi(optarg);
+      break;
+    case 't':
+      params.nbThreads = atoi(optarg);
+      break;
+    case '?':
+      printf("\n"); help(argv);
+      abort();
+    default:
+      printf("\n"); help(argv);
+      abort();
+    }
+  }
+
+  string error;
+  if(params.inDir.empty() || ! isDirectory(params.inDir.c_str()))
+    error = "can't find directory " + params.inDir;
+  else if(params.inFq1.empty())
+    error = "missing compulsory option --ifq1";
+  else if(! doesFileExist(params.inDir + "/" + params.inFq1))
+    error = "can't find file " + params.inDir + "/" + params.inFq1;
+  else if(! params.inFq2.empty()
+	  && ! doesFileExist(params.inDir + "/" + params.inFq2))
+    error = "can't find file " + params.inDir + "/" + params.inFq2;
+  else if(params.outPrefix.empty())
+    error = "missing compulsory option --op";
+  if(! error.empty()){
+    cerr << "cmd-line: " << getCmdLine(argc, argv) << endl << endl
+	 << "ERROR: " << error << endl << endl;
+    help(argv);
+    exit(1);
+  }
+  if(params.batchSize == 0)
+    params.batchSize = 1;
+  if(params.nbThreads < 1)
+    params.nbThreads = 1;
+}
+
+void run(const QcParams & params)
+{
+  bool paired = ! params.inFq2.empty();
+  if(params.verbose > 0)
+    cout << "compute statistics of " << (paired ? "paired" : "single")
+	 << "-end reads (threads=" << params.nbThreads << ") ..." << endl
+	 << flush;
+
+  FastqReader fr1, fr2;
+  openFastqReader(fr1, params.inDir + "/" + params.inFq1);
+  if(paired)
+    openFastqReader(fr2, params.inDir + "/" + params.inFq2);
+
+  // each thread adds a slice of the batch to its own statistics
+  vector<FastqStats> stats1(params.nbThreads), stats2(params.nbThreads);
+  for(int s = 0; s < params.nbThreads; ++s){
+    initFastqStats(stats1[s]);
+    initFastqStats(stats2[s]);
+  }
+  vector<FastqRecord> reads1, reads2;
+  while(true){
+    size_t nbReads = paired ?
+      readFastqBatch(fr1, fr2, params.batchSize, reads1, reads2)
+      : readFastqBatch(fr1, params.batchSize, reads1);
+    if(nbReads == 0)
+      break;
+    size_t sliceSize = (nbReads + params.nbThreads - 1) / params.nbThreads;
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(params.nbThreads)
+#endif
+    for(int s = 0; s < params.nbThreads; ++s){
+      size_t last = min(nbReads, (s + 1) * sliceSize);
+      for(size_t r = s * sliceSize; r < last; ++r){
+	addToFastqStats(stats1[s], reads1[r]);
+	if(paired)
+	  addToFastqStats(stats2[s], reads2[r]);
+      }
+    }
+  }
+  closeFastqReader(fr1);
+  if(paired)
+    closeFastqReader(fr2);
+
+  for(int s = 1; s < params.nbThreads; ++s){
+    mergeFastqStats(stats1[0], stats1[s]);
+    mergeFastqStats(stats2[0], stats2[s]);
+  }
+  writeFastqStats(stats1[0], params.outPrefix + "_R1_qc.txt", params.inFq1);
+  if(paired)
+    writeFastqStats(stats2[0], params.outPrefix + "_R2_qc.txt",
+		    params.inFq2);
+
+  if(params.verbose > 0)
+    cout << "total nb of " << (paired ? "read pairs: " : "reads: ")
+	 << stats1[0].nbReads << endl;
+}
+
+int main(int argc, char ** argv)
+{
+  QcParams params;
+  params.inDir = ".";
+  params.batchSize = 100000;
+  params.nbThreads = 1;
+  params.verbose = 1;
+
+  parseCmdLine(argc, argv, params);
+
+  time_t startRawTime, endRawTime;
+  if(params.verbose > 0){
+    time(&startRawTime);
+    cout << "START " << basename(argv[0])
+         << " " << getDateTime(startRawTime) << endl
+         << "version " << VERSION << " compiled " << __DATE__
+         << " " << __TIME__ << endl
+         << "cmd-line: " << getCmdLine(argc, argv) << endl
+         << "cwd: " << getCurrentDirectory() << endl;
+    cout << flush;
+  }
+
+  run(params);
+
+  if(params.verbose > 0){
+    time(&endRawTime);
+    cout << "END " << basename(argv[0])
+         << " " << getDateTime(endRawTime) << endl
+         << "elapsed -> " << getElapsedTime(startRawTime, endRawTime) << endl
+         << "max.mem -> " << getMaxMemUsedByProcess2Str() << endl;
+  }
+
+  return EXIT_SUCCESS;
+}
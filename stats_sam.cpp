@@ -0,0 +1,643 @@
+/** \file stats_sam.cpp
+ *
+ *  `stats_sam' computes statistics of alignments in the SAM format.
+ *  Copyright (C) 2011-2014 Timothée Flutre
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Compile with: g++ -Wall -O3 -fopenmp -I.. utils_io.cpp stats_sam.cpp -lz -o stats_sam
+ */
+
+#include <cmath>
+#include <ctime>
+#include <cstring>
+#include <cstdio>
+#include <getopt.h>
+#include <libgen.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+using namespace std;
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "utils_io.hpp"
+using namespace utils;
+
+#ifndef VERSION
+#define VERSION "1.0.0" // http://semver.org/
+#endif
+
+// same threshold as samtools flagstat for mates on different references
+#define FLAGSTAT_MIN_MAPQ 5
+
+struct SamParams
+{
+  string inSam;
+  string outPrefix;
+  int maxEditDist;
+  bool filter;
+  size_t batchSize;
+  int nbThreads;
+  int verbose;
+};
+
+/** \brief Display the help on stdout.
+ *  \note The format complies with help2man (http://www.gnu.org/s/help2man)
+ */
+void help(char ** argv)
+{
+  cout << "`" << argv[0] << "'"
+       << " computes statistics of alignments in the SAM format." << endl
+       << endl
+       << "Usage: " << argv[0] << " [OPTIONS] ..." << endl
+       << endl
+       << "Options:" << endl
+       << "  -h, --help\tdisplay the help and exit" << endl
+       << "  -V, --version\toutput version information and exit" << endl
+       << "  -v, --verbose\tverbosity level (0/default=1/2/3)" << endl
+       << "      --isam\tpath to the input SAM file (can be gzipped)" << endl
+       << "\t\tdefault=- for stdin, e.g. after the aligner in a pipe" << endl
+       << "      --op\tprefix for the output files" << endl
+       << "\t\t<op>_flagstat.txt as 'samtools flagstat'" << endl
+       << "\t\t<op>_mapq.txt with the MAPQ histogram of primary alignments" << endl
+       << "\t\t<op>_refs.txt as 'samtools idxstats'" << endl
+       << "      --maxed\tmax edit distance (NM) of the reads kept by --filter (default=0)" << endl
+       << "      --filter\tsave the reads mapping uniquely and (almost) perfectly" << endl
+       << "\t\tin <op>.sam and <op>.bed.gz, as parse_sam.py" << endl
+       << "      --batch\tnumber of lines processed at once (default=100000)" << endl
+       << "  -t, --threads\tnumber of threads (default=1)" << endl
+       << endl
+       << "Remarks:" << endl
+       << "  The input is read once, by batches of lines which are parsed in parallel" << endl
+       << "  without copy, hence it can be piped from the aligner without any" << endl
+       << "  intermediate file." << endl
+       << "  A read maps uniquely if it has the tags XT:A:U, X0:i:1 and X1:i:0 (BWA)." << endl
+       << endl
+       << "Examples:" << endl
+       << "  " << argv[0] << " --isam aln.sam.gz --op test" << endl
+       << "  bwa samse ref.fa aln.sai reads.fq | " << argv[0] << " --op test --filter -t 4" << endl
+       << endl
+       << "Report bugs to <timothee.flutre@supagro.inra.fr>." << endl
+    ;
+}
+
+/** \brief Display version and license information on stdout.
+ */
+void version(char ** argv)
+{
+  cout << argv[0] << " " << VERSION << endl
+       << endl
+       << "Copyright (C) 2011-2014 Timothée Flutre." << endl
+       << "License GPLv3+: GNU GPL version 3 or later <http://gnu.org/licenses/gpl.html>" << endl
+       << "This is free software; see the source for copying conditions.  There is NO" << endl
+       << "warranty; not even for MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE." << endl
+       << endl
+       << "Written by Timothée Flutre." << endl
+    ;
+}
+
+/** \brief Parse the command-line arguments and check the values of the
+ *  compulsory ones.
+ */
+void
+parseCmdLine(
+  int argc,
+  char ** argv,
+  SamParams & params)
+{
+  int c = 0;
+  while(true)
+  {
+    static struct option long_options[] =
+    {
+      {"help", no_argument, 0, 'h'},
+      {"version", no_argument, 0, 'V'},
+      {"verbose", required_argument, 0, 'v'},
+      {"isam", required_argument, 0, 0},
+      {"op", required_argument, 0, 0},
+      {"maxed", required_argument, 0, 0},
+      {"filter", no_argument, 0, 0},
+      {"batch", required_argument, 0, 0},
+      {"threads", required_argument, 0, 't'},
+      {0, 0, 0, 0}
+    };
+    int option_index = 0;
+    c = getopt_long(argc, argv, "hVv:t:",
+                    long_options, &option_index);
+    if(c == -1)
+      break;
+    switch(c)
+    {
+    case 0:
+      if(long_options[option_index].flag != 0)
+        break;
+      if(strcmp(long_options[option_index].name, "isam") == 0)
+        params.inSam = optarg;
+      else if(strcmp(long_options[option_index].name, "op") == 0)
+        params.outPrefix = optarg;
+      else if(strcmp(long_options[option_index].name, "maxed") == 0)
+        params.maxEditDist = atoi(optarg);
+      else if(strcmp(long_options[option_index].name, "filter") == 0)
+        params.filter = true;
+      else if(strcmp(long_options[option_index].name, "batch") == 0)
+        params.batchSize = atol(optarg);
+      break;
+    case 'h':
+      help(argv);
+      exit(0);
+    case 'V':
+      version(argv);
+      exit(0);
+    case 'v':
+      params.verbose = atoi(optarg);
+      break;
+    case 't':
+      params.nbThreads = atoi(optarg);
+      break;
+    case '?':
+      printf("\n"); help(argv);
+      abort();
+    default:
+      printf("\n"); help(argv);
+      abort();
+    }
+  }
+
+  string error;
+  if(params.inSam.empty())
+    error = "missing compulsory option --isam";
+  else if(params.inSam != "-" && ! doesFileExist(params.inSam))
+    error = "can't find file " + params.inSam;
+  else if(params.outPrefix.empty())
+    error = "missing compulsory option --op";
+  if(! error.empty()){
+    cerr << "cmd-line: " << getCmdLine(argc, argv) << endl << endl
+	 << "ERROR: " << error << endl << endl;
+    help(argv);
+    exit(1);
+  }
+  if(params.maxEditDist < 0)
+    params.maxEditDist = 0;
+  if(params.batchSize == 0)
+    params.batchSize = 1;
+  if(params.nbThreads < 1)
+    params.nbThreads = 1;
+}
+
+// counts of samtools flagstat, each for QC-passed and QC-failed reads
+enum FlagstatCount {FS_TOTAL, FS_SECONDARY, FS_SUPPLEMENTARY, FS_DUPLICATES,
+		    FS_MAPPED, FS_PAIRED, FS_READ1, FS_READ2, FS_PROPER,
+		    FS_BOTH_MAPPED, FS_SINGLETONS, FS_DIFF_CHR,
+		    FS_DIFF_CHR_HIGH, NB_FS_COUNTS};
+
+struct RefCounts
+{
+  size_t mapped;
+  size_t unmapped;
+};
+
+struct SamStats
+{
+  size_t flagstat[NB_FS_COUNTS][2];
+  vector<size_t> mapqCounts;
+  vector<RefCounts> refCounts; // references of the header, then '*'
+  map<string, RefCounts> otherRefCounts; // references absent from it
+  size_t nbUniqueReads;
+  size_t nbPerfectReads;
+  size_t nbAlmostPerfectReads;
+  size_t nbSavedReads;
+  string sam; // reads saved by --filter
+  string bed;
+};
+
+void initSamStats(SamStats & st, const size_t nbRefs)
+{
+  memset(st.flagstat, 0, sizeof(st.flagstat));
+  st.mapqCounts.assign(256, 0);
+  RefCounts zero = {0, 0};
+  st.refCounts.assign(nbRefs + 1, zero);
+  st.otherRefCounts.clear();
+  st.nbUniqueReads = st.nbPerfectReads = st.nbAlmostPerfectReads
+    = st.nbSavedReads = 0;
+}
+
+/** \brief References from the @SQ lines of the header.
+ */
+struct References
+{
+  vector<string> names;
+  vector<size_t> lengths;
+  map<string, size_t> ids;
+};
+
+void addReference(References & refs, const StringView & line,
+		  vector<StringView> & tokens)
+{
+  tokenize(line, "\t", tokens);
+  string name;
+  size_t length = 0;
+  for(size_t i = 1; i < tokens.size(); ++i)
+    if(tokens[i].size > 3 && memcmp(tokens[i].data, "SN:", 3) == 0)
+      name.assign(tokens[i].data + 3, tokens[i].size - 3);
+    else if(tokens[i].size > 3 && memcmp(tokens[i].data, "LN:", 3) == 0){
+      StringView ln = tokens[i];
+      ln.data += 3;
+      ln.size -= 3;
+      parseUnsigned(ln, length);
+    }
+  if(! name.empty() && refs.ids.find(name) == refs.ids.end()){
+    refs.ids[name] = refs.names.size();
+    refs.names.push_back(name);
+    refs.lengths.push_back(length);
+  }
+}
+
+static inline bool isSameRef(const StringView & a, const StringView & b)
+{
+  return a.size == b.size && memcmp(a.data, b.data, a.size) == 0;
+}
+
+/** \brief Return the counts of a reference, the last one being cached as
+ *  alignments are often sorted.
+ */
+RefCounts & getRefCounts(SamStats & st, const References & refs,
+			 const StringView & rname, StringView & lastName,
+			 size_t & lastId)
+{
+  if(rname.size == 1 && rname.data[0] == '*')
+    return st.refCounts.back();
+  if(lastName.data == NULL || ! isSameRef(rname, lastName)){
+    map<string, size_t>::const_iterator it = refs.ids.find(toString(rname));
+    if(it == refs.ids.end()){
+      RefCounts zero = {0, 0};
+      pair<map<string, RefCounts>::iterator, bool> res =
+	st.otherRefCounts.insert(make_pair(toString(rname), zero));
+      return res.first->second;
+    }
+    lastName = rname;
+    lastId = it->second;
+  }
+  return st.refCounts[lastId];
+}
+
+/** \brief Return the integer value of an optional field such as "NM:i:2",
+ *  or -1 if absent.
+ */
+long getIntTag(const vector<StringView> & tokens, const char * tag)
+{
+  for(size_t i = 11; i < tokens.size(); ++i)
+    if(tokens[i].size > 5 && tokens[i].data[0] == tag[0]
+       && tokens[i].data[1] == tag[1] && tokens[i].data[2] == ':'){
+      StringView value = tokens[i];
+      value.data += 5;
+      value.size -= 5;
+      size_t x;
+      if(parseUnsigned(value, x))
+	return (long) x;
+    }
+  return -1;
+}
+
+char getCharTag(const vector<StringView> & tokens, const char * tag)
+{
+  for(size_t i = 11; i < tokens.size(); ++i)
+    if(tokens[i].size == 6 && tokens[i].data[0] == tag[0]
+       && tokens[i].data[1] == tag[1] && tokens[i].data[2] == ':')
+      return tokens[i].data[5];
+  return '\0';
+}
+
+/** \brief Add an alignment line to the statistics, as samtools flagstat
+ *  and idxstats, and save it if it complies with --filter.
+ */
+void addAlignment(SamStats & st, const References & refs,
+		  const SamParams & params, const StringView & line,
+		  const size_t lineId, vector<StringView> & tokens,
+		  StringView & lastName, size_t & lastId)
+{
+  size_t flag, pos, mapq;
+  if(tokenize(line, "\t", tokens) < 11
+     || ! parseUnsigned(tokens[1], flag)
+     || ! parseUnsigned(tokens[3], pos)
+     || ! parseUnsigned(tokens[4], mapq)){
+    cerr << "ERROR: line " << lineId << " of file " << params.inSam
+	 << " isn't a valid alignment" << endl;
+    exit(1);
+  }
+
+  // see bam_flagstat.c in samtools
+  size_t w = (flag & 0x200) ? 1 : 0;
+  bool mapped = ! (flag & 0x4), mateMapped = ! (flag & 0x8);
+  ++st.flagstat[FS_TOTAL][w];
+  if(flag & 0x100)
+    ++st.flagstat[FS_SECONDARY][w];
+  else if(flag & 0x800)
+    ++st.flagstat[FS_SUPPLEMENTARY][w];
+  else if(flag & 0x1){
+    ++st.flagstat[FS_PAIRED][w];
+    if((flag & 0x2) && mapped)
+      ++st.flagstat[FS_PROPER][w];
+    if(flag & 0x40)
+      ++st.flagstat[FS_READ1][w];
+    if(flag & 0x80)
+      ++st.flagstat[FS_READ2][w];
+    if(! mateMapped && mapped)
+      ++st.flagstat[FS_SINGLETONS][w];
+    if(mapped && mateMapped){
+      ++st.flagstat[FS_BOTH_MAPPED][w];
+      const StringView & rnext = tokens[6];
+      if(! (rnext.size == 1 && rnext.data[0] == '=')
+	 && ! isSameRef(rnext, tokens[2])){
+	++st.flagstat[FS_DIFF_CHR][w];
+	if(mapq >= FLAGSTAT_MIN_MAPQ)
+	  ++st.flagstat[FS_DIFF_CHR_HIGH][w];
+      }
+    }
+  }
+  if(mapped)
+    ++st.flagstat[FS_MAPPED][w];
+  if(flag & 0x400)
+    ++st.flagstat[FS_DUPLICATES][w];
+
+  if(mapped && ! (flag & 0x900))
+    ++st.mapqCounts[min(mapq, (size_t) 255)];
+  RefCounts & rc = getRefCounts(st, refs, tokens[2], lastName, lastId);
+  if(mapped)
+    ++rc.mapped;
+  else
+    ++rc.unmapped;
+
+  // reads mapping uniquely and (almost) perfectly, as parse_sam.py
+  if(! mapped)
+    return;
+  if(getCharTag(tokens, "XT") != 'U' || getIntTag(tokens, "X0") != 1
+     || getIntTag(tokens, "X1") != 0)
+    return;
+  ++st.nbUniqueReads;
+  long nm = getIntTag(tokens, "NM");
+  if(nm == 0)
+    ++st.nbPerfectReads;
+  else if(nm > 0 && nm <= params.maxEditDist)
+    ++st.nbAlmostPerfectReads;
+  else
+    return;
+  ++st.nbSavedReads;
+  if(params.filter){
+    st.sam.append(line.data, line.size);
+    st.sam += '\n';
+    char buf[64];
+    st.bed.append(tokens[2].data, tokens[2].size);
+    snprintf(buf, sizeof(buf), "\t%lu\t%lu\t", (unsigned long) pos - 1,
+	     (unsigned long) (pos - 1 + tokens[9].size));
+    st.bed += buf;
+    st.bed.append(tokens[0].data, tokens[0].size);
+    st.bed += (flag & 0x10) ? "\t1000\t-\n" : "\t1000\t+\n";
+  }
+}
+
+void mergeSamStats(SamStats & st, const SamStats & other)
+{
+  for(size_t i = 0; i < NB_FS_COUNTS; ++i)
+    for(size_t w = 0; w < 2; ++w)
+      st.flagstat[i][w] += other.flagstat[i][w];
+  for(size_t q = 0; q < st.mapqCounts.size(); ++q)
+    st.mapqCounts[q] += other.mapqCounts[q];
+  for(size_t r = 0; r < st.refCounts.size(); ++r){
+    st.refCounts[r].mapped += other.refCounts[r].mapped;
+    st.refCounts[r].unmapped += other.refCounts[r].unmapped;
+  }
+  for(map<string, RefCounts>::const_iterator it =
+	other.otherRefCounts.begin(); it != other.otherRefCounts.end(); ++it){
+    RefCounts zero = {0, 0};
+    RefCounts & rc = st.otherRefCounts.insert(make_pair(it->first,
+							zero)).first->second;
+    rc.mapped += it->second.mapped;
+    rc.unmapped += it->second.unmapped;
+  }
+  st.nbUniqueReads += other.nbUniqueReads;
+  st.nbPerfectReads += other.nbPerfectReads;
+  st.nbAlmostPerfectReads += other.nbAlmostPerfectReads;
+  st.nbSavedReads += other.nbSavedReads;
+}
+
+static string percent(const size_t n, const size_t total)
+{
+  if(total == 0)
+    return "N/A";
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%.2f%%", 100.0 * n / total);
+  return buf;
+}
+
+void saveStats(const SamParams & params, const References & refs,
+	       const SamStats & st)
+{
+  const size_t (* n)[2] = st.flagstat;
+  ostringstream oss;
+  oss << n[FS_TOTAL][0] << " + " << n[FS_TOTAL][1]
+      << " in total (QC-passed reads + QC-failed reads)" << endl
+      << n[FS_SECONDARY][0] << " + " << n[FS_SECONDARY][1]
+      << " secondary" << endl
+      << n[FS_SUPPLEMENTARY][0] << " + " << n[FS_SUPPLEMENTARY][1]
+      << " supplementary" << endl
+      << n[FS_DUPLICATES][0] << " + " << n[FS_DUPLICATES][1]
+      << " duplicates" << endl
+      << n[FS_MAPPED][0] << " + " << n[FS_MAPPED][1]
+      << " mapped (" << percent(n[FS_MAPPED][0], n[FS_TOTAL][0])
+      << " : " << percent(n[FS_MAPPED][1], n[FS_TOTAL][1]) << ")" << endl
+      << n[FS_PAIRED][0] << " + " << n[FS_PAIRED][1]
+      << " paired in sequencing" << endl
+      << n[FS_READ1][0] << " + " << n[FS_READ1][1] << " read1" << endl
+      << n[FS_READ2][0] << " + " << n[FS_READ2][1] << " read2" << endl
+      << n[FS_PROPER][0] << " + " << n[FS_PROPER][1]
+      << " properly paired (" << percent(n[FS_PROPER][0], n[FS_PAIRED][0])
+      << " : " << percent(n[FS_PROPER][1], n[FS_PAIRED][1]) << ")" << endl
+      << n[FS_BOTH_MAPPED][0] << " + " << n[FS_BOTH_MAPPED][1]
+      << " with itself and mate mapped" << endl
+      << n[FS_SINGLETONS][0] << " + " << n[FS_SINGLETONS][1]
+      << " singletons (" << percent(n[FS_SINGLETONS][0], n[FS_PAIRED][0])
+      << " : " << percent(n[FS_SINGLETONS][1], n[FS_PAIRED][1]) << ")"
+      << endl
+      << n[FS_DIFF_CHR][0] << " + " << n[FS_DIFF_CHR][1]
+      << " with mate mapped to a different chr" << endl
+      << n[FS_DIFF_CHR_HIGH][0] << " + " << n[FS_DIFF_CHR_HIGH][1]
+      << " with mate mapped to a different chr (mapQ>="
+      << FLAGSTAT_MIN_MAPQ << ")" << endl;
+  BlockWriter bw;
+  openBlockWriter(bw, params.outPrefix + "_flagstat.txt");
+  bwrite(bw, oss.str());
+  closeBlockWriter(bw);
+
+  oss.str("");
+  oss << "mapq\tcount" << endl;
+  for(size_t q = 0; q < st.mapqCounts.size(); ++q)
+    if(st.mapqCounts[q] > 0)
+      oss << q << "\t" << st.mapqCounts[q] << endl;
+  openBlockWriter(bw, params.outPrefix + "_mapq.txt");
+  bwrite(bw, oss.str());
+  closeBlockWriter(bw);
+
+  oss.str("");
+  for(size_t r = 0; r < refs.names.size(); ++r)
+    oss << refs.names[r] << "\t" << refs.lengths[r]
+	<< "\t" << st.refCounts[r].mapped
+	<< "\t" << st.refCounts[r].unmapped << endl;
+  for(map<string, RefCounts>::const_iterator it = st.otherRefCounts.begin();
+      it != st.otherRefCounts.end(); ++it)
+    oss << it->first << "\t0\t" << it->second.mapped
+	<< "\t" << it->second.unmapped << endl;
+  oss << "*\t0\t" << st.refCounts.back().mapped
+      << "\t" << st.refCounts.back().unmapped << endl;
+  openBlockWriter(bw, params.outPrefix + "_refs.txt");
+  bwrite(bw, oss.str());
+  closeBlockWriter(bw);
+}
+
+void run(const SamParams & params)
+{
+  if(params.verbose > 0)
+    cout << "compute statistics of alignments (threads="
+	 << params.nbThreads << ") ..." << endl << flush;
+
+  BlockReader br;
+  openBlockReader(br, params.inSam);
+  BlockWriter samWriter, bedWriter;
+  if(params.filter){
+    openBlockWriter(samWriter, params.outPrefix + ".sam");
+    openBlockWriter(bedWriter, params.outPrefix + ".bed.gz",
+		    params.nbThreads);
+  }
+
+  References refs;
+  vector<SamStats> stats(params.nbThreads);
+  vector<vector<StringView> > tokens(params.nbThreads);
+  vector<StringView> lines;
+  bool inHeader = true;
+  while(true){
+    size_t firstLineId = br.nbLines + 1;
+    size_t nbLines = readLineBatch(br, params.batchSize, lines);
+    if(nbLines == 0)
+      break;
+
+    // the header, with the references, is before the alignments
+    size_t first = 0;
+    for(; inHeader && first < nbLines; ++first){
+      if(lines[first].size > 0 && lines[first].data[0] != '@'){
+	inHeader = false;
+	for(int s = 0; s < params.nbThreads; ++s)
+	  initSamStats(stats[s], refs.names.size());
+	break;
+      }
+      if(lines[first].size > 3 && memcmp(lines[first].data, "@SQ", 3) == 0)
+	addReference(refs, lines[first], tokens[0]);
+    }
+    if(inHeader)
+      continue;
+
+    size_t sliceSize = (nbLines - first + params.nbThreads - 1)
+      / params.nbThreads;
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(params.nbThreads)
+#endif
+    for(int s = 0; s < params.nbThreads; ++s){
+      SamStats & st = stats[s];
+      st.sam.clear();
+      st.bed.clear();
+      StringView lastName;
+      lastName.data = NULL;
+      lastName.size = 0;
+      size_t lastId = 0;
+      size_t last = min(nbLines, first + (s + 1) * sliceSize);
+      for(size_t l = first + s * sliceSize; l < last; ++l)
+	if(lines[l].size > 0 && lines[l].data[0] != '@')
+	  addAlignment(st, refs, params, lines[l], firstLineId + l,
+		       tokens[s], lastName, lastId);
+    }
+    if(params.filter)
+      for(int s = 0; s < params.nbThreads; ++s){
+	bwrite(samWriter, stats[s].sam);
+	bwrite(bedWriter, stats[s].bed);
+      }
+  }
+  closeBlockReader(br);
+  if(params.filter){
+    closeBlockWriter(samWriter);
+    closeBlockWriter(bedWriter);
+  }
+  if(inHeader)
+    for(int s = 0; s < params.nbThreads; ++s)
+      initSamStats(stats[s], refs.names.size());
+
+  for(int s = 1; s < params.nbThreads; ++s)
+    mergeSamStats(stats[0], stats[s]);
+  saveStats(params, refs, stats[0]);
+
+  if(params.verbose > 0){
+    const SamStats & st = stats[0];
+    cout << "nb of references: " << refs.names.size() << endl
+	 << "nb of alignments: " << st.flagstat[FS_TOTAL][0]
+      + st.flagstat[FS_TOTAL][1] << endl
+	 << "nb of mapped alignments: " << st.flagstat[FS_MAPPED][0]
+      + st.flagstat[FS_MAPPED][1] << endl
+	 << "nb of reads mapping uniquely: " << st.nbUniqueReads << endl
+	 << "nb of reads mapping perfectly: " << st.nbPerfectReads << endl
+	 << "nb of reads mapping almost perfectly: "
+	 << st.nbAlmostPerfectReads << endl;
+    if(params.filter)
+      cout << "nb of saved reads: " << st.nbSavedReads << endl;
+  }
+}
+
+int main(int argc, char ** argv)
+{
+  SamParams params;
+  params.inSam = "-";
+  params.maxEditDist = 0;
+  params.filter = false;
+  params.batchSize = 100000;
+  params.nbThreads = 1;
+  params.verbose = 1;
+
+  parseCmdLine(argc, argv, params);
+
+  time_t startRawTime, endRawTime;
+  if(params.verbose > 0){
+    time(&startRawTime);
+    cout << "START " << basename(argv[0])
+         << " " << getDateTime(startRawTime) << endl
+         << "version " << VERSION << " compiled " << __DATE__
+         << " " << __TIME__ << endl
+         << "cmd-line: " << getCmdLine(argc, argv) << endl
+         << "cwd: " << getCurrentDirectory() << endl;
+    cout << flush;
+  }
+
+  run(params);
+
+  if(params.verbose > 0){
+    time(&endRawTime);
+    cout << "END " << basename(argv[0])
+         << " " << getDateTime(endRawTime) << endl
+         << "elapsed -> " << getElapsedTime(startRawTime, endRawTime) << endl
+         << "max.mem -> " << getMaxMemUsedByProcess2Str() << endl;
+  }
+
+  return EXIT_SUCCESS;
+}
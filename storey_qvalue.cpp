@@ -0,0 +1,838 @@
+/** \file storey_qvalue.cpp
+ *
+ *  `storey_qvalue' controls the FDR of many p-values with Storey's method.
+ *  Copyright (C) 2011-2014 Timothée Flutre
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Compile with: g++ -Wall -O3 -I.. utils_io.cpp storey_qvalue.cpp -lgsl -lgslcblas -lz -o storey_qvalue
+ */
+
+#include <cmath>
+#include <ctime>
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
+#include <climits>
+#include <getopt.h>
+#include <libgen.h>
+#include <stdint.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+using namespace std;
+
+#include <gsl/gsl_rng.h>
+#include <gsl/gsl_randist.h>
+
+#include "utils_io.hpp"
+using namespace utils;
+
+#ifndef VERSION
+#define VERSION "1.0.0" // http://semver.org/
+#endif
+
+// the histogram has 2^14 bins per power of 2, from 2^-63 to 1
+#define NB_BINS_PER_BINADE 16384
+#define NB_BINADES 64
+#define NB_BINS (NB_BINS_PER_BINADE * NB_BINADES)
+
+// lambda = 0, 0.05, ..., 0.95 as in the qvalue package
+#define NB_LAMBDAS 20
+
+/** \brief Display the help on stdout.
+ *  \note The format complies with help2man (http://www.gnu.org/s/help2man)
+ */
+void help(char ** argv)
+{
+  cout << "`" << argv[0] << "'"
+       << " controls the FDR of many p-values with Storey's method." << endl
+       << endl
+       << "Usage: " << argv[0] << " [OPTIONS] ..." << endl
+       << endl
+       << "Options:" << endl
+       << "  -h, --help\tdisplay the help and exit" << endl
+       << "  -V, --version\toutput version information and exit" << endl
+       << "  -v, --verbose\tverbosity level (0/default=1/2/3)" << endl
+       << "  -i, --in\tpath to the input file (can be gzipped)" << endl
+       << "      --col\tcolumn of the p-values (default=1)" << endl
+       << "\t\tmissing p-values ('NA') get a missing q-value" << endl
+       << "      --head\tif there is a header line" << endl
+       << "      --fdr\tthreshold on the FDR (default=0.05)" << endl
+       << "  -o, --out\tpath to the output file (optional, gzipped if ending with '.gz')" << endl
+       << "\t\tinput lines with their q-value as last column" << endl
+       << "      --sig\tpath to the output file with the significant input lines (optional)" << endl
+       << "      --pi0\tproportion of true nulls (default=estimated, 1=Benjamini-Hochberg)" << endl
+       << "      --no-robust\tdon't use the robust q-values for small p-values" << endl
+       << "      --boot\tnumber of bootstrap samples to estimate pi0 (default=100)" << endl
+       << "  -s, --seed\tseed for the bootstrap (default=1859)" << endl
+       << "      --mem\tmaximum memory in MB for the q-values (default=1024)" << endl
+       << endl
+       << "Remarks:" << endl
+       << "  pi0 is estimated as in qvalue(pi0.method=\"bootstrap\"), the counts of" << endl
+       << "  p-values above each lambda being resampled instead of the p-values." << endl
+       << "  The p-values are first counted in a histogram with bins of relative width" << endl
+       << "  2^-14. Without --out, only the p-values in the bins where the FDR threshold" << endl
+       << "  can be crossed are sorted, in a second pass, to find the p-value threshold." << endl
+       << "  With --out, the p-values are sorted by buckets of bins fitting in --mem," << endl
+       << "  via temporary files '<out>_tmp*', to compute all q-values in four passes." << endl
+       << "  Ties get the maximum rank, as in qvalue." << endl
+       << "  The input file is read several times, hence it can't be stdin." << endl
+       << endl
+       << "Examples:" << endl
+       << "  " << argv[0] << " -i trans.txt.gz --col 5 --head --fdr 0.05 --sig signif.txt.gz" << endl
+       << endl
+       << "Report bugs to <timothee.flutre@supagro.inra.fr>." << endl
+    ;
+}
+
+/** \brief Display version and license information on stdout.
+ */
+void version(char ** argv)
+{
+  cout << argv[0] << " " << VERSION << endl
+       << endl
+       << "Copyright (C) 2011-2014 Timothée Flutre." << endl
+       << "License GPLv3+: GNU GPL version 3 or later <http://gnu.org/licenses/gpl.html>" << endl
+       << "This is free software; see the source for copying conditions.  There is NO" << endl
+       << "warranty; not even for MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE." << endl
+       << endl
+       << "Written by Timothée Flutre." << endl
+    ;
+}
+
+struct QvalParams
+{
+  string inFile;
+  size_t col;
+  bool header;
+  double fdr;
+  string outFile;
+  string sigFile;
+  double pi0;
+  bool robust;
+  size_t nbBoots;
+  size_t seed;
+  size_t memMb;
+  int verbose;
+};
+
+/** \brief Parse the command-line arguments and check the values of the
+ *  compulsory ones.
+ */
+void
+parseCmdLine(
+  int argc,
+  char ** argv,
+  QvalParams & par)
+{
+  int c = 0;
+  while(true)
+  {
+    static struct option long_options[] =
+    {
+      {"help", no_argument, 0, 'h'},
+      {"version", no_argument, 0, 'V'},
+      {"verbose", required_argument, 0, 'v'},
+      {"in", required_argument, 0, 'i'},
+      {"col", required_argument, 0, 0},
+      {"head", no_argument, 0, 0},
+      {"fdr", required_argument, 0, 0},
+      {"out", required_argument, 0, 'o'},
+      {"sig", required_argument, 0, 0},
+      {"pi0", required_argument, 0, 0},
+      {"no-robust", no_argument, 0, 0},
+      {"boot", required_argument, 0, 0},
+      {"seed", required_argument, 0, 's'},
+      {"mem", required_argument, 0, 0},
+      {0, 0, 0, 0}
+    };
+    int option_index = 0;
+    c = getopt_long(argc, argv, "hVv:i:o:s:",
+                    long_options, &option_index);
+    if(c == -1)
+      break;
+    switch(c)
+    {
+    case 0:
+      if(long_options[option_index].flag != 0)
+        break;
+      if(strcmp(long_options[option_index].name, "col") == 0)
+        par.col = atol(optarg);
+      else if(strcmp(long_options[option_index].name, "head") == 0)
+        par.header = true;
+      else if(strcmp(long_options[option_index].name, "fdr") == 0)
+        par.fdr = atof(optarg);
+      else if(strcmp(long_options[option_index].name, "sig") == 0)
+        par.sigFile = optarg;
+      else if(strcmp(long_options[option_index].name, "pi0") == 0)
+        par.pi0 = atof(optarg);
+      else if(strcmp(long_options[option_index].name, "no-robust") == 0)
+        par.robust = false;
+      else if(strcmp(long_options[option_index].name, "boot") == 0)
+        par.nbBoots = atol(optarg);
+      else if(strcmp(long_options[option_index].name, "mem") == 0)
+        par.memMb = atol(optarg);
+      break;
+    case 'h':
+      help(argv);
+      exit(0);
+    case 'V':
+      version(argv);
+      exit(0);
+    case 'v':
+      par.verbose = atoi(optarg);
+      break;
+    case 'i':
+      par.inFile = optarg;
+      break;
+    case 'o':
+      par.outFile = optarg;
+      break;
+    case 's':
+      par.seed = atol(optarg);
+      break;
+    case '?':
+      printf("\n"); help(argv);
+      abort();
+    default:
+      printf("\n"); help(argv);
+      abort();
+    }
+  }
+  if(par.inFile.empty() || par.inFile == "-"){
+    cerr << "cmd-line: " << getCmdLine(argc, argv) << endl << endl
+	 << "ERROR: missing compulsory option --in (stdin isn't allowed)"
+	 << endl << endl;
+    help(argv);
+    exit(1);
+  }
+  if(! doesFileExist(par.inFile)){
+    cerr << "cmd-line: " << getCmdLine(argc, argv) << endl << endl
+	 << "ERROR: can't find file " << par.inFile << endl << endl;
+    help(argv);
+    exit(1);
+  }
+  if(par.col == 0){
+    cerr << "cmd-line: " << getCmdLine(argc, argv) << endl << endl
+	 << "ERROR: --col should be at least 1" << endl << endl;
+    help(argv);
+    exit(1);
+  }
+  if(par.fdr <= 0 || par.fdr > 1){
+    cerr << "cmd-line: " << getCmdLine(argc, argv) << endl << endl
+	 << "ERROR: --fdr should be in ]0,1]" << endl << endl;
+    help(argv);
+    exit(1);
+  }
+  if(! isnan(par.pi0) && (par.pi0 <= 0 || par.pi0 > 1)){
+    cerr << "cmd-line: " << getCmdLine(argc, argv) << endl << endl
+	 << "ERROR: --pi0 should be in ]0,1]" << endl << endl;
+    help(argv);
+    exit(1);
+  }
+  if(par.memMb == 0)
+    par.memMb = 1;
+}
+
+/** \brief Return the histogram bin of p, the bins being increasing with p:
+ *  the top 14 bits of the mantissa and the exponent, clamped below 2^-63.
+ */
+size_t getPvalBin(const double p)
+{
+  if(p <= 0)
+    return 0;
+  int e;
+  double f = frexp(p, &e); // p = f 2^e with f in [0.5,1[
+  if(e < 2 - NB_BINADES)
+    return 0;
+  return (e + NB_BINADES - 2) * NB_BINS_PER_BINADE
+    + (size_t) ((2 * f - 1) * NB_BINS_PER_BINADE);
+}
+
+/** \brief Return the lower bound of the histogram bin b (inclusive).
+ */
+double getPvalBinLow(const size_t b)
+{
+  if(b == 0)
+    return 0.0;
+  int e = (int) (b / NB_BINS_PER_BINADE) + 2 - NB_BINADES;
+  double f = 0.5 + (b % NB_BINS_PER_BINADE) / (2.0 * NB_BINS_PER_BINADE);
+  return ldexp(f, e);
+}
+
+/** \brief Return the index of the largest lambda <= p.
+ */
+size_t getLambdaCell(const double p)
+{
+  size_t k = min((size_t) (p * NB_LAMBDAS), (size_t) NB_LAMBDAS - 1);
+  while(k > 0 && p < k / (double) NB_LAMBDAS)
+    --k;
+  while(k + 1 < NB_LAMBDAS && p >= (k + 1) / (double) NB_LAMBDAS)
+    ++k;
+  return k;
+}
+
+/** \brief Counts from the first pass over the input file.
+ */
+struct PvalCounts
+{
+  size_t nbLines; // data lines, with or without a p-value
+  size_t nbPvals;
+  vector<uint64_t> bins; // NB_BINS
+  vector<uint64_t> cells; // NB_LAMBDAS, p in [lambda_k, lambda_k+1[
+};
+
+/** \brief Read the input file line by line, calling f.line(header) once for
+ *  the header if any, then f.data(line, pval) for each non-empty line, pval
+ *  being NaN if missing.
+ */
+template <class F>
+void scanInputFile(const QvalParams & par, F & f)
+{
+  BlockReader br;
+  StringView line;
+  vector<StringView> tokens;
+  openBlockReader(br, par.inFile);
+  if(par.header && getline(br, line))
+    f.header(line);
+  while(getline(br, line)){
+    if(tokenize(line, " \t", tokens) == 0)
+      continue;
+    if(tokens.size() < par.col){
+      cerr << "ERROR: line " << br.nbLines << " of file " << par.inFile
+	   << " has less than " << par.col << " columns" << endl;
+      exit(1);
+    }
+    double p;
+    if(! parseDouble(tokens[par.col - 1], p))
+      p = NAN;
+    else if(p < 0 || p > 1){
+      cerr << "ERROR: p-value at line " << br.nbLines << " of file "
+	   << par.inFile << " isn't in [0,1]" << endl;
+      exit(1);
+    }
+    f.data(line, p);
+  }
+  closeBlockReader(br);
+}
+
+/** \brief First pass: fill the histogram and optionally save the p-values
+ *  in binary (one double per data line) for the next passes.
+ */
+struct CountPvals
+{
+  PvalCounts & counts;
+  FILE * stream;
+  string path;
+  vector<double> buffer;
+
+  CountPvals(PvalCounts & c, FILE * s, const string & p)
+    : counts(c), stream(s), path(p) {}
+  void header(const StringView &) {}
+  void data(const StringView &, const double p)
+  {
+    ++counts.nbLines;
+    if(! isnan(p)){
+      ++counts.nbPvals;
+      ++counts.bins[getPvalBin(p)];
+      ++counts.cells[getLambdaCell(p)];
+    }
+    if(stream != NULL){
+      buffer.push_back(p);
+      if(buffer.size() == 65536)
+	flush();
+    }
+  }
+  void flush()
+  {
+    if(! buffer.empty()
+       && fwrite(&buffer[0], sizeof(double), buffer.size(), stream)
+       != buffer.size()){
+      cerr << "ERROR: can't write in file " << path << " (errno=" << errno
+	   << ")" << endl;
+      exit(1);
+    }
+    buffer.clear();
+  }
+};
+
+/** \brief Draw from Binomial(n, p) for any size_t n.
+ */
+size_t drawBinomial(const gsl_rng * rng, const double p, size_t n)
+{
+  size_t x = 0;
+  while(n > 0){
+    unsigned int m = (unsigned int) min(n, (size_t) UINT_MAX);
+    x += gsl_ran_binomial(rng, p, m);
+    n -= m;
+  }
+  return x;
+}
+
+/** \brief Estimate pi0 as qvalue(pi0.method="bootstrap"): among the
+ *  estimates #{p >= lambda} / (m (1 - lambda)), take the one whose
+ *  bootstrap MSE with respect to their minimum is the smallest.
+ *  \note Resampling the counts of the cells [lambda_k, lambda_k+1[ from a
+ *  multinomial is the same as resampling the p-values.
+ */
+double estimatePi0(const PvalCounts & counts, const QvalParams & par)
+{
+  const size_t m = counts.nbPvals;
+  vector<double> pi0s(NB_LAMBDAS), mse(NB_LAMBDAS, 0.0);
+  size_t above = 0;
+  for(size_t k = NB_LAMBDAS; k-- > 0; ){
+    above += counts.cells[k];
+    pi0s[k] = above / (m * (1 - k / (double) NB_LAMBDAS));
+  }
+  double minPi0 = *min_element(pi0s.begin(), pi0s.end());
+
+  gsl_rng_env_setup();
+  gsl_rng * rng = gsl_rng_alloc(gsl_rng_default);
+  gsl_rng_set(rng, par.seed);
+  vector<size_t> boot(NB_LAMBDAS);
+  for(size_t b = 0; b < par.nbBoots; ++b){
+    size_t left = m, leftCells = m;
+    for(size_t k = 0; k < NB_LAMBDAS; ++k){
+      boot[k] = (k + 1 == NB_LAMBDAS || leftCells == 0) ? left
+	: drawBinomial(rng, counts.cells[k] / (double) leftCells, left);
+      left -= boot[k];
+      leftCells -= counts.cells[k];
+    }
+    above = 0;
+    for(size_t k = NB_LAMBDAS; k-- > 0; ){
+      above += boot[k];
+      double pi0 = above / (m * (1 - k / (double) NB_LAMBDAS));
+      mse[k] += (pi0 - minPi0) * (pi0 - minPi0);
+    }
+  }
+  gsl_rng_free(rng);
+
+  double minMse = *min_element(mse.begin(), mse.end()), pi0 = 1.0;
+  for(size_t k = 0; k < NB_LAMBDAS; ++k)
+    if(mse[k] == minMse)
+      pi0 = min(pi0, pi0s[k]);
+  return pi0;
+}
+
+/** \brief Return the q-value of p before taking the cumulative minimum,
+ *  rank being the number of p-values <= p.
+ */
+double getRawQvalue(const double p, const size_t rank, const size_t m,
+		    const double pi0, const bool robust)
+{
+  double q = pi0 * m * p / rank;
+  if(robust) // divide by Pr(min of m p-values <= p)
+    q = (p > 0) ? q / (- expm1(m * log1p(- p))) : pi0 / rank;
+  return q;
+}
+
+/** \brief Temporary files of records, one per bucket.
+ */
+struct BucketFiles
+{
+  vector<string> paths;
+  vector<FILE*> streams;
+};
+
+void openBucketFiles(BucketFiles & bf, const string & prefix,
+		     const size_t nbBuckets)
+{
+  bf.paths.resize(nbBuckets);
+  bf.streams.resize(nbBuckets);
+  for(size_t k = 0; k < nbBuckets; ++k){
+    bf.paths[k] = prefix + toString(k);
+    bf.streams[k] = fopen(bf.paths[k].c_str(), "w+b");
+    if(bf.streams[k] == NULL){
+      cerr << "ERROR: can't open file " << bf.paths[k] << " to write"
+	   << " (errno=" << errno << ")" << endl;
+      exit(1);
+    }
+  }
+}
+
+template <class T>
+void writeRecord(BucketFiles & bf, const size_t k, const T & rec)
+{
+  if(fwrite(&rec, sizeof(T), 1, bf.streams[k]) != 1){
+    cerr << "ERROR: can't write in file " << bf.paths[k] << " (errno="
+	 << errno << ")" << endl;
+    exit(1);
+  }
+}
+
+template <class T>
+void readBucket(BucketFiles & bf, const size_t k, vector<T> & recs)
+{
+  long size = ftell(bf.streams[k]);
+  recs.resize(size / sizeof(T));
+  rewind(bf.streams[k]);
+  if(! recs.empty()
+     && fread(&recs[0], sizeof(T), recs.size(), bf.streams[k])
+     != recs.size()){
+    cerr << "ERROR: can't read file " << bf.paths[k] << " (errno=" << errno
+	 << ")" << endl;
+    exit(1);
+  }
+  fclose(bf.streams[k]);
+  bf.streams[k] = NULL;
+  remove(bf.paths[k].c_str());
+}
+
+struct PvalRecord
+{
+  double p;
+  uint64_t line;
+};
+
+bool operator<(const PvalRecord & a, const PvalRecord & b)
+{
+  return a.p < b.p;
+}
+
+struct QvalRecord
+{
+  uint64_t line;
+  double q;
+};
+
+/** \brief Last pass: write the input lines, with their q-value if any, and
+ *  the significant ones.
+ */
+struct WriteQvals
+{
+  const QvalParams & par;
+  BlockWriter * out;
+  BlockWriter * sig;
+  BucketFiles * qbuckets; // q-values by buckets of consecutive lines
+  size_t bucketSize;
+  size_t nbLines;
+  double maxPval; // threshold-only mode
+  size_t line;
+  vector<double> qvals;
+  size_t nbSignif;
+
+  WriteQvals(const QvalParams & p) : par(p), out(NULL), sig(NULL),
+				     qbuckets(NULL), bucketSize(0),
+				     nbLines(0), maxPval(-1.0), line(0),
+				     nbSignif(0) {}
+  void header(const StringView & l)
+  {
+    if(out != NULL){
+      bwrite(*out, l.data, l.size);
+      bwrite(*out, "\tqvalue\n");
+    }
+    if(sig != NULL){
+      bwrite(*sig, l.data, l.size);
+      bwrite(*sig, "\n", 1);
+    }
+  }
+  void data(const StringView & l, const double p)
+  {
+    double q = NAN;
+    bool isSig;
+    if(qbuckets != NULL){
+      if(line % bucketSize == 0){
+	vector<QvalRecord> recs;
+	readBucket(*qbuckets, line / bucketSize, recs);
+	qvals.assign(min(bucketSize, nbLines - line), NAN);
+	for(size_t r = 0; r < recs.size(); ++r)
+	  qvals[recs[r].line % bucketSize] = recs[r].q;
+      }
+      q = qvals[line % bucketSize];
+      isSig = (! isnan(q) && q <= par.fdr);
+    }
+    else
+      isSig = (! isnan(p) && p <= maxPval);
+    ++line;
+    nbSignif += isSig;
+    if(out != NULL){
+      char buf[64];
+      int n = isnan(q) ? snprintf(buf, sizeof(buf), "\tNA\n")
+	: snprintf(buf, sizeof(buf), "\t%.8g\n", q);
+      bwrite(*out, l.data, l.size);
+      bwrite(*out, buf, n);
+    }
+    if(sig != NULL && isSig){
+      bwrite(*sig, l.data, l.size);
+      bwrite(*sig, "\n", 1);
+    }
+  }
+};
+
+/** \brief Second pass of the threshold-only mode: collect the p-values of
+ *  the bins [bLo,bHi].
+ */
+struct CollectPvals
+{
+  size_t bLo;
+  size_t bHi;
+  vector<double> pvals;
+
+  void header(const StringView &) {}
+  void data(const StringView &, const double p)
+  {
+    if(! isnan(p)){
+      size_t b = getPvalBin(p);
+      if(b >= bLo && b <= bHi)
+	pvals.push_back(p);
+    }
+  }
+};
+
+/** \brief Return the largest p-value whose q-value is <= fdr (-1 if none),
+ *  reading again the input file but only sorting the p-values of the bins
+ *  where the threshold can be.
+ */
+double findPvalThreshold(const PvalCounts & counts, const double pi0,
+			 const QvalParams & par, size_t & nbSignif)
+{
+  nbSignif = 0;
+  const size_t m = counts.nbPvals;
+  vector<uint64_t> before(NB_BINS + 1, 0);
+  for(size_t b = 0; b < NB_BINS; ++b)
+    before[b+1] = before[b] + counts.bins[b];
+
+  // q(p_(j)) <= fdr iff some raw q-value at rank >= j is; the raw q-values
+  // in bin b are between those at (low(b), before[b+1]) and (low(b+1), ...)
+  CollectPvals cp;
+  cp.bLo = 0;
+  cp.bHi = NB_BINS;
+  for(size_t b = NB_BINS; b-- > 0; ){
+    if(counts.bins[b] == 0)
+      continue;
+    if(getRawQvalue(getPvalBinLow(b), before[b+1], m, pi0, par.robust)
+       > par.fdr)
+      continue;
+    if(cp.bHi == NB_BINS)
+      cp.bHi = b;
+    if(getRawQvalue(min(1.0, getPvalBinLow(b+1)), before[b+1], m, pi0,
+		    par.robust) <= par.fdr){
+      cp.bLo = b; // its largest p-value is significant
+      break;
+    }
+  }
+  if(cp.bHi == NB_BINS)
+    return -1.0;
+  if(before[cp.bHi+1] - before[cp.bLo] > par.memMb * 131072){
+    cerr << "ERROR: too many p-values around the threshold, increase --mem"
+	 << endl;
+    exit(1);
+  }
+  if(par.verbose > 0)
+    cout << "sort " << before[cp.bHi+1] - before[cp.bLo]
+	 << " p-values around the threshold ..." << endl << flush;
+
+  scanInputFile(par, cp);
+  sort(cp.pvals.begin(), cp.pvals.end());
+  for(size_t i = cp.pvals.size(); i-- > 0; ){
+    if(i + 1 < cp.pvals.size() && cp.pvals[i+1] == cp.pvals[i])
+      continue; // ties get the maximum rank
+    if(getRawQvalue(cp.pvals[i], before[cp.bLo] + i + 1, m, pi0, par.robust)
+       <= par.fdr){
+      nbSignif = before[cp.bLo] + i + 1;
+      return cp.pvals[i];
+    }
+  }
+  return -1.0;
+}
+
+/** \brief Compute all q-values via an external sort: the p-values saved in
+ *  binary at the first pass are dispatched into buckets of consecutive bins
+ *  fitting in memory, each bucket is sorted from the largest p-values to
+ *  get the cumulative minimum, and the q-values are dispatched into buckets
+ *  of consecutive lines for the last pass.
+ */
+void computeQvalues(const PvalCounts & counts, const double pi0,
+		    const string & pvalsFile, BucketFiles & qb,
+		    WriteQvals & wq, const QvalParams & par)
+{
+  const size_t m = counts.nbPvals,
+    maxRecs = max((size_t) 1, par.memMb * 1048576 / sizeof(PvalRecord));
+
+  // buckets of consecutive bins
+  vector<uint32_t> bin2bucket(NB_BINS);
+  vector<uint64_t> before(1, 0); // nb of p-values before each bucket
+  size_t nbInBucket = 0;
+  for(size_t b = 0; b < NB_BINS; ++b){
+    if(nbInBucket > 0 && nbInBucket + counts.bins[b] > maxRecs){
+      before.push_back(before.back() + nbInBucket);
+      nbInBucket = 0;
+    }
+    bin2bucket[b] = before.size() - 1;
+    nbInBucket += counts.bins[b];
+  }
+  const size_t nbPvalBuckets = before.size();
+  wq.bucketSize = maxRecs;
+  wq.nbLines = counts.nbLines;
+  if(par.verbose > 0)
+    cout << "sort the p-values in " << nbPvalBuckets << " bucket(s) ..."
+	 << endl << flush;
+
+  BucketFiles pb;
+  openBucketFiles(pb, par.outFile + "_tmpp", nbPvalBuckets);
+  FILE * stream = fopen(pvalsFile.c_str(), "rb");
+  if(stream == NULL){
+    cerr << "ERROR: can't open file " << pvalsFile << " to read (errno="
+	 << errno << ")" << endl;
+    exit(1);
+  }
+  vector<double> buffer(65536);
+  size_t n, line = 0;
+  while((n = fread(&buffer[0], sizeof(double), buffer.size(), stream)) > 0)
+    for(size_t i = 0; i < n; ++i, ++line)
+      if(! isnan(buffer[i])){
+	PvalRecord rec = {buffer[i], line};
+	writeRecord(pb, bin2bucket[getPvalBin(buffer[i])], rec);
+      }
+  fclose(stream);
+  remove(pvalsFile.c_str());
+
+  openBucketFiles(qb, par.outFile + "_tmpq",
+		  (counts.nbLines + maxRecs - 1) / maxRecs);
+  double qmin = 1.0;
+  vector<PvalRecord> recs;
+  for(size_t k = nbPvalBuckets; k-- > 0; ){
+    readBucket(pb, k, recs);
+    sort(recs.begin(), recs.end());
+    for(size_t i = recs.size(); i-- > 0; ){
+      size_t j = i; // ties get the maximum rank
+      while(j + 1 < recs.size() && recs[j+1].p == recs[i].p)
+	++j;
+      qmin = min(qmin, getRawQvalue(recs[i].p, before[k] + j + 1, m, pi0,
+				    par.robust));
+      QvalRecord qrec = {recs[i].line, qmin};
+      writeRecord(qb, recs[i].line / maxRecs, qrec);
+    }
+  }
+
+  wq.qbuckets = &qb;
+}
+
+void run(const QvalParams & par)
+{
+  const bool allQvals = ! par.outFile.empty();
+  PvalCounts counts;
+  counts.nbLines = 0;
+  counts.nbPvals = 0;
+  counts.bins.assign(NB_BINS, 0);
+  counts.cells.assign(NB_LAMBDAS, 0);
+  string pvalsFile;
+  FILE * stream = NULL;
+  if(allQvals){
+    pvalsFile = par.outFile + "_tmp";
+    stream = fopen(pvalsFile.c_str(), "wb");
+    if(stream == NULL){
+      cerr << "ERROR: can't open file " << pvalsFile << " to write (errno="
+	   << errno << ")" << endl;
+      exit(1);
+    }
+  }
+
+  if(par.verbose > 0)
+    cout << "count the p-values ..." << endl << flush;
+  CountPvals cp(counts, stream, pvalsFile);
+  scanInputFile(par, cp);
+  if(stream != NULL){
+    cp.flush();
+    fclose(stream);
+  }
+  if(counts.nbPvals == 0){
+    cerr << "ERROR: no p-value in file " << par.inFile << endl;
+    exit(1);
+  }
+
+  double pi0 = isnan(par.pi0) ? estimatePi0(counts, par) : par.pi0;
+  if(par.verbose > 0)
+    cout << "nb of lines: " << counts.nbLines << endl
+	 << "nb of p-values: " << counts.nbPvals << endl
+	 << "pi0: " << pi0 << endl;
+
+  WriteQvals wq(par);
+  BucketFiles qb;
+  size_t nbSignif = 0;
+  if(allQvals)
+    computeQvalues(counts, pi0, pvalsFile, qb, wq, par);
+  else{
+    wq.maxPval = findPvalThreshold(counts, pi0, par, nbSignif);
+    if(par.verbose > 0)
+      cout << "p-value threshold: " << wq.maxPval << endl;
+  }
+
+  if(allQvals || ! par.sigFile.empty()){
+    if(par.verbose > 0)
+      cout << "write the output ..." << endl << flush;
+    BlockWriter bwOut, bwSig;
+    if(allQvals){
+      openBlockWriter(bwOut, par.outFile);
+      wq.out = &bwOut;
+    }
+    if(! par.sigFile.empty()){
+      openBlockWriter(bwSig, par.sigFile);
+      wq.sig = &bwSig;
+    }
+    scanInputFile(par, wq);
+    if(allQvals)
+      closeBlockWriter(bwOut);
+    if(! par.sigFile.empty())
+      closeBlockWriter(bwSig);
+    nbSignif = wq.nbSignif;
+  }
+
+  if(par.verbose > 0)
+    cout << "nb of significant tests at FDR=" << par.fdr << ": "
+	 << nbSignif << endl;
+}
+
+int main(int argc, char ** argv)
+{
+  QvalParams par;
+  par.col = 1;
+  par.header = false;
+  par.fdr = 0.05;
+  par.pi0 = NAN;
+  par.robust = true;
+  par.nbBoots = 100;
+  par.seed = 1859;
+  par.memMb = 1024;
+  par.verbose = 1;
+
+  parseCmdLine(argc, argv, par);
+
+  time_t startRawTime, endRawTime;
+  if(par.verbose > 0){
+    time(&startRawTime);
+    cout << "START " << basename(argv[0])
+         << " " << getDateTime(startRawTime) << endl
+         << "version " << VERSION << " compiled " << __DATE__
+         << " " << __TIME__ << endl
+         << "cmd-line: " << getCmdLine(argc, argv) << endl
+         << "cwd: " << getCurrentDirectory() << endl;
+    cout << flush;
+  }
+
+  run(par);
+
+  if(par.verbose > 0){
+    time(&endRawTime);
+    cout << "END " << basename(argv[0])
+         << " " << getDateTime(endRawTime) << endl
+         << "elapsed -> " << getElapsedTime(startRawTime, endRawTime) << endl
+         << "max.mem -> " << getMaxMemUsedByProcess2Str() << endl;
+  }
+
+  return EXIT_SUCCESS;
+}
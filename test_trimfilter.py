@@ -42,7 +42,8 @@ class TestTrimfilter(object):
     def __init__(self):
         self.verbose = 0
         self.pathToProg = ""
-        self.testsToRun = ["pairedexact", "pairedfuzzy", "singleexact"]
+        self.testsToRun = ["pairedexact", "pairedfuzzy", "singleexact",
+                           "singlehomopolymer"]
         self.clean = True
         
         
@@ -61,7 +62,7 @@ class TestTrimfilter(object):
         msg += "  -V, --version\toutput version information and exit\n"
         msg += "  -v, --verbose\tverbosity level (default=0/1/2/3)\n"
         msg += "  -p, --p2p\tfull path to the program to be tested\n"
-        msg += "  -t, --test\tidentifiers of test(s) to run (default=pairedexact-pairedfuzzy-singleexact)\n"
+        msg += "  -t, --test\tidentifiers of test(s) to run (default=pairedexact-pairedfuzzy-singleexact-singlehomopolymer)\n"
         msg += "  -n, --noclean\tkeep temporary directory with all files\n"
         msg += "\n"
         msg += "Examples:\n"
@@ -132,7 +133,8 @@ class TestTrimfilter(object):
             self.help()
             sys.exit(1)
         for t in self.testsToRun:
-            if t not in ["pairedexact", "pairedfuzzy", "singleexact"]:
+            if t not in ["pairedexact", "pairedfuzzy", "singleexact",
+                         "singlehomopolymer"]:
                 msg = "ERROR: unknown --test %s" % t
                 sys.stderr.write("%s\n\n" % msg)
                 self.help()
@@ -483,6 +485,69 @@ class TestTrimfilter(object):
     #==========================================================================
     
     
+    def test_singlehomopolymer_prepare(self):
+        """
+        The adapter TTT matches the read end TTTT at two consecutive
+        positions, the leftmost one being expected, as with seq.find.
+        """
+        ifq1 = "reads_R1.fq.gz"
+        ifq1Handle = gzip.open(ifq1, "w")
+        txt = "@INST1:1:FLOW1:2:2104:15343:197393 1:N:0:\n"
+        txt += "GGGGGGGGGG" # insert
+        txt += "TTTT\n" # adp read-through overlapping a T of the insert end
+        txt += "+\n"
+        txt += "~~~~~~~~~~~~~~\n"
+        ifq1Handle.write(txt)
+        ifq1Handle.close()
+        
+        if os.path.isfile("test.fq.gz"):
+            os.remove("test.fq.gz")
+            
+        adpFile = "adapters.fa"
+        self.writeAdpFile(adpFile, False)
+        
+        return ifq1, adpFile
+        
+        
+    def test_singlehomopolymer_comp(self, msgs):
+        testId = 1
+        if not os.path.exists("test.fq.gz") \
+           or not os.path.exists("test.log.gz"):
+            print("test_singlehomopolymer: fail (%i)" % testId)
+            return
+        testId += 1
+        with gzip.open("test.log.gz") as logHandle:
+            lines = logHandle.readlines()
+            if lines[1] != "INST1:1:FLOW1:2:2104:15343:197393 1:N:0:\tadp2_rc\t10\n":
+                print("test_singlehomopolymer: fail (%i)" % testId)
+                print(lines[1])
+                return
+            testId += 1
+        with gzip.open("test.fq.gz") as inFqHandle:
+            reads = list(SeqIO.parse(inFqHandle, "fastq",
+                                      alphabet=IUPAC.ambiguous_dna))
+            if str(reads[0].seq) != "GGGGGGGGGG":
+                print("test_singlehomopolymer: fail (%i)" % testId)
+                print(str(reads[0].seq))
+                return
+            testId += 1
+        print("test_singlehomopolymer: pass")
+        
+        
+    def test_singlehomopolymer(self):
+        if self.verbose > 0:
+            print("launch test_singlehomopolymer ...")
+            sys.stdout.flush()
+        cwd, testDir = self.beforeTest()
+        ifq1, adpFile = self.test_singlehomopolymer_prepare()
+        msgs = self.launchProg(ifq1, None, adpFile, 0)
+        self.test_singlehomopolymer_comp(msgs)
+        self.afterTest(cwd, testDir)
+        
+        
+    #==========================================================================
+    
+    
     def run(self):
         if "pairedexact" in self.testsToRun:
             self.test_pairedexact()
@@ -490,6 +555,8 @@ class TestTrimfilter(object):
             self.test_pairedfuzzy()
         if "singleexact" in self.testsToRun:
             self.test_singleexact()
+        if "singlehomopolymer" in self.testsToRun:
+            self.test_singlehomopolymer()
             
             
 if __name__ == "__main__":
@@ -0,0 +1,328 @@
+/** \file test_utils_geno.cpp
+ *
+ *  `test_utils_geno' tests functions from `utils_geno'.
+ *  Copyright (C) 2013 Timothee Flutre
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  g++ -Wall -Wextra -g utils_io.cpp utils_geno.cpp test_utils_geno.cpp -lz -o test_utils_geno
+ */
+
+#include <cmath>
+#include <cstdlib>
+#include <cstdio>
+
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "utils_io.hpp"
+#include "utils_geno.hpp"
+using namespace utils;
+
+void
+checkBelow (
+  const double obs,
+  const double bound,
+  const string & what,
+  const char * function)
+{
+  if (! (obs <= bound))
+  {
+    cerr << "ERROR: in " << function << endl;
+    cerr << what << " (" << obs << ") > bound (" << bound << ")" << endl;
+    exit (1);
+  }
+}
+
+/** \brief Dosages spread over [0,2], with a missing one every 17 samples.
+ */
+void
+test_simulDosages (
+  const size_t nbSnps,
+  const size_t nbSamples,
+  vector<double> & dosages)
+{
+  dosages.resize (nbSnps * nbSamples);
+  for (size_t s = 0; s < nbSnps; ++s)
+    for (size_t i = 0; i < nbSamples; ++i)
+      dosages[s*nbSamples+i] = (i % 17 == 16) ? NAN :
+	2.0 * fmod (0.618033988749895 * (s * nbSamples + i + 1), 1.0);
+}
+
+void
+test_DosageMatrix (const int & verbose)
+{
+  if (verbose > 0)
+    cout << "START '" << __FUNCTION__ << "'" << endl << flush;
+
+  size_t nbSnps = 30, N = 101;
+  vector<double> exp, obs(N), x(N);
+  test_simulDosages (nbSnps, N, exp);
+  double sumAbsX = 0.0;
+  for (size_t i = 0; i < N; ++i)
+  {
+    x[i] = sin (i + 1.0);
+    sumAbsX += fabs (x[i]);
+  }
+
+  DosageEncoding encodings[] = {DOSAGE_F32, DOSAGE_U16, DOSAGE_U8};
+  for (size_t e = 0; e < 3; ++e)
+  {
+    DosageMatrix dm;
+    initDosageMatrix (dm, encodings[e], nbSnps, N);
+    double maxErr = getDosageEncodingMaxError (encodings[e]);
+    string name = getDosageEncodingName (encodings[e]);
+    for (size_t s = 0; s < nbSnps; ++s)
+      setDosageRow (dm, s, &exp[s*N]);
+    checkBelow (getDosageMatrixBytes (dm), nbSnps * N * 4.0,
+		name + " bytes", __FUNCTION__);
+
+    for (size_t s = 0; s < nbSnps; ++s)
+    {
+      const double * d = &exp[s*N];
+      getDosageRow (dm, s, &obs[0]);
+      double sumExp = 0.0, dotExp = 0.0;
+      size_t nbMissExp = 0, nbMissObs;
+      for (size_t i = 0; i < N; ++i)
+      {
+	if (isnan (d[i]))
+	{
+	  ++nbMissExp;
+	  checkBelow (isnan (obs[i]) ? 0 : 1, 0, name + " missing",
+		      __FUNCTION__);
+	  continue;
+	}
+	checkBelow (fabs (obs[i] - d[i]), maxErr, name + " decode",
+		    __FUNCTION__);
+	sumExp += d[i];
+	dotExp += d[i] * x[i];
+      }
+      double sumObs = sumDosageRow (dm, s, nbMissObs);
+      checkBelow (fabs (sumObs - sumExp), N * maxErr, name + " sum",
+		  __FUNCTION__);
+      checkBelow (nbMissObs == nbMissExp ? 0 : 1, 0, name + " nb missing",
+		  __FUNCTION__);
+      checkBelow (fabs (dotDosageRow (dm, s, &x[0]) - dotExp),
+		  sumAbsX * maxErr, name + " dot", __FUNCTION__);
+    }
+  }
+
+  if (verbose > 0)
+    cout << "END '" << __FUNCTION__ << "'" << endl << flush;
+}
+
+void
+test_DosageWriter (const int & verbose)
+{
+  if (verbose > 0)
+    cout << "START '" << __FUNCTION__ << "'" << endl << flush;
+
+  size_t nbSnps = 7, N = 20;
+  vector<double> exp, obs(N);
+  test_simulDosages (nbSnps, N, exp);
+  vector<string> vFileNames (1, "test_dosages.bin");
+
+  DosageWriter dw;
+  openDosageWriter (dw, vFileNames[0], DOSAGE_U16, N);
+  for (size_t s = 0; s < nbSnps; ++s)
+    writeDosageRow (dw, &exp[s*N]);
+  closeDosageWriter (dw);
+
+  DosageMatrix dm;
+  loadDosageFile (vFileNames[0], dm);
+  checkBelow (dm.nbSnps == nbSnps && dm.nbSamples == N &&
+	      dm.encoding == DOSAGE_U16 ? 0 : 1, 0, "header", __FUNCTION__);
+  for (size_t s = 0; s < nbSnps; ++s)
+  {
+    getDosageRow (dm, s, &obs[0]);
+    for (size_t i = 0; i < N; ++i)
+      if (! isnan (exp[s*N+i]))
+	checkBelow (fabs (obs[i] - exp[s*N+i]),
+		    getDosageEncodingMaxError (DOSAGE_U16), "reload",
+		    __FUNCTION__);
+  }
+
+  // by blocks of 3 SNPs, the last one being incomplete
+  DosageReader dr;
+  DosageMatrix block;
+  size_t nbRead = 0, nb;
+  openDosageReader (dr, vFileNames[0]);
+  while ((nb = readDosageRows (dr, 3, block)) > 0)
+  {
+    for (size_t k = 0; k < nb * N; ++k)
+      checkBelow (block.u16[k] == dm.u16[nbRead*N+k] ? 0 : 1, 0, "reader",
+		  __FUNCTION__);
+    nbRead += nb;
+  }
+  closeDosageReader (dr);
+  checkBelow (nbRead == nbSnps ? 0 : 1, 0, "reader nb SNPs", __FUNCTION__);
+
+  removeFiles (vFileNames);
+
+  if (verbose > 0)
+    cout << "END '" << __FUNCTION__ << "'" << endl << flush;
+}
+
+void
+test_transposeDosageFile (const int & verbose)
+{
+  if (verbose > 0)
+    cout << "START '" << __FUNCTION__ << "'" << endl << flush;
+
+  size_t nbSnps = 23, N = 37;
+  vector<double> exp, obs(N);
+  test_simulDosages (nbSnps, N, exp);
+  vector<string> vFileNames;
+  vFileNames.push_back ("test_dosages.bin");
+  vFileNames.push_back ("test_dosages_t.bin");
+  vFileNames.push_back ("test_dosages_tt.bin");
+
+  DosageWriter dw;
+  openDosageWriter (dw, vFileNames[0], DOSAGE_U16, N);
+  for (size_t s = 0; s < nbSnps; ++s)
+    writeDosageRow (dw, &exp[s*N]);
+  closeDosageWriter (dw);
+  DosageMatrix dm;
+  loadDosageFile (vFileNames[0], dm);
+
+  // bands of 5 samples then of 3 SNPs, the last ones being incomplete
+  transposeDosageFile (vFileNames[0], vFileNames[1], 2 * nbSnps * 2 * 5);
+  transposeDosageFile (vFileNames[1], vFileNames[2], 2 * N * 2 * 3);
+
+  FILE * stream = fopen (vFileNames[1].c_str (), "rb");
+  vector<uint16_t> codes (nbSnps * N);
+  checkBelow (stream != NULL && fseek (stream, 32, SEEK_SET) == 0 &&
+	      fread (&codes[0], 2, codes.size (), stream) == codes.size ()
+	      ? 0 : 1, 0, "read sample-major", __FUNCTION__);
+  fclose (stream);
+  for (size_t s = 0; s < nbSnps; ++s)
+    for (size_t i = 0; i < N; ++i)
+      checkBelow (codes[i*nbSnps+s] == dm.u16[s*N+i] ? 0 : 1, 0,
+		  "sample-major", __FUNCTION__);
+
+  DosageMatrix dm2;
+  loadDosageFile (vFileNames[2], dm2);
+  checkBelow (dm2.nbSnps == nbSnps && dm2.nbSamples == N &&
+	      dm2.u16 == dm.u16 ? 0 : 1, 0, "round trip", __FUNCTION__);
+
+  removeFiles (vFileNames);
+
+  if (verbose > 0)
+    cout << "END '" << __FUNCTION__ << "'" << endl << flush;
+}
+
+void
+test_PackedGenoMatrix (const int & verbose)
+{
+  if (verbose > 0)
+    cout << "START '" << __FUNCTION__ << "'" << endl << flush;
+
+  // N not a multiple of 4 nor 32 to go through the padding
+  size_t nbSnps = 9, N = 71;
+  vector<uint8_t> calls(nbSnps * N);
+  for (size_t s = 0; s < nbSnps; ++s)
+    for (size_t i = 0; i < N; ++i)
+      calls[s*N+i] = (s == 4) ? (uint8_t) GENO_MISSING :
+	(uint8_t) ((i * 7 + s * s) % 4);
+  vector<double> x(N), obs(N), dots(nbSnps);
+  for (size_t i = 0; i < N; ++i)
+    x[i] = cos (i + 1.0);
+  static const double code2dosage[4] = {2.0, NAN, 1.0, 0.0};
+  vector<string> vFileNames (1, "test_genos.bed");
+
+  PackedGenoWriter pw;
+  openPackedGenoWriter (pw, vFileNames[0], N);
+  for (size_t s = 0; s < nbSnps; ++s)
+    writePackedGenoRow (pw, &calls[s*N]);
+  closePackedGenoWriter (pw);
+
+  for (int load = 0; load < 2; ++load)
+  {
+    PackedGenoMatrix pm;
+    if (load == 0)
+    {
+      initPackedGenoMatrix (pm, nbSnps, N);
+      for (size_t s = 0; s < nbSnps; ++s)
+	setPackedGenoRow (pm, s, &calls[s*N]);
+    }
+    else
+      loadPackedGenoFile (vFileNames[0], N, pm);
+    checkBelow (pm.nbSnps == nbSnps ? 0 : 1, 0, "nb SNPs", __FUNCTION__);
+    checkBelow (getPackedGenoMatrixBytes (pm), nbSnps * (N / 4 + 8),
+		"bytes", __FUNCTION__);
+    dotPackedGenoRows (pm, &x[0], &dots[0]);
+
+    for (size_t s = 0; s < nbSnps; ++s)
+    {
+      size_t exp[4] = {0, 0, 0, 0}, nbHomA1, nbHet, nbHomA2, nbMissing;
+      double dotExp = 0.0;
+      getPackedGenoRow (pm, s, &obs[0]);
+      for (size_t i = 0; i < N; ++i)
+      {
+	double d = code2dosage[calls[s*N+i]];
+	++exp[calls[s*N+i]];
+	checkBelow ((isnan (d) ? isnan (obs[i]) : obs[i] == d) ? 0 : 1, 0,
+		    "decode", __FUNCTION__);
+	if (! isnan (d))
+	  dotExp += d * x[i];
+      }
+      countPackedGenoRow (pm, s, nbHomA1, nbHet, nbHomA2, nbMissing);
+      checkBelow (nbHomA1 == exp[GENO_HOM_A1] && nbHet == exp[GENO_HET] &&
+		  nbHomA2 == exp[GENO_HOM_A2] && nbMissing == exp[GENO_MISSING]
+		  ? 0 : 1, 0, "counts", __FUNCTION__);
+      double maf = getPackedGenoMaf (pm, s);
+      if (s == 4)
+	checkBelow (isnan (maf) ? 0 : 1, 0, "maf missing", __FUNCTION__);
+      else
+      {
+	double f = (2.0 * nbHomA1 + nbHet) / (2.0 * (N - nbMissing));
+	checkBelow (fabs (maf - min (f, 1 - f)), 1e-12, "maf", __FUNCTION__);
+      }
+      checkBelow (fabs (dotPackedGenoRow (pm, s, &x[0]) - dotExp), 1e-12,
+		  "dot", __FUNCTION__);
+      checkBelow (fabs (dots[s] - dotExp), 1e-12, "dots", __FUNCTION__);
+    }
+  }
+
+  checkBelow (getHardCall (0.05, 0.9, 0.05, 0.9) == GENO_HET &&
+	      getHardCall (0.3, 0.3, 0.4, 0.9) == GENO_MISSING ? 0 : 1, 0,
+	      "hard call", __FUNCTION__);
+  checkBelow (getHardCall (0, 0, 0, 0) == GENO_MISSING &&
+	      getHardCall (0, 0, 0, 0.9) == GENO_MISSING &&
+	      getHardCall (1, 0, 0, 0) == GENO_HOM_A1 ? 0 : 1, 0,
+	      "hard call of missing triplet", __FUNCTION__);
+
+  removeFiles (vFileNames);
+
+  if (verbose > 0)
+    cout << "END '" << __FUNCTION__ << "'" << endl << flush;
+}
+
+int main (int argc, char ** argv)
+{
+  int verbose;
+  if (argc > 1)
+    verbose = atoi (argv[1]);
+  else
+    verbose = 0;
+
+  test_DosageMatrix (verbose);
+  test_DosageWriter (verbose);
+  test_transposeDosageFile (verbose);
+  test_PackedGenoMatrix (verbose);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,548 @@
+/** \file test_utils_math.cpp
+ *
+ *  `test_utils_math' tests functions from `utils_math'.
+ *  Copyright (C) 2013 Timothee Flutre
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  g++ -Wall -Wextra -g -fopenmp -I.. utils_io.cpp utils_math.cpp test_utils_math.cpp -lgsl -lgslcblas -lz -o test_utils_math
+ */
+
+#include <cmath>
+#include <cstdlib>
+#include <cstdio>
+
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "utils_io.hpp"
+#include "utils_math.hpp"
+using namespace utils;
+
+/** \brief Exit if obs and exp differ by more than tol, relatively to exp.
+ */
+void
+checkClose (
+  const double obs,
+  const double exp,
+  const double tol,
+  const string & what,
+  const char * function)
+{
+  if (fabs(obs - exp) > tol * max(1.0, fabs(exp)))
+  {
+    cerr << "ERROR: in " << function << endl;
+    cerr << what << " obs (" << obs << ") != exp (" << exp << ")" << endl;
+    exit (1);
+  }
+}
+
+/** \brief Fill X with an intercept, genotypes in 0/1/2 in the 2nd column
+ *  and normal covariates, and y with a genetic effect plus noise.
+ */
+void
+test_simulRegression (
+  RngStream & rng,
+  gsl_matrix * X,
+  gsl_vector * y,
+  const bool monomorphic)
+{
+  size_t N = X->size1, P = X->size2;
+  vector<double> z(N * P);
+  rngStreamNormalBatch (rng, &z[0], z.size());
+  for (size_t i = 0; i < N; ++i)
+  {
+    gsl_matrix_set (X, i, 0, 1.0);
+    gsl_matrix_set (X, i, 1, monomorphic ? 2.0 :
+		    floor (3 * rngStreamUniform (rng)));
+    double y_i = 0.3 * gsl_matrix_get (X, i, 1) + z[i*P];
+    for (size_t p = 2; p < P; ++p)
+    {
+      gsl_matrix_set (X, i, p, z[i*P+p]);
+      y_i += 0.1 * z[i*P+p];
+    }
+    gsl_vector_set (y, i, y_i);
+  }
+}
+
+void
+test_FitSingleGeneWithSingleSnp (const int & verbose)
+{
+  if (verbose > 0)
+    cout << "START '" << __FUNCTION__ << "'" << endl << flush;
+
+  RngStream rng;
+  rngStreamInit (rng, 1859, 0);
+  size_t vN[] = {20, 50, 300};
+
+  // P up to UTILS_MAX_SMALL_P+1 to also go through the generic path
+  for (size_t P = 2; P <= UTILS_MAX_SMALL_P + 1; ++P)
+  {
+    for (size_t n = 0; n < 3; ++n)
+    {
+      size_t N = vN[n];
+      if (N <= P + 1)
+	continue;
+      for (int mono = 0; mono < 2; ++mono)
+      {
+	gsl_matrix * X = gsl_matrix_alloc (N, P);
+	gsl_vector * y = gsl_vector_alloc (N);
+	test_simulRegression (rng, X, y, mono == 1);
+
+	double exp[5], obs[5];
+	FitSingleGeneWithSingleSnpSvd (X, y, exp[0], exp[1], exp[2], exp[3],
+				       exp[4]);
+	FitSingleGeneWithSingleSnp (X, y, obs[0], obs[1], obs[2], obs[3],
+				    obs[4]);
+	if (mono == 0) // rank deficient otherwise, betahat is arbitrary
+	  for (size_t k = 0; k < 5; ++k)
+	    checkClose (obs[k], exp[k], 1e-8,
+			"P=" + toString(P) + " N=" + toString(N)
+			+ " output " + toString(k), __FUNCTION__);
+
+	gsl_matrix_free (X);
+	gsl_vector_free (y);
+      }
+    }
+  }
+
+  if (verbose > 0)
+    cout << "END '" << __FUNCTION__ << "'" << endl << flush;
+}
+
+void
+test_FitSingleGeneWithManySnps (const int & verbose)
+{
+  if (verbose > 0)
+    cout << "START '" << __FUNCTION__ << "'" << endl << flush;
+
+  RngStream rng;
+  rngStreamInit (rng, 1859, 1);
+  size_t N = 100, S = 40;
+
+  for (size_t Q = 1; Q <= UTILS_MAX_SMALL_P; Q += 3)
+  {
+    size_t P = Q + 1;
+    gsl_matrix * X = gsl_matrix_alloc (N, P), * C = gsl_matrix_alloc (N, Q),
+      * G = gsl_matrix_alloc (N, S);
+    gsl_vector * y = gsl_vector_alloc (N);
+    test_simulRegression (rng, X, y, false);
+    for (size_t i = 0; i < N; ++i)
+    {
+      gsl_matrix_set (C, i, 0, 1.0);
+      for (size_t q = 1; q < Q; ++q)
+	gsl_matrix_set (C, i, q, gsl_matrix_get (X, i, q + 1));
+      for (size_t s = 0; s < S; ++s)
+	gsl_matrix_set (G, i, s, s == 7 ? 1.0 : // monomorphic
+			floor (3 * rngStreamUniform (rng)));
+    }
+
+    vector<gsl_vector *> obs(5);
+    for (size_t k = 0; k < 5; ++k)
+      obs[k] = gsl_vector_alloc (S);
+    FitSingleGeneWithManySnps (C, y, G, obs[0], obs[1], obs[2], obs[3],
+			       obs[4]);
+
+    double exp[5];
+    for (size_t s = 0; s < S; ++s)
+    {
+      for (size_t i = 0; i < N; ++i)
+	gsl_matrix_set (X, i, 1, gsl_matrix_get (G, i, s));
+      FitSingleGeneWithSingleSnpSvd (X, y, exp[0], exp[1], exp[2], exp[3],
+				     exp[4]);
+      for (size_t k = 0; k < 5; ++k)
+	if (s != 7 || k < 2)
+	  checkClose (gsl_vector_get (obs[k], s), exp[k], 1e-8,
+		      "Q=" + toString(Q) + " s=" + toString(s)
+		      + " output " + toString(k), __FUNCTION__);
+    }
+
+    for (size_t k = 0; k < 5; ++k)
+      gsl_vector_free (obs[k]);
+    gsl_matrix_free (X);
+    gsl_matrix_free (C);
+    gsl_matrix_free (G);
+    gsl_vector_free (y);
+  }
+
+  if (verbose > 0)
+    cout << "END '" << __FUNCTION__ << "'" << endl << flush;
+}
+
+/** \brief Fill C with an intercept, G with genotypes in 0/1/2 and y with
+ *  an effect of the SNP effectSnp plus noise.
+ */
+void
+test_simulPermutation (
+  RngStream & rng,
+  gsl_vector * y,
+  gsl_matrix * G,
+  gsl_matrix * C,
+  const double effect,
+  const size_t effectSnp)
+{
+  size_t N = G->size1, S = G->size2;
+  vector<double> z(N);
+  rngStreamNormalBatch (rng, &z[0], N);
+  for (size_t i = 0; i < N; ++i)
+  {
+    gsl_matrix_set (C, i, 0, 1.0);
+    for (size_t s = 0; s < S; ++s)
+      gsl_matrix_set (G, i, s, floor (3 * rngStreamUniform (rng)));
+    gsl_vector_set (y, i, effect * gsl_matrix_get (G, i, effectSnp) + z[i]);
+  }
+}
+
+/** \brief Return in maxAbsT the max |t| over the SNPs of the phenotypes
+ *  permuted as in PermuteSingleGeneWithManySnps, one regression at a time.
+ *  \note With an intercept as only covariate, permuting y is the same as
+ *  permuting its residuals, and |t| increases with |cor|.
+ */
+void
+test_bruteForcePermutations (
+  const gsl_vector * y,
+  const gsl_matrix * G,
+  const size_t nbPerms,
+  const size_t seed,
+  double & maxAbsTobs,
+  vector<double> & maxAbsT)
+{
+  size_t N = G->size1, S = G->size2;
+  gsl_matrix * X = gsl_matrix_alloc (N, 2);
+  gsl_vector * yp = gsl_vector_alloc (N);
+  vector<size_t> idx(N);
+  RngStream rng;
+  double pve, sigmahat, betahat, sebetahat, pval;
+  maxAbsT.assign (nbPerms, 0.0);
+  maxAbsTobs = 0.0;
+  for (size_t k = 0; k <= nbPerms; ++k) // last one is the observed
+  {
+    for (size_t i = 0; i < N; ++i)
+      idx[i] = i;
+    if (k < nbPerms)
+    {
+      rngStreamInit (rng, seed, k);
+      rngStreamShuffle (rng, &idx[0], N);
+    }
+    for (size_t i = 0; i < N; ++i)
+      gsl_vector_set (yp, i, gsl_vector_get (y, idx[i]));
+    double & m = (k < nbPerms) ? maxAbsT[k] : maxAbsTobs;
+    for (size_t s = 0; s < S; ++s)
+    {
+      for (size_t i = 0; i < N; ++i)
+      {
+	gsl_matrix_set (X, i, 0, 1.0);
+	gsl_matrix_set (X, i, 1, gsl_matrix_get (G, i, s));
+      }
+      FitSingleGeneWithSingleSnp (X, yp, pve, sigmahat, betahat, sebetahat,
+				  pval);
+      m = max (m, fabs (betahat / sebetahat));
+    }
+  }
+  gsl_matrix_free (X);
+  gsl_vector_free (yp);
+}
+
+void
+test_PermuteSingleGeneWithManySnps (const int & verbose)
+{
+  if (verbose > 0)
+    cout << "START '" << __FUNCTION__ << "'" << endl << flush;
+
+  RngStream rng;
+  rngStreamInit (rng, 1859, 2);
+  size_t N = 60, S = 20, seed = 1859;
+  gsl_matrix * G = gsl_matrix_alloc (N, S), * C = gsl_matrix_alloc (N, 1);
+  gsl_vector * y = gsl_vector_alloc (N);
+
+  // all permutations, the last batch being incomplete
+  size_t nbPerms = 300, nbPermsDone = 0, nbSuccesses = 0;
+  double maxAbsCorObs, maxAbsTobs, pval;
+  vector<double> maxAbsT;
+  test_simulPermutation (rng, y, G, C, 0.7, 3);
+  pval = PermuteSingleGeneWithManySnps (y, G, C, nbPerms, 0, seed,
+					nbPermsDone, maxAbsCorObs);
+  test_bruteForcePermutations (y, G, nbPerms, seed, maxAbsTobs, maxAbsT);
+  for (size_t k = 0; k < nbPerms; ++k)
+    if (maxAbsT[k] >= maxAbsTobs)
+      ++nbSuccesses;
+  checkClose (nbPermsDone, nbPerms, 0.0, "nb of permutations", __FUNCTION__);
+  checkClose (maxAbsCorObs, maxAbsTobs / sqrt (maxAbsTobs * maxAbsTobs
+					       + N - 2), 1e-8,
+	      "observed max |cor|", __FUNCTION__);
+  checkClose (pval, (1 + nbSuccesses) / (double) (1 + nbPerms), 1e-12,
+	      "p-value", __FUNCTION__);
+  if (nbSuccesses == 0 || nbSuccesses == nbPerms)
+  {
+    cerr << "ERROR: in " << __FUNCTION__ << endl;
+    cerr << "all or none of the permutations are successes" << endl;
+    exit (1);
+  }
+
+  // early stopping, only after a whole batch of 128 permutations
+  size_t nbSuccessesToStop = 10;
+  nbPerms = 1000;
+  test_simulPermutation (rng, y, G, C, 0.7, 3);
+  pval = PermuteSingleGeneWithManySnps (y, G, C, nbPerms, nbSuccessesToStop,
+					seed, nbPermsDone, maxAbsCorObs);
+  test_bruteForcePermutations (y, G, nbPerms, seed, maxAbsTobs, maxAbsT);
+  vector<size_t> cumSuccesses(nbPerms + 1, 0);
+  for (size_t k = 0; k < nbPerms; ++k)
+    cumSuccesses[k+1] = cumSuccesses[k] + (maxAbsT[k] >= maxAbsTobs ? 1 : 0);
+  if (nbPermsDone == 0 || nbPermsDone >= nbPerms || nbPermsDone % 128 != 0
+      || cumSuccesses[nbPermsDone] < nbSuccessesToStop
+      || cumSuccesses[nbPermsDone - 128] >= nbSuccessesToStop)
+  {
+    cerr << "ERROR: in " << __FUNCTION__ << endl;
+    cerr << "stopped after " << nbPermsDone << " permutations" << endl;
+    exit (1);
+  }
+  checkClose (pval, (1 + cumSuccesses[nbPermsDone])
+	      / (double) (1 + nbPermsDone), 1e-12,
+	      "p-value with early stopping", __FUNCTION__);
+
+  gsl_matrix_free (G);
+  gsl_matrix_free (C);
+  gsl_vector_free (y);
+
+  if (verbose > 0)
+    cout << "END '" << __FUNCTION__ << "'" << endl << flush;
+}
+
+/** \brief Exit if the permutations with 1 and 4 threads differ in any bit,
+ *  the substream of a permutation being its index, whoever draws it.
+ */
+void
+test_PermuteSingleGeneWithManySnpsThreads (const int & verbose)
+{
+  if (verbose > 0)
+    cout << "START '" << __FUNCTION__ << "'" << endl << flush;
+
+#ifdef _OPENMP
+  RngStream rng;
+  rngStreamInit (rng, 1859, 3);
+  size_t N = 60, S = 20, seed = 1859;
+  gsl_matrix * G = gsl_matrix_alloc (N, S), * C = gsl_matrix_alloc (N, 1);
+  gsl_vector * y = gsl_vector_alloc (N);
+  test_simulPermutation (rng, y, G, C, 0.2, 3);
+
+  // with and without early stopping
+  int nbThreads = omp_get_max_threads();
+  size_t vNbSuccessesToStop[] = {0, 10}, nbPermsDone[2];
+  double pval[2], maxAbsCorObs[2];
+  for (size_t k = 0; k < 2; ++k)
+  {
+    for (int t = 0; t < 2; ++t)
+    {
+      omp_set_num_threads (t == 0 ? 1 : 4);
+      pval[t] = PermuteSingleGeneWithManySnps (y, G, C, 1000,
+					       vNbSuccessesToStop[k], seed,
+					       nbPermsDone[t],
+					       maxAbsCorObs[t]);
+    }
+    omp_set_num_threads (nbThreads);
+    if (pval[0] != pval[1] || nbPermsDone[0] != nbPermsDone[1]
+	|| maxAbsCorObs[0] != maxAbsCorObs[1])
+    {
+      cerr << "ERROR: in " << __FUNCTION__ << endl;
+      cerr << "1 thread: p=" << pval[0] << " after " << nbPermsDone[0]
+	   << ", 4 threads: p=" << pval[1] << " after " << nbPermsDone[1]
+	   << endl;
+      exit (1);
+    }
+  }
+
+  gsl_matrix_free (G);
+  gsl_matrix_free (C);
+  gsl_vector_free (y);
+#endif
+
+  if (verbose > 0)
+    cout << "END '" << __FUNCTION__ << "'" << endl << flush;
+}
+
+void
+test_rngStream (const int & verbose)
+{
+  if (verbose > 0)
+    cout << "START '" << __FUNCTION__ << "'" << endl << flush;
+
+  // known-answer test of Random123 for philox4x32-10
+  RngStream rng;
+  rngStreamInit (rng, 0, 0);
+  uint32_t exp[4] = {0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8};
+  for (size_t i = 0; i < 4; ++i)
+  {
+    uint32_t obs = rngStreamNext (rng);
+    if (obs != exp[i])
+    {
+      cerr << "ERROR: in " << __FUNCTION__ << endl;
+      cerr << "word " << i << " obs (" << obs << ") != exp (" << exp[i]
+	   << ")" << endl;
+      exit (1);
+    }
+  }
+
+  // same substream, same draws, whatever the batches
+  RngStream rng1, rng2;
+  rngStreamInit (rng1, 1859, 12);
+  rngStreamInit (rng2, 1859, 12);
+  vector<double> u1(10), u2(10);
+  rngStreamUniformBatch (rng1, &u1[0], 10);
+  for (size_t i = 0; i < 10; ++i)
+    u2[i] = rngStreamUniform (rng2);
+  for (size_t i = 0; i < 10; ++i)
+    checkClose (u1[i], u2[i], 0.0, "uniform " + toString(i), __FUNCTION__);
+
+  if (verbose > 0)
+    cout << "END '" << __FUNCTION__ << "'" << endl << flush;
+}
+
+void
+test_mygsl_elementwise (const int & verbose)
+{
+  if (verbose > 0)
+    cout << "START '" << __FUNCTION__ << "'" << endl << flush;
+
+  // 5 x 9 view of a 10 x 12 matrix, ie. tda > size2 and strided columns
+  RngStream rng;
+  rngStreamInit (rng, 1859, 2);
+  size_t R = 10, C = 12;
+  gsl_matrix * M = gsl_matrix_alloc (R, C), * M0 = gsl_matrix_alloc (R, C);
+  double exponents[] = {1.0, 2.0, -1.0, 0.5, -0.5, 0.0, 1.7};
+
+  for (size_t e = 0; e < 7; ++e)
+  {
+    double ex = exponents[e];
+    string what = "exponent " + toString(ex);
+    for (size_t i = 0; i < R; ++i)
+      for (size_t j = 0; j < C; ++j)
+	gsl_matrix_set (M0, i, j, 0.1 + 2 * rngStreamUniform (rng));
+    gsl_matrix_view V = gsl_matrix_submatrix (M, 1, 2, 5, 9);
+    gsl_matrix_const_view V0 = gsl_matrix_const_submatrix (M0, 1, 2, 5, 9);
+    gsl_vector_const_view col0 = gsl_matrix_const_column (&V0.matrix, 3),
+      row0 = gsl_matrix_const_row (&V0.matrix, 2);
+    size_t n1 = V.matrix.size1, n2 = V.matrix.size2;
+
+    // matrix power, the elements out of the view being left unchanged
+    gsl_matrix_memcpy (M, M0);
+    mygsl_matrix_pow (&V.matrix, ex);
+    for (size_t i = 0; i < R; ++i)
+      for (size_t j = 0; j < C; ++j)
+      {
+	double x0 = gsl_matrix_get (M0, i, j);
+	bool in = i >= 1 && i < 1 + n1 && j >= 2 && j < 2 + n2;
+	checkClose (gsl_matrix_get (M, i, j), in ? pow (x0, ex) : x0, 1e-14,
+		    what + " matrix_pow " + toString(i) + "," + toString(j),
+		    __FUNCTION__);
+      }
+
+    // vector power and sums, on a strided column and a contiguous row
+    gsl_matrix_memcpy (M, M0);
+    gsl_vector_view col = gsl_matrix_column (&V.matrix, 3),
+      row = gsl_matrix_row (&V.matrix, 2);
+    double expColSum = 0.0, expRowSum = 0.0, expRowPowSum = 0.0;
+    for (size_t i = 0; i < n1; ++i)
+      expColSum += pow (gsl_vector_get (&col0.vector, i), ex);
+    for (size_t j = 0; j < n2; ++j)
+    {
+      expRowSum += gsl_vector_get (&row0.vector, j);
+      expRowPowSum += pow (gsl_vector_get (&row0.vector, j), ex);
+    }
+    checkClose (mygsl_vector_pow_sum (&col.vector, ex), expColSum, 1e-14,
+		what + " vector_pow_sum strided", __FUNCTION__);
+    checkClose (mygsl_vector_pow_sum (&row.vector, ex), expRowPowSum, 1e-14,
+		what + " vector_pow_sum", __FUNCTION__);
+    checkClose (mygsl_vector_sum (&row.vector), expRowSum, 1e-14,
+		what + " vector_sum", __FUNCTION__);
+    mygsl_vector_pow (&col.vector, ex);
+    checkClose (mygsl_vector_sum (&col.vector), expColSum, 1e-14,
+		what + " vector_pow strided", __FUNCTION__);
+    for (size_t i = 0; i < n1; ++i)
+      checkClose (gsl_vector_get (&col.vector, i),
+		  pow (gsl_vector_get (&col0.vector, i), ex), 1e-14,
+		  what + " vector_pow strided " + toString(i), __FUNCTION__);
+
+    // columns scaled by a strided vector, rows by a contiguous one
+    gsl_matrix_memcpy (M, M0);
+    gsl_vector_const_view colScales = gsl_matrix_const_column (M0, 0),
+      rowScales = gsl_vector_const_subvector (&row0.vector, 0, n1);
+    gsl_vector_const_view scales = gsl_matrix_const_subcolumn (M0, 11, 0,
+							       n2);
+    mygsl_matrix_scale_columns (&V.matrix, &scales.vector, ex);
+    for (size_t i = 0; i < n1; ++i)
+      for (size_t j = 0; j < n2; ++j)
+	checkClose (gsl_matrix_get (&V.matrix, i, j),
+		    gsl_matrix_get (&V0.matrix, i, j)
+		    * pow (gsl_vector_get (&scales.vector, j), ex), 1e-14,
+		    what + " scale_columns", __FUNCTION__);
+    gsl_matrix_memcpy (M, M0);
+    mygsl_matrix_scale_rows (&V.matrix, &rowScales.vector, ex);
+    for (size_t i = 0; i < n1; ++i)
+      for (size_t j = 0; j < n2; ++j)
+	checkClose (gsl_matrix_get (&V.matrix, i, j),
+		    gsl_matrix_get (&V0.matrix, i, j)
+		    * pow (gsl_vector_get (&rowScales.vector, i), ex), 1e-14,
+		    what + " scale_rows", __FUNCTION__);
+    gsl_matrix_memcpy (M, M0);
+    mygsl_matrix_scale_rows (&V.matrix, &colScales.vector, ex);
+    for (size_t i = 0; i < n1; ++i)
+      checkClose (gsl_matrix_get (&V.matrix, i, 0),
+		  gsl_matrix_get (&V0.matrix, i, 0)
+		  * pow (gsl_vector_get (&colScales.vector, i), ex), 1e-14,
+		  what + " scale_rows strided", __FUNCTION__);
+
+    // alpha V + x I, the last columns being off the diagonal
+    gsl_matrix_memcpy (M, M0);
+    mygsl_matrix_scale_add_diag (&V.matrix, -ex, 1.0);
+    for (size_t i = 0; i < n1; ++i)
+      for (size_t j = 0; j < n2; ++j)
+	checkClose (gsl_matrix_get (&V.matrix, i, j),
+		    -ex * gsl_matrix_get (&V0.matrix, i, j) + (i == j ? 1.0 : 0.0),
+		    1e-14, what + " scale_add_diag", __FUNCTION__);
+    for (size_t j = 0; j < C; ++j)
+      checkClose (gsl_matrix_get (M, 0, j), gsl_matrix_get (M0, 0, j), 0.0,
+		  what + " scale_add_diag out of view", __FUNCTION__);
+  }
+
+  gsl_matrix_free (M);
+  gsl_matrix_free (M0);
+
+  if (verbose > 0)
+    cout << "END '" << __FUNCTION__ << "'" << endl << flush;
+}
+
+int main (int argc, char ** argv)
+{
+  int verbose;
+  if (argc > 1)
+    verbose = atoi (argv[1]);
+  else
+    verbose = 0;
+
+  test_rngStream (verbose);
+  test_mygsl_elementwise (verbose);
+  test_FitSingleGeneWithSingleSnp (verbose);
+  test_FitSingleGeneWithManySnps (verbose);
+  test_PermuteSingleGeneWithManySnps (verbose);
+  test_PermuteSingleGeneWithManySnpsThreads (verbose);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,675 @@
+/** \file trans_eqtl.cpp
+ *
+ *  `trans_eqtl' tests the association between all genes and all SNPs.
+ *  Copyright (C) 2011-2014 Timothée Flutre
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Compile with: g++ -Wall -O3 -fopenmp -I.. utils_io.cpp utils_math.cpp utils_geno.cpp trans_eqtl.cpp -lgsl -lgslcblas -lz -o trans_eqtl
+ *  (see utils_math.hpp to link with an optimized BLAS)
+ */
+
+#include <cmath>
+#include <ctime>
+#include <cstring>
+#include <cstdio>
+#include <getopt.h>
+#include <libgen.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+using namespace std;
+
+#include <gsl/gsl_matrix.h>
+#include <gsl/gsl_blas.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "utils_io.hpp"
+#include "utils_math.hpp"
+#include "utils_geno.hpp"
+using namespace utils;
+
+#ifndef VERSION
+#define VERSION "1.0.0" // http://semver.org/
+#endif
+
+// number of genes per tile, each tile being handled by a single thread
+#define TRANS_TILE_SIZE 256
+
+/** \brief Display the help on stdout.
+ *  \note The format complies with help2man (http://www.gnu.org/s/help2man)
+ */
+void help(char ** argv)
+{
+  cout << "`" << argv[0] << "'"
+       << " tests the association between all genes and all SNPs." << endl
+       << endl
+       << "Usage: " << argv[0] << " [OPTIONS] ..." << endl
+       << endl
+       << "Options:" << endl
+       << "  -h, --help\tdisplay the help and exit" << endl
+       << "  -V, --version\toutput version information and exit" << endl
+       << "  -v, --verbose\tverbosity level (0/default=1/2/3)" << endl
+       << "  -g, --geno\tpath to the genotype file in the MatrixEQTL format (can be gzipped)" << endl
+       << "\t\theader with sample names, 1 row per SNP" << endl
+       << "\t\tmissing values are '-1' or 'NA'" << endl
+       << "      --dose\tpath to a binary dosage file instead of --geno (see impute2bimbam)" << endl
+       << "\t\tsamples in the order of the columns of --pheno" << endl
+       << "\t\tSNPs identified by their index in the file, starting at 1" << endl
+       << "  -p, --pheno\tpath to the phenotype file in the MatrixEQTL format (can be gzipped)" << endl
+       << "\t\theader with sample names, 1 row per gene" << endl
+       << "  -c, --cvrt\tpath to the covariate file in the MatrixEQTL format (optional)" << endl
+       << "\t\theader with sample names, 1 row per covariate, no intercept" << endl
+       << "  -o, --out\tpath to the output file (gzipped if ending with '.gz')" << endl
+       << "\t\tcolumns: SNP gene beta t-stat p-value" << endl
+       << "      --egenes\tpath to the output file with one row per gene (optional)" << endl
+       << "\t\tcolumns: gene nb.snps best.snp pvalue pval.beta" << endl
+       << "      --pv\tmaximum p-value to report a gene-SNP pair (default=1e-5)" << endl
+       << "      --block\tnumber of SNPs read from the genotype file at once (default=1024)" << endl
+       << "  -t, --threads\tnumber of threads (default=1)" << endl
+       << endl
+       << "Remarks:" << endl
+       << "  The model is the one of MatrixEQTL (modelLINEAR): y = mu + g b + covariates + e." << endl
+       << "  Only the phenotypes are kept in memory; SNPs are read by blocks, regressed on" << endl
+       << "  the covariates, and multiplied with the phenotypes by tiles of " << TRANS_TILE_SIZE << " genes." << endl
+       << "  The p-value threshold is converted into a correlation threshold so that" << endl
+       << "  p-values are only computed for the pairs which are reported." << endl
+       << "  Missing genotypes and phenotypes are replaced by the mean of their row." << endl
+       << "  pval.beta is the minimum p-value corrected as 1-(1-p)^nb.snps." << endl
+       << endl
+       << "Examples:" << endl
+       << "  " << argv[0] << " -g genos.txt.gz -p phenos.txt.gz -o trans.txt.gz --pv 1e-8 -t 8" << endl
+       << endl
+       << "Report bugs to <timothee.flutre@supagro.inra.fr>." << endl
+    ;
+}
+
+/** \brief Display version and license information on stdout.
+ */
+void version(char ** argv)
+{
+  cout << argv[0] << " " << VERSION << endl
+       << endl
+       << "Copyright (C) 2011-2014 Timothée Flutre." << endl
+       << "License GPLv3+: GNU GPL version 3 or later <http://gnu.org/licenses/gpl.html>" << endl
+       << "This is free software; see the source for copying conditions.  There is NO" << endl
+       << "warranty; not even for MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE." << endl
+       << endl
+       << "Written by Timothée Flutre." << endl
+    ;
+}
+
+struct TransParams
+{
+  string genoFile;
+  string doseFile;
+  string phenoFile;
+  string cvrtFile;
+  string outFile;
+  string egenesFile;
+  double maxPval;
+  size_t blockSize;
+  int nbThreads;
+  int verbose;
+};
+
+void checkFile(int argc, char ** argv, const string & file,
+	       const string & option, const bool compulsory)
+{
+  if(file.empty() && compulsory){
+    cerr << "cmd-line: " << getCmdLine(argc, argv) << endl << endl
+	 << "ERROR: missing compulsory option --" << option << endl << endl;
+    help(argv);
+    exit(1);
+  }
+  if(! file.empty() && ! doesFileExist(file)){
+    cerr << "cmd-line: " << getCmdLine(argc, argv) << endl << endl
+	 << "ERROR: can't find file " << file << endl << endl;
+    help(argv);
+    exit(1);
+  }
+}
+
+/** \brief Parse the command-line arguments and check the values of the
+ *  compulsory ones.
+ */
+void
+parseCmdLine(
+  int argc,
+  char ** argv,
+  TransParams & par)
+{
+  int c = 0;
+  while(true)
+  {
+    static struct option long_options[] =
+    {
+      {"help", no_argument, 0, 'h'},
+      {"version", no_argument, 0, 'V'},
+      {"verbose", required_argument, 0, 'v'},
+      {"geno", required_argument, 0, 'g'},
+      {"dose", required_argument, 0, 0},
+      {"pheno", required_argument, 0, 'p'},
+      {"cvrt", required_argument, 0, 'c'},
+      {"out", required_argument, 0, 'o'},
+      {"egenes", required_argument, 0, 0},
+      {"pv", required_argument, 0, 0},
+      {"block", required_argument, 0, 0},
+      {"threads", required_argument, 0, 't'},
+      {0, 0, 0, 0}
+    };
+    int option_index = 0;
+    c = getopt_long(argc, argv, "hVv:g:p:c:o:t:",
+                    long_options, &option_index);
+    if(c == -1)
+      break;
+    switch(c)
+    {
+    case 0:
+      if(long_options[option_index].flag != 0)
+        break;
+      if(strcmp(long_options[option_index].name, "dose") == 0)
+        par.doseFile = optarg;
+      else if(strcmp(long_options[option_index].name, "egenes") == 0)
+        par.egenesFile = optarg;
+      else if(strcmp(long_options[option_index].name, "pv") == 0)
+        par.maxPval = atof(optarg);
+      else if(strcmp(long_options[option_index].name, "block") == 0)
+        par.blockSize = (size_t) atof(optarg);
+      break;
+    case 'h':
+      help(argv);
+      exit(0);
+    case 'V':
+      version(argv);
+      exit(0);
+    case 'v':
+      par.verbose = atoi(optarg);
+      break;
+    case 'g':
+      par.genoFile = optarg;
+      break;
+    case 'p':
+      par.phenoFile = optarg;
+      break;
+    case 'c':
+      par.cvrtFile = optarg;
+      break;
+    case 'o':
+      par.outFile = optarg;
+      break;
+    case 't':
+      par.nbThreads = atoi(optarg);
+      break;
+    case '?':
+      printf("\n"); help(argv);
+      abort();
+    default:
+      printf("\n"); help(argv);
+      abort();
+    }
+  }
+  if(par.genoFile.empty() == par.doseFile.empty()){
+    cerr << "cmd-line: " << getCmdLine(argc, argv) << endl << endl
+	 << "ERROR: give either --geno or --dose" << endl << endl;
+    help(argv);
+    exit(1);
+  }
+  checkFile(argc, argv, par.genoFile, "geno", false);
+  checkFile(argc, argv, par.doseFile, "dose", false);
+  checkFile(argc, argv, par.phenoFile, "pheno", true);
+  checkFile(argc, argv, par.cvrtFile, "cvrt", false);
+  if(par.outFile.empty()){
+    cerr << "cmd-line: " << getCmdLine(argc, argv) << endl << endl
+	 << "ERROR: missing compulsory option --out" << endl << endl;
+    help(argv);
+    exit(1);
+  }
+  if(par.maxPval < 0 || par.maxPval > 1){
+    cerr << "cmd-line: " << getCmdLine(argc, argv) << endl << endl
+	 << "ERROR: --pv should be between 0 and 1" << endl << endl;
+    help(argv);
+    exit(1);
+  }
+  if(par.blockSize == 0)
+    par.blockSize = 1;
+  if(par.nbThreads < 1)
+    par.nbThreads = 1;
+}
+
+/** \brief Return, for each sample of 'to', its column in 'from'.
+ */
+vector<size_t> matchSamples(const vector<string> & from,
+			    const vector<string> & to,
+			    const string & fromFile)
+{
+  map<string, size_t> name2col;
+  for(size_t j = 0; j < from.size(); ++j)
+    name2col[from[j]] = j;
+  vector<size_t> cols(to.size());
+  for(size_t i = 0; i < to.size(); ++i){
+    map<string, size_t>::const_iterator it = name2col.find(to[i]);
+    if(it == name2col.end()){
+      cerr << "ERROR: sample " << to[i] << " is missing from file "
+	   << fromFile << endl;
+      exit(1);
+    }
+    cols[i] = it->second;
+  }
+  return cols;
+}
+
+/** \brief Fill rows with the values of file reordered as the samples,
+ *  missing values being replaced by the row mean.
+ */
+void loadRowsInSampleOrder(const string & file,
+			   const vector<string> & samples,
+			   vector<string> & rowNames, gsl_matrix *& rows)
+{
+  vector<string> colNames;
+  vector<double> values;
+  loadLabeledMatrix(file, rowNames, colNames, values);
+  vector<size_t> cols = matchSamples(colNames, samples, file);
+  size_t N = samples.size(), J = colNames.size();
+  rows = gsl_matrix_alloc(rowNames.size(), N);
+  for(size_t r = 0; r < rowNames.size(); ++r){
+    double sum = 0.0;
+    size_t nb = 0;
+    for(size_t i = 0; i < N; ++i){
+      double x = values[r * J + cols[i]];
+      gsl_matrix_set(rows, r, i, x);
+      if(! isNan(x)){
+	sum += x;
+	++nb;
+      }
+    }
+    for(size_t i = 0; i < N; ++i)
+      if(isNan(gsl_matrix_get(rows, r, i)))
+	gsl_matrix_set(rows, r, i, nb > 0 ? sum / nb : 0.0);
+  }
+}
+
+/** \brief Block of SNPs read from the genotype file, the lines being
+ *  copied so that they can be parsed in parallel.
+ */
+struct SnpBlock
+{
+  vector<string> ids;
+  vector<string> lines;
+  vector<double> rows;
+  vector<double> norms;
+};
+
+/** \brief Parse the genotypes of the block, missing ones being NaN.
+ */
+void parseSnpBlock(SnpBlock & blk, const size_t N, const string & genoFile)
+{
+  const size_t S = blk.ids.size();
+  blk.rows.resize(S * N);
+  bool ok = true;
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+  for(long s = 0; s < (long) S; ++s){
+    StringView line = {blk.lines[s].data(), blk.lines[s].size()};
+    vector<StringView> tokens;
+    tokenize(line, " \t", tokens);
+    double * x = &blk.rows[s * N];
+    if(tokens.size() != N + 1){
+      ok = false;
+      continue;
+    }
+    for(size_t i = 0; i < N; ++i)
+      if(! parseDouble(tokens[1+i], x[i]) || x[i] == -1)
+	x[i] = NaN;
+  }
+  if(! ok){
+    cerr << "ERROR: some SNPs of file " << genoFile << " don't have "
+	 << N + 1 << " columns (block starting at " << blk.ids[0] << ")"
+	 << endl;
+    exit(1);
+  }
+}
+
+/** \brief Decode the dosages of the block, missing ones being NaN.
+ */
+void decodeSnpBlock(const DosageMatrix & dm, SnpBlock & blk)
+{
+  const size_t S = dm.nbSnps, N = dm.nbSamples;
+  blk.rows.resize(S * N);
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+  for(long s = 0; s < (long) S; ++s)
+    getDosageRow(dm, s, &blk.rows[s * N]);
+}
+
+/** \brief Mean-impute the missing genotypes of the block, regress out the
+ *  covariates and scale each SNP to unit norm.
+ */
+void prepareSnpBlock(SnpBlock & blk, const gsl_matrix * U, const size_t N)
+{
+  const size_t S = blk.ids.size();
+  blk.norms.resize(S);
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+  for(long s = 0; s < (long) S; ++s){
+    double * x = &blk.rows[s * N];
+    size_t nbMissing = 0;
+    double sum = 0.0;
+    for(size_t i = 0; i < N; ++i){
+      if(isNan(x[i]))
+	++nbMissing;
+      else
+	sum += x[i];
+    }
+    double mean = (nbMissing < N) ? sum / (N - nbMissing) : 0.0;
+    for(size_t i = 0; i < N; ++i)
+      if(isNan(x[i]))
+	x[i] = mean;
+  }
+  gsl_matrix_view B = gsl_matrix_view_array(&blk.rows[0], S, N);
+  vector<double> refNorms(S);
+  CalcRowNorms(&B.matrix, &refNorms[0]);
+  ResidualizeOnBasis(U, &B.matrix, true);
+  ScaleRowsToUnitNorm(&B.matrix, &refNorms[0], &blk.norms[0]);
+}
+
+/** \brief Best SNP of a gene so far, see --egenes.
+ */
+struct GeneBest
+{
+  double maxAbsCor;
+  size_t snp; // index in the genotype file
+  string snpId;
+};
+
+/** \brief Correlate the block with all the genes, one tile of genes per
+ *  task, and write the pairs whose |r| is at least minAbsCor.
+ *  \note Each tile owns its genes and its output buffer, so that tiles
+ *  need no synchronization and the output doesn't depend on the number of
+ *  threads.
+ */
+void testSnpBlock(const SnpBlock & blk, const size_t firstSnp,
+		  const gsl_matrix * Y, const vector<string> & geneIds,
+		  const vector<double> & yNorms, const size_t df,
+		  const double minAbsCor, const double maxPval,
+		  vector<GeneBest> & bests, vector<string> & tileOuts,
+		  BlockWriter & bw)
+{
+  const size_t S = blk.ids.size(), N = Y->size2, G = Y->size1,
+    nbTiles = (G + TRANS_TILE_SIZE - 1) / TRANS_TILE_SIZE;
+  gsl_matrix_const_view B = gsl_matrix_const_view_array(&blk.rows[0], S, N);
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+  for(long t = 0; t < (long) nbTiles; ++t){
+    size_t gBegin = t * TRANS_TILE_SIZE,
+      gEnd = min(G, gBegin + TRANS_TILE_SIZE);
+    gsl_matrix_const_view Yt = gsl_matrix_const_submatrix(Y, gBegin, 0,
+							  gEnd - gBegin, N);
+    gsl_matrix * R = gsl_matrix_alloc(S, gEnd - gBegin);
+    gsl_blas_dgemm(CblasNoTrans, CblasTrans, 1.0, &B.matrix, &Yt.matrix,
+		   0.0, R);
+    string & out = tileOuts[t];
+    out.clear();
+    char buf[1024];
+    for(size_t s = 0; s < S; ++s){
+      if(blk.norms[s] == 0.0) // monomorphic once covariates are regressed out
+	continue;
+      const double * r_s = R->data + s * R->tda;
+      for(size_t g = gBegin; g < gEnd; ++g){
+	double r = r_s[g - gBegin], absR = fabs(r);
+	if(absR > bests[g].maxAbsCor){
+	  bests[g].maxAbsCor = absR;
+	  bests[g].snp = firstSnp + s;
+	}
+	if(absR < minAbsCor || yNorms[g] == 0.0)
+	  continue;
+	double pval = CalcPvalFromCorrelation(r, df);
+	if(pval > maxPval)
+	  continue;
+	double tstat = (r * r < 1.0) ? r * sqrt(df / (1 - r * r))
+	  : (r > 0 ? INFINITY : -INFINITY),
+	  beta = r * yNorms[g] / blk.norms[s];
+	int n = snprintf(buf, sizeof(buf), "%s\t%s\t%.8g\t%.8g\t%.8g\n",
+			 blk.ids[s].c_str(), geneIds[g].c_str(), beta, tstat,
+			 pval);
+	out.append(buf, min((size_t) n, sizeof(buf) - 1));
+      }
+    }
+    gsl_matrix_free(R);
+  }
+
+  for(size_t t = 0; t < nbTiles; ++t)
+    if(! tileOuts[t].empty())
+      bwrite(bw, tileOuts[t]);
+  for(size_t g = 0; g < G; ++g)
+    if(bests[g].snp >= firstSnp && bests[g].snp < firstSnp + S)
+      bests[g].snpId = blk.ids[bests[g].snp - firstSnp];
+}
+
+void run(const TransParams & par)
+{
+  // the threads handle whole tiles, hence a sequential BLAS in each of them
+  mygsl_blas_set_num_threads(1);
+#ifdef _OPENMP
+  omp_set_num_threads(par.nbThreads);
+#endif
+
+  // genotype header gives the sample order, the binary dosages having the
+  // one of the phenotypes
+  BlockReader brGeno;
+  DosageReader drDose;
+  StringView line;
+  vector<StringView> tokens;
+  vector<string> samples, genoHeader;
+  if(par.doseFile.empty()){
+    openBlockReader(brGeno, par.genoFile);
+    if(! getline(brGeno, line)){
+      cerr << "ERROR: file " << par.genoFile << " is empty" << endl;
+      exit(1);
+    }
+    tokenize(line, " \t", tokens);
+    for(size_t j = 0; j < tokens.size(); ++j)
+      genoHeader.push_back(toString(tokens[j]));
+  }
+  else
+    openDosageReader(drDose, par.doseFile);
+
+  if(par.verbose > 0)
+    cout << "load phenotypes and covariates ..." << endl << flush;
+  vector<string> phenoNames, phenoCols, cvrtNames;
+  vector<double> values;
+  loadLabeledMatrix(par.phenoFile, phenoNames, phenoCols, values);
+  values.clear();
+  size_t N = phenoCols.size();
+  if(! par.doseFile.empty()){
+    if(drDose.nbSamples != N){
+      cerr << "ERROR: different numbers of samples in files " << par.doseFile
+	   << " and " << par.phenoFile << endl;
+      exit(1);
+    }
+    samples = phenoCols;
+  }
+  else if(genoHeader.size() == N + 1)
+    samples.assign(genoHeader.begin() + 1, genoHeader.end());
+  else if(genoHeader.size() == N){
+    samples = genoHeader;
+  }
+  else{
+    cerr << "ERROR: different numbers of samples in files " << par.genoFile
+	 << " and " << par.phenoFile << endl;
+    exit(1);
+  }
+  gsl_matrix * Y = NULL, * cvrt = NULL;
+  loadRowsInSampleOrder(par.phenoFile, samples, phenoNames, Y);
+  if(! par.cvrtFile.empty())
+    loadRowsInSampleOrder(par.cvrtFile, samples, cvrtNames, cvrt);
+
+  gsl_matrix * C = gsl_matrix_alloc(N, 1 + cvrtNames.size());
+  for(size_t i = 0; i < N; ++i){
+    gsl_matrix_set(C, i, 0, 1.0);
+    for(size_t q = 0; q < cvrtNames.size(); ++q)
+      gsl_matrix_set(C, i, 1 + q, gsl_matrix_get(cvrt, q, i));
+  }
+  size_t rank;
+  gsl_matrix * U = CalcCovariateBasis(C, rank);
+  if(N <= rank + 1){
+    cerr << "ERROR: not enough samples (" << N << ") for " << rank
+	 << " covariates" << endl;
+    exit(1);
+  }
+  const size_t df = N - rank - 1;
+  const size_t G = Y->size1;
+  vector<double> yRefNorms(G), yNorms(G);
+  CalcRowNorms(Y, &yRefNorms[0]);
+  ResidualizeOnBasis(U, Y, true);
+  ScaleRowsToUnitNorm(Y, &yRefNorms[0], &yNorms[0]);
+  const double minAbsCor = CalcCorrelationFromPval(par.maxPval, df);
+  if(par.verbose > 0)
+    cout << "nb of samples: " << N << endl
+	 << "nb of genes: " << G << endl
+	 << "nb of covariates: " << cvrtNames.size()
+	 << " (rank with intercept=" << rank << ")" << endl
+	 << "minimum |correlation| to report a pair: " << minAbsCor << endl
+	 << "memory for phenotypes and a block of SNPs: "
+	 << (G + par.blockSize) * N * sizeof(double) / 1048576.0 << " MiB"
+	 << endl;
+
+  if(par.verbose > 0)
+    cout << "test all gene-SNP pairs ..." << endl << flush;
+  BlockWriter bw;
+  openBlockWriter(bw, par.outFile, par.nbThreads);
+  bwrite(bw, "SNP\tgene\tbeta\tt-stat\tp-value\n");
+
+  vector<GeneBest> bests(G);
+  for(size_t g = 0; g < G; ++g){
+    bests[g].maxAbsCor = -1.0;
+    bests[g].snp = string::npos;
+  }
+  vector<string> tileOuts((G + TRANS_TILE_SIZE - 1) / TRANS_TILE_SIZE);
+  SnpBlock blk;
+  DosageMatrix dm;
+  size_t nbSnps = 0, nbSnpsTested = 0;
+  while(true){
+    blk.ids.clear();
+    if(par.doseFile.empty()){
+      blk.lines.clear();
+      while(blk.ids.size() < par.blockSize && getline(brGeno, line)){
+	if(tokenize(line, " \t", tokens) == 0)
+	  continue;
+	blk.ids.push_back(toString(tokens[0]));
+	blk.lines.push_back(toString(line));
+      }
+      if(blk.ids.empty())
+	break;
+      parseSnpBlock(blk, N, par.genoFile);
+    }
+    else{
+      size_t nb = readDosageRows(drDose, par.blockSize, dm);
+      if(nb == 0)
+	break;
+      for(size_t s = 0; s < nb; ++s)
+	blk.ids.push_back(toString(nbSnps + s + 1));
+      decodeSnpBlock(dm, blk);
+    }
+    prepareSnpBlock(blk, U, N);
+    testSnpBlock(blk, nbSnps, Y, phenoNames, yNorms, df, minAbsCor,
+		 par.maxPval, bests, tileOuts, bw);
+    nbSnps += blk.ids.size();
+    for(size_t s = 0; s < blk.ids.size(); ++s)
+      nbSnpsTested += (blk.norms[s] > 0.0);
+    if(par.verbose > 1)
+      cout << "nb of SNPs done: " << nbSnps << endl << flush;
+  }
+  if(par.doseFile.empty())
+    closeBlockReader(brGeno);
+  else
+    closeDosageReader(drDose);
+  closeBlockWriter(bw);
+
+  if(! par.egenesFile.empty()){
+    BlockWriter bwGenes;
+    openBlockWriter(bwGenes, par.egenesFile, 1);
+    bwrite(bwGenes, "gene\tnb.snps\tbest.snp\tpvalue\tpval.beta\n");
+    char buf[1024];
+    for(size_t g = 0; g < G; ++g){
+      if(yNorms[g] == 0.0 || bests[g].snp == string::npos)
+	continue;
+      double minPval = CalcPvalFromCorrelation(bests[g].maxAbsCor, df),
+	pBeta = - expm1(nbSnpsTested * log1p(- minPval));
+      int n = snprintf(buf, sizeof(buf), "%s\t%lu\t%s\t%.8g\t%.8g\n",
+		       phenoNames[g].c_str(), (unsigned long) nbSnpsTested,
+		       bests[g].snpId.c_str(), minPval, pBeta);
+      bwrite(bwGenes, buf, min((size_t) n, sizeof(buf) - 1));
+    }
+    closeBlockWriter(bwGenes);
+  }
+
+  if(par.verbose > 0)
+    cout << "nb of SNPs: " << nbSnps << endl
+	 << "nb of SNPs tested (polymorphic): " << nbSnpsTested << endl
+	 << "nb of tests: " << nbSnpsTested * G << endl;
+
+  gsl_matrix_free(Y);
+  gsl_matrix_free(C);
+  if(cvrt != NULL)
+    gsl_matrix_free(cvrt);
+  if(U != NULL)
+    gsl_matrix_free(U);
+}
+
+int main(int argc, char ** argv)
+{
+  TransParams par;
+  par.maxPval = 1e-5;
+  par.blockSize = 1024;
+  par.nbThreads = 1;
+  par.verbose = 1;
+
+  parseCmdLine(argc, argv, par);
+
+  time_t startRawTime, endRawTime;
+  if(par.verbose > 0){
+    time(&startRawTime);
+    cout << "START " << basename(argv[0])
+         << " " << getDateTime(startRawTime) << endl
+         << "version " << VERSION << " compiled " << __DATE__
+         << " " << __TIME__ << endl
+         << "cmd-line: " << getCmdLine(argc, argv) << endl
+         << "cwd: " << getCurrentDirectory() << endl;
+    cout << flush;
+  }
+
+  run(par);
+
+  if(par.verbose > 0){
+    time(&endRawTime);
+    cout << "END " << basename(argv[0])
+         << " " << getDateTime(endRawTime) << endl
+         << "elapsed -> " << getElapsedTime(startRawTime, endRawTime) << endl
+         << "max.mem -> " << getMaxMemUsedByProcess2Str() << endl;
+  }
+
+  return EXIT_SUCCESS;
+}
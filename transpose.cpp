@@ -0,0 +1,403 @@
+/** \file transpose.cpp
+ *
+ *  `transpose' transposes a matrix stored in a text or binary file.
+ *  Copyright (C) 2011-2014 Timothée Flutre
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Compile with: g++ -Wall -O3 -fopenmp -I.. utils_io.cpp utils_geno.cpp transpose.cpp -lz -o transpose
+ */
+
+#include <cmath>
+#include <ctime>
+#include <cstring>
+#include <cstdio>
+#include <getopt.h>
+#include <libgen.h>
+#include <stdint.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+using namespace std;
+
+#include "utils_io.hpp"
+#include "utils_geno.hpp"
+using namespace utils;
+
+#ifndef VERSION
+#define VERSION "1.0.0" // http://semver.org/
+#endif
+
+// number of columns transposed at once, their output lines being built
+// while the tokens of the rows are still in cache
+#define TRANSPOSE_TILE_SIZE 64
+
+/** \brief Display the help on stdout.
+ *  \note The format complies with help2man (http://www.gnu.org/s/help2man)
+ */
+void help(char ** argv)
+{
+  cout << "`" << argv[0] << "'"
+       << " transposes a matrix stored in a text or binary file." << endl
+       << endl
+       << "Usage: " << argv[0] << " [OPTIONS] ..." << endl
+       << endl
+       << "Options:" << endl
+       << "  -h, --help\tdisplay the help and exit" << endl
+       << "  -V, --version\toutput version information and exit" << endl
+       << "  -v, --verbose\tverbosity level (0/default=1/2/3)" << endl
+       << "  -i, --in\tpath to the input file (default=stdin, can be gzipped)" << endl
+       << "\t\ttokens separated by spaces or tabs, empty lines being skipped" << endl
+       << "  -o, --out\tpath to the output file (default=stdout, gzipped if ending with '.gz')" << endl
+       << "      --sep\tseparator of the output tokens (default=' ')" << endl
+       << "      --mem\tmaximum memory in MB (default=1024)" << endl
+       << "      --tmp\tprefix of the temporary files (default=<out>_tmp)" << endl
+       << "      --binary\tthe input is a binary dosage file (see impute2bimbam)" << endl
+       << "\t\tconverted between the SNP-major and sample-major layouts" << endl
+       << "  -t, --threads\tnumber of threads to compress the output (default=1)" << endl
+       << endl
+       << "Remarks:" << endl
+       << "  If the input fits in --mem, it is transposed in memory by tiles of " << TRANSPOSE_TILE_SIZE << " columns." << endl
+       << "  Otherwise, each chunk of rows fitting in --mem is transposed into a temporary" << endl
+       << "  file, whose line j holds column j of the chunk, and the output line j is the" << endl
+       << "  concatenation of the lines j of all temporary files, read in parallel." << endl
+       << "  With --binary, the input file is read by bands of columns fitting in --mem," << endl
+       << "  the output being written sequentially, one band of rows at a time," << endl
+       << "  and can't be stdin, nor the output stdout." << endl
+       << endl
+       << "Examples:" << endl
+       << "  zcat genos.txt.gz | " << argv[0] << " -o genos_t.txt.gz --sep '\\t'" << endl
+       << "  " << argv[0] << " --binary -i genos.dosage.bin -o genos.dosage_t.bin" << endl
+       << endl
+       << "Report bugs to <timothee.flutre@supagro.inra.fr>." << endl
+    ;
+}
+
+/** \brief Display version and license information on stdout.
+ */
+void version(char ** argv)
+{
+  cout << argv[0] << " " << VERSION << endl
+       << endl
+       << "Copyright (C) 2011-2014 Timothée Flutre." << endl
+       << "License GPLv3+: GNU GPL version 3 or later <http://gnu.org/licenses/gpl.html>" << endl
+       << "This is free software; see the source for copying conditions.  There is NO" << endl
+       << "warranty; not even for MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE." << endl
+       << endl
+       << "Written by Timothée Flutre." << endl
+    ;
+}
+
+/** \brief Parse the command-line arguments and check the values of the
+ *  compulsory ones.
+ */
+void
+parseCmdLine(
+  int argc,
+  char ** argv,
+  string & inFile,
+  string & outFile,
+  string & sep,
+  size_t & memMb,
+  string & tmpPrefix,
+  bool & binary,
+  int & nbThreads,
+  int & verbose)
+{
+  int c = 0;
+  while(true)
+  {
+    static struct option long_options[] =
+    {
+      {"help", no_argument, 0, 'h'},
+      {"version", no_argument, 0, 'V'},
+      {"verbose", required_argument, 0, 'v'},
+      {"in", required_argument, 0, 'i'},
+      {"out", required_argument, 0, 'o'},
+      {"sep", required_argument, 0, 0},
+      {"mem", required_argument, 0, 0},
+      {"tmp", required_argument, 0, 0},
+      {"binary", no_argument, 0, 0},
+      {"threads", required_argument, 0, 't'},
+      {0, 0, 0, 0}
+    };
+    int option_index = 0;
+    c = getopt_long(argc, argv, "hVv:i:o:t:",
+                    long_options, &option_index);
+    if(c == -1)
+      break;
+    switch(c)
+    {
+    case 0:
+      if(long_options[option_index].flag != 0)
+        break;
+      if(strcmp(long_options[option_index].name, "sep") == 0){
+        sep = optarg;
+	replaceAll(sep, "\\t", "\t");
+      }
+      else if(strcmp(long_options[option_index].name, "mem") == 0)
+        memMb = atol(optarg);
+      else if(strcmp(long_options[option_index].name, "tmp") == 0)
+        tmpPrefix = optarg;
+      else if(strcmp(long_options[option_index].name, "binary") == 0)
+        binary = true;
+      break;
+    case 'h':
+      help(argv);
+      exit(0);
+    case 'V':
+      version(argv);
+      exit(0);
+    case 'v':
+      verbose = atoi(optarg);
+      break;
+    case 'i':
+      inFile = optarg;
+      break;
+    case 'o':
+      outFile = optarg;
+      break;
+    case 't':
+      nbThreads = atoi(optarg);
+      break;
+    case '?':
+      printf("\n"); help(argv);
+      abort();
+    default:
+      printf("\n"); help(argv);
+      abort();
+    }
+  }
+  if(inFile != "-" && ! doesFileExist(inFile)){
+    cerr << "cmd-line: " << getCmdLine(argc, argv) << endl << endl
+	 << "ERROR: can't find file " << inFile << endl << endl;
+    help(argv);
+    exit(1);
+  }
+  if(binary && (inFile == "-" || outFile == "-")){
+    cerr << "cmd-line: " << getCmdLine(argc, argv) << endl << endl
+	 << "ERROR: --binary needs files for --in and --out" << endl << endl;
+    help(argv);
+    exit(1);
+  }
+  if(tmpPrefix.empty())
+    tmpPrefix = (outFile == "-" ? "transpose" : outFile) + "_tmp";
+  if(memMb == 0)
+    memMb = 1;
+  if(nbThreads < 1)
+    nbThreads = 1;
+  if(outFile == "-") // the progress would be mixed with the output
+    verbose = 0;
+}
+
+/** \brief Chunk of consecutive rows, the tokens being copied in a single
+ *  buffer.
+ */
+struct TextChunk
+{
+  size_t nbRows;
+  size_t nbCols;
+  vector<char> text;
+  vector<uint64_t> starts; // nbRows x nbCols
+  vector<uint32_t> sizes;
+};
+
+size_t getTextChunkBytes(const TextChunk & chunk)
+{
+  return chunk.text.size() + chunk.starts.size()
+    * (sizeof(uint64_t) + sizeof(uint32_t));
+}
+
+void clearTextChunk(TextChunk & chunk)
+{
+  chunk.nbRows = 0;
+  chunk.text.clear();
+  chunk.starts.clear();
+  chunk.sizes.clear();
+}
+
+/** \brief Write the chunk transposed, line j holding its column j.
+ */
+void writeTransposedChunk(const TextChunk & chunk, const string & sep,
+			  BlockWriter & bw)
+{
+  vector<string> lines(TRANSPOSE_TILE_SIZE);
+  for(size_t j0 = 0; j0 < chunk.nbCols; j0 += TRANSPOSE_TILE_SIZE){
+    size_t j1 = min(chunk.nbCols, j0 + TRANSPOSE_TILE_SIZE);
+    for(size_t j = j0; j < j1; ++j)
+      lines[j-j0].clear();
+    for(size_t i = 0; i < chunk.nbRows; ++i){
+      const uint64_t * starts = &chunk.starts[i * chunk.nbCols];
+      const uint32_t * sizes = &chunk.sizes[i * chunk.nbCols];
+      for(size_t j = j0; j < j1; ++j){
+	if(i > 0)
+	  lines[j-j0] += sep;
+	lines[j-j0].append(&chunk.text[starts[j]], sizes[j]);
+      }
+    }
+    for(size_t j = j0; j < j1; ++j){
+      lines[j-j0] += '\n';
+      bwrite(bw, lines[j-j0]);
+    }
+  }
+}
+
+/** \brief Write the output line j as the concatenation of the lines j of
+ *  the temporary files.
+ */
+void mergeTransposedChunks(const vector<string> & tmpFiles,
+			   const size_t nbCols, const string & sep,
+			   BlockWriter & bw)
+{
+  vector<BlockReader> brs(tmpFiles.size());
+  for(size_t c = 0; c < tmpFiles.size(); ++c)
+    openBlockReader(brs[c], tmpFiles[c], 1048576);
+  StringView line;
+  for(size_t j = 0; j < nbCols; ++j){
+    for(size_t c = 0; c < tmpFiles.size(); ++c){
+      if(! getline(brs[c], line)){
+	cerr << "ERROR: file " << tmpFiles[c] << " is truncated" << endl;
+	exit(1);
+      }
+      if(c > 0)
+	bwrite(bw, sep);
+      bwrite(bw, line.data, line.size);
+    }
+    bwrite(bw, "\n", 1);
+  }
+  for(size_t c = 0; c < tmpFiles.size(); ++c)
+    closeBlockReader(brs[c]);
+}
+
+void transposeText(const string & inFile, const string & outFile,
+		   const string & sep, const size_t memMb,
+		   const string & tmpPrefix, const int & nbThreads,
+		   const int & verbose)
+{
+  const size_t maxBytes = memMb * 1048576;
+  BlockReader br;
+  StringView line;
+  vector<StringView> tokens;
+  TextChunk chunk;
+  clearTextChunk(chunk);
+  chunk.nbCols = 0;
+  vector<string> tmpFiles;
+  size_t nbRows = 0;
+  openBlockReader(br, inFile);
+  while(true){
+    bool eof = ! getline(br, line);
+    if(! eof && tokenize(line, " \t", tokens) == 0)
+      continue;
+    if(! eof){
+      if(nbRows == 0)
+	chunk.nbCols = tokens.size();
+      else if(tokens.size() != chunk.nbCols){
+	cerr << "ERROR: line " << br.nbLines << " of file " << inFile
+	     << " has " << tokens.size() << " tokens instead of "
+	     << chunk.nbCols << endl;
+	exit(1);
+      }
+      for(size_t j = 0; j < tokens.size(); ++j){
+	chunk.starts.push_back(chunk.text.size());
+	chunk.sizes.push_back(tokens[j].size);
+	chunk.text.insert(chunk.text.end(), tokens[j].data,
+			  tokens[j].data + tokens[j].size);
+      }
+      ++chunk.nbRows;
+      ++nbRows;
+    }
+    if(eof && tmpFiles.empty()) // everything fits in memory
+      break;
+    if(chunk.nbRows > 0 && (eof || getTextChunkBytes(chunk) >= maxBytes)){
+      tmpFiles.push_back(tmpPrefix + toString(tmpFiles.size()));
+      if(verbose > 0)
+	cout << "transpose rows " << nbRows - chunk.nbRows + 1 << "-"
+	     << nbRows << " into " << tmpFiles.back() << " ..." << endl
+	     << flush;
+      BlockWriter bwTmp;
+      openBlockWriter(bwTmp, tmpFiles.back(), 1);
+      writeTransposedChunk(chunk, sep, bwTmp);
+      closeBlockWriter(bwTmp);
+      clearTextChunk(chunk);
+    }
+    if(eof)
+      break;
+  }
+  closeBlockReader(br);
+
+  BlockWriter bw;
+  openBlockWriter(bw, outFile, nbThreads);
+  if(tmpFiles.empty())
+    writeTransposedChunk(chunk, sep, bw);
+  else{
+    if(verbose > 0)
+      cout << "merge " << tmpFiles.size() << " temporary files ..." << endl
+	   << flush;
+    mergeTransposedChunks(tmpFiles, chunk.nbCols, sep, bw);
+    removeFiles(tmpFiles);
+  }
+  closeBlockWriter(bw);
+
+  if(verbose > 0)
+    cout << "nb of input rows: " << nbRows << endl
+	 << "nb of input columns: " << chunk.nbCols << endl;
+}
+
+void run(const string & inFile, const string & outFile, const string & sep,
+	 const size_t memMb, const string & tmpPrefix, const bool binary,
+	 const int & nbThreads, const int & verbose)
+{
+  if(binary)
+    transposeDosageFile(inFile, outFile, memMb * 1048576);
+  else
+    transposeText(inFile, outFile, sep, memMb, tmpPrefix, nbThreads,
+		  verbose);
+}
+
+int main(int argc, char ** argv)
+{
+  string inFile = "-", outFile = "-", sep = " ", tmpPrefix;
+  size_t memMb = 1024;
+  bool binary = false;
+  int nbThreads = 1, verbose = 1;
+
+  parseCmdLine(argc, argv, inFile, outFile, sep, memMb, tmpPrefix, binary,
+	       nbThreads, verbose);
+
+  time_t startRawTime, endRawTime;
+  if(verbose > 0){
+    time(&startRawTime);
+    cout << "START " << basename(argv[0])
+         << " " << getDateTime(startRawTime) << endl
+         << "version " << VERSION << " compiled " << __DATE__
+         << " " << __TIME__ << endl
+         << "cmd-line: " << getCmdLine(argc, argv) << endl
+         << "cwd: " << getCurrentDirectory() << endl;
+    cout << flush;
+  }
+
+  run(inFile, outFile, sep, memMb, tmpPrefix, binary, nbThreads, verbose);
+
+  if(verbose > 0){
+    time(&endRawTime);
+    cout << "END " << basename(argv[0])
+         << " " << getDateTime(endRawTime) << endl
+         << "elapsed -> " << getElapsedTime(startRawTime, endRawTime) << endl
+         << "max.mem -> " << getMaxMemUsedByProcess2Str() << endl;
+  }
+
+  return EXIT_SUCCESS;
+}
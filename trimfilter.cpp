@@ -0,0 +1,684 @@
+/** \file trimfilter.cpp
+ *
+ *  `trimfilter' trims adapters from reads in fastq files and filters them.
+ *  Copyright (C) 2011-2014 Timothée Flutre
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Compile with: g++ -Wall -O3 -fopenmp -I.. utils_io.cpp trimfilter.cpp -lz -o trimfilter
+ */
+
+#include <cmath>
+#include <ctime>
+#include <cstring>
+#include <cstdio>
+#include <getopt.h>
+#include <libgen.h>
+#include <stdint.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+using namespace std;
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "utils_io.hpp"
+using namespace utils;
+
+#ifndef VERSION
+#define VERSION "1.0.0" // http://semver.org/
+#endif
+
+// adapters are searched with one machine word per read position
+#define MAX_ADAPTER_LENGTH 64
+
+struct TrimParams
+{
+  string inDir;
+  string inFq1;
+  string inFq2;
+  string adpFile;
+  int maxNbErrors;
+  size_t minOvl;
+  size_t minReadLen;
+  string outPrefix;
+  int level;
+  bool qc;
+  size_t batchSize;
+  int nbThreads;
+  int verbose;
+};
+
+/** \brief Display the help on stdout.
+ *  \note The format complies with help2man (http://www.gnu.org/s/help2man)
+ */
+void help(char ** argv)
+{
+  cout << "`" << argv[0] << "'"
+       << " trims adapters from reads in fastq files and filters them." << endl
+       << endl
+       << "Usage: " << argv[0] << " [OPTIONS] ..." << endl
+       << endl
+       << "Options:" << endl
+       << "  -h, --help\tdisplay the help and exit" << endl
+       << "  -V, --version\toutput version information and exit" << endl
+       << "  -v, --verbose\tverbosity level (0/default=1/2/3)" << endl
+       << "      --idir\tpath to the input directory with the fastq files (default=.)" << endl
+       << "      --ifq1\tpath to the first input fastq file (can be gzipped)" << endl
+       << "      --ifq2\tpath to the second input fastq file, optional (can be gzipped)" << endl
+       << "\t\terror raised if reads not in same order as --ifq1" << endl
+       << "      --adp\tpath to file with adapters in fasta format" << endl
+       << "\t\tnames with '/1' (resp. '/2') are searched in R1 (resp. R2) only" << endl
+       << "\t\tat most " << MAX_ADAPTER_LENGTH << " bp, IUPAC letters allowed" << endl
+       << "      --err\tmax number of errors (default=0, i.e. exact matches)" << endl
+       << "\t\tsubstitutions, insertions and deletions" << endl
+       << "      --ovl\tmin overlap between the read end and a partial adapter (default=0)" << endl
+       << "\t\tthe overlap being allowed err * overlap / adapter length errors" << endl
+       << "\t\t0: each missing base of the adapter counts as an error" << endl
+       << "      --minlen\tmin read length after trimming (default=0)" << endl
+       << "      --op\tprefix for the output files (2 paired, 2 unpaired, 1 log)" << endl
+       << "\t\twill be compressed with gzip" << endl
+       << "      --level\tcompression level of the output files (default=1)" << endl
+       << "\t\thigher levels are several times slower on reads" << endl
+       << "      --qc\tcompute quality control statistics of the kept reads" << endl
+       << "\t\tsaved in <op>_R1_qc.txt (and R2), see qc_fastq" << endl
+       << "      --batch\tmaximum number of reads (or pairs) processed at once (default=100000)" << endl
+       << "  -t, --threads\tnumber of threads (default=1)" << endl
+       << endl
+       << "Remarks:" << endl
+       << "  Each adapter is searched with Myers' bit-parallel algorithm, from the read" << endl
+       << "  end towards its start, a read being trimmed at the leftmost group of" << endl
+       << "  positions where the adapter starts with at most --err errors, at the one" << endl
+       << "  with the fewest errors (the leftmost if tied, as seq.find in" << endl
+       << "  trimfilter.py, unless the adapter starts there on a mismatch)." << endl
+       << "  Pairs whose both reads are at least --minlen long are saved in the 'paired'" << endl
+       << "  files, pairs with only one such read save it in the 'unpaired' files," << endl
+       << "  and the others are discarded." << endl
+       << "  The log gives, for each read and adapter, the start of the match (or -1)." << endl
+       << endl
+       << "Examples:" << endl
+       << "  " << argv[0] << " --ifq1 reads1.fastq.gz --ifq2 reads2.fastq.gz --adp adapters.fa --op test" << endl
+       << "  " << argv[0] << " --ifq1 reads1.fastq.gz --adp adapters.fa --err 2 --ovl 3 --minlen 35 --op test -t 4" << endl
+       << endl
+       << "Report bugs to <timothee.flutre@supagro.inra.fr>." << endl
+    ;
+}
+
+/** \brief Display version and license information on stdout.
+ */
+void version(char ** argv)
+{
+  cout << argv[0] << " " << VERSION << endl
+       << endl
+       << "Copyright (C) 2011-2014 Timothée Flutre." << endl
+       << "License GPLv3+: GNU GPL version 3 or later <http://gnu.org/licenses/gpl.html>" << endl
+       << "This is free software; see the source for copying conditions.  There is NO" << endl
+       << "warranty; not even for MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE." << endl
+       << endl
+       << "Written by Timothée Flutre." << endl
+    ;
+}
+
+/** \brief Parse the command-line arguments and check the values of the
+ *  compulsory ones.
+ */
+void
+parseCmdLine(
+  int argc,
+  char ** argv,
+  TrimParams & params)
+{
+  int c = 0;
+  while(true)
+  {
+    static struct option long_options[] =
+    {
+      {"help", no_argument, 0, 'h'},
+      {"version", no_argument, 0, 'V'},
+      {"verbose", required_argument, 0, 'v'},
+      {"idir", required_argument, 0, 0},
+      {"ifq1", required_argument, 0, 0},
+      {"ifq2", required_argument, 0, 0},
+      {"adp", required_argument, 0, 0},
+      {"err", required_argument, 0, 0},
+      {"ovl", required_argument, 0, 0},
+      {"minlen", required_argument, 0, 0},
+      {"op", required_argument, 0, 0},
+      {"level", required_argument, 0, 0},
+      {"qc", no_argument, 0, 0},
+      {"batch", required_argument, 0, 0},
+      {"threads", required_argument, 0, 't'},
+      {0, 0, 0, 0}
+    };
+    int option_index = 0;
+    c = getopt_long(argc, argv, "hVv:t:",
+                    long_options, &option_index);
+    if(c == -1)
+      break;
+    switch(c)
+    {
+    case 0:
+      if(long_options[option_index].flag != 0)
+        break;
+      if(strcmp(long_options[option_index].name, "idir") == 0)
+        params.inDir = optarg;
+      else if(strcmp(long_options[option_index].name, "ifq1") == 0)
+        params.inFq1 = optarg;
+      else if(strcmp(long_options[option_index].name, "ifq2") == 0)
+        params.inFq2 = optarg;
+      else if(strcmp(long_options[option_index].name, "adp") == 0)
+        params.adpFile = optarg;
+      else if(strcmp(long_options[option_index].name, "err") == 0)
+        params.maxNbErrors = atoi(optarg);
+      else if(strcmp(long_options[option_index].name, "ovl") == 0)
+        params.minOvl = atol(optarg);
+      else if(strcmp(long_options[option_index].name, "minlen") == 0)
+        params.minReadLen = atol(optarg);
+      else if(strcmp(long_options[option_index].name, "op") == 0)
+        params.outPrefix = optarg;
+      else if(strcmp(long_options[option_index].name, "level") == 0)
+        params.level = atoi(optarg);
+      else if(strcmp(long_options[option_index].name, "qc") == 0)
+        params.qc = true;
+      else if(strcmp(long_options[option_index].name, "batch") == 0)
+        params.batchSize = atol(optarg);
+      break;
+    case 'h':
+      help(argv);
+      exit(0);
+    case 'V':
+      version(argv);
+      exit(0);
+    case 'v':
+      params.verbose = atoi(optarg);
+      break;
+    case 't':
+      params.nbThreads = atoi(optarg);
+      break;
+    case '?':
+      printf("\n"); help(argv);
+      abort();
+    default:
+      printf("\n"); help(argv);
+      abort();
+    }
+  }
+
+  string error;
+  if(params.inDir.empty() || ! isDirectory(params.inDir.c_str()))
+    error = "can't find directory " + params.inDir;
+  else if(params.inFq1.empty())
+    error = "missing compulsory option --ifq1";
+  else if(! doesFileExist(params.inDir + "/" + params.inFq1))
+    error = "can't find file " + params.inDir + "/" + params.inFq1;
+  else if(! params.inFq2.empty()
+	  && ! doesFileExist(params.inDir + "/" + params.inFq2))
+    error = "can't find file " + params.inDir + "/" + params.inFq2;
+  else if(params.adpFile.empty())
+    error = "missing compulsory option --adp";
+  else if(! doesFileExist(params.adpFile))
+    error = "can't find file " + params.adpFile;
+  else if(params.outPrefix.empty())
+    error = "missing compulsory option --op";
+  if(! error.empty()){
+    cerr << "cmd-line: " << getCmdLine(argc, argv) << endl << endl
+	 << "ERROR: " << error << endl << endl;
+    help(argv);
+    exit(1);
+  }
+  if(params.maxNbErrors < 0)
+    params.maxNbErrors = 0;
+  if(params.level < 1 || params.level > 9)
+    params.level = 1;
+  if(params.batchSize == 0)
+    params.batchSize = 1;
+  if(params.nbThreads < 1)
+    params.nbThreads = 1;
+}
+
+/** \brief Return the IUPAC code of a nucleotide as a mask of its possible
+ *  bases (A=1, C=2, G=4, T=8), 0 if unknown.
+ */
+uint8_t getIupacMask(const char nt)
+{
+  switch(toupper(nt)){
+  case 'A': return 1;
+  case 'C': return 2;
+  case 'G': return 4;
+  case 'T': return 8;
+  case 'R': return 1|4;
+  case 'Y': return 2|8;
+  case 'S': return 2|4;
+  case 'W': return 1|8;
+  case 'K': return 4|8;
+  case 'M': return 1|2;
+  case 'B': return 2|4|8;
+  case 'D': return 1|4|8;
+  case 'H': return 1|2|8;
+  case 'V': return 1|2|4;
+  case 'N': return 1|2|4|8;
+  default: return 0;
+  }
+}
+
+/** \brief Adapter searched with Myers' algorithm, its pattern being
+ *  reversed so that the reads are scanned from their end.
+ */
+struct Adapter
+{
+  string name;
+  string seq;
+  size_t length;
+  uint64_t peq[256]; // bit i set if read base matches the i-th last base
+};
+
+void initAdapter(Adapter & adp, const string & name, const string & seq)
+{
+  adp.name = name;
+  adp.seq = seq;
+  adp.length = seq.size();
+  for(int c = 0; c < 256; ++c){
+    adp.peq[c] = 0;
+    uint8_t readMask = 0;
+    if(c == 'A' || c == 'C' || c == 'G' || c == 'T'
+       || c == 'a' || c == 'c' || c == 'g' || c == 't')
+      readMask = getIupacMask((char) c); // N in reads matches nothing
+    for(size_t i = 0; i < adp.length; ++i)
+      if(readMask & getIupacMask(seq[adp.length - 1 - i]))
+	adp.peq[c] |= (1ULL << i);
+  }
+}
+
+/** \brief Load the adapters, in the fasta format, those whose name
+ *  contains "/1" (resp. "/2") being searched only in R1 (resp. R2).
+ */
+void loadAdapters(const string & adpFile, vector<Adapter> & adps1,
+		  vector<Adapter> & adps2, vector<Adapter> & adps,
+		  const int & verbose)
+{
+  if(verbose > 0)
+    cout << "load adapter file..." << endl << flush;
+  vector<pair<string, string> > records;
+  BlockReader br;
+  StringView line;
+  openBlockReader(br, adpFile);
+  while(getline(br, line)){
+    if(line.size == 0)
+      continue;
+    if(line.data[0] == '>'){
+      string name = toString(line).substr(1);
+      name = name.substr(0, name.find_first_of(" \t"));
+      records.push_back(make_pair(name, string()));
+    }
+    else if(records.empty()){
+      cerr << "ERROR: adapter file " << adpFile << " should start with '>'"
+	   << endl;
+      exit(1);
+    }
+    else
+      records.back().second.append(line.data, line.size);
+  }
+  closeBlockReader(br);
+
+  for(size_t r = 0; r < records.size(); ++r){
+    string & seq = records[r].second;
+    transform(seq.begin(), seq.end(), seq.begin(), ::toupper);
+    if(seq.empty())
+      continue;
+    for(size_t i = 0; i < seq.size(); ++i)
+      if(getIupacMask(seq[i]) == 0){
+	cerr << "ERROR: adapter " << records[r].first << " has an unknown"
+	     << " letter '" << seq[i] << "'" << endl;
+	exit(1);
+      }
+    if(seq.size() > MAX_ADAPTER_LENGTH){
+      cerr << "WARNING: adapter " << records[r].first << " is truncated to its"
+	   << " first " << MAX_ADAPTER_LENGTH << " bp" << endl;
+      seq.resize(MAX_ADAPTER_LENGTH);
+    }
+    vector<Adapter> & dest =
+      (records[r].first.find("/1") != string::npos ? adps1 :
+       (records[r].first.find("/2") != string::npos ? adps2 : adps));
+    dest.push_back(Adapter());
+    initAdapter(dest.back(), records[r].first, seq);
+  }
+}
+
+/** \brief Return the start of the adapter in the read, or -1.
+ *  \note The reversed adapter is aligned on the reversed read with Myers'
+ *  bit-parallel algorithm (J ACM 1999), the read being scanned from its end
+ *  so that the score of each column is the edit distance between the
+ *  adapter and the best read substring starting at this position.
+ *  If minOvl is 0, the bases of the adapter overhanging the read end count
+ *  as errors. Otherwise, the last (length - minOvl) ones can overhang for
+ *  free, as in cutadapt, the overlap with the read then being allowed
+ *  maxNbErrors * overlap / length errors.
+ *  Among the positions with at most maxNbErrors, those of the leftmost
+ *  group of consecutive ones are kept, and the one with the fewest errors
+ *  is returned, the leftmost if tied (as seq.find in trimfilter.py for
+ *  exact matches), except for a start on a mismatch.
+ */
+long getAdpStart(const Adapter & adp, const char * seq, const size_t len,
+		 const int maxNbErrors, const size_t minOvl)
+{
+  size_t m = adp.length, free = 0;
+  if(minOvl > 0 && minOvl < m)
+    free = m - minOvl;
+  uint64_t full = (m == 64) ? ~0ULL : ((1ULL << m) - 1),
+    high = 1ULL << (m - 1),
+    pv = full & ~((1ULL << free) - 1), mv = 0;
+  int score = (int) (m - free);
+  long start = -1;
+  int bestScore = maxNbErrors + 1;
+  bool inGroup = false;
+  for(long j = (long) len - 1; j >= 0; --j){
+    uint64_t eq = adp.peq[(unsigned char) seq[j]],
+      xv = eq | mv,
+      xh = (((eq & pv) + pv) ^ pv) | eq,
+      ph = mv | ~(xh | pv),
+      mh = pv & xh;
+    if(ph & high)
+      ++score;
+    else if(mh & high)
+      --score;
+    ph <<= 1;
+    mh <<= 1;
+    pv = (mh | ~(xv | ph)) & full;
+    mv = ph & xv;
+    size_t overlap = len - j;
+    int maxErrors = maxNbErrors;
+    if(minOvl > 0 && overlap < m) // partial adapter at the read end
+      maxErrors = (overlap < minOvl) ? -1 : (int) (maxNbErrors * overlap / m);
+    if(score <= maxErrors){
+      if(! inGroup){ // a group more on the left replaces the previous one
+	inGroup = true;
+	bestScore = score;
+	start = j;
+      }
+      // scanning leftward, a tie moves the start unless the adapter would
+      // start on a mismatch, which would only trim one more insert base
+      else if(score < bestScore || (score == bestScore && (eq & high))){
+	bestScore = score;
+	start = j;
+      }
+    }
+    else
+      inGroup = false;
+  }
+  return start;
+}
+
+/** \brief Search the adapters in a read, log their starts and return the
+ *  length of the trimmed read.
+ */
+size_t trimRead(const FastqRecord & rec,
+		const vector<const vector<Adapter> *> & adps,
+		const TrimParams & params, string & log)
+{
+  const StringView & id = rec.id, & seq = rec.seq;
+  size_t idx = seq.size;
+  char buf[32];
+  for(size_t a = 0; a < adps.size(); ++a)
+    for(size_t i = 0; i < adps[a]->size(); ++i){
+      const Adapter & adp = (*adps[a])[i];
+      long start = getAdpStart(adp, seq.data, seq.size, params.maxNbErrors,
+			       params.minOvl);
+      if(start != -1 && (size_t) start < idx)
+	idx = start;
+      log.append(id.data, id.size);
+      log += '\t';
+      log += adp.name;
+      snprintf(buf, sizeof(buf), "\t%ld\n", start);
+      log += buf;
+    }
+  return idx;
+}
+
+// outputs of a slice of a batch, in the order of the output files
+enum TrimOutput {OUT_LOG, OUT_P1, OUT_P2, OUT_U1, OUT_U2, NB_OUTPUTS};
+
+struct TrimStats
+{
+  size_t nbPairs;
+  size_t nbTrimmedPairs;
+  size_t nbTrimmedRead1;
+  size_t nbTrimmedRead2;
+  size_t nbUnpairedRead1;
+  size_t nbUnpairedRead2;
+  size_t nbFilteredPairs;
+};
+
+void run(const TrimParams & params)
+{
+  vector<Adapter> adps1, adps2, adps;
+  loadAdapters(params.adpFile, adps1, adps2, adps, params.verbose);
+  bool paired = ! params.inFq2.empty();
+  if(! paired && adps.empty()){
+    cerr << "ERROR: no adapter was loaded" << endl;
+    exit(1);
+  }
+  if(params.verbose > 0){
+    if(! paired)
+      cout << "nb of adapters: " << adps.size() << endl;
+    else
+      cout << "nb of adapters: R1=" << adps1.size() << " R2=" << adps2.size()
+	   << " both=" << adps.size() << endl;
+  }
+  vector<const vector<Adapter> *> searched1, searched2;
+  if(paired){
+    searched1.push_back(&adps1);
+    searched2.push_back(&adps2);
+    searched2.push_back(&adps);
+  }
+  searched1.push_back(&adps);
+
+  if(params.verbose > 0)
+    cout << "trim and filter " << (paired ? "paired" : "single")
+	 << "-end reads (err=" << params.maxNbErrors
+	 << ", threads=" << params.nbThreads << ") ..." << endl << flush;
+
+  FastqReader fr1, fr2;
+  openFastqReader(fr1, params.inDir + "/" + params.inFq1);
+  if(paired)
+    openFastqReader(fr2, params.inDir + "/" + params.inFq2);
+
+  vector<BlockWriter> writers(NB_OUTPUTS);
+  openBlockWriter(writers[OUT_LOG], params.outPrefix + ".log.gz",
+		  params.nbThreads, params.level);
+  bwrite(writers[OUT_LOG], "read.id\tadp.name\tadp.start\n");
+  if(! paired)
+    openBlockWriter(writers[OUT_P1], params.outPrefix + ".fq.gz",
+		    params.nbThreads, params.level);
+  else{
+    openBlockWriter(writers[OUT_P1], params.outPrefix + "_paired_R1.fq.gz",
+		    params.nbThreads, params.level);
+    openBlockWriter(writers[OUT_P2], params.outPrefix + "_paired_R2.fq.gz",
+		    params.nbThreads, params.level);
+    openBlockWriter(writers[OUT_U1], params.outPrefix + "_unpaired_R1.fq.gz",
+		    params.nbThreads, params.level);
+    openBlockWriter(writers[OUT_U2], params.outPrefix + "_unpaired_R2.fq.gz",
+		    params.nbThreads, params.level);
+  }
+
+  TrimStats stats;
+  memset(&stats, 0, sizeof(TrimStats));
+
+  // each thread trims a slice of the batch into its own output buffers
+  vector<vector<string> > outs(params.nbThreads,
+			       vector<string>(NB_OUTPUTS));
+  vector<TrimStats> sliceStats(params.nbThreads);
+  vector<FastqStats> qc1(params.qc ? params.nbThreads : 0),
+    qc2(params.qc ? params.nbThreads : 0);
+  for(size_t s = 0; s < qc1.size(); ++s){
+    initFastqStats(qc1[s]);
+    initFastqStats(qc2[s]);
+  }
+  vector<FastqRecord> reads1, reads2;
+  while(true){
+    size_t nbReads = paired ?
+      readFastqBatch(fr1, fr2, params.batchSize, reads1, reads2)
+      : readFastqBatch(fr1, params.batchSize, reads1);
+    if(nbReads == 0)
+      break;
+
+    size_t sliceSize = (nbReads + params.nbThreads - 1)
+      / params.nbThreads;
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(params.nbThreads)
+#endif
+    for(int s = 0; s < params.nbThreads; ++s){
+      vector<string> & out = outs[s];
+      TrimStats & st = sliceStats[s];
+      memset(&st, 0, sizeof(TrimStats));
+      for(size_t o = 0; o < NB_OUTPUTS; ++o)
+	out[o].clear();
+      size_t last = min(nbReads, (s + 1) * sliceSize);
+      for(size_t r = s * sliceSize; r < last; ++r){
+	size_t len1 = reads1[r].seq.size, len2 = 0,
+	  idx1 = trimRead(reads1[r], searched1, params, out[OUT_LOG]),
+	  idx2 = 0;
+	if(paired){
+	  len2 = reads2[r].seq.size;
+	  idx2 = trimRead(reads2[r], searched2, params, out[OUT_LOG]);
+	}
+	bool trimmed1 = (idx1 != len1), trimmed2 = paired && (idx2 != len2),
+	  kept1 = (idx1 >= params.minReadLen),
+	  kept2 = paired && (idx2 >= params.minReadLen);
+	if(trimmed1 && trimmed2)
+	  ++st.nbTrimmedPairs;
+	else if(trimmed1)
+	  ++st.nbTrimmedRead1;
+	else if(trimmed2)
+	  ++st.nbTrimmedRead2;
+	if(! paired){
+	  if(kept1)
+	    appendFastqRecord(out[OUT_P1], reads1[r], 0, idx1);
+	  else
+	    ++st.nbFilteredPairs;
+	}
+	else if(kept1 && kept2){
+	  appendFastqRecord(out[OUT_P1], reads1[r], 0, idx1);
+	  appendFastqRecord(out[OUT_P2], reads2[r], 0, idx2);
+	}
+	else if(kept1){
+	  appendFastqRecord(out[OUT_U1], reads1[r], 0, idx1);
+	  ++st.nbUnpairedRead1;
+	}
+	else if(kept2){
+	  appendFastqRecord(out[OUT_U2], reads2[r], 0, idx2);
+	  ++st.nbUnpairedRead2;
+	}
+	else
+	  ++st.nbFilteredPairs;
+	if(params.qc && kept1)
+	  addToFastqStats(qc1[s], reads1[r], 0, idx1);
+	if(params.qc && kept2)
+	  addToFastqStats(qc2[s], reads2[r], 0, idx2);
+      }
+    }
+
+    // write the slices in order, the writers compressing in parallel
+    stats.nbPairs += nbReads;
+    for(int s = 0; s < params.nbThreads; ++s){
+      for(size_t o = 0; o < NB_OUTPUTS; ++o)
+	if(! outs[s][o].empty())
+	  bwrite(writers[o], outs[s][o]);
+      stats.nbTrimmedPairs += sliceStats[s].nbTrimmedPairs;
+      stats.nbTrimmedRead1 += sliceStats[s].nbTrimmedRead1;
+      stats.nbTrimmedRead2 += sliceStats[s].nbTrimmedRead2;
+      stats.nbUnpairedRead1 += sliceStats[s].nbUnpairedRead1;
+      stats.nbUnpairedRead2 += sliceStats[s].nbUnpairedRead2;
+      stats.nbFilteredPairs += sliceStats[s].nbFilteredPairs;
+    }
+  }
+  closeFastqReader(fr1);
+  if(paired)
+    closeFastqReader(fr2);
+  closeBlockWriter(writers[OUT_LOG]);
+  closeBlockWriter(writers[OUT_P1]);
+  if(paired){
+    closeBlockWriter(writers[OUT_P2]);
+    closeBlockWriter(writers[OUT_U1]);
+    closeBlockWriter(writers[OUT_U2]);
+  }
+
+  if(params.qc){
+    for(int s = 1; s < params.nbThreads; ++s){
+      mergeFastqStats(qc1[0], qc1[s]);
+      mergeFastqStats(qc2[0], qc2[s]);
+    }
+    writeFastqStats(qc1[0], params.outPrefix + "_R1_qc.txt", params.inFq1);
+    if(paired)
+      writeFastqStats(qc2[0], params.outPrefix + "_R2_qc.txt", params.inFq2);
+  }
+
+  if(params.verbose > 0){
+    if(! paired)
+      cout << "total nb of reads: " << stats.nbPairs << endl
+	   << "nb of trimmed reads: " << stats.nbTrimmedRead1 << endl
+	   << "nb of filtered reads: " << stats.nbFilteredPairs << endl;
+    else
+      cout << "total nb of read pairs: " << stats.nbPairs << endl
+	   << "nb of trimmed read pairs: " << stats.nbTrimmedPairs
+	   << " (R1 only=" << stats.nbTrimmedRead1
+	   << " R2 only=" << stats.nbTrimmedRead2 << ")" << endl
+	   << "nb of unpaired reads: R1=" << stats.nbUnpairedRead1
+	   << " R2=" << stats.nbUnpairedRead2 << endl
+	   << "nb of filtered read pairs: " << stats.nbFilteredPairs << endl;
+  }
+}
+
+int main(int argc, char ** argv)
+{
+  TrimParams params;
+  params.inDir = ".";
+  params.maxNbErrors = 0;
+  params.minOvl = 0;
+  params.minReadLen = 0;
+  params.level = 1;
+  params.qc = false;
+  params.batchSize = 100000;
+  params.nbThreads = 1;
+  params.verbose = 1;
+
+  parseCmdLine(argc, argv, params);
+
+  time_t startRawTime, endRawTime;
+  if(params.verbose > 0){
+    time(&startRawTime);
+    cout << "START " << basename(argv[0])
+         << " " << getDateTime(startRawTime) << endl
+         << "version " << VERSION << " compiled " << __DATE__
+         << " " << __TIME__ << endl
+         << "cmd-line: " << getCmdLine(argc, argv) << endl
+         << "cwd: " << getCurrentDirectory() << endl;
+    cout << flush;
+  }
+
+  run(params);
+
+  if(params.verbose > 0){
+    time(&endRawTime);
+    cout << "END " << basename(argv[0])
+         << " " << getDateTime(endRawTime) << endl
+         << "elapsed -> " << getElapsedTime(startRawTime, endRawTime) << endl
+         << "max.mem -> " << getMaxMemUsedByProcess2Str() << endl;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,865 @@
+/** \file utils_geno.cpp
+ *
+ *  `utils_geno' gathers compact containers for genotype data.
+ *  Copyright (C) 2013 Timothee Flutre
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cmath>
+#include <cstring>
+#include <cerrno>
+
+#include <iostream>
+#include <algorithm>
+
+#include "utils_geno.hpp"
+
+using namespace std;
+
+namespace utils {
+
+  static const uint16_t U16_MISSING = 65535;
+  static const uint8_t U8_MISSING = 255;
+  static const double U16_STEPS = 32767.0; // codes 0..65534 for [0,2]
+  static const double U8_STEPS = 127.0; // codes 0..254 for [0,2]
+
+  static const char DOSAGE_MAGIC[8] = {'Q','G','D','O','S','A','G','E'};
+  static const uint32_t DOSAGE_VERSION = 1;
+  // flag added to the encoding in the header of sample-major files
+  static const uint32_t DOSAGE_SAMPLE_MAJOR = 0x100;
+
+  static const char COORDS_MAGIC[8] = {'Q','G','C','O','O','R','D','S'};
+  static const uint32_t COORDS_VERSION = 1;
+
+  DosageEncoding getDosageEncoding(const string & name)
+  {
+    if(name == "f32")
+      return DOSAGE_F32;
+    else if(name == "u16")
+      return DOSAGE_U16;
+    else if(name == "u8")
+      return DOSAGE_U8;
+    cerr << "ERROR: unknown dosage encoding " << name
+	 << " (should be f32, u16 or u8)" << endl;
+    exit(1);
+  }
+
+  string getDosageEncodingName(const DosageEncoding & encoding)
+  {
+    if(encoding == DOSAGE_F32)
+      return "f32";
+    else if(encoding == DOSAGE_U16)
+      return "u16";
+    return "u8";
+  }
+
+/** \brief Return the number of bytes per dosage.
+ */
+  size_t getDosageEncodingSize(const DosageEncoding & encoding)
+  {
+    if(encoding == DOSAGE_F32)
+      return sizeof(float);
+    else if(encoding == DOSAGE_U16)
+      return sizeof(uint16_t);
+    return sizeof(uint8_t);
+  }
+
+/** \brief Return the maximum absolute error on a dosage in [0,2].
+ */
+  double getDosageEncodingMaxError(const DosageEncoding & encoding)
+  {
+    if(encoding == DOSAGE_F32)
+      return 2.0 * pow(2.0, -24);
+    else if(encoding == DOSAGE_U16)
+      return 0.5 / U16_STEPS;
+    return 0.5 / U8_STEPS;
+  }
+
+  static inline double clampDosage(const double d)
+  {
+    return (d < 0.0 ? 0.0 : (d > 2.0 ? 2.0 : d));
+  }
+
+/** \brief Encode n dosages into codes, which should have room for
+ *  n * getDosageEncodingSize(encoding) bytes.
+ *  \note NaN encodes a missing dosage; other values are clamped to [0,2].
+ */
+  void encodeDosages(const double * dosages, const size_t n,
+		     const DosageEncoding & encoding, void * codes)
+  {
+    if(encoding == DOSAGE_F32){
+      float * c = (float *) codes;
+      for(size_t i = 0; i < n; ++i)
+	c[i] = (dosages[i] != dosages[i]) ? dosages[i] :
+	  (float) clampDosage(dosages[i]);
+    }
+    else if(encoding == DOSAGE_U16){
+      uint16_t * c = (uint16_t *) codes;
+      for(size_t i = 0; i < n; ++i)
+	c[i] = (dosages[i] != dosages[i]) ? U16_MISSING :
+	  (uint16_t) (clampDosage(dosages[i]) * U16_STEPS + 0.5);
+    }
+    else{
+      uint8_t * c = (uint8_t *) codes;
+      for(size_t i = 0; i < n; ++i)
+	c[i] = (dosages[i] != dosages[i]) ? U8_MISSING :
+	  (uint8_t) (clampDosage(dosages[i]) * U8_STEPS + 0.5);
+    }
+  }
+
+  void initDosageMatrix(DosageMatrix & dm, const DosageEncoding & encoding,
+			const size_t nbSnps, const size_t nbSamples)
+  {
+    dm.encoding = encoding;
+    dm.nbSnps = nbSnps;
+    dm.nbSamples = nbSamples;
+    dm.f32.clear();
+    dm.u16.clear();
+    dm.u8.clear();
+    if(encoding == DOSAGE_F32)
+      dm.f32.resize(nbSnps * nbSamples);
+    else if(encoding == DOSAGE_U16)
+      dm.u16.resize(nbSnps * nbSamples);
+    else
+      dm.u8.resize(nbSnps * nbSamples);
+  }
+
+  static void * getDosageRowPtr(DosageMatrix & dm, const size_t snp)
+  {
+    size_t offset = snp * dm.nbSamples;
+    if(dm.encoding == DOSAGE_F32)
+      return &dm.f32[offset];
+    else if(dm.encoding == DOSAGE_U16)
+      return &dm.u16[offset];
+    return &dm.u8[offset];
+  }
+
+  void setDosageRow(DosageMatrix & dm, const size_t snp,
+		    const double * dosages)
+  {
+    encodeDosages(dosages, dm.nbSamples, dm.encoding,
+		  getDosageRowPtr(dm, snp));
+  }
+
+/** \brief Decode the dosages of a SNP, missing ones being NaN.
+ */
+  void getDosageRow(const DosageMatrix & dm, const size_t snp,
+		    double * dosages)
+  {
+    const size_t N = dm.nbSamples, offset = snp * N;
+    if(dm.encoding == DOSAGE_F32){
+      const float * c = &dm.f32[offset];
+      for(size_t i = 0; i < N; ++i)
+	dosages[i] = c[i];
+    }
+    else if(dm.encoding == DOSAGE_U16){
+      const uint16_t * c = &dm.u16[offset];
+      for(size_t i = 0; i < N; ++i)
+	dosages[i] = (c[i] == U16_MISSING) ? NAN : c[i] / U16_STEPS;
+    }
+    else{
+      const uint8_t * c = &dm.u8[offset];
+      for(size_t i = 0; i < N; ++i)
+	dosages[i] = (c[i] == U8_MISSING) ? NAN : c[i] / U8_STEPS;
+    }
+  }
+
+/** \brief Return the sum of the non-missing dosages of a SNP.
+ *  \note Integer codes are summed exactly before a single scaling.
+ */
+  double sumDosageRow(const DosageMatrix & dm, const size_t snp,
+		      size_t & nbMissing)
+  {
+    const size_t N = dm.nbSamples, offset = snp * N;
+    nbMissing = 0;
+    if(dm.encoding == DOSAGE_F32){
+      const float * c = &dm.f32[offset];
+      double sum = 0.0;
+      for(size_t i = 0; i < N; ++i){
+	if(c[i] == c[i])
+	  sum += c[i];
+	else
+	  ++nbMissing;
+      }
+      return sum;
+    }
+    uint64_t sum = 0;
+    if(dm.encoding == DOSAGE_U16){
+      const uint16_t * c = &dm.u16[offset];
+      for(size_t i = 0; i < N; ++i){
+	bool miss = (c[i] == U16_MISSING);
+	sum += miss ? 0 : c[i];
+	nbMissing += miss;
+      }
+      return sum / U16_STEPS;
+    }
+    const uint8_t * c = &dm.u8[offset];
+    for(size_t i = 0; i < N; ++i){
+      bool miss = (c[i] == U8_MISSING);
+      sum += miss ? 0 : c[i];
+      nbMissing += miss;
+    }
+    return sum / U8_STEPS;
+  }
+
+/** \brief Return sum_i d_i x_i over the non-missing dosages of a SNP.
+ *  \note The codes are widened in the loop and the scaling is applied once
+ *  at the end, so that the loop vectorizes.
+ */
+  double dotDosageRow(const DosageMatrix & dm, const size_t snp,
+		      const double * x)
+  {
+    const size_t N = dm.nbSamples, offset = snp * N;
+    double s0 = 0.0, s1 = 0.0;
+    size_t i = 0;
+    if(dm.encoding == DOSAGE_F32){
+      const float * c = &dm.f32[offset];
+      for(i = 0; i < N; ++i)
+	if(c[i] == c[i])
+	  s0 += c[i] * x[i];
+      return s0;
+    }
+    else if(dm.encoding == DOSAGE_U16){
+      const uint16_t * c = &dm.u16[offset];
+      for(; i + 2 <= N; i += 2){
+	s0 += (c[i] == U16_MISSING ? 0.0 : (double) c[i]) * x[i];
+	s1 += (c[i+1] == U16_MISSING ? 0.0 : (double) c[i+1]) * x[i+1];
+      }
+      for(; i < N; ++i)
+	s0 += (c[i] == U16_MISSING ? 0.0 : (double) c[i]) * x[i];
+      return (s0 + s1) / U16_STEPS;
+    }
+    const uint8_t * c = &dm.u8[offset];
+    for(; i + 2 <= N; i += 2){
+      s0 += (c[i] == U8_MISSING ? 0.0 : (double) c[i]) * x[i];
+      s1 += (c[i+1] == U8_MISSING ? 0.0 : (double) c[i+1]) * x[i+1];
+    }
+    for(; i < N; ++i)
+      s0 += (c[i] == U8_MISSING ? 0.0 : (double) c[i]) * x[i];
+    return (s0 + s1) / U8_STEPS;
+  }
+
+/** \brief Compute res = D x for all SNPs, eg. the G'y of a genotype scan.
+ *  \note SNPs are split among the OpenMP threads.
+ */
+  void dotDosageRows(const DosageMatrix & dm, const double * x, double * res)
+  {
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+    for(long s = 0; s < (long) dm.nbSnps; ++s)
+      res[s] = dotDosageRow(dm, (size_t) s, x);
+  }
+
+  size_t getDosageMatrixBytes(const DosageMatrix & dm)
+  {
+    return dm.nbSnps * dm.nbSamples * getDosageEncodingSize(dm.encoding);
+  }
+
+  static void writeDosageHeader(DosageWriter & dw)
+  {
+    uint32_t version = DOSAGE_VERSION, encoding = (uint32_t) dw.encoding;
+    uint64_t nbSamples = dw.nbSamples, nbSnps = dw.nbSnps;
+    if(fwrite(DOSAGE_MAGIC, 1, 8, dw.stream) != 8 ||
+       fwrite(&version, sizeof(uint32_t), 1, dw.stream) != 1 ||
+       fwrite(&encoding, sizeof(uint32_t), 1, dw.stream) != 1 ||
+       fwrite(&nbSamples, sizeof(uint64_t), 1, dw.stream) != 1 ||
+       fwrite(&nbSnps, sizeof(uint64_t), 1, dw.stream) != 1){
+      cerr << "ERROR: can't write header of file " << dw.path
+	   << " (errno=" << errno << ")" << endl;
+      exit(1);
+    }
+  }
+
+/** \brief Open a binary dosage file, the number of SNPs being filled in by
+ *  closeDosageWriter so that rows can be streamed.
+ */
+  void openDosageWriter(DosageWriter & dw, const string & path,
+			const DosageEncoding & encoding,
+			const size_t nbSamples)
+  {
+    dw.path = path;
+    dw.encoding = encoding;
+    dw.nbSamples = nbSamples;
+    dw.nbSnps = 0;
+    dw.codes.resize(nbSamples * getDosageEncodingSize(encoding));
+    dw.stream = fopen(path.c_str(), "wb");
+    if(dw.stream == NULL){
+      cerr << "ERROR: can't open file " << path << " to write"
+	   << " (errno=" << errno << ")" << endl;
+      exit(1);
+    }
+    writeDosageHeader(dw);
+  }
+
+  void writeDosageRow(DosageWriter & dw, const double * dosages)
+  {
+    encodeDosages(dosages, dw.nbSamples, dw.encoding, &dw.codes[0]);
+    if(fwrite(&dw.codes[0], 1, dw.codes.size(), dw.stream) !=
+       dw.codes.size()){
+      cerr << "ERROR: can't write SNP " << dw.nbSnps + 1
+	   << " in file " << dw.path << " (errno=" << errno << ")" << endl;
+      exit(1);
+    }
+    ++dw.nbSnps;
+  }
+
+  void closeDosageWriter(DosageWriter & dw)
+  {
+    rewind(dw.stream);
+    writeDosageHeader(dw);
+    if(fclose(dw.stream) != 0){
+      cerr << "ERROR: can't close file " << dw.path
+	   << " (errno=" << errno << ")" << endl;
+      exit(1);
+    }
+    dw.stream = NULL;
+  }
+
+/** \brief Read the header of a binary dosage file, the stream being then
+ *  at the first code.
+ */
+  static void readDosageHeader(FILE * stream, const string & path,
+			       DosageEncoding & encoding, bool & sampleMajor,
+			       uint64_t & nbSamples, uint64_t & nbSnps)
+  {
+    char magic[8];
+    uint32_t version, code;
+    if(fread(magic, 1, 8, stream) != 8 ||
+       memcmp(magic, DOSAGE_MAGIC, 8) != 0 ||
+       fread(&version, sizeof(uint32_t), 1, stream) != 1 ||
+       fread(&code, sizeof(uint32_t), 1, stream) != 1 ||
+       fread(&nbSamples, sizeof(uint64_t), 1, stream) != 1 ||
+       fread(&nbSnps, sizeof(uint64_t), 1, stream) != 1 ||
+       version != DOSAGE_VERSION ||
+       (code & ~DOSAGE_SAMPLE_MAJOR) > DOSAGE_U8){
+      cerr << "ERROR: file " << path << " isn't a binary dosage file"
+	   << " of version " << DOSAGE_VERSION << endl;
+      exit(1);
+    }
+    encoding = (DosageEncoding) (code & ~DOSAGE_SAMPLE_MAJOR);
+    sampleMajor = (code & DOSAGE_SAMPLE_MAJOR) != 0;
+  }
+
+/** \brief Load a whole binary dosage file, keeping its encoding.
+ */
+  void loadDosageFile(const string & path, DosageMatrix & dm)
+  {
+    FILE * stream = fopen(path.c_str(), "rb");
+    if(stream == NULL){
+      cerr << "ERROR: can't open file " << path << " to read"
+	   << " (errno=" << errno << ")" << endl;
+      exit(1);
+    }
+    DosageEncoding encoding;
+    bool sampleMajor;
+    uint64_t nbSamples, nbSnps;
+    readDosageHeader(stream, path, encoding, sampleMajor, nbSamples, nbSnps);
+    if(sampleMajor){
+      cerr << "ERROR: file " << path << " is sample-major, transpose it"
+	   << " first" << endl;
+      exit(1);
+    }
+    initDosageMatrix(dm, encoding, nbSnps, nbSamples);
+    void * data = (nbSnps * nbSamples == 0) ? NULL : getDosageRowPtr(dm, 0);
+    size_t nbBytes = getDosageMatrixBytes(dm);
+    if(nbBytes > 0 && fread(data, 1, nbBytes, stream) != nbBytes){
+      cerr << "ERROR: file " << path << " is truncated" << endl;
+      exit(1);
+    }
+    fclose(stream);
+  }
+
+/** \brief Open a SNP-major binary dosage file to read it by blocks of SNPs.
+ */
+  void openDosageReader(DosageReader & dr, const string & path)
+  {
+    dr.path = path;
+    dr.stream = fopen(path.c_str(), "rb");
+    if(dr.stream == NULL){
+      cerr << "ERROR: can't open file " << path << " to read"
+	   << " (errno=" << errno << ")" << endl;
+      exit(1);
+    }
+    bool sampleMajor;
+    uint64_t nbSamples, nbSnps;
+    readDosageHeader(dr.stream, path, dr.encoding, sampleMajor, nbSamples,
+		     nbSnps);
+    if(sampleMajor){
+      cerr << "ERROR: file " << path << " is sample-major, transpose it"
+	   << " first" << endl;
+      exit(1);
+    }
+    dr.nbSamples = nbSamples;
+    dr.nbSnps = nbSnps;
+    dr.nbSnpsRead = 0;
+  }
+
+/** \brief Load the next SNPs, at most maxNbSnps, into dm and return their
+ *  number (0 at the end of the file).
+ */
+  size_t readDosageRows(DosageReader & dr, const size_t maxNbSnps,
+			DosageMatrix & dm)
+  {
+    size_t nb = min(maxNbSnps, dr.nbSnps - dr.nbSnpsRead);
+    initDosageMatrix(dm, dr.encoding, nb, dr.nbSamples);
+    size_t nbBytes = getDosageMatrixBytes(dm);
+    if(nbBytes > 0 && fread(getDosageRowPtr(dm, 0), 1, nbBytes, dr.stream)
+       != nbBytes){
+      cerr << "ERROR: file " << dr.path << " is truncated" << endl;
+      exit(1);
+    }
+    dr.nbSnpsRead += nb;
+    return nb;
+  }
+
+  void closeDosageReader(DosageReader & dr)
+  {
+    fclose(dr.stream);
+    dr.stream = NULL;
+  }
+
+/** \brief Transpose the nbRows x nbCols matrix in into out by tiles of
+ *  64 x 64 so that both stay in cache.
+ */
+  template <class T>
+  static void transposeTiles(const T * in, T * out, const size_t nbRows,
+			     const size_t nbCols)
+  {
+    for(size_t r0 = 0; r0 < nbRows; r0 += 64)
+      for(size_t c0 = 0; c0 < nbCols; c0 += 64){
+	size_t r1 = min(nbRows, r0 + 64), c1 = min(nbCols, c0 + 64);
+	for(size_t r = r0; r < r1; ++r)
+	  for(size_t c = c0; c < c1; ++c)
+	    out[c * nbRows + r] = in[r * nbCols + c];
+      }
+  }
+
+/** \brief Convert a binary dosage file between the SNP-major and
+ *  sample-major layouts, using at most about maxBytes of memory.
+ *  \note The input is read by bands of consecutive columns (one segment
+ *  per input row), each band being transposed in memory into consecutive
+ *  output rows, so that the output is written sequentially, and a single
+ *  band (hence sequential input) suffices if the file fits.
+ */
+  void transposeDosageFile(const string & inPath, const string & outPath,
+			   const size_t maxBytes)
+  {
+    FILE * in = fopen(inPath.c_str(), "rb");
+    if(in == NULL){
+      cerr << "ERROR: can't open file " << inPath << " to read"
+	   << " (errno=" << errno << ")" << endl;
+      exit(1);
+    }
+    DosageEncoding encoding;
+    bool sampleMajor;
+    uint64_t nbSamples, nbSnps;
+    readDosageHeader(in, inPath, encoding, sampleMajor, nbSamples, nbSnps);
+    const size_t nbRows = sampleMajor ? nbSamples : nbSnps,
+      nbCols = sampleMajor ? nbSnps : nbSamples,
+      eltSize = getDosageEncodingSize(encoding),
+      headerSize = 8 + 2 * sizeof(uint32_t) + 2 * sizeof(uint64_t);
+
+    FILE * out = fopen(outPath.c_str(), "wb");
+    if(out == NULL){
+      cerr << "ERROR: can't open file " << outPath << " to write"
+	   << " (errno=" << errno << ")" << endl;
+      exit(1);
+    }
+    uint32_t version = DOSAGE_VERSION,
+      code = (uint32_t) encoding | (sampleMajor ? 0 : DOSAGE_SAMPLE_MAJOR);
+    if(fwrite(DOSAGE_MAGIC, 1, 8, out) != 8 ||
+       fwrite(&version, sizeof(uint32_t), 1, out) != 1 ||
+       fwrite(&code, sizeof(uint32_t), 1, out) != 1 ||
+       fwrite(&nbSamples, sizeof(uint64_t), 1, out) != 1 ||
+       fwrite(&nbSnps, sizeof(uint64_t), 1, out) != 1){
+      cerr << "ERROR: can't write header of file " << outPath
+	   << " (errno=" << errno << ")" << endl;
+      exit(1);
+    }
+
+    size_t bandCols = (nbRows == 0) ? nbCols
+      : max((size_t) 1, maxBytes / (2 * nbRows * eltSize));
+    bandCols = min(bandCols, nbCols);
+    vector<uint8_t> band(nbRows * bandCols * eltSize),
+      tband(band.size());
+    for(size_t c0 = 0; c0 < nbCols; c0 += bandCols){
+      size_t nb = min(bandCols, nbCols - c0);
+      for(size_t r = 0; r < nbRows; ++r){
+	if(nb < nbCols
+	   && fseeko(in, headerSize + (r * nbCols + c0) * eltSize,
+		     SEEK_SET) != 0){
+	  cerr << "ERROR: can't seek in file " << inPath
+	       << " (errno=" << errno << ")" << endl;
+	  exit(1);
+	}
+	if(fread(&band[r * nb * eltSize], eltSize, nb, in) != nb){
+	  cerr << "ERROR: file " << inPath << " is truncated" << endl;
+	  exit(1);
+	}
+      }
+      if(eltSize == 4)
+	transposeTiles((const uint32_t*) &band[0], (uint32_t*) &tband[0],
+		       nbRows, nb);
+      else if(eltSize == 2)
+	transposeTiles((const uint16_t*) &band[0], (uint16_t*) &tband[0],
+		       nbRows, nb);
+      else
+	transposeTiles(&band[0], &tband[0], nbRows, nb);
+      if(nb * nbRows > 0
+	 && fwrite(&tband[0], eltSize, nb * nbRows, out) != nb * nbRows){
+	cerr << "ERROR: can't write in file " << outPath
+	     << " (errno=" << errno << ")" << endl;
+	exit(1);
+      }
+    }
+    fclose(in);
+    if(fclose(out) != 0){
+      cerr << "ERROR: can't close file " << outPath
+	   << " (errno=" << errno << ")" << endl;
+      exit(1);
+    }
+  }
+
+  static const uint64_t MASK_LO = 0x5555555555555555ULL;
+  static const unsigned char BED_MAGIC[3] = {0x6c, 0x1b, 0x01};
+
+  static inline size_t popcount64(const uint64_t w)
+  {
+    return (size_t) __builtin_popcountll(w);
+  }
+
+/** \brief Return the most likely genotype if its probability is at least
+ *  minProb, GENO_MISSING otherwise, as well as for an all-zero triplet
+ *  (missing in the IMPUTE format) whatever minProb.
+ */
+  uint8_t getHardCall(const double pA1A1, const double pA1A2,
+		      const double pA2A2, const double minProb)
+  {
+    if(pA1A1 + pA1A2 + pA2A2 <= 0)
+      return GENO_MISSING;
+    if(pA1A1 >= pA1A2 && pA1A1 >= pA2A2)
+      return (pA1A1 >= minProb) ? GENO_HOM_A1 : GENO_MISSING;
+    if(pA1A2 >= pA2A2)
+      return (pA1A2 >= minProb) ? GENO_HET : GENO_MISSING;
+    return (pA2A2 >= minProb) ? GENO_HOM_A2 : GENO_MISSING;
+  }
+
+  void initPackedGenoMatrix(PackedGenoMatrix & pm, const size_t nbSnps,
+			    const size_t nbSamples)
+  {
+    pm.nbSnps = nbSnps;
+    pm.nbSamples = nbSamples;
+    pm.nbWordsPerSnp = (nbSamples + 31) / 32;
+    pm.words.assign(nbSnps * pm.nbWordsPerSnp, 0);
+  }
+
+/** \brief Set the genotypes of a SNP from one HardCall per sample.
+ */
+  void setPackedGenoRow(PackedGenoMatrix & pm, const size_t snp,
+			const uint8_t * calls)
+  {
+    uint64_t * row = &pm.words[snp * pm.nbWordsPerSnp];
+    for(size_t w = 0; w < pm.nbWordsPerSnp; ++w)
+      row[w] = 0;
+    for(size_t i = 0; i < pm.nbSamples; ++i)
+      row[i / 32] |= ((uint64_t) (calls[i] & 3)) << (2 * (i % 32));
+  }
+
+/** \brief Decode the genotypes of a SNP as A1 dosages, missing being NaN.
+ */
+  void getPackedGenoRow(const PackedGenoMatrix & pm, const size_t snp,
+			double * dosages)
+  {
+    static const double code2dosage[4] = {2.0, NAN, 1.0, 0.0};
+    const uint64_t * row = &pm.words[snp * pm.nbWordsPerSnp];
+    for(size_t i = 0; i < pm.nbSamples; ++i)
+      dosages[i] = code2dosage[(row[i / 32] >> (2 * (i % 32))) & 3];
+  }
+
+/** \brief Mask of the low bits of the genotypes of word w actually used.
+ */
+  static inline uint64_t getValidMaskLo(const PackedGenoMatrix & pm,
+					const size_t w)
+  {
+    size_t nbLast = pm.nbSamples % 32;
+    if(w + 1 < pm.nbWordsPerSnp || nbLast == 0)
+      return MASK_LO;
+    return MASK_LO & ((1ULL << (2 * nbLast)) - 1);
+  }
+
+/** \brief Count each genotype class of a SNP with popcounts over words.
+ */
+  void countPackedGenoRow(const PackedGenoMatrix & pm, const size_t snp,
+			  size_t & nbHomA1, size_t & nbHet, size_t & nbHomA2,
+			  size_t & nbMissing)
+  {
+    const uint64_t * row = &pm.words[snp * pm.nbWordsPerSnp];
+    size_t n01 = 0, n10 = 0, n11 = 0;
+    for(size_t w = 0; w < pm.nbWordsPerSnp; ++w){
+      uint64_t mask = getValidMaskLo(pm, w),
+	lo = row[w] & mask, hi = (row[w] >> 1) & mask;
+      n01 += popcount64(lo & ~hi);
+      n10 += popcount64(hi & ~lo);
+      n11 += popcount64(lo & hi);
+    }
+    nbMissing = n01;
+    nbHet = n10;
+    nbHomA2 = n11;
+    nbHomA1 = pm.nbSamples - n01 - n10 - n11;
+  }
+
+/** \brief Return the minor allele frequency among non-missing genotypes,
+ *  or NaN if all are missing.
+ */
+  double getPackedGenoMaf(const PackedGenoMatrix & pm, const size_t snp)
+  {
+    size_t nbHomA1, nbHet, nbHomA2, nbMissing;
+    countPackedGenoRow(pm, snp, nbHomA1, nbHet, nbHomA2, nbMissing);
+    if(nbMissing == pm.nbSamples)
+      return NAN;
+    double f = (2 * nbHomA1 + nbHet)
+      / (2.0 * (pm.nbSamples - nbMissing));
+    return (f <= 0.5) ? f : 1 - f;
+  }
+
+/** \brief Return sum_i d_i x_i over the non-missing genotypes of a SNP,
+ *  d_i being the A1 dosage.
+ */
+  double dotPackedGenoRow(const PackedGenoMatrix & pm, const size_t snp,
+			  const double * x)
+  {
+    static const double code2dosage[4] = {2.0, 0.0, 1.0, 0.0};
+    const uint64_t * row = &pm.words[snp * pm.nbWordsPerSnp];
+    double res = 0.0;
+    for(size_t w = 0; w < pm.nbWordsPerSnp; ++w){
+      uint64_t word = row[w];
+      size_t end = min((size_t) 32, pm.nbSamples - 32 * w);
+      const double * xw = x + 32 * w;
+      for(size_t k = 0; k < end; ++k, word >>= 2)
+	res += code2dosage[word & 3] * xw[k];
+    }
+    return res;
+  }
+
+/** \brief Compute res = D x for all SNPs, D being the A1 dosages.
+ *  \note For each group of 4 samples, the 256 possible contributions
+ *  sum_k d_k x_k are tabulated once, so that each SNP then needs one lookup
+ *  per byte instead of 4 multiply-adds; the table takes 512 bytes per
+ *  sample. SNPs are split among the OpenMP threads.
+ */
+  void dotPackedGenoRows(const PackedGenoMatrix & pm, const double * x,
+			 double * res)
+  {
+    static const double code2dosage[4] = {2.0, 0.0, 1.0, 0.0};
+    const size_t nbBytes = (pm.nbSamples + 3) / 4;
+    vector<double> table(256 * nbBytes, 0.0);
+    for(size_t j = 0; j < nbBytes; ++j){
+      double * t = &table[256 * j];
+      for(size_t b = 0; b < 256; ++b)
+	for(size_t k = 0; k < 4 && 4 * j + k < pm.nbSamples; ++k)
+	  t[b] += code2dosage[(b >> (2 * k)) & 3] * x[4 * j + k];
+    }
+  
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+    for(long s = 0; s < (long) pm.nbSnps; ++s){
+      const uint64_t * row = &pm.words[s * pm.nbWordsPerSnp];
+      double sum = 0.0;
+      for(size_t j = 0; j < nbBytes; ++j)
+	sum += table[256 * j + ((row[j / 8] >> (8 * (j % 8))) & 0xff)];
+      res[s] = sum;
+    }
+  }
+
+  size_t getPackedGenoMatrixBytes(const PackedGenoMatrix & pm)
+  {
+    return pm.words.size() * sizeof(uint64_t);
+  }
+
+  void openPackedGenoWriter(PackedGenoWriter & pw, const string & path,
+			    const size_t nbSamples)
+  {
+    pw.path = path;
+    pw.nbSamples = nbSamples;
+    pw.nbSnps = 0;
+    pw.bytes.resize((nbSamples + 3) / 4);
+    pw.stream = fopen(path.c_str(), "wb");
+    if(pw.stream == NULL){
+      cerr << "ERROR: can't open file " << path << " to write"
+	   << " (errno=" << errno << ")" << endl;
+      exit(1);
+    }
+    if(fwrite(BED_MAGIC, 1, 3, pw.stream) != 3){
+      cerr << "ERROR: can't write header of file " << path
+	   << " (errno=" << errno << ")" << endl;
+      exit(1);
+    }
+  }
+
+/** \brief Write the genotypes of a SNP from one HardCall per sample.
+ */
+  void writePackedGenoRow(PackedGenoWriter & pw, const uint8_t * calls)
+  {
+    for(size_t j = 0; j < pw.bytes.size(); ++j)
+      pw.bytes[j] = 0;
+    for(size_t i = 0; i < pw.nbSamples; ++i)
+      pw.bytes[i / 4] |= (calls[i] & 3) << (2 * (i % 4));
+    if(fwrite(&pw.bytes[0], 1, pw.bytes.size(), pw.stream) !=
+       pw.bytes.size()){
+      cerr << "ERROR: can't write SNP " << pw.nbSnps + 1
+	   << " in file " << pw.path << " (errno=" << errno << ")" << endl;
+      exit(1);
+    }
+    ++pw.nbSnps;
+  }
+
+  void closePackedGenoWriter(PackedGenoWriter & pw)
+  {
+    if(fclose(pw.stream) != 0){
+      cerr << "ERROR: can't close file " << pw.path
+	   << " (errno=" << errno << ")" << endl;
+      exit(1);
+    }
+    pw.stream = NULL;
+  }
+
+/** \brief Load a whole PLINK BED file in SNP-major mode, the number of
+ *  samples coming from the FAM file.
+ */
+  void loadPackedGenoFile(const string & path, const size_t nbSamples,
+			  PackedGenoMatrix & pm)
+  {
+    FILE * stream = fopen(path.c_str(), "rb");
+    if(stream == NULL){
+      cerr << "ERROR: can't open file " << path << " to read"
+	   << " (errno=" << errno << ")" << endl;
+      exit(1);
+    }
+    unsigned char magic[3];
+    if(fread(magic, 1, 3, stream) != 3 || memcmp(magic, BED_MAGIC, 3) != 0){
+      cerr << "ERROR: file " << path << " isn't a SNP-major BED file" << endl;
+      exit(1);
+    }
+    fseek(stream, 0, SEEK_END);
+    size_t nbBytesPerSnp = (nbSamples + 3) / 4,
+      nbBytes = (size_t) ftell(stream) - 3;
+    if(nbBytesPerSnp == 0 || nbBytes % nbBytesPerSnp != 0){
+      cerr << "ERROR: size of file " << path << " doesn't match "
+	   << nbSamples << " samples" << endl;
+      exit(1);
+    }
+    fseek(stream, 3, SEEK_SET);
+  
+    initPackedGenoMatrix(pm, nbBytes / nbBytesPerSnp, nbSamples);
+    vector<uint8_t> bytes(nbBytesPerSnp);
+    for(size_t s = 0; s < pm.nbSnps; ++s){
+      if(fread(&bytes[0], 1, nbBytesPerSnp, stream) != nbBytesPerSnp){
+	cerr << "ERROR: can't read SNP " << s + 1 << " in file " << path
+	     << endl;
+	exit(1);
+      }
+      uint64_t * row = &pm.words[s * pm.nbWordsPerSnp];
+      for(size_t j = 0; j < nbBytesPerSnp; ++j)
+	row[j / 8] |= ((uint64_t) bytes[j]) << (8 * (j % 8));
+    }
+    fclose(stream);
+  }
+
+  size_t getNbSnps(const SnpCoords & sc)
+  {
+    size_t nbSnps = 0;
+    for(size_t c = 0; c < sc.coords.size(); ++c)
+      nbSnps += sc.coords[c].size();
+    return nbSnps;
+  }
+
+  void writeSnpCoordsFile(const string & path, const SnpCoords & sc)
+  {
+    FILE * stream = fopen(path.c_str(), "wb");
+    if(stream == NULL){
+      cerr << "ERROR: can't open file " << path << " to write"
+	   << " (errno=" << errno << ")" << endl;
+      exit(1);
+    }
+    uint32_t version = COORDS_VERSION, nbChrs = sc.chrNames.size();
+    uint64_t nbSnps = getNbSnps(sc);
+    bool ok = fwrite(COORDS_MAGIC, 1, 8, stream) == 8 &&
+      fwrite(&version, sizeof(uint32_t), 1, stream) == 1 &&
+      fwrite(&nbChrs, sizeof(uint32_t), 1, stream) == 1 &&
+      fwrite(&nbSnps, sizeof(uint64_t), 1, stream) == 1;
+    for(size_t c = 0; ok && c < sc.chrNames.size(); ++c){
+      uint32_t nameSize = sc.chrNames[c].size();
+      uint64_t n = sc.coords[c].size();
+      ok = fwrite(&nameSize, sizeof(uint32_t), 1, stream) == 1 &&
+	fwrite(sc.chrNames[c].data(), 1, nameSize, stream) == nameSize &&
+	fwrite(&n, sizeof(uint64_t), 1, stream) == 1 &&
+	(n == 0 || fwrite(&sc.coords[c][0], sizeof(uint32_t), n, stream) == n);
+    }
+    if(! ok || fclose(stream) != 0){
+      cerr << "ERROR: can't write file " << path
+	   << " (errno=" << errno << ")" << endl;
+      exit(1);
+    }
+  }
+
+  void loadSnpCoordsFile(const string & path, SnpCoords & sc)
+  {
+    FILE * stream = fopen(path.c_str(), "rb");
+    if(stream == NULL){
+      cerr << "ERROR: can't open file " << path
+	   << " (errno=" << errno << ")" << endl;
+      exit(1);
+    }
+    char magic[8];
+    uint32_t version, nbChrs;
+    uint64_t nbSnps;
+    bool ok = fread(magic, 1, 8, stream) == 8 &&
+      memcmp(magic, COORDS_MAGIC, 8) == 0 &&
+      fread(&version, sizeof(uint32_t), 1, stream) == 1 &&
+      fread(&nbChrs, sizeof(uint32_t), 1, stream) == 1 &&
+      fread(&nbSnps, sizeof(uint64_t), 1, stream) == 1 &&
+      version == COORDS_VERSION;
+    if(! ok){
+      cerr << "ERROR: file " << path << " isn't a binary coordinate file"
+	   << " of version " << COORDS_VERSION << endl;
+      exit(1);
+    }
+    sc.chrNames.assign(nbChrs, string());
+    sc.coords.assign(nbChrs, vector<uint32_t>());
+    for(size_t c = 0; ok && c < nbChrs; ++c){
+      uint32_t nameSize;
+      uint64_t n;
+      ok = fread(&nameSize, sizeof(uint32_t), 1, stream) == 1;
+      if(ok){
+	sc.chrNames[c].resize(nameSize);
+	ok = (nameSize == 0 ||
+	      fread(&sc.chrNames[c][0], 1, nameSize, stream) == nameSize) &&
+	  fread(&n, sizeof(uint64_t), 1, stream) == 1 && n <= nbSnps;
+      }
+      if(ok){
+	sc.coords[c].resize(n);
+	ok = n == 0 || fread(&sc.coords[c][0], sizeof(uint32_t), n, stream) == n;
+      }
+    }
+    fclose(stream);
+    if(! ok || getNbSnps(sc) != nbSnps){
+      cerr << "ERROR: file " << path << " is truncated" << endl;
+      exit(1);
+    }
+  }
+
+} // namespace utils
@@ -0,0 +1,212 @@
+/** \file utils_geno.hpp
+ *
+ *  `utils_geno' gathers compact containers for genotype data.
+ *  Copyright (C) 2013 Timothee Flutre
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Dosages in [0,2] are stored SNP-major with one of these encodings, the
+ *  kernels decoding on the fly and accumulating in double:
+ *  - f32: float, |error| <= 2 * 2^-24 ~ 1.2e-7, 4 bytes per dosage;
+ *  - u16: round(d * 65534/2), |error| <= 1/65534 ~ 1.5e-5, 2 bytes;
+ *  - u8: round(d * 254/2), |error| <= 1/254 ~ 3.9e-3, 1 byte.
+ *  The largest code (65535, 255) and NaN for f32 denote a missing dosage.
+ *  Hence a dot product with x has an error <= max|error| * sum_i |x_i|,
+ *  and a sum over N samples an error <= N * max|error|.
+ *
+ *  Hard calls are stored on 2 bits with the SNP-major encoding of PLINK BED
+ *  files (00 hom A1, 01 missing, 10 het, 11 hom A2), the dosage being the
+ *  number of copies of A1. In memory, each SNP takes whole 64-bit words of
+ *  32 genotypes so that the counts use popcount (compile with -mpopcnt).
+ */
+
+#ifndef UTILS_UTILS_GENO_HPP
+#define UTILS_UTILS_GENO_HPP
+
+#include <cstdlib>
+#include <cstdio>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+namespace utils {
+
+  enum DosageEncoding { DOSAGE_F32 = 0, DOSAGE_U16 = 1, DOSAGE_U8 = 2 };
+
+  struct DosageMatrix
+  {
+    DosageEncoding encoding;
+    size_t nbSnps;
+    size_t nbSamples;
+    std::vector<float> f32;
+    std::vector<uint16_t> u16;
+    std::vector<uint8_t> u8;
+  };
+
+  DosageEncoding getDosageEncoding(const std::string & name);
+
+  std::string getDosageEncodingName(const DosageEncoding & encoding);
+
+  size_t getDosageEncodingSize(const DosageEncoding & encoding);
+
+  double getDosageEncodingMaxError(const DosageEncoding & encoding);
+
+  void encodeDosages(const double * dosages, const size_t n,
+		     const DosageEncoding & encoding, void * codes);
+
+  void initDosageMatrix(DosageMatrix & dm, const DosageEncoding & encoding,
+			const size_t nbSnps, const size_t nbSamples);
+
+  void setDosageRow(DosageMatrix & dm, const size_t snp,
+		    const double * dosages);
+
+  void getDosageRow(const DosageMatrix & dm, const size_t snp,
+		    double * dosages);
+
+  double sumDosageRow(const DosageMatrix & dm, const size_t snp,
+		      size_t & nbMissing);
+
+  double dotDosageRow(const DosageMatrix & dm, const size_t snp,
+		      const double * x);
+
+  void dotDosageRows(const DosageMatrix & dm, const double * x, double * res);
+
+  size_t getDosageMatrixBytes(const DosageMatrix & dm);
+
+/** \brief Binary dosage file: a 32-byte header (magic "QGDOSAGE", version,
+ *  encoding, nb of samples, nb of SNPs) followed by the SNP-major codes.
+ *  Sample-major files, from transposeDosageFile, have 0x100 added to the
+ *  encoding.
+ */
+  struct DosageWriter
+  {
+    std::string path;
+    FILE * stream;
+    DosageEncoding encoding;
+    size_t nbSamples;
+    size_t nbSnps;
+    std::vector<uint8_t> codes;
+  };
+
+  void openDosageWriter(DosageWriter & dw, const std::string & path,
+			const DosageEncoding & encoding,
+			const size_t nbSamples);
+
+  void writeDosageRow(DosageWriter & dw, const double * dosages);
+
+  void closeDosageWriter(DosageWriter & dw);
+
+  void loadDosageFile(const std::string & path, DosageMatrix & dm);
+
+  struct DosageReader
+  {
+    std::string path;
+    FILE * stream;
+    DosageEncoding encoding;
+    size_t nbSamples;
+    size_t nbSnps;
+    size_t nbSnpsRead;
+  };
+
+  void openDosageReader(DosageReader & dr, const std::string & path);
+
+  size_t readDosageRows(DosageReader & dr, const size_t maxNbSnps,
+			DosageMatrix & dm);
+
+  void closeDosageReader(DosageReader & dr);
+
+  void transposeDosageFile(const std::string & inPath,
+			   const std::string & outPath,
+			   const size_t maxBytes);
+
+  enum HardCall { GENO_HOM_A1 = 0, GENO_MISSING = 1, GENO_HET = 2,
+		  GENO_HOM_A2 = 3 };
+
+  struct PackedGenoMatrix
+  {
+    size_t nbSnps;
+    size_t nbSamples;
+    size_t nbWordsPerSnp;
+    std::vector<uint64_t> words;
+  };
+
+  uint8_t getHardCall(const double pA1A1, const double pA1A2,
+		      const double pA2A2, const double minProb);
+
+  void initPackedGenoMatrix(PackedGenoMatrix & pm, const size_t nbSnps,
+			    const size_t nbSamples);
+
+  void setPackedGenoRow(PackedGenoMatrix & pm, const size_t snp,
+			const uint8_t * calls);
+
+  void getPackedGenoRow(const PackedGenoMatrix & pm, const size_t snp,
+			double * dosages);
+
+  void countPackedGenoRow(const PackedGenoMatrix & pm, const size_t snp,
+			  size_t & nbHomA1, size_t & nbHet, size_t & nbHomA2,
+			  size_t & nbMissing);
+
+  double getPackedGenoMaf(const PackedGenoMatrix & pm, const size_t snp);
+
+  double dotPackedGenoRow(const PackedGenoMatrix & pm, const size_t snp,
+			  const double * x);
+
+  void dotPackedGenoRows(const PackedGenoMatrix & pm, const double * x,
+			 double * res);
+
+  size_t getPackedGenoMatrixBytes(const PackedGenoMatrix & pm);
+
+/** \brief PLINK BED file in SNP-major mode, one row of ceil(N/4) bytes per
+ *  SNP after the 3 magic bytes.
+ */
+  struct PackedGenoWriter
+  {
+    std::string path;
+    FILE * stream;
+    size_t nbSamples;
+    size_t nbSnps;
+    std::vector<uint8_t> bytes;
+  };
+
+  void openPackedGenoWriter(PackedGenoWriter & pw, const std::string & path,
+			    const size_t nbSamples);
+
+  void writePackedGenoRow(PackedGenoWriter & pw, const uint8_t * calls);
+
+  void closePackedGenoWriter(PackedGenoWriter & pw);
+
+  void loadPackedGenoFile(const std::string & path, const size_t nbSamples,
+			  PackedGenoMatrix & pm);
+
+/** \brief Sorted SNP coordinates of each chromosome.
+ *  \note In binary, a 24-byte header (magic "QGCOORDS", version, nb of
+ *  chromosomes, nb of SNPs) is followed, for each chromosome, by the length
+ *  of its name, its name, its nb of SNPs and their coordinates as uint32.
+ */
+  struct SnpCoords
+  {
+    std::vector<std::string> chrNames;
+    std::vector<std::vector<uint32_t> > coords;
+  };
+
+  size_t getNbSnps(const SnpCoords & sc);
+
+  void writeSnpCoordsFile(const std::string & path, const SnpCoords & sc);
+
+  void loadSnpCoordsFile(const std::string & path, SnpCoords & sc);
+
+} // namespace utils
+
+#endif // UTILS_UTILS_GENO_HPP
@@ -25,6 +25,16 @@
 #include <sys/time.h>
 #include <dirent.h>
 #include <glob.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#if defined(__GLIBC__) \
+  && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 27))
+#define HAS_COPY_FILE_RANGE 1 // glibc wrapper of the syscall
+#endif
+#endif
 
 #include <iomanip>
 #include <algorithm>
@@ -589,6 +599,7 @@ namespace utils {
  *  \note http://stackoverflow.com/a/1149769/597069
  *  \note Don't do anything if the supplied path is empty
  *  or if the directory doesn't exist.
+ *  \note Symbolic links are removed, not followed.
  */
   int
   removeDir(
@@ -597,9 +608,6 @@ namespace utils {
     if (path.empty())
       return 0;
   
-    if (path[path.size()] == '.')
-      return 0;
-  
     if (path[path.length()-1] != '/')
       path += "/";
   
@@ -608,7 +616,7 @@ namespace utils {
     pdir = opendir (path.c_str());
     if (pdir == NULL)
     {
-      if (errno == 2) // No such file or directory
+      if (errno == ENOENT) // No such file or directory
 	return 0;
       else
       {
@@ -619,10 +627,10 @@ namespace utils {
     }
   
     struct dirent *pent = NULL;
-    char file[1024];
-    int counter = 1; // use this to skip the first TWO which cause an infinite loop (and eventually, stack overflow)
+    struct stat st;
     while (true)
     {
+      errno = 0;
       pent = readdir (pdir); // while there is still something in the directory
       if (pent == NULL)
       {
@@ -630,24 +638,20 @@ namespace utils {
 	{
 	  cerr << "ERROR: readdir returned NULL for path " << path << endl;
 	  fprintf (stderr, "errno=%i %s\n", errno, strerror(errno));
+	  closedir (pdir);
 	  return errno; // we couldn't do it
 	}
 	else // if the directory is empty
 	  break;
       }
-      if (counter > 2)
-      {
-	for (int i = 0; i < 256; i++)
-	  file[i] = '\0';
-	strcat(file, path.c_str());
-	// otherwise, it was initialised correctly, so let's delete the file~
-	strcat(file, pent->d_name); // concatenate the strings to get the complete path
-	if (isDirectory(file) == true)
-	  removeDir(file);
-	else // it's a file, we can use remove
-	  remove(file);
-      }
-      counter++;
+      // skip "." and ".." which cause an infinite loop (and eventually, stack overflow)
+      if (strcmp (pent->d_name, ".") == 0 || strcmp (pent->d_name, "..") == 0)
+	continue;
+      string file = path + pent->d_name;
+      if (lstat (file.c_str(), &st) == 0 && S_ISDIR(st.st_mode))
+	removeDir (file);
+      else // it's a file or a link, we can use remove
+	remove (file.c_str());
     }
   
     // finally, let's clean up
@@ -753,4 +757,1492 @@ namespace utils {
     return (oss.str());
   }
 
+  string
+  toString (
+    const StringView & sv)
+  {
+    return string (sv.data, sv.size);
+  }
+
+  bool
+  operator== (
+    const StringView & sv,
+    const char * str)
+  {
+    return strlen (str) == sv.size && memcmp (sv.data, str, sv.size) == 0;
+  }
+
+/** \brief Open a (gzipped) file, "-" meaning stdin, to be read by blocks.
+ */
+  void
+  openBlockReader (
+    BlockReader & br,
+    const string & path,
+    const size_t blockSize)
+  {
+    br.path = path;
+    if (path == "-")
+      br.stream = gzdopen (fileno (stdin), "rb");
+    else
+      br.stream = gzopen (path.c_str(), "rb");
+    if (br.stream == NULL)
+    {
+      cerr << "ERROR: can't open file " << path << " to read"
+	   << " (errno=" << errno << ")" << endl;
+      exit (1);
+    }
+    gzbuffer (br.stream, 131072);
+    br.buffer.resize (blockSize);
+    br.begin = 0;
+    br.end = 0;
+    br.eof = false;
+    br.nbLines = 0;
+  }
+
+/** \brief Return the next line as a view on the buffer, without '\n' nor
+ *  '\r', and false at the end of the file.
+ *  \note The buffer grows if a line is longer than it.
+ */
+  bool
+  getline (
+    BlockReader & br,
+    StringView & line)
+  {
+    while (true)
+    {
+      char * first = &br.buffer[0] + br.begin,
+	* newline = (char *) memchr (first, '\n', br.end - br.begin);
+      if (newline != NULL || (br.eof && br.begin < br.end))
+      {
+	char * last = (newline != NULL) ? newline : &br.buffer[0] + br.end;
+	line.data = first;
+	line.size = last - first;
+	if (line.size > 0 && first[line.size-1] == '\r')
+	  --line.size;
+	br.begin = (last - &br.buffer[0]) + (newline != NULL ? 1 : 0);
+	++br.nbLines;
+	return true;
+      }
+      if (br.eof)
+	return false;
+
+      // move the partial line at the front, then refill
+      size_t nbLeft = br.end - br.begin;
+      if (nbLeft > 0 && br.begin > 0)
+	memmove (&br.buffer[0], &br.buffer[br.begin], nbLeft);
+      br.begin = 0;
+      br.end = nbLeft;
+      if (br.end == br.buffer.size())
+	br.buffer.resize (2 * br.buffer.size());
+      int nbRead = gzread (br.stream, &br.buffer[br.end],
+			   br.buffer.size() - br.end);
+      if (nbRead < 0)
+      {
+	int errnum;
+	cerr << "ERROR: can't read file " << br.path << " after line "
+	     << br.nbLines << " (" << gzerror (br.stream, &errnum) << ")"
+	     << endl;
+	exit (1);
+      }
+      br.end += nbRead;
+      if (nbRead == 0)
+	br.eof = true;
+    }
+  }
+
+  void
+  closeBlockReader (
+    BlockReader & br)
+  {
+    closeFile (br.path, br.stream);
+    vector<char>().swap (br.buffer);
+  }
+
+/** \brief Split a line into views on its tokens, consecutive delimiters
+ *  being merged as with split(s, delim, tokens).
+ */
+  size_t
+  tokenize (
+    const StringView & line,
+    const char * delims,
+    vector<StringView> & tokens)
+  {
+    bool isDelim[256];
+    memset (isDelim, 0, sizeof(isDelim));
+    for (const char * d = delims; *d != '\0'; ++d)
+      isDelim[(unsigned char) *d] = true;
+
+    tokens.clear();
+    const char * p = line.data, * end = line.data + line.size;
+    while (p < end)
+    {
+      while (p < end && isDelim[(unsigned char) *p])
+	++p;
+      if (p == end)
+	break;
+      StringView token;
+      token.data = p;
+      while (p < end && ! isDelim[(unsigned char) *p])
+	++p;
+      token.size = p - token.data;
+      tokens.push_back (token);
+    }
+    return tokens.size();
+  }
+
+/** \brief Parse a token such as "-1.25e-3" into a double, returning false
+ *  if it isn't a number (eg. "NA").
+ *  \note When there are at most 15 digits and the power of ten is below 22, the
+ *  result is computed exactly by one multiplication or division (Clinger's
+ *  fast path); otherwise strtod is called, hence the result is always
+ *  correctly rounded.
+ */
+  bool
+  parseDouble (
+    const StringView & token,
+    double & x)
+  {
+    static const double pow10[23] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7,
+				     1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14,
+				     1e15, 1e16, 1e17, 1e18, 1e19, 1e20,
+				     1e21, 1e22};
+    const char * p = token.data, * end = token.data + token.size;
+    if (p == end)
+      return false;
+    bool negative = (*p == '-');
+    if (*p == '-' || *p == '+')
+      ++p;
+
+    uint64_t mantissa = 0;
+    int nbDigits = 0, exponent = 0;
+    for (; p < end && *p >= '0' && *p <= '9'; ++p, ++nbDigits)
+      mantissa = 10 * mantissa + (*p - '0');
+    if (p < end && *p == '.')
+    {
+      ++p;
+      for (; p < end && *p >= '0' && *p <= '9'; ++p, ++nbDigits, --exponent)
+	mantissa = 10 * mantissa + (*p - '0');
+    }
+    if (nbDigits == 0)
+      goto slow;
+    if (p < end && (*p == 'e' || *p == 'E'))
+    {
+      ++p;
+      bool negExp = (p < end && *p == '-');
+      if (p < end && (*p == '-' || *p == '+'))
+	++p;
+      if (p == end || *p < '0' || *p > '9')
+	return false;
+      int e = 0;
+      for (; p < end && *p >= '0' && *p <= '9'; ++p)
+	if (e < 100000)
+	  e = 10 * e + (*p - '0');
+      exponent += negExp ? -e : e;
+    }
+    if (p != end)
+      return false;
+
+    if (nbDigits <= 15 && exponent >= -22 && exponent <= 22)
+    {
+      x = (exponent < 0) ? mantissa / pow10[-exponent]
+	: mantissa * pow10[exponent];
+      if (negative)
+	x = -x;
+      return true;
+    }
+
+  slow:
+    char buf[128];
+    if (token.size >= sizeof(buf))
+      return false;
+    memcpy (buf, token.data, token.size);
+    buf[token.size] = '\0';
+    char * last;
+    x = strtod (buf, &last);
+    return (last == buf + token.size && last != buf);
+  }
+
+/** \brief Parse a token made only of digits.
+ */
+  bool
+  parseUnsigned (
+    const StringView & token,
+    size_t & x)
+  {
+    if (token.size == 0)
+      return false;
+    x = 0;
+    for (size_t i = 0; i < token.size; ++i)
+    {
+      if (token.data[i] < '0' || token.data[i] > '9')
+	return false;
+      x = 10 * x + (token.data[i] - '0');
+    }
+    return true;
+  }
+
+/** \brief Load a (gzipped) matrix with a header line of column names and
+ *  a first column of row names, as for MatrixEQTL, in row-major order.
+ *  \note The header may or may not have a label for the column of row
+ *  names. Non-numeric values (eg. "NA") are NaN.
+ */
+  void
+  loadLabeledMatrix (
+    const string & path,
+    vector<string> & rowNames,
+    vector<string> & colNames,
+    vector<double> & values)
+  {
+    BlockReader br;
+    StringView line;
+    vector<StringView> tokens, header;
+    string headerLine;
+    rowNames.clear();
+    colNames.clear();
+    values.clear();
+
+    openBlockReader (br, path);
+    if (! getline (br, line))
+    {
+      cerr << "ERROR: file " << path << " is empty" << endl;
+      exit (1);
+    }
+    headerLine = toString (line);
+    StringView headerView = {headerLine.data(), headerLine.size()};
+    tokenize (headerView, " \t", header);
+    while (getline (br, line))
+    {
+      if (tokenize (line, " \t", tokens) == 0)
+	continue;
+      if (colNames.empty())
+      {
+	if (tokens.size() != header.size() && tokens.size() != header.size() + 1)
+	{
+	  cerr << "ERROR: the header of file " << path << " has "
+	       << header.size() << " columns but line 2 has " << tokens.size()
+	       << endl;
+	  exit (1);
+	}
+	for (size_t j = header.size() - (tokens.size() - 1); j < header.size();
+	     ++j)
+	  colNames.push_back (toString (header[j]));
+      }
+      if (tokens.size() != colNames.size() + 1)
+      {
+	cerr << "ERROR: line " << br.nbLines << " of file " << path << " has "
+	     << tokens.size() << " columns instead of " << colNames.size() + 1
+	     << endl;
+	exit (1);
+      }
+      rowNames.push_back (toString (tokens[0]));
+      for (size_t j = 1; j < tokens.size(); ++j)
+      {
+	double x;
+	values.push_back (parseDouble (tokens[j], x) ? x : NAN);
+      }
+    }
+    closeBlockReader (br);
+  }
+
+  static const char MATRIX_MAGIC[8] = {'Q','G','M','A','T','R','I','X'};
+  static const uint32_t MATRIX_VERSION = 1;
+
+/** \brief Write a matrix in binary: a 32-byte header (magic "QGMATRIX",
+ *  version, 0, nb of rows, nb of columns), the column names then the row
+ *  names, each followed by '\n', and the values as row-major doubles.
+ */
+  void
+  writeBinaryMatrix (
+    const string & path,
+    const vector<string> & rowNames,
+    const vector<string> & colNames,
+    const double * values)
+  {
+    FILE * stream = fopen (path.c_str(), "wb");
+    if (stream == NULL)
+    {
+      cerr << "ERROR: can't open file " << path << " to write"
+	   << " (errno=" << errno << ")" << endl;
+      exit (1);
+    }
+    uint32_t version = MATRIX_VERSION, flags = 0;
+    uint64_t nbRows = rowNames.size(), nbCols = colNames.size();
+    string names;
+    for (size_t j = 0; j < colNames.size(); ++j)
+      names += colNames[j] + "\n";
+    for (size_t i = 0; i < rowNames.size(); ++i)
+      names += rowNames[i] + "\n";
+    size_t n = nbRows * nbCols;
+    if (fwrite (MATRIX_MAGIC, 1, 8, stream) != 8
+	|| fwrite (&version, sizeof(uint32_t), 1, stream) != 1
+	|| fwrite (&flags, sizeof(uint32_t), 1, stream) != 1
+	|| fwrite (&nbRows, sizeof(uint64_t), 1, stream) != 1
+	|| fwrite (&nbCols, sizeof(uint64_t), 1, stream) != 1
+	|| fwrite (names.data(), 1, names.size(), stream) != names.size()
+	|| (n > 0 && fwrite (values, sizeof(double), n, stream) != n)
+	|| fclose (stream) != 0)
+    {
+      cerr << "ERROR: can't write file " << path
+	   << " (errno=" << errno << ")" << endl;
+      exit (1);
+    }
+  }
+
+/** \brief Load a matrix written by writeBinaryMatrix.
+ */
+  void
+  loadBinaryMatrix (
+    const string & path,
+    vector<string> & rowNames,
+    vector<string> & colNames,
+    vector<double> & values)
+  {
+    FILE * stream = fopen (path.c_str(), "rb");
+    if (stream == NULL)
+    {
+      cerr << "ERROR: can't open file " << path
+	   << " (errno=" << errno << ")" << endl;
+      exit (1);
+    }
+    char magic[8];
+    uint32_t version, flags;
+    uint64_t nbRows, nbCols;
+    if (fread (magic, 1, 8, stream) != 8
+	|| memcmp (magic, MATRIX_MAGIC, 8) != 0
+	|| fread (&version, sizeof(uint32_t), 1, stream) != 1
+	|| fread (&flags, sizeof(uint32_t), 1, stream) != 1
+	|| fread (&nbRows, sizeof(uint64_t), 1, stream) != 1
+	|| fread (&nbCols, sizeof(uint64_t), 1, stream) != 1
+	|| version != MATRIX_VERSION)
+    {
+      cerr << "ERROR: file " << path << " isn't a binary matrix file"
+	   << " of version " << MATRIX_VERSION << endl;
+      exit (1);
+    }
+    rowNames.assign (nbRows, string());
+    colNames.assign (nbCols, string());
+    bool ok = true;
+    for (size_t k = 0; ok && k < nbCols + nbRows; ++k)
+    {
+      string & name = (k < nbCols) ? colNames[k] : rowNames[k - nbCols];
+      int c;
+      while ((c = getc (stream)) != EOF && c != '\n')
+	name += (char) c;
+      ok = (c == '\n');
+    }
+    values.resize (nbRows * nbCols);
+    if (! ok || (! values.empty()
+		 && fread (&values[0], sizeof(double), values.size(), stream)
+		 != values.size()))
+    {
+      cerr << "ERROR: file " << path << " is truncated" << endl;
+      exit (1);
+    }
+    fclose (stream);
+  }
+
+/** \brief Compress data into one complete gzip member.
+ */
+  void
+  compressToGzipMember (
+    const char * data,
+    const size_t size,
+    const int level,
+    string & member)
+  {
+    z_stream zs;
+    memset (&zs, 0, sizeof(zs));
+    if (deflateInit2 (&zs, level, Z_DEFLATED, 15 + 16, 8,
+		      Z_DEFAULT_STRATEGY) != Z_OK)
+    {
+      cerr << "ERROR: can't initialize zlib" << endl;
+      exit (1);
+    }
+    member.resize (deflateBound (&zs, size));
+    zs.next_in = (Bytef *) data;
+    zs.avail_in = size;
+    zs.next_out = (Bytef *) &member[0];
+    zs.avail_out = member.size();
+    if (deflate (&zs, Z_FINISH) != Z_STREAM_END)
+    {
+      cerr << "ERROR: can't compress a block of " << size << " bytes" << endl;
+      exit (1);
+    }
+    member.resize (zs.total_out);
+    deflateEnd (&zs);
+  }
+
+/** \brief Open a file, "-" meaning stdout, to be written by blocks.
+ *  \note Up to nbThreads blocks are kept in memory and compressed at once.
+ */
+  void
+  openBlockWriter (
+    BlockWriter & bw,
+    const string & path,
+    const int nbThreads,
+    const int level,
+    const size_t blockSize)
+  {
+    bw.path = path;
+    bw.compress = (path.size() > 3 && path.substr (path.size() - 3) == ".gz");
+    bw.level = level;
+    bw.nbThreads = max (nbThreads, 1);
+    bw.blockSize = blockSize;
+    bw.current.clear();
+    bw.current.reserve (blockSize);
+    bw.blocks.clear();
+    bw.members.resize (bw.nbThreads);
+    if (path == "-")
+      bw.stream = stdout;
+    else
+      bw.stream = fopen (path.c_str(), "wb");
+    if (bw.stream == NULL)
+    {
+      cerr << "ERROR: can't open file " << path << " to write"
+	   << " (errno=" << errno << ")" << endl;
+      exit (1);
+    }
+  }
+
+  void
+  bwrite (
+    BlockWriter & bw,
+    const char * data,
+    const size_t size)
+  {
+    bw.current.append (data, size);
+    if (bw.current.size() >= bw.blockSize)
+    {
+      bw.blocks.push_back (string());
+      bw.blocks.back().swap (bw.current);
+      bw.current.reserve (bw.blockSize);
+      if (bw.blocks.size() >= (size_t) bw.nbThreads)
+	flushBlockWriter (bw);
+    }
+  }
+
+  void
+  bwrite (
+    BlockWriter & bw,
+    const string & str)
+  {
+    bwrite (bw, str.data(), str.size());
+  }
+
+/** \brief Compress the pending blocks in parallel and write them in order.
+ */
+  void
+  flushBlockWriter (
+    BlockWriter & bw)
+  {
+    if (! bw.current.empty())
+    {
+      bw.blocks.push_back (string());
+      bw.blocks.back().swap (bw.current);
+    }
+    if (bw.compress)
+    {
+      if (bw.members.size() < bw.blocks.size())
+	bw.members.resize (bw.blocks.size());
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(bw.nbThreads) schedule(dynamic)
+#endif
+      for (long b = 0; b < (long) bw.blocks.size(); ++b)
+	compressToGzipMember (bw.blocks[b].data(), bw.blocks[b].size(),
+			      bw.level, bw.members[b]);
+    }
+    for (size_t b = 0; b < bw.blocks.size(); ++b)
+    {
+      const string & out = bw.compress ? bw.members[b] : bw.blocks[b];
+      if (fwrite (out.data(), 1, out.size(), bw.stream) != out.size())
+      {
+	cerr << "ERROR: can't write in file " << bw.path
+	     << " (errno=" << errno << ")" << endl;
+	exit (1);
+      }
+    }
+    bw.blocks.clear();
+  }
+
+  void
+  closeBlockWriter (
+    BlockWriter & bw)
+  {
+    flushBlockWriter (bw);
+    if (bw.compress && bw.stream != stdout && ftell (bw.stream) == 0)
+    {
+      // an empty gzip member, so that an empty file is still valid gzip
+      string member;
+      compressToGzipMember ("", 0, bw.level, member);
+      fwrite (member.data(), 1, member.size(), bw.stream);
+    }
+    if (bw.stream == stdout)
+      fflush (stdout);
+    else if (fclose (bw.stream) != 0)
+    {
+      cerr << "ERROR: can't close file " << bw.path
+	   << " (errno=" << errno << ")" << endl;
+      exit (1);
+    }
+    bw.stream = NULL;
+  }
+
+/** \brief Initialize a multiplexer, files being added with addFile.
+ *  \note Up to nbThreads full buffers are kept and compressed at once.
+ */
+  void
+  openFileMultiplexer (
+    FileMultiplexer & fm,
+    const int nbThreads,
+    const int level,
+    const size_t maxNbOpen,
+    const size_t blockSize)
+  {
+    fm.paths.clear();
+    fm.compress.clear();
+    fm.created.clear();
+    fm.streams.clear();
+    fm.lastUses.clear();
+    fm.buffers.clear();
+    fm.openFiles.clear();
+    fm.blockFiles.clear();
+    fm.blocks.clear();
+    fm.members.clear();
+    fm.nbUses = 0;
+    fm.maxNbOpen = max (maxNbOpen, (size_t) 1);
+    fm.nbThreads = max (nbThreads, 1);
+    fm.level = level;
+    fm.blockSize = blockSize;
+  }
+
+/** \brief Add a file to the multiplexer and return its index, the file
+ *  being created only when data are written in it, or at the end.
+ */
+  size_t
+  addFile (
+    FileMultiplexer & fm,
+    const string & path)
+  {
+    fm.paths.push_back (path);
+    fm.compress.push_back (path.size() > 3
+			   && path.substr (path.size() - 3) == ".gz");
+    fm.created.push_back (false);
+    fm.streams.push_back (NULL);
+    fm.lastUses.push_back (0);
+    fm.buffers.push_back (string());
+    return fm.paths.size() - 1;
+  }
+
+  static void
+  closeMultiplexedFile (
+    FileMultiplexer & fm,
+    const size_t file)
+  {
+    if (fclose (fm.streams[file]) != 0)
+    {
+      cerr << "ERROR: can't close file " << fm.paths[file]
+	   << " (errno=" << errno << ")" << endl;
+      exit (1);
+    }
+    fm.streams[file] = NULL;
+  }
+
+/** \brief Return the stream of a file, opening it if necessary after
+ *  closing the least recently used one.
+ */
+  static FILE *
+  getMultiplexedStream (
+    FileMultiplexer & fm,
+    const size_t file)
+  {
+    if (fm.streams[file] == NULL)
+    {
+      if (fm.openFiles.size() >= fm.maxNbOpen)
+      {
+	size_t lru = 0;
+	for (size_t i = 1; i < fm.openFiles.size(); ++i)
+	  if (fm.lastUses[fm.openFiles[i]] < fm.lastUses[fm.openFiles[lru]])
+	    lru = i;
+	closeMultiplexedFile (fm, fm.openFiles[lru]);
+	fm.openFiles[lru] = fm.openFiles.back();
+	fm.openFiles.pop_back();
+      }
+      // gzip members appended to a gzip file still make a valid one
+      fm.streams[file] = fopen (fm.paths[file].c_str(),
+				fm.created[file] ? "ab" : "wb");
+      if (fm.streams[file] == NULL)
+      {
+	cerr << "ERROR: can't open file " << fm.paths[file] << " to write"
+	     << " (errno=" << errno << ")" << endl;
+	exit (1);
+      }
+      fm.created[file] = true;
+      fm.openFiles.push_back (file);
+    }
+    fm.lastUses[file] = ++fm.nbUses;
+    return fm.streams[file];
+  }
+
+/** \brief Compress the full blocks in parallel and write them in order.
+ */
+  static void
+  writeMultiplexedBlocks (
+    FileMultiplexer & fm)
+  {
+    if (fm.members.size() < fm.blocks.size())
+      fm.members.resize (fm.blocks.size());
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(fm.nbThreads) schedule(dynamic)
+#endif
+    for (long b = 0; b < (long) fm.blocks.size(); ++b)
+      if (fm.compress[fm.blockFiles[b]])
+	compressToGzipMember (fm.blocks[b].data(), fm.blocks[b].size(),
+			      fm.level, fm.members[b]);
+    for (size_t b = 0; b < fm.blocks.size(); ++b)
+    {
+      size_t file = fm.blockFiles[b];
+      const string & out = fm.compress[file] ? fm.members[b] : fm.blocks[b];
+      FILE * stream = getMultiplexedStream (fm, file);
+      if (fwrite (out.data(), 1, out.size(), stream) != out.size())
+      {
+	cerr << "ERROR: can't write in file " << fm.paths[file]
+	     << " (errno=" << errno << ")" << endl;
+	exit (1);
+      }
+    }
+    fm.blocks.clear();
+    fm.blockFiles.clear();
+  }
+
+  static void
+  queueMultiplexedBuffer (
+    FileMultiplexer & fm,
+    const size_t file)
+  {
+    fm.blockFiles.push_back (file);
+    fm.blocks.push_back (string());
+    fm.blocks.back().swap (fm.buffers[file]);
+    if (fm.blocks.size() >= (size_t) fm.nbThreads)
+      writeMultiplexedBlocks (fm);
+  }
+
+  void
+  mwrite (
+    FileMultiplexer & fm,
+    const size_t file,
+    const char * data,
+    const size_t size)
+  {
+    fm.buffers[file].append (data, size);
+    if (fm.buffers[file].size() >= fm.blockSize)
+      queueMultiplexedBuffer (fm, file);
+  }
+
+  void
+  mwrite (
+    FileMultiplexer & fm,
+    const size_t file,
+    const string & str)
+  {
+    mwrite (fm, file, str.data(), str.size());
+  }
+
+/** \brief Write all the buffers, even if they are not full.
+ */
+  void
+  flushFileMultiplexer (
+    FileMultiplexer & fm)
+  {
+    for (size_t f = 0; f < fm.paths.size(); ++f)
+      if (! fm.buffers[f].empty())
+      {
+	fm.blockFiles.push_back (f);
+	fm.blocks.push_back (string());
+	fm.blocks.back().swap (fm.buffers[f]);
+      }
+    writeMultiplexedBlocks (fm);
+  }
+
+/** \brief Flush and close all the files, the ones without data being
+ *  created empty (a valid gzip file if compressed).
+ */
+  void
+  closeFileMultiplexer (
+    FileMultiplexer & fm)
+  {
+    flushFileMultiplexer (fm);
+    string member;
+    for (size_t f = 0; f < fm.paths.size(); ++f)
+      if (! fm.created[f])
+      {
+	FILE * stream = getMultiplexedStream (fm, f);
+	if (fm.compress[f])
+	{
+	  if (member.empty())
+	    compressToGzipMember ("", 0, fm.level, member);
+	  fwrite (member.data(), 1, member.size(), stream);
+	}
+      }
+    for (size_t i = 0; i < fm.openFiles.size(); ++i)
+      closeMultiplexedFile (fm, fm.openFiles[i]);
+    fm.openFiles.clear();
+  }
+
+/** \brief Append the content of a file to an open file descriptor, and
+ *  return the number of bytes copied.
+ *  \note On Linux, the data stays in the kernel: copy_file_range is tried
+ *  first (it can even share extents on btrfs, xfs, nfs), then sendfile, and
+ *  read/write is only used as a last resort.
+ */
+  size_t
+  appendFileContent (
+    const int outFd,
+    const string & inPath)
+  {
+    int inFd = open (inPath.c_str(), O_RDONLY);
+    if (inFd < 0)
+    {
+      cerr << "ERROR: can't open file " << inPath
+	   << " (errno=" << errno << ")" << endl;
+      exit (1);
+    }
+    const size_t chunkSize = 1 << 30;
+    size_t nbBytes = 0;
+#if defined(HAS_COPY_FILE_RANGE)
+    int method = 0; // 0: copy_file_range, 1: sendfile, 2: read/write
+#elif defined(__linux__)
+    int method = 1;
+#else
+    int method = 2;
+#endif
+    vector<char> buffer;
+    while (true)
+    {
+      ssize_t n = -1;
+#ifdef HAS_COPY_FILE_RANGE
+      if (method == 0)
+      {
+	n = copy_file_range (inFd, NULL, outFd, NULL, chunkSize, 0);
+	if (n < 0 && (errno == EXDEV || errno == ENOSYS || errno == EINVAL
+		      || errno == EOPNOTSUPP || errno == EBADF))
+	{
+	  method = 1;
+	  continue;
+	}
+      }
+#endif
+#ifdef __linux__
+      if (method == 1)
+      {
+	n = sendfile (outFd, inFd, NULL, chunkSize);
+	if (n < 0 && (errno == ENOSYS || errno == EINVAL))
+	{
+	  method = 2;
+	  continue;
+	}
+      }
+#endif
+      if (method == 2)
+      {
+	if (buffer.empty())
+	  buffer.resize (1048576);
+	n = read (inFd, &buffer[0], buffer.size());
+	ssize_t written = 0;
+	while (n > 0 && written < n)
+	{
+	  ssize_t w = write (outFd, &buffer[written], n - written);
+	  if (w >= 0)
+	    written += w;
+	  else if (errno != EINTR)
+	  {
+	    n = -1;
+	    break;
+	  }
+	}
+      }
+      if (n < 0 && errno == EINTR)
+	continue;
+      if (n < 0)
+      {
+	cerr << "ERROR: can't copy file " << inPath
+	     << " (errno=" << errno << ")" << endl;
+	exit (1);
+      }
+      if (n == 0)
+	break;
+      nbBytes += n;
+    }
+    close (inFd);
+    return nbBytes;
+  }
+
+/** \brief Decompress a gzip file member after member, so that zlib checks
+ *  the CRC-32 and the length of each one, and return the number of members.
+ */
+  size_t
+  checkGzipMembers (
+    const string & path)
+  {
+    FILE * stream = fopen (path.c_str(), "rb");
+    if (stream == NULL)
+    {
+      cerr << "ERROR: can't open file " << path
+	   << " (errno=" << errno << ")" << endl;
+      exit (1);
+    }
+    z_stream zs;
+    memset (&zs, 0, sizeof(zs));
+    if (inflateInit2 (&zs, 15 + 16) != Z_OK)
+    {
+      cerr << "ERROR: can't initialize zlib" << endl;
+      exit (1);
+    }
+    vector<unsigned char> in (1048576), out (262144);
+    size_t nbMembers = 0;
+    bool inMember = false;
+    string error;
+    while (error.empty())
+    {
+      if (zs.avail_in == 0)
+      {
+	zs.avail_in = fread (&in[0], 1, in.size(), stream);
+	zs.next_in = &in[0];
+	if (zs.avail_in == 0)
+	{
+	  if (ferror (stream))
+	    error = "can't read file";
+	  else if (inMember)
+	    error = "unexpected end of file";
+	  else if (nbMembers == 0)
+	    error = "not in the gzip format";
+	  break;
+	}
+      }
+      inMember = true;
+      zs.next_out = &out[0];
+      zs.avail_out = out.size();
+      int ret = inflate (&zs, Z_NO_FLUSH);
+      if (ret == Z_STREAM_END)
+      {
+	++nbMembers;
+	inMember = false;
+	inflateReset (&zs);
+      }
+      else if (ret != Z_OK && ret != Z_BUF_ERROR)
+	error = (zs.msg != NULL ? zs.msg : "corrupted data");
+    }
+    inflateEnd (&zs);
+    fclose (stream);
+    if (! error.empty())
+    {
+      cerr << "ERROR: " << error << " in member " << nbMembers + 1
+	   << " of file " << path << endl;
+      exit (1);
+    }
+    return nbMembers;
+  }
+
+/** \brief Open a (gzipped) fastq file, "-" meaning stdin, to be read by
+ *  batches of records.
+ *  \note A batch holds at most the records fitting in a block, the buffer
+ *  growing only if a single record is longer than it.
+ */
+  void
+  openFastqReader (
+    FastqReader & fr,
+    const string & path,
+    const size_t blockSize)
+  {
+    openBlockReader (fr.br, path, blockSize);
+    fr.nbRecords = 0;
+    fr.recordLines.clear();
+  }
+
+/** \brief Move the unparsed end of the buffer at its front, then fill it
+ *  until it is full or the file ends.
+ */
+  static void
+  fillBlockReader (
+    BlockReader & br)
+  {
+    size_t nbLeft = br.end - br.begin;
+    if (nbLeft > 0 && br.begin > 0)
+      memmove (&br.buffer[0], &br.buffer[br.begin], nbLeft);
+    br.begin = 0;
+    br.end = nbLeft;
+    while (! br.eof && br.end < br.buffer.size())
+    {
+      int nbRead = gzread (br.stream, &br.buffer[br.end],
+			   br.buffer.size() - br.end);
+      if (nbRead < 0)
+      {
+	int errnum;
+	cerr << "ERROR: can't read file " << br.path << " after line "
+	     << br.nbLines << " (" << gzerror (br.stream, &errnum) << ")"
+	     << endl;
+	exit (1);
+      }
+      br.end += nbRead;
+      if (nbRead == 0)
+	br.eof = true;
+    }
+  }
+
+/** \brief Return the next batch of at most maxNbLines lines, as views on
+ *  the buffer valid until the next read, and 0 at the end of the file.
+ *  \note Unlike getline, the lines of a batch are all valid at once, eg.
+ *  to be processed in parallel.
+ */
+  size_t
+  readLineBatch (
+    BlockReader & br,
+    const size_t maxNbLines,
+    vector<StringView> & lines)
+  {
+    lines.clear();
+    if (maxNbLines == 0)
+      return 0;
+    while (true)
+    {
+      fillBlockReader (br);
+      char * buf = &br.buffer[0];
+      while (lines.size() < maxNbLines && br.begin < br.end)
+      {
+	char * newline = (char *) memchr (buf + br.begin, '\n',
+					  br.end - br.begin);
+	if (newline == NULL && ! br.eof)
+	  break;
+	char * last = (newline != NULL) ? newline : buf + br.end;
+	StringView line;
+	line.data = buf + br.begin;
+	line.size = last - line.data;
+	if (line.size > 0 && line.data[line.size-1] == '\r')
+	  --line.size;
+	lines.push_back (line);
+	br.begin = (last - buf) + (newline != NULL ? 1 : 0);
+	++br.nbLines;
+      }
+      if (! lines.empty() || br.eof)
+	return lines.size();
+      // a line longer than the buffer
+      br.buffer.resize (2 * br.buffer.size());
+    }
+  }
+
+/** \brief Parse the complete records of the buffer, at most maxNbRecords,
+ *  and check that each has an id, a '+' line and a quality per nucleotide.
+ */
+  static void
+  parseFastqRecords (
+    FastqReader & fr,
+    const size_t maxNbRecords,
+    vector<FastqRecord> & records)
+  {
+    BlockReader & br = fr.br;
+    char * buf = &br.buffer[0];
+    StringView lines[4];
+    while (records.size() < maxNbRecords)
+    {
+      // skip empty lines between records
+      size_t pos = br.begin, nbLines = br.nbLines;
+      while (pos < br.end && (buf[pos] == '\n' || buf[pos] == '\r'))
+      {
+	if (buf[pos] == '\n')
+	  ++nbLines;
+	++pos;
+      }
+      if (pos == br.end && (br.eof || pos > br.begin))
+      {
+	br.begin = pos;
+	br.nbLines = nbLines;
+	if (br.eof)
+	  return;
+	continue;
+      }
+
+      size_t next = pos;
+      int l = 0;
+      for (; l < 4; ++l)
+      {
+	char * newline = (char *) memchr (buf + next, '\n', br.end - next);
+	if (newline == NULL && (! br.eof || l < 3 || next == br.end))
+	  break;
+	char * last = (newline != NULL) ? newline : buf + br.end;
+	lines[l].data = buf + next;
+	lines[l].size = last - (buf + next);
+	if (lines[l].size > 0 && lines[l].data[lines[l].size-1] == '\r')
+	  --lines[l].size;
+	next = (last - buf) + (newline != NULL ? 1 : 0);
+      }
+      if (l < 4)
+      {
+	if (! br.eof)
+	  return; // incomplete record, to be parsed after the next fill
+	cerr << "ERROR: file " << br.path << " ends with a truncated record"
+	     << endl;
+	exit (1);
+      }
+
+      if (lines[0].size == 0 || lines[0].data[0] != '@')
+      {
+	cerr << "ERROR: line " << nbLines + 1 << " of file " << br.path
+	     << " should start with '@'" << endl;
+	exit (1);
+      }
+      if (lines[2].size == 0 || lines[2].data[0] != '+')
+      {
+	cerr << "ERROR: line " << nbLines + 3 << " of file " << br.path
+	     << " should start with '+'" << endl;
+	exit (1);
+      }
+      if (lines[3].size != lines[1].size)
+      {
+	cerr << "ERROR: line " << nbLines + 4 << " of file " << br.path
+	     << " should have a quality per nucleotide" << endl;
+	exit (1);
+      }
+      FastqRecord rec;
+      rec.id.data = lines[0].data + 1;
+      rec.id.size = lines[0].size - 1;
+      rec.seq = lines[1];
+      rec.qual = lines[3];
+      records.push_back (rec);
+      fr.recordLines.push_back (nbLines);
+      br.begin = next;
+      br.nbLines = nbLines + 4;
+      ++fr.nbRecords;
+    }
+  }
+
+/** \brief Return the next batch of at most maxNbRecords records, as views
+ *  on the buffer valid until the next read, and 0 at the end of the file.
+ */
+  size_t
+  readFastqBatch (
+    FastqReader & fr,
+    const size_t maxNbRecords,
+    vector<FastqRecord> & records)
+  {
+    records.clear();
+    fr.recordLines.clear();
+    if (maxNbRecords == 0)
+      return 0;
+    while (true)
+    {
+      fillBlockReader (fr.br);
+      parseFastqRecords (fr, maxNbRecords, records);
+      if (! records.empty() || fr.br.eof)
+	return records.size();
+      // a record longer than the buffer
+      fr.br.buffer.resize (2 * fr.br.buffer.size());
+    }
+  }
+
+/** \brief Give back the records of the batch from the n-th one, so that
+ *  they are returned again by the next read.
+ */
+  static void
+  unreadFastqRecords (
+    FastqReader & fr,
+    const size_t n,
+    vector<FastqRecord> & records)
+  {
+    if (n >= records.size())
+      return;
+    fr.br.begin = (records[n].id.data - 1) - &fr.br.buffer[0];
+    fr.br.nbLines = fr.recordLines[n];
+    fr.nbRecords -= records.size() - n;
+    records.resize (n);
+    fr.recordLines.resize (n);
+  }
+
+/** \brief Return the next batch of read pairs, the records of both files
+ *  being in lockstep and having the same id up to the first space.
+ */
+  size_t
+  readFastqBatch (
+    FastqReader & fr1,
+    FastqReader & fr2,
+    const size_t maxNbRecords,
+    vector<FastqRecord> & records1,
+    vector<FastqRecord> & records2)
+  {
+    size_t n1 = readFastqBatch (fr1, maxNbRecords, records1),
+      n2 = readFastqBatch (fr2, (n1 > 0 ? n1 : 1), records2);
+    if ((n1 == 0) != (n2 == 0))
+    {
+      cerr << "ERROR: files " << fr1.br.path << " and " << fr2.br.path
+	   << " don't have the same number of reads" << endl;
+      exit (1);
+    }
+    if (n2 < n1)
+      unreadFastqRecords (fr1, n2, records1);
+    for (size_t r = 0; r < records1.size(); ++r)
+      if (! arePaired (records1[r].id, records2[r].id))
+      {
+	cerr << "ERROR: for pair " << fr1.nbRecords - records1.size() + r
+	     << ", reads " << toString (records1[r].id) << " and "
+	     << toString (records2[r].id) << " are not paired" << endl;
+	exit (1);
+      }
+    return records1.size();
+  }
+
+  void
+  closeFastqReader (
+    FastqReader & fr)
+  {
+    closeBlockReader (fr.br);
+    fr.recordLines.clear();
+  }
+
+/** \brief Return true if the ids of two reads are identical up to the
+ *  first space.
+ */
+  bool
+  arePaired (
+    const StringView & id1,
+    const StringView & id2)
+  {
+    const char * end1 = (const char *) memchr (id1.data, ' ', id1.size);
+    const char * end2 = (const char *) memchr (id2.data, ' ', id2.size);
+    size_t size1 = (end1 == NULL) ? id1.size : end1 - id1.data;
+    size_t size2 = (end2 == NULL) ? id2.size : end2 - id2.data;
+    return size1 == size2 && memcmp (id1.data, id2.data, size1) == 0;
+  }
+
+/** \brief Append a record, its sequence and quality being restricted to
+ *  [start,end[, with an empty '+' line.
+ */
+  void
+  appendFastqRecord (
+    string & out,
+    const FastqRecord & rec,
+    const size_t start,
+    const size_t end)
+  {
+    size_t last = min (end, rec.seq.size), first = min (start, last);
+    out += '@';
+    out.append (rec.id.data, rec.id.size);
+    out += '\n';
+    out.append (rec.seq.data + first, last - first);
+    out += "\n+\n";
+    out.append (rec.qual.data + first, last - first);
+    out += '\n';
+  }
+
+/** \brief Write a record as appendFastqRecord, compressed with the others
+ *  by the block writer.
+ */
+  void
+  writeFastqRecord (
+    BlockWriter & bw,
+    const FastqRecord & rec,
+    const size_t start,
+    const size_t end)
+  {
+    size_t last = min (end, rec.seq.size), first = min (start, last);
+    bwrite (bw, "@", 1);
+    bwrite (bw, rec.id.data, rec.id.size);
+    bwrite (bw, "\n", 1);
+    bwrite (bw, rec.seq.data + first, last - first);
+    bwrite (bw, "\n+\n", 3);
+    bwrite (bw, rec.qual.data + first, last - first);
+    bwrite (bw, "\n", 1);
+  }
+
+/** \brief Write a record as appendFastqRecord in the buffer of a file of
+ *  the multiplexer.
+ */
+  void
+  writeFastqRecord (
+    FileMultiplexer & fm,
+    const size_t file,
+    const FastqRecord & rec,
+    const size_t start,
+    const size_t end)
+  {
+    appendFastqRecord (fm.buffers[file], rec, start, end);
+    if (fm.buffers[file].size() >= fm.blockSize)
+      queueMultiplexedBuffer (fm, file);
+  }
+
+  // adapters searched by FastQC, as 12-mers
+  static const char * fastqcAdapters[][2] = {
+    {"Illumina Universal Adapter", "AGATCGGAAGAG"},
+    {"Illumina Small RNA 3' Adapter", "TGGAATTCTCGG"},
+    {"Illumina Small RNA 5' Adapter", "GATCGTCGGACT"},
+    {"Nextera Transposase Sequence", "CTGTCTCTTATA"},
+    {"SOLID Small RNA Adapter", "CGCCTTGGCCGT"},
+    {NULL, NULL}
+  };
+
+/** \brief Initialize the statistics with the adapters of FastQC, which can
+ *  be replaced before adding records.
+ */
+  void
+  initFastqStats (
+    FastqStats & st)
+  {
+    st.nbReads = 0;
+    st.nbBases = 0;
+    st.nbGC = 0;
+    st.minLength = 0;
+    st.maxLength = 0;
+    st.lengthCounts.assign (1, 0);
+    st.qualCounts.clear();
+    st.meanQualCounts.assign (128, 0);
+    st.baseCounts.clear();
+    st.adpNames.clear();
+    st.adpSeqs.clear();
+    for (size_t a = 0; fastqcAdapters[a][0] != NULL; ++a)
+    {
+      st.adpNames.push_back (fastqcAdapters[a][0]);
+      st.adpSeqs.push_back (fastqcAdapters[a][1]);
+    }
+    st.adpCounts.clear();
+  }
+
+  static void
+  resizeFastqStats (
+    FastqStats & st,
+    const size_t maxLength)
+  {
+    st.maxLength = maxLength;
+    st.lengthCounts.resize (maxLength + 1, 0);
+    st.qualCounts.resize (128 * maxLength, 0);
+    st.baseCounts.resize (5 * maxLength, 0);
+    st.adpCounts.resize (st.adpSeqs.size() * maxLength, 0);
+  }
+
+  static inline size_t
+  getBaseIndex (
+    const char nt)
+  {
+    switch (nt)
+    {
+    case 'G': case 'g': return 0;
+    case 'A': case 'a': return 1;
+    case 'T': case 't': return 2;
+    case 'C': case 'c': return 3;
+    default: return 4;
+    }
+  }
+
+/** \brief Add a record, its sequence and quality being restricted to
+ *  [start,end[ as in appendFastqRecord.
+ */
+  void
+  addToFastqStats (
+    FastqStats & st,
+    const FastqRecord & rec,
+    const size_t start,
+    const size_t end)
+  {
+    size_t last = min (end, rec.seq.size), first = min (start, last),
+      len = last - first;
+    const char * seq = rec.seq.data + first, * qual = rec.qual.data + first;
+    if (len > st.maxLength)
+      resizeFastqStats (st, len);
+    if (st.nbReads == 0 || len < st.minLength)
+      st.minLength = len;
+    ++st.nbReads;
+    st.nbBases += len;
+    ++st.lengthCounts[len];
+
+    size_t sumQual = 0, nbGC = 0;
+    for (size_t i = 0; i < len; ++i)
+    {
+      size_t q = (unsigned char) qual[i] & 127, b = getBaseIndex (seq[i]);
+      ++st.qualCounts[128*i + q];
+      sumQual += q;
+      ++st.baseCounts[5*i + b];
+      if (b == 0 || b == 3)
+	++nbGC;
+    }
+    st.nbGC += nbGC;
+    if (len > 0)
+      ++st.meanQualCounts[sumQual / len];
+
+    size_t nbAdps = st.adpSeqs.size();
+    for (size_t a = 0; a < nbAdps; ++a)
+    {
+      const string & adp = st.adpSeqs[a];
+      for (size_t i = 0; i + adp.size() <= len; ++i)
+	if (seq[i] == adp[0] && memcmp (seq + i, adp.data(), adp.size()) == 0)
+	{
+	  ++st.adpCounts[nbAdps*i + a];
+	  break;
+	}
+    }
+  }
+
+/** \brief Add the statistics of other records, eg. of another thread.
+ */
+  void
+  mergeFastqStats (
+    FastqStats & st,
+    const FastqStats & other)
+  {
+    if (other.nbReads == 0)
+      return;
+    if (other.maxLength > st.maxLength)
+      resizeFastqStats (st, other.maxLength);
+    if (st.nbReads == 0 || other.minLength < st.minLength)
+      st.minLength = other.minLength;
+    st.nbReads += other.nbReads;
+    st.nbBases += other.nbBases;
+    st.nbGC += other.nbGC;
+    for (size_t i = 0; i < other.lengthCounts.size(); ++i)
+      st.lengthCounts[i] += other.lengthCounts[i];
+    for (size_t i = 0; i < other.qualCounts.size(); ++i)
+      st.qualCounts[i] += other.qualCounts[i];
+    for (size_t i = 0; i < other.meanQualCounts.size(); ++i)
+      st.meanQualCounts[i] += other.meanQualCounts[i];
+    for (size_t i = 0; i < other.baseCounts.size(); ++i)
+      st.baseCounts[i] += other.baseCounts[i];
+    for (size_t i = 0; i < other.adpCounts.size(); ++i)
+      st.adpCounts[i] += other.adpCounts[i];
+  }
+
+/** \brief Return the quality such that at least perc% of the counts are
+ *  lower or equal, as FastQC.
+ */
+  static int
+  getQualityPercentile (
+    const size_t * counts,
+    const double perc)
+  {
+    size_t total = 0, cumul = 0;
+    for (size_t q = 0; q < 128; ++q)
+      total += counts[q];
+    for (size_t q = 0; q < 128; ++q)
+    {
+      cumul += counts[q];
+      if (cumul > 0 && cumul >= total * perc / 100)
+	return q;
+    }
+    return 0;
+  }
+
+/** \brief Write the statistics in the format of fastqc_data.txt, so that
+ *  they can be loaded with read.fastqc.txt() from utils_fastqc.R.
+ *  \note The modules have no pass/warn/fail flag.
+ */
+  void
+  writeFastqStats (
+    const FastqStats & st,
+    const string & path,
+    const string & inFile)
+  {
+    // Phred+64 only if no quality is below '@', as FastQC
+    size_t lowest = 128;
+    for (size_t i = 0; i < st.qualCounts.size(); ++i)
+      if (st.qualCounts[i] > 0 && i % 128 < lowest)
+	lowest = i % 128;
+    size_t offset = (lowest < 64 ? 33 : 64);
+
+    ostringstream oss;
+    oss << "##FastQC\tutils_io" << endl
+	<< ">>Basic Statistics" << endl
+	<< "#Measure\tValue" << endl
+	<< "Filename\t" << inFile << endl
+	<< "File type\tConventional base calls" << endl
+	<< "Encoding\t" << (offset == 33 ? "Sanger / Illumina 1.9"
+			    : "Illumina 1.5") << endl
+	<< "Total Sequences\t" << st.nbReads << endl
+	<< "Sequences flagged as poor quality\t0" << endl
+	<< "Sequence length\t" << st.minLength;
+    if (st.maxLength > st.minLength)
+      oss << "-" << st.maxLength;
+    oss << endl
+	<< "%GC\t" << (st.nbBases == 0 ? 0 :
+		       (size_t) (100.0 * st.nbGC / st.nbBases)) << endl
+	<< ">>END_MODULE" << endl;
+
+    oss << ">>Per base sequence quality" << endl
+	<< "#Base\tMean\tMedian\tLower Quartile\tUpper Quartile"
+	<< "\t10th Percentile\t90th Percentile" << endl;
+    for (size_t i = 0; i < st.maxLength; ++i)
+    {
+      const size_t * counts = &st.qualCounts[128*i];
+      double sum = 0, total = 0;
+      for (size_t q = 0; q < 128; ++q)
+      {
+	sum += (double) counts[q] * q;
+	total += counts[q];
+      }
+      oss << i+1 << "\t" << sum / total - offset
+	  << "\t" << getQualityPercentile (counts, 50) - (int) offset
+	  << "\t" << getQualityPercentile (counts, 25) - (int) offset
+	  << "\t" << getQualityPercentile (counts, 75) - (int) offset
+	  << "\t" << getQualityPercentile (counts, 10) - (int) offset
+	  << "\t" << getQualityPercentile (counts, 90) - (int) offset << endl;
+    }
+    oss << ">>END_MODULE" << endl;
+
+    oss << ">>Per sequence quality scores" << endl
+	<< "#Quality\tCount" << endl;
+    for (size_t q = offset; q < 128; ++q)
+      if (st.meanQualCounts[q] > 0)
+	oss << q - offset << "\t" << st.meanQualCounts[q] << endl;
+    oss << ">>END_MODULE" << endl;
+
+    oss << ">>Per base sequence content" << endl
+	<< "#Base\tG\tA\tT\tC" << endl;
+    for (size_t i = 0; i < st.maxLength; ++i)
+    {
+      const size_t * counts = &st.baseCounts[5*i];
+      double total = counts[0] + counts[1] + counts[2] + counts[3];
+      oss << i+1;
+      for (size_t b = 0; b < 4; ++b)
+	oss << "\t" << (total == 0 ? 0 : 100 * counts[b] / total);
+      oss << endl;
+    }
+    oss << ">>END_MODULE" << endl;
+
+    oss << ">>Per base N content" << endl
+	<< "#Base\tN-Count" << endl;
+    for (size_t i = 0; i < st.maxLength; ++i)
+    {
+      const size_t * counts = &st.baseCounts[5*i];
+      double total = counts[0] + counts[1] + counts[2] + counts[3]
+	+ counts[4];
+      oss << i+1 << "\t" << (total == 0 ? 0 : 100 * counts[4] / total)
+	  << endl;
+    }
+    oss << ">>END_MODULE" << endl;
+
+    oss << ">>Sequence Length Distribution" << endl
+	<< "#Length\tCount" << endl;
+    for (size_t l = st.minLength; l <= st.maxLength; ++l)
+      oss << l << "\t" << st.lengthCounts[l] << endl;
+    oss << ">>END_MODULE" << endl;
+
+    // percentage of reads with the adapter at this position or before
+    size_t nbAdps = st.adpSeqs.size();
+    vector<size_t> cumuls (nbAdps, 0);
+    oss << ">>Adapter Content" << endl
+	<< "#Position";
+    for (size_t a = 0; a < nbAdps; ++a)
+      oss << "\t" << st.adpNames[a];
+    oss << endl;
+    for (size_t i = 0; i < st.maxLength; ++i)
+    {
+      oss << i+1;
+      for (size_t a = 0; a < nbAdps; ++a)
+      {
+	cumuls[a] += st.adpCounts[nbAdps*i + a];
+	oss << "\t" << 100.0 * cumuls[a] / st.nbReads;
+      }
+      oss << endl;
+    }
+    oss << ">>END_MODULE" << endl;
+
+    BlockWriter bw;
+    openBlockWriter (bw, path);
+    bwrite (bw, oss.str());
+    closeBlockWriter (bw);
+  }
+
 } // namespace utils
@@ -129,6 +129,222 @@ namespace utils {
 
   std::string getCmdLine (int argc, char ** argv);
 
+/** \brief Read-only view on characters owned by someone else, eg. a line
+ *  of a BlockReader, valid until the next read.
+ */
+  struct StringView
+  {
+    const char * data;
+    size_t size;
+  };
+
+  std::string toString (const StringView & sv);
+
+  bool operator== (const StringView & sv, const char * str);
+
+/** \brief Read a (gzipped) file by large blocks and return its lines as
+ *  views on the buffer, hence without copy nor per-character call.
+ */
+  struct BlockReader
+  {
+    std::string path;
+    gzFile stream;
+    std::vector<char> buffer;
+    size_t begin;
+    size_t end;
+    bool eof;
+    size_t nbLines;
+  };
+
+  void openBlockReader (BlockReader & br, const std::string & path,
+			const size_t blockSize = 4194304);
+
+  bool getline (BlockReader & br, StringView & line);
+
+  size_t readLineBatch (BlockReader & br, const size_t maxNbLines,
+			std::vector<StringView> & lines);
+
+  void closeBlockReader (BlockReader & br);
+
+  size_t tokenize (const StringView & line, const char * delims,
+		   std::vector<StringView> & tokens);
+
+  bool parseDouble (const StringView & token, double & x);
+
+  bool parseUnsigned (const StringView & token, size_t & x);
+
+  void loadLabeledMatrix (const std::string & path,
+			  std::vector<std::string> & rowNames,
+			  std::vector<std::string> & colNames,
+			  std::vector<double> & values);
+
+  void writeBinaryMatrix (const std::string & path,
+			  const std::vector<std::string> & rowNames,
+			  const std::vector<std::string> & colNames,
+			  const double * values);
+
+  void loadBinaryMatrix (const std::string & path,
+			 std::vector<std::string> & rowNames,
+			 std::vector<std::string> & colNames,
+			 std::vector<double> & values);
+
+  void compressToGzipMember (const char * data, const size_t size,
+			     const int level, std::string & member);
+
+/** \brief Write a file by blocks, each being compressed as an independent
+ *  gzip member (if the path ends with ".gz") so that several blocks can be
+ *  compressed in parallel. The concatenation of gzip members is a valid
+ *  gzip file for gzread, zcat, R's gzfile, etc.
+ */
+  struct BlockWriter
+  {
+    std::string path;
+    FILE * stream;
+    bool compress;
+    int level;
+    int nbThreads;
+    size_t blockSize;
+    std::string current;
+    std::vector<std::string> blocks;
+    std::vector<std::string> members;
+  };
+
+  void openBlockWriter (BlockWriter & bw, const std::string & path,
+			const int nbThreads = 1, const int level = 6,
+			const size_t blockSize = 1048576);
+
+  void bwrite (BlockWriter & bw, const char * data, const size_t size);
+
+  void bwrite (BlockWriter & bw, const std::string & str);
+
+  void flushBlockWriter (BlockWriter & bw);
+
+  void closeBlockWriter (BlockWriter & bw);
+
+/** \brief Write many (gzipped) files at once, eg. one per sample, each
+ *  having its own buffer. Full buffers are compressed in parallel as
+ *  independent gzip members, and at most maxNbOpen files are open at any
+ *  time, the least recently used one being closed, then reopened in
+ *  append mode when needed.
+ */
+  struct FileMultiplexer
+  {
+    std::vector<std::string> paths;
+    std::vector<bool> compress;
+    std::vector<bool> created;
+    std::vector<FILE *> streams;
+    std::vector<size_t> lastUses;
+    std::vector<std::string> buffers;
+    std::vector<size_t> openFiles;
+    std::vector<size_t> blockFiles; // full blocks waiting to be written
+    std::vector<std::string> blocks;
+    std::vector<std::string> members;
+    size_t nbUses;
+    size_t maxNbOpen;
+    int nbThreads;
+    int level;
+    size_t blockSize;
+  };
+
+  void openFileMultiplexer (FileMultiplexer & fm, const int nbThreads = 1,
+			    const int level = 6, const size_t maxNbOpen = 256,
+			    const size_t blockSize = 131072);
+
+  size_t addFile (FileMultiplexer & fm, const std::string & path);
+
+  void mwrite (FileMultiplexer & fm, const size_t file, const char * data,
+	       const size_t size);
+
+  void mwrite (FileMultiplexer & fm, const size_t file,
+	       const std::string & str);
+
+  void flushFileMultiplexer (FileMultiplexer & fm);
+
+  void closeFileMultiplexer (FileMultiplexer & fm);
+
+  size_t appendFileContent (const int outFd, const std::string & inPath);
+
+  size_t checkGzipMembers (const std::string & path);
+
+/** \brief One record of a fastq file, its id being without '@', as views
+ *  on the buffer of a FastqReader.
+ */
+  struct FastqRecord
+  {
+    StringView id;
+    StringView seq;
+    StringView qual;
+  };
+
+/** \brief Read a (gzipped) fastq file by large blocks and parse them into
+ *  batches of validated records, without copy.
+ */
+  struct FastqReader
+  {
+    BlockReader br;
+    size_t nbRecords;
+    std::vector<size_t> recordLines; // line before each record of the batch
+  };
+
+  void openFastqReader (FastqReader & fr, const std::string & path,
+			const size_t blockSize = 16777216);
+
+  size_t readFastqBatch (FastqReader & fr, const size_t maxNbRecords,
+			 std::vector<FastqRecord> & records);
+
+  size_t readFastqBatch (FastqReader & fr1, FastqReader & fr2,
+			 const size_t maxNbRecords,
+			 std::vector<FastqRecord> & records1,
+			 std::vector<FastqRecord> & records2);
+
+  void closeFastqReader (FastqReader & fr);
+
+  bool arePaired (const StringView & id1, const StringView & id2);
+
+  void appendFastqRecord (std::string & out, const FastqRecord & rec,
+			  const size_t start = 0,
+			  const size_t end = std::string::npos);
+
+  void writeFastqRecord (BlockWriter & bw, const FastqRecord & rec,
+			 const size_t start = 0,
+			 const size_t end = std::string::npos);
+
+  void writeFastqRecord (FileMultiplexer & fm, const size_t file,
+			 const FastqRecord & rec, const size_t start = 0,
+			 const size_t end = std::string::npos);
+
+/** \brief Quality control statistics of fastq records, as the modules of
+ *  FastQC, accumulated in one pass and mergeable across threads.
+ *  \note Qualities are counted as characters, the encoding being guessed
+ *  from the lowest one when writing.
+ */
+  struct FastqStats
+  {
+    size_t nbReads;
+    size_t nbBases;
+    size_t nbGC;
+    size_t minLength;
+    size_t maxLength;
+    std::vector<size_t> lengthCounts;
+    std::vector<size_t> qualCounts; // 128 characters per position
+    std::vector<size_t> meanQualCounts;
+    std::vector<size_t> baseCounts; // G, A, T, C and N per position
+    std::vector<std::string> adpNames;
+    std::vector<std::string> adpSeqs;
+    std::vector<size_t> adpCounts; // first occurrences per position
+  };
+
+  void initFastqStats (FastqStats & st);
+
+  void addToFastqStats (FastqStats & st, const FastqRecord & rec,
+			const size_t start = 0,
+			const size_t end = std::string::npos);
+
+  void mergeFastqStats (FastqStats & st, const FastqStats & other);
+
+  void writeFastqStats (const FastqStats & st, const std::string & path,
+			const std::string & inFile);
+
   /** \brief Fill a vector with the keys of a map
    *  \note http://stackoverflow.com/a/771463/597069
    *  \note http://stackoverflow.com/a/10632266/597069
@@ -19,6 +19,7 @@
 
 #include <cmath>
 #include <sys/time.h>
+#include <unistd.h>
 
 #include <gsl/gsl_sort.h>
 #include <gsl/gsl_sort_vector.h>
@@ -28,10 +29,28 @@
 #include <gsl/gsl_blas.h>
 #include <gsl/gsl_linalg.h>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #include "utils/utils_math.hpp"
 
 using namespace std;
 
+// thread control of the optimized BLAS libraries, declared here rather than
+// by including their own cblas.h which clashes with gsl_cblas.h
+#if defined(UTILS_BLAS_OPENBLAS)
+extern "C" {
+  void openblas_set_num_threads(int num_threads);
+  int openblas_get_num_threads(void);
+}
+#elif defined(UTILS_BLAS_BLIS)
+extern "C" {
+  void bli_thread_set_num_threads(int64_t n_threads);
+  int64_t bli_thread_get_num_threads(void);
+}
+#endif
+
 namespace utils {
 
   bool isNonZero(size_t i) { return (i != 0); };
@@ -41,14 +60,151 @@ namespace utils {
 // http://www.johndcook.com/IEEE_exceptions_in_cpp.html
   bool isNan(double i) { return (! (i == i)); };
 
-/** \brief Return a seed based on microseconds since epoch.
- *  \note http://www.guyrutenberg.com/2007/09/03/seeding-srand/
+/** \brief Return a seed based on microseconds since epoch and process id.
+ *  \note The fields are combined and mixed with the finalizer of SplitMix64
+ *  to avoid the collisions of their product (eg. when tv_usec is 0).
+ *  \note Use it only as a default, and print it: reproducible runs need the
+ *  seed to be given by the user, see rngStreamInit for parallel streams.
  */
   size_t getSeed(void)
   {
     timeval t1;
     gettimeofday (&t1, NULL);
-    return ((size_t) t1.tv_usec * t1.tv_sec);
+    uint64_t z = ((uint64_t) t1.tv_sec * 1000000 + t1.tv_usec)
+      ^ ((uint64_t) getpid() << 40);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return (size_t) (z ^ (z >> 31));
+  }
+
+  static inline uint32_t mulhilo32(const uint32_t a, const uint32_t b,
+				   uint32_t & hi)
+  {
+    uint64_t p = (uint64_t) a * b;
+    hi = (uint32_t) (p >> 32);
+    return (uint32_t) p;
+  }
+
+/** \brief Apply the 10 rounds of Philox4x32 to a counter with a key.
+ */
+  static void philox4x32_10(const uint32_t in[4], const uint32_t k[2],
+			    uint32_t out[4])
+  {
+    uint32_t c0 = in[0], c1 = in[1], c2 = in[2], c3 = in[3],
+      k0 = k[0], k1 = k[1], hi0, hi1, lo0, lo1;
+    for(int r = 0; r < 10; ++r){
+      if(r > 0){
+	k0 += 0x9E3779B9;
+	k1 += 0xBB67AE85;
+      }
+      lo0 = mulhilo32(0xD2511F53, c0, hi0);
+      lo1 = mulhilo32(0xCD9E8D57, c2, hi1);
+      c0 = hi1 ^ c1 ^ k0;
+      c1 = lo1;
+      c2 = hi0 ^ c3 ^ k1;
+      c3 = lo0;
+    }
+    out[0] = c0; out[1] = c1; out[2] = c2; out[3] = c3;
+  }
+
+/** \brief Initialize the substream of a seed, eg. one per thread or, to get
+ *  the same results whatever the number of threads, one per task (gene,
+ *  permutation, simulation replicate...).
+ */
+  void rngStreamInit(RngStream & rng, const size_t seed,
+		     const size_t substream)
+  {
+    uint64_t s = (uint64_t) seed, id = (uint64_t) substream;
+    rng.key[0] = (uint32_t) s;
+    rng.key[1] = (uint32_t) (s >> 32);
+    rng.counter[0] = 0;
+    rng.counter[1] = 0;
+    rng.counter[2] = (uint32_t) id;
+    rng.counter[3] = (uint32_t) (id >> 32);
+    rng.nbUnused = 0;
+  }
+
+  static inline void rngStreamRefill(RngStream & rng)
+  {
+    philox4x32_10(rng.counter, rng.key, rng.block);
+    if(++rng.counter[0] == 0)
+      ++rng.counter[1];
+    rng.nbUnused = 4;
+  }
+
+/** \brief Return the next 32 random bits of the substream.
+ */
+  uint32_t rngStreamNext(RngStream & rng)
+  {
+    if(rng.nbUnused == 0)
+      rngStreamRefill(rng);
+    return rng.block[4 - rng.nbUnused--];
+  }
+
+  static inline double twoWordsToUniform(const uint32_t a, const uint32_t b)
+  {
+    // 53 random bits, in [0,1)
+    return ((a >> 5) * 67108864.0 + (b >> 6)) * (1.0 / 9007199254740992.0);
+  }
+
+/** \brief Return a uniform deviate in [0,1) with 53 random bits.
+ */
+  double rngStreamUniform(RngStream & rng)
+  {
+    uint32_t a = rngStreamNext(rng);
+    return twoWordsToUniform(a, rngStreamNext(rng));
+  }
+
+/** \brief Fill out with n uniform deviates in [0,1).
+ *  \note Faster than calling rngStreamUniform n times as whole blocks are
+ *  generated and converted in a tight loop.
+ */
+  void rngStreamUniformBatch(RngStream & rng, double * out, const size_t n)
+  {
+    size_t i = 0;
+    while(i < n && rng.nbUnused >= 2)
+      out[i++] = rngStreamUniform(rng);
+    rng.nbUnused = 0; // an odd word left is discarded
+    uint32_t b[4];
+    for(; i + 2 <= n; i += 2){
+      philox4x32_10(rng.counter, rng.key, b);
+      if(++rng.counter[0] == 0)
+	++rng.counter[1];
+      out[i] = twoWordsToUniform(b[0], b[1]);
+      out[i+1] = twoWordsToUniform(b[2], b[3]);
+    }
+    if(i < n)
+      out[i] = rngStreamUniform(rng);
+  }
+
+/** \brief Fill out with n standard normal deviates (Box-Muller).
+ */
+  void rngStreamNormalBatch(RngStream & rng, double * out, const size_t n)
+  {
+    rngStreamUniformBatch(rng, out, n);
+    double u1, u2, radius;
+    for(size_t i = 0; i + 1 < n; i += 2){
+      u1 = 1.0 - out[i]; // in (0,1]
+      u2 = out[i+1];
+      radius = sqrt(-2.0 * log(u1));
+      out[i] = radius * cos(2 * M_PI * u2);
+      out[i+1] = radius * sin(2 * M_PI * u2);
+    }
+    if(n % 2 == 1){
+      u1 = 1.0 - out[n-1];
+      out[n-1] = sqrt(-2.0 * log(u1)) * cos(2 * M_PI * rngStreamUniform(rng));
+    }
+  }
+
+/** \brief Shuffle idx in place (Fisher-Yates).
+ */
+  void rngStreamShuffle(RngStream & rng, size_t * idx, const size_t n)
+  {
+    for(size_t i = n; i > 1; --i){
+      size_t j = (size_t) (rngStreamUniform(rng) * i), tmp = idx[i-1];
+      idx[i-1] = idx[j];
+      idx[j] = tmp;
+    }
   }
 
   size_t sum_bool(const vector<bool> & vec)
@@ -139,14 +295,16 @@ namespace utils {
  *  of the errors and the std error of the estimated effect size in the 
  *  multiple linear regression Y = XB + E with E~MVN(0,sigma^2I)
  *  \note genotype supposed to be 2nd column of X
+ *  \note generic path via the SVD of X, used for any P and when X is rank
+ *  deficient
  */
-  void FitSingleGeneWithSingleSnp(const gsl_matrix * X,
-				  const gsl_vector * y,
-				  double & pve,
-				  double & sigmahat,
-				  double & betahat_geno,
-				  double & sebetahat_geno,
-				  double & betapval_geno)
+  void FitSingleGeneWithSingleSnpSvd(const gsl_matrix * X,
+				     const gsl_vector * y,
+				     double & pve,
+				     double & sigmahat,
+				     double & betahat_geno,
+				     double & sebetahat_geno,
+				     double & betapval_geno)
   {
     size_t N = X->size1, P = X->size2, rank;
     double rss;
@@ -166,25 +324,468 @@ namespace utils {
     gsl_multifit_linear_free(work);
   }
 
+/** \brief Solve the P x P normal equations A B = b by Cholesky, with P known
+ *  at compile time so that all loops are unrolled on stack arrays.
+ *  \param A upper triangle of X'X, overwritten by the Cholesky factor
+ *  \param inv11 receives the element (1,1) of (X'X)^-1
+ *  \return false if A isn't numerically positive definite, in which case
+ *  the caller should use the SVD path
+ */
+  template <size_t P>
+  static bool solveNormalEquations(double * A, const double * b,
+				   double * B, double & inv11)
+  {
+    double maxDiag = 0.0;
+    for(size_t a = 0; a < P; ++a)
+      if(A[a*P+a] > maxDiag)
+	maxDiag = A[a*P+a];
+  
+    // A = R'R with R upper triangular, stored in the upper triangle of A
+    for(size_t j = 0; j < P; ++j){
+      double d = A[j*P+j];
+      for(size_t k = 0; k < j; ++k)
+	d -= A[k*P+j] * A[k*P+j];
+      if(d <= 1e3 * GSL_DBL_EPSILON * maxDiag)
+	return false;
+      d = sqrt(d);
+      A[j*P+j] = d;
+      for(size_t i = j + 1; i < P; ++i){
+	double v = A[j*P+i];
+	for(size_t k = 0; k < j; ++k)
+	  v -= A[k*P+j] * A[k*P+i];
+	A[j*P+i] = v / d;
+      }
+    }
+  
+    // R'z = b then R B = z
+    double z[P];
+    for(size_t i = 0; i < P; ++i){
+      double v = b[i];
+      for(size_t k = 0; k < i; ++k)
+	v -= A[k*P+i] * z[k];
+      z[i] = v / A[i*P+i];
+    }
+    for(size_t ii = P; ii > 0; --ii){
+      size_t i = ii - 1;
+      double v = z[i];
+      for(size_t k = i + 1; k < P; ++k)
+	v -= A[i*P+k] * B[k];
+      B[i] = v / A[i*P+i];
+    }
+  
+    // (X'X)^-1_11 = ||R'^-1 e_1||^2
+    double w[P];
+    inv11 = 0.0;
+    for(size_t i = 0; i < P; ++i){
+      double v = (i == 1 ? 1.0 : 0.0);
+      for(size_t k = 0; k < i; ++k)
+	v -= A[k*P+i] * w[k];
+      w[i] = v / A[i*P+i];
+      inv11 += w[i] * w[i];
+    }
+  
+    return true;
+  }
+
+/** \brief Accumulate the upper triangle of X'X and X'y in a single pass
+ *  over the rows of X.
+ */
+  template <size_t P>
+  static void calcCrossProducts(const gsl_matrix * X, const gsl_vector * y,
+				double * XtX, double * Xty, double & yty)
+  {
+    for(size_t a = 0; a < P*P; ++a)
+      XtX[a] = 0.0;
+    for(size_t a = 0; a < P; ++a)
+      Xty[a] = 0.0;
+    yty = 0.0;
+    for(size_t i = 0; i < X->size1; ++i){
+      const double * x = X->data + i * X->tda;
+      const double y_i = y->data[i * y->stride];
+      for(size_t a = 0; a < P; ++a){
+	for(size_t b = a; b < P; ++b)
+	  XtX[a*P+b] += x[a] * x[b];
+	Xty[a] += x[a] * y_i;
+      }
+      yty += y_i * y_i;
+    }
+  }
+
+  template <size_t P>
+  static bool fitSmallP(const gsl_matrix * X, const gsl_vector * y,
+			double & pve, double & sigmahat, double & betahat_geno,
+			double & sebetahat_geno, double & betapval_geno)
+  {
+    double XtX[P*P], Xty[P], B[P], yty, inv11;
+    calcCrossProducts<P>(X, y, XtX, Xty, yty);
+    if(! solveNormalEquations<P>(XtX, Xty, B, inv11))
+      return false;
+  
+    // residuals computed directly rather than by y'y - B'X'y, which cancels
+    const size_t N = X->size1;
+    double rss = 0.0, e;
+    for(size_t i = 0; i < N; ++i){
+      const double * x = X->data + i * X->tda;
+      e = y->data[i * y->stride];
+      for(size_t a = 0; a < P; ++a)
+	e -= x[a] * B[a];
+      rss += e * e;
+    }
+  
+    pve = 1 - rss / gsl_stats_tss(y->data, y->stride, y->size);
+    sigmahat = sqrt(rss / (double)(N-P));
+    betahat_geno = B[1];
+    sebetahat_geno = sigmahat * sqrt(inv11);
+    betapval_geno = 2 * gsl_cdf_tdist_Q(fabs(betahat_geno / sebetahat_geno),
+					N-P);
+    return true;
+  }
+
+/** \brief Call the kernel specialized for the given P, from 2 to
+ *  UTILS_MAX_SMALL_P.
+ *  \return false if P is out of range or X is rank deficient
+ */
+  static bool dispatchFitSmallP(const gsl_matrix * X, const gsl_vector * y,
+				double & pve, double & sigmahat,
+				double & betahat_geno, double & sebetahat_geno,
+				double & betapval_geno)
+  {
+#define UTILS_FIT_SMALL_P_CASE(p)					\
+    case p: return fitSmallP<p>(X, y, pve, sigmahat, betahat_geno,	\
+				sebetahat_geno, betapval_geno);
+    switch(X->size2){
+      UTILS_FIT_SMALL_P_CASE(2) UTILS_FIT_SMALL_P_CASE(3)
+      UTILS_FIT_SMALL_P_CASE(4) UTILS_FIT_SMALL_P_CASE(5)
+      UTILS_FIT_SMALL_P_CASE(6) UTILS_FIT_SMALL_P_CASE(7)
+      UTILS_FIT_SMALL_P_CASE(8) UTILS_FIT_SMALL_P_CASE(9)
+      UTILS_FIT_SMALL_P_CASE(10) UTILS_FIT_SMALL_P_CASE(11)
+      UTILS_FIT_SMALL_P_CASE(12) UTILS_FIT_SMALL_P_CASE(13)
+      UTILS_FIT_SMALL_P_CASE(14) UTILS_FIT_SMALL_P_CASE(15)
+      UTILS_FIT_SMALL_P_CASE(16)
+    default:
+      return false;
+    }
+#undef UTILS_FIT_SMALL_P_CASE
+  }
+
+/** \brief Estimate by ML the effect size of the genotype, the std deviation 
+ *  of the errors and the std error of the estimated effect size in the 
+ *  multiple linear regression Y = XB + E with E~MVN(0,sigma^2I)
+ *  \note genotype supposed to be 2nd column of X
+ *  \note for P <= UTILS_MAX_SMALL_P, uses a kernel specialized on P which
+ *  solves the normal equations on the stack, otherwise (or if X is rank
+ *  deficient) uses FitSingleGeneWithSingleSnpSvd
+ */
+  void FitSingleGeneWithSingleSnp(const gsl_matrix * X,
+				  const gsl_vector * y,
+				  double & pve,
+				  double & sigmahat,
+				  double & betahat_geno,
+				  double & sebetahat_geno,
+				  double & betapval_geno)
+  {
+    if(X->size1 <= X->size2 ||
+       ! dispatchFitSmallP(X, y, pve, sigmahat, betahat_geno, sebetahat_geno,
+			   betapval_geno))
+      FitSingleGeneWithSingleSnpSvd(X, y, pve, sigmahat, betahat_geno,
+				    sebetahat_geno, betapval_geno);
+  }
+
+/** \brief Same as fitSmallP but for one SNP among many, the cross-products
+ *  involving only covariates and phenotype being computed once per gene.
+ *  \param CtC upper triangle of C'C (Q x Q)
+ *  \param Cty C'y (Q)
+ *  \param Ctg C'g (Q, stride ctgStride)
+ *  \note the design matrix is [c_1 g c_2 ... c_Q], ie. genotype 2nd
+ */
+  template <size_t P>
+  static bool fitSmallPFromCrossProducts(const double * CtC, const double * Cty,
+					 const double yty, const double tss,
+					 const double * Ctg,
+					 const size_t ctgStride,
+					 const double gtg, const double gty,
+					 const size_t N, double & pve,
+					 double & sigmahat,
+					 double & betahat_geno,
+					 double & sebetahat_geno,
+					 double & betapval_geno)
+  {
+    const size_t Q = P - 1;
+    double XtX[P*P], Xty[P], B[P], inv11;
+    size_t ca, cb; // index of the covariate in C for columns a and b of X
+    for(size_t a = 0; a < P; ++a){
+      ca = (a == 0 ? 0 : a - 1);
+      Xty[a] = (a == 1 ? gty : Cty[ca]);
+      for(size_t b = a; b < P; ++b){
+	cb = b - 1;
+	if(a == 1 && b == 1)
+	  XtX[a*P+b] = gtg;
+	else if(a == 1)
+	  XtX[a*P+b] = Ctg[cb * ctgStride];
+	else if(b == 1) // then a == 0
+	  XtX[a*P+b] = Ctg[0];
+	else
+	  XtX[a*P+b] = CtC[ca*Q + (b == 0 ? 0 : cb)];
+      }
+    }
+    if(! solveNormalEquations<P>(XtX, Xty, B, inv11))
+      return false;
+    double rss = yty;
+    for(size_t a = 0; a < P; ++a)
+      rss -= B[a] * Xty[a];
+    if(rss < 1e-8 * tss) // too much cancellation, let the caller refit
+      return false;
+  
+    pve = 1 - rss / tss;
+    sigmahat = sqrt(rss / (double)(N-P));
+    betahat_geno = B[1];
+    sebetahat_geno = sigmahat * sqrt(inv11);
+    betapval_geno = 2 * gsl_cdf_tdist_Q(fabs(betahat_geno / sebetahat_geno),
+					N-P);
+    return true;
+  }
+
+/** \brief Fit y = [c_1 g_s c_2 ... c_Q] B + E for each SNP s in G, as
+ *  FitSingleGeneWithSingleSnp would do one SNP at a time.
+ *  \param C covariates, 1st column being the intercept (N x Q)
+ *  \param G genotypes (N x S)
+ *  \note The products C'G, G'y and the g_s'g_s are computed for all SNPs
+ *  at once with BLAS, then each SNP only needs a P x P solve, with a kernel
+ *  specialized on P = Q+1 <= UTILS_MAX_SMALL_P. SNPs are split among the
+ *  OpenMP threads.
+ */
+  void FitSingleGeneWithManySnps(const gsl_matrix * C,
+				 const gsl_vector * y,
+				 const gsl_matrix * G,
+				 gsl_vector * pve,
+				 gsl_vector * sigmahat,
+				 gsl_vector * betahat_geno,
+				 gsl_vector * sebetahat_geno,
+				 gsl_vector * betapval_geno)
+  {
+    const size_t N = G->size1, S = G->size2, Q = C->size2, P = Q + 1;
+  
+    gsl_matrix * CtC = gsl_matrix_alloc(Q, Q), * CtG = gsl_matrix_alloc(Q, S);
+    gsl_vector * Cty = gsl_vector_alloc(Q), * Gty = gsl_vector_alloc(S),
+      * gtg = gsl_vector_calloc(S);
+    gsl_blas_dgemm(CblasTrans, CblasNoTrans, 1.0, C, C, 0.0, CtC);
+    gsl_blas_dgemm(CblasTrans, CblasNoTrans, 1.0, C, G, 0.0, CtG);
+    gsl_blas_dgemv(CblasTrans, 1.0, C, y, 0.0, Cty);
+    gsl_blas_dgemv(CblasTrans, 1.0, G, y, 0.0, Gty);
+    for(size_t i = 0; i < N; ++i){
+      const double * g = G->data + i * G->tda;
+      for(size_t s = 0; s < S; ++s)
+	gtg->data[s] += g[s] * g[s];
+    }
+    double yty, tss = gsl_stats_tss(y->data, y->stride, y->size);
+    gsl_blas_ddot(y, y, &yty);
+  
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+    for(long ls = 0; ls < (long) S; ++ls){
+      size_t s = (size_t) ls;
+      double r[5];
+      bool ok = false;
+      const double * Ctg = CtG->data + s;
+#define UTILS_FIT_MANY_CASE(p)						\
+      case p: ok = fitSmallPFromCrossProducts<p>(CtC->data, Cty->data,	\
+						 yty, tss, Ctg, CtG->tda, \
+						 gtg->data[s],		\
+						 Gty->data[s], N, r[0], r[1], \
+						 r[2], r[3], r[4]);	\
+	break;
+      if(N > P){
+	switch(P){
+	  UTILS_FIT_MANY_CASE(2) UTILS_FIT_MANY_CASE(3)
+	  UTILS_FIT_MANY_CASE(4) UTILS_FIT_MANY_CASE(5)
+	  UTILS_FIT_MANY_CASE(6) UTILS_FIT_MANY_CASE(7)
+	  UTILS_FIT_MANY_CASE(8) UTILS_FIT_MANY_CASE(9)
+	  UTILS_FIT_MANY_CASE(10) UTILS_FIT_MANY_CASE(11)
+	  UTILS_FIT_MANY_CASE(12) UTILS_FIT_MANY_CASE(13)
+	  UTILS_FIT_MANY_CASE(14) UTILS_FIT_MANY_CASE(15)
+	  UTILS_FIT_MANY_CASE(16)
+	default:
+	  break;
+	}
+      }
+#undef UTILS_FIT_MANY_CASE
+      if(! ok){ // rank deficient (eg. monomorphic SNP) or large P
+	gsl_matrix * X = gsl_matrix_alloc(N, P);
+	for(size_t i = 0; i < N; ++i){
+	  gsl_matrix_set(X, i, 0, gsl_matrix_get(C, i, 0));
+	  gsl_matrix_set(X, i, 1, gsl_matrix_get(G, i, s));
+	  for(size_t q = 1; q < Q; ++q)
+	    gsl_matrix_set(X, i, q + 1, gsl_matrix_get(C, i, q));
+	}
+	FitSingleGeneWithSingleSnpSvd(X, y, r[0], r[1], r[2], r[3], r[4]);
+	gsl_matrix_free(X);
+      }
+      gsl_vector_set(pve, s, r[0]);
+      gsl_vector_set(sigmahat, s, r[1]);
+      gsl_vector_set(betahat_geno, s, r[2]);
+      gsl_vector_set(sebetahat_geno, s, r[3]);
+      gsl_vector_set(betapval_geno, s, r[4]);
+    }
+  
+    gsl_matrix_free(CtC);
+    gsl_matrix_free(CtG);
+    gsl_vector_free(Cty);
+    gsl_vector_free(Gty);
+    gsl_vector_free(gtg);
+  }
+
+/** \brief Raise the n elements of x, spaced by stride, to the given power.
+ *  \note The usual exponents avoid the call to pow(), and the loops work on
+ *  the raw data so that the compiler can vectorize them when stride is 1.
+ */
+  static void powArray(double * x, const size_t n, const size_t stride,
+		       const double exponent)
+  {
+    if(exponent == 1.0)
+      return;
+    const size_t end = n * stride;
+    if(exponent == 2.0)
+      for(size_t i = 0; i < end; i += stride)
+	x[i] = x[i] * x[i];
+    else if(exponent == -1.0)
+      for(size_t i = 0; i < end; i += stride)
+	x[i] = 1.0 / x[i];
+    else if(exponent == 0.5)
+      for(size_t i = 0; i < end; i += stride)
+	x[i] = sqrt(x[i]);
+    else if(exponent == -0.5)
+      for(size_t i = 0; i < end; i += stride)
+	x[i] = 1.0 / sqrt(x[i]);
+    else if(exponent == 0.0)
+      for(size_t i = 0; i < end; i += stride)
+	x[i] = 1.0;
+    else
+      for(size_t i = 0; i < end; i += stride)
+	x[i] = pow(x[i], exponent);
+  }
+
+  static inline double powScalar(const double x, const double exponent)
+  {
+    if(exponent == 1.0)
+      return x;
+    if(exponent == 2.0)
+      return x * x;
+    if(exponent == -1.0)
+      return 1.0 / x;
+    if(exponent == 0.5)
+      return sqrt(x);
+    return pow(x, exponent);
+  }
+
+/** \brief Return the sum of the elements of vec.
+ *  \note Four partial sums break the dependency chain between additions.
+ */
   double mygsl_vector_sum(const gsl_vector * vec)
   {
-    double res = 0.0;
-    for(size_t i = 0; i < vec->size; ++i)
-      res += gsl_vector_get(vec, i);
-    return res;
+    const double * x = vec->data;
+    const size_t n = vec->size, stride = vec->stride;
+    double s0 = 0.0, s1 = 0.0, s2 = 0.0, s3 = 0.0;
+    size_t i = 0;
+    if(stride == 1){
+      for(; i + 4 <= n; i += 4){
+	s0 += x[i];
+	s1 += x[i+1];
+	s2 += x[i+2];
+	s3 += x[i+3];
+      }
+      for(; i < n; ++i)
+	s0 += x[i];
+    }
+    else
+      for(; i < n; ++i)
+	s0 += x[i * stride];
+    return (s0 + s1) + (s2 + s3);
+  }
+
+/** \brief Return the sum of the elements of vec raised to the given power,
+ *  without modifying vec, ie. mygsl_vector_pow then mygsl_vector_sum in a
+ *  single pass.
+ */
+  double mygsl_vector_pow_sum(const gsl_vector * vec, const double exponent)
+  {
+    const double * x = vec->data;
+    const size_t n = vec->size, stride = vec->stride;
+    double s0 = 0.0, s1 = 0.0;
+    size_t i = 0;
+    if(stride == 1 && exponent == 2.0){
+      for(; i + 2 <= n; i += 2){
+	s0 += x[i] * x[i];
+	s1 += x[i+1] * x[i+1];
+      }
+      for(; i < n; ++i)
+	s0 += x[i] * x[i];
+    }
+    else
+      for(; i < n; ++i)
+	s0 += powScalar(x[i * stride], exponent);
+    return s0 + s1;
   }
 
   void mygsl_vector_pow(gsl_vector * vec, const double exponent)
   {
-    for(size_t i = 0; i < vec->size; ++i)
-      gsl_vector_set(vec, i, pow(gsl_vector_get(vec, i), exponent));
+    powArray(vec->data, vec->size, vec->stride, exponent);
   }
 
   void mygsl_matrix_pow(gsl_matrix * mat, const double exponent)
   {
-    for(size_t i = 0; i < mat->size1; ++i)
+    if(mat->tda == mat->size2) // no padding, a single contiguous array
+      powArray(mat->data, mat->size1 * mat->size2, 1, exponent);
+    else
+      for(size_t i = 0; i < mat->size1; ++i)
+	powArray(mat->data + i * mat->tda, mat->size2, 1, exponent);
+  }
+
+/** \brief Compute mat <- mat diag(vec)^exponent in place, ie. scale
+ *  column j of mat by vec_j^exponent, without allocating the diagonal
+ *  matrix as mygsl_matrix_diagalloc followed by gsl_blas_dgemm would.
+ */
+  void mygsl_matrix_scale_columns(gsl_matrix * mat, const gsl_vector * vec,
+				  const double exponent)
+  {
+    vector<double> scales(mat->size2);
+    for(size_t j = 0; j < mat->size2; ++j)
+      scales[j] = vec->data[j * vec->stride];
+    powArray(&scales[0], scales.size(), 1, exponent);
+    for(size_t i = 0; i < mat->size1; ++i){
+      double * row = mat->data + i * mat->tda;
       for(size_t j = 0; j < mat->size2; ++j)
-	gsl_matrix_set(mat, i, j, pow(gsl_matrix_get(mat, i, j), exponent));
+	row[j] *= scales[j];
+    }
+  }
+
+/** \brief Compute mat <- diag(vec)^exponent mat in place, ie. scale row i
+ *  of mat by vec_i^exponent.
+ */
+  void mygsl_matrix_scale_rows(gsl_matrix * mat, const gsl_vector * vec,
+			       const double exponent)
+  {
+    for(size_t i = 0; i < mat->size1; ++i){
+      double scale = powScalar(vec->data[i * vec->stride], exponent);
+      double * row = mat->data + i * mat->tda;
+      for(size_t j = 0; j < mat->size2; ++j)
+	row[j] *= scale;
+    }
+  }
+
+/** \brief Compute mat <- alpha mat + x I in place, eg. I - H from the hat
+ *  matrix H with alpha=-1 and x=1.
+ */
+  void mygsl_matrix_scale_add_diag(gsl_matrix * mat, const double alpha,
+				   const double x)
+  {
+    for(size_t i = 0; i < mat->size1; ++i){
+      double * row = mat->data + i * mat->tda;
+      for(size_t j = 0; j < mat->size2; ++j)
+	row[j] *= alpha;
+      if(i < mat->size2)
+	row[i] += x;
+    }
   }
 
 // from http://lists.gnu.org/archive/html/help-gsl/2005-09/msg00007.html
@@ -215,21 +816,47 @@ namespace utils {
     gsl_matrix_memcpy(U, A);
     gsl_linalg_SV_decomp(U, V, D_diag, work);
   
-    // V D^(-1)
-    gsl_matrix * VDinv = gsl_matrix_alloc(N, N);
-    mygsl_vector_pow(D_diag, -1.0);
-    gsl_matrix * D_inv = mygsl_matrix_diagalloc(D_diag, 0.0);
-    gsl_blas_dgemm(CblasNoTrans, CblasNoTrans, 1.0, V, D_inv, 0.0, VDinv);
+    // V D^(-1), in place
+    mygsl_matrix_scale_columns(V, D_diag, -1.0);
   
-    // A_ps = VDinv U'
-    gsl_blas_dgemm(CblasNoTrans, CblasTrans, 1.0, VDinv, U, 0.0, A_ps);
+    // A_ps = V D^(-1) U'
+    gsl_blas_dgemm(CblasNoTrans, CblasTrans, 1.0, V, U, 0.0, A_ps);
+  
+    gsl_matrix_free(U);
+    gsl_matrix_free(V);
+    gsl_vector_free(D_diag);
+    gsl_vector_free(work);
+  }
+
+/** \brief Compute A^(-1/2) for a symmetric positive semi-definite matrix,
+ *  the singular values below tol times the largest one being discarded.
+ */
+  void mygsl_linalg_invsqrt(const gsl_matrix * A, gsl_matrix * A_invsqrt,
+			    const double tol)
+  {
+    size_t N = A->size1;
+  
+    // A = U D U' as A is symmetric, V being equal to U
+    gsl_matrix * U = gsl_matrix_alloc(N, N), * V = gsl_matrix_alloc(N, N);
+    gsl_vector * D_diag = gsl_vector_alloc(N),
+      * work = gsl_vector_alloc(N);
+    gsl_matrix_memcpy(U, A);
+    gsl_linalg_SV_decomp(U, V, D_diag, work);
+    for(size_t k = 0; k < N; ++k){
+      double d = gsl_vector_get(D_diag, k);
+      gsl_vector_set(D_diag, k, (d > tol * gsl_vector_get(D_diag, 0)) ?
+		     1 / sqrt(d) : 0.0);
+    }
+  
+    // A_invsqrt = V D^(-1/2) V'
+    gsl_matrix_memcpy(U, V);
+    mygsl_matrix_scale_columns(U, D_diag, 1.0);
+    gsl_blas_dgemm(CblasNoTrans, CblasTrans, 1.0, U, V, 0.0, A_invsqrt);
   
     gsl_matrix_free(U);
     gsl_matrix_free(V);
     gsl_vector_free(D_diag);
     gsl_vector_free(work);
-    gsl_matrix_free(VDinv);
-    gsl_matrix_free(D_inv);
   }
 
   gsl_vector * mygsl_vector_alloc(const gsl_vector * src)
@@ -278,20 +905,11 @@ namespace utils {
     gsl_matrix * tmp1 = gsl_matrix_alloc(N, P); // X (X'X)^-1
     gsl_blas_dgemm(CblasNoTrans, CblasNoTrans, 1.0, X, XtX_inv, 0.0, tmp1);
   
-    gsl_matrix * tmp2 = gsl_matrix_alloc(N, N); // X (X'X)^-1 X'
-    gsl_blas_dgemm(CblasNoTrans, CblasTrans, 1.0, tmp1, X, 0.0, tmp2);
-  
-    gsl_matrix * T = gsl_matrix_alloc(N, N); // I - X (X'X)^-1 X'
-    for(size_t i = 0; i < T->size1; ++i){
-      for(size_t j = 0; j < T->size2; ++j){
-	double T_ij = - gsl_matrix_get(tmp2, i, j);
-	if(i == j)
-	  T_ij += 1;
-	gsl_matrix_set(T, i, j, T_ij);
-      }
-    }
+    gsl_matrix * T = gsl_matrix_alloc(N, N); // X (X'X)^-1 X'
+    gsl_blas_dgemm(CblasNoTrans, CblasTrans, 1.0, tmp1, X, 0.0, T);
+    mygsl_matrix_scale_add_diag(T, -1.0, 1.0); // I - X (X'X)^-1 X'
   
-    gsl_matrix * tmp3 = gsl_matrix_alloc(N, 2); // (I - X (X'X)^-1 X') Y
+    gsl_matrix * tmp3 = gsl_matrix_alloc(N, Y->size2); // (I - X (X'X)^-1 X') Y
     gsl_blas_dgemm(CblasNoTrans, CblasNoTrans, 1.0, T, Y, 0.0, tmp3);
   
     gsl_blas_dgemm(CblasTrans, CblasNoTrans, 1/(double)N, Y, tmp3, 0.0, Sigma_hat);
@@ -300,7 +918,6 @@ namespace utils {
       gsl_matrix_free(XtX);
     gsl_matrix_free(XtX_inv);
     gsl_matrix_free(tmp1);
-    gsl_matrix_free(tmp2);
     gsl_matrix_free(T);
     gsl_matrix_free(tmp3);
   }
@@ -334,10 +951,332 @@ namespace utils {
   void mygsl_linalg_outer(const gsl_vector * vec1, const gsl_vector * vec2,
 			  gsl_matrix * mat)
   {
-    for(size_t i = 0; i < mat->size1; ++i)
+    const double * v2 = vec2->data;
+    vector<double> v2_contiguous;
+    if(vec2->stride != 1){
+      v2_contiguous.resize(mat->size2);
       for(size_t j = 0; j < mat->size2; ++j)
-	gsl_matrix_set(mat, i, j, gsl_vector_get(vec1, i) *
-		       gsl_vector_get(vec2, j));
+	v2_contiguous[j] = vec2->data[j * vec2->stride];
+      v2 = &v2_contiguous[0];
+    }
+    for(size_t i = 0; i < mat->size1; ++i){
+      const double v1_i = vec1->data[i * vec1->stride];
+      double * row = mat->data + i * mat->tda;
+      for(size_t j = 0; j < mat->size2; ++j)
+	row[j] = v1_i * v2[j];
+    }
+  }
+
+/** \brief Return an orthonormal basis of the column space of C (N x rank),
+ *  or NULL if C is null.
+ */
+  gsl_matrix * CalcCovariateBasis(const gsl_matrix * C, size_t & rank)
+  {
+    size_t N = C->size1, Q = C->size2;
+  
+    // C = U D V' where U is NxQ
+    gsl_matrix * U = mygsl_matrix_alloc(C), * V = gsl_matrix_alloc(Q, Q);
+    gsl_vector * D_diag = gsl_vector_alloc(Q), * work = gsl_vector_alloc(Q);
+    gsl_linalg_SV_decomp(U, V, D_diag, work);
+  
+    // singular values are sorted, drop the columns of U for the null space
+    rank = 0;
+    while(rank < Q && gsl_vector_get(D_diag, rank) >
+	  GSL_DBL_EPSILON * N * gsl_vector_get(D_diag, 0))
+      ++rank;
+  
+    gsl_matrix * Ur = NULL;
+    if(rank > 0){
+      Ur = gsl_matrix_alloc(N, rank);
+      gsl_matrix_const_view tmp = gsl_matrix_const_submatrix(U, 0, 0, N, rank);
+      gsl_matrix_memcpy(Ur, &tmp.matrix);
+    }
+  
+    gsl_matrix_free(U);
+    gsl_matrix_free(V);
+    gsl_vector_free(D_diag);
+    gsl_vector_free(work);
+  
+    return Ur;
+  }
+
+/** \brief Replace M by its residuals M - U U' M, the variables being in
+ *  the columns of M (N x K), or in its rows if byRows (K x N).
+ *  \param U orthonormal basis from CalcCovariateBasis, nothing done if NULL
+ */
+  void ResidualizeOnBasis(const gsl_matrix * U, gsl_matrix * M,
+			  const bool byRows)
+  {
+    if(U == NULL)
+      return;
+    size_t K = byRows ? M->size1 : M->size2, rank = U->size2;
+    gsl_matrix * UtM = gsl_matrix_alloc(rank, K);
+    if(! byRows){
+      gsl_blas_dgemm(CblasTrans, CblasNoTrans, 1.0, U, M, 0.0, UtM);
+      gsl_blas_dgemm(CblasNoTrans, CblasNoTrans, -1.0, U, UtM, 1.0, M);
+    }
+    else{
+      gsl_blas_dgemm(CblasTrans, CblasTrans, 1.0, U, M, 0.0, UtM);
+      gsl_blas_dgemm(CblasTrans, CblasTrans, -1.0, UtM, U, 1.0, M);
+    }
+    gsl_matrix_free(UtM);
+  }
+
+/** \brief Replace each column of M by its residuals after regression on
+ *  the columns of C, ie. M <- (I - Q Q') M where Q is an orthonormal basis
+ *  of the column space of C.
+ *  \note C is N x Q (intercept included), M is N x K; rank receives the
+ *  rank of C so that callers can get the residual degrees of freedom.
+ */
+  void ResidualizeOnCovariates(const gsl_matrix * C, gsl_matrix * M,
+			       size_t & rank)
+  {
+    gsl_matrix * U = CalcCovariateBasis(C, rank);
+    ResidualizeOnBasis(U, M, false);
+    if(U != NULL)
+      gsl_matrix_free(U);
+  }
+
+/** \brief Return the two-sided p-value of the genotype effect in a linear
+ *  regression from the correlation r between residualized genotype and
+ *  phenotype, with df the residual degrees of freedom.
+ */
+  double CalcPvalFromCorrelation(const double r, const size_t df)
+  {
+    double r2 = r * r;
+    if(r2 >= 1.0)
+      return 0.0;
+    return 2 * gsl_cdf_tdist_Q(sqrt(df * r2 / (1 - r2)), df);
+  }
+
+/** \brief Return the smallest |r| whose p-value from
+ *  CalcPvalFromCorrelation is at most pval, so that scans can discard
+ *  pairs before computing their p-value.
+ */
+  double CalcCorrelationFromPval(const double pval, const size_t df)
+  {
+    if(pval >= 1.0)
+      return 0.0;
+    if(pval <= 0.0)
+      return 1.0;
+    double t = gsl_cdf_tdist_Qinv(pval / 2, df);
+    return t / sqrt(df + t * t);
+  }
+
+/** \brief Fill norms with the Euclidean norm of each row of M.
+ */
+  void CalcRowNorms(const gsl_matrix * M, double * norms)
+  {
+    for(size_t r = 0; r < M->size1; ++r){
+      gsl_vector_const_view row = gsl_matrix_const_row(M, r);
+      norms[r] = gsl_blas_dnrm2(&row.vector);
+    }
+  }
+
+/** \brief Scale each row of M to unit norm, norms receiving the original
+ *  norms; rows whose norm is negligible compared to refNorms (eg. the norms
+ *  before regressing out the covariates) are set to zero, as their norm.
+ */
+  void ScaleRowsToUnitNorm(gsl_matrix * M, const double * refNorms,
+			   double * norms)
+  {
+    CalcRowNorms(M, norms);
+    for(size_t r = 0; r < M->size1; ++r){
+      gsl_vector_view row = gsl_matrix_row(M, r);
+      if(norms[r] > 1e-10 * refNorms[r])
+	gsl_vector_scale(&row.vector, 1 / norms[r]);
+      else{
+	norms[r] = 0.0;
+	gsl_vector_set_zero(&row.vector);
+      }
+    }
+  }
+
+/** \brief Scale each column of M to unit norm.
+ *  \note Constant columns are set to zero so that their correlation with
+ *  anything is zero.
+ */
+  static void scaleColumnsToUnitNorm(gsl_matrix * M)
+  {
+    for(size_t k = 0; k < M->size2; ++k){
+      gsl_vector_view col = gsl_matrix_column(M, k);
+      double norm = gsl_blas_dnrm2(&col.vector);
+      if(norm > GSL_DBL_EPSILON * sqrt((double) M->size1))
+	gsl_vector_scale(&col.vector, 1 / norm);
+      else
+	gsl_vector_set_zero(&col.vector);
+    }
+  }
+
+/** \brief Return the max over rows of |M_ik| for each column k of M.
+ */
+  static void maxAbsPerColumn(const gsl_matrix * M, vector<double> & maxs)
+  {
+    maxs.assign(M->size2, 0.0);
+    for(size_t i = 0; i < M->size1; ++i){
+      const double * row = gsl_matrix_const_ptr(M, i, 0);
+      for(size_t k = 0; k < M->size2; ++k)
+	if(fabs(row[k]) > maxs[k])
+	  maxs[k] = fabs(row[k]);
+    }
+  }
+
+/** \brief Compute the gene-level permutation p-value of the best cis SNP,
+ *  ie. the probability under the null of a max |correlation| between
+ *  residualized genotypes and phenotype at least as large as observed.
+ *  \param y phenotype of the gene (N)
+ *  \param G genotypes of the gene's SNPs (N x S)
+ *  \param C covariates, intercept included (N x Q)
+ *  \param nbPerms maximum number of permutations
+ *  \param nbSuccessesToStop stop once as many permutations reached the
+ *  observed statistic (Besag and Clifford, 1991); 0 to do all permutations
+ *  \param seed seed of the pseudo-random number generator, permutation k
+ *  using the substream k of this seed
+ *  \note Genotypes and phenotype are residualized on the covariates once,
+ *  then the residualized phenotype is permuted (as in FastQTL), so that
+ *  each permutation is a single product G' y_perm. Permutations are done in
+ *  batches whose columns are drawn by the OpenMP threads, then multiplied
+ *  by G' in a single BLAS call (or one per thread with gslcblas), and the
+ *  early stopping is checked between batches, hence the result doesn't
+ *  depend on the number of threads.
+ *  \return (1 + nb of successes) / (1 + nbPermsDone)
+ */
+  double PermuteSingleGeneWithManySnps(const gsl_vector * y,
+				       const gsl_matrix * G,
+				       const gsl_matrix * C,
+				       const size_t nbPerms,
+				       const size_t nbSuccessesToStop,
+				       const size_t seed,
+				       size_t & nbPermsDone,
+				       double & maxAbsCorObs)
+  {
+    const size_t N = G->size1, S = G->size2, batchSize = 128;
+    size_t rank, nbSuccesses = 0;
+  
+    gsl_matrix * Gr = mygsl_matrix_alloc(G);
+    ResidualizeOnCovariates(C, Gr, rank);
+    scaleColumnsToUnitNorm(Gr);
+    gsl_matrix * yr = gsl_matrix_alloc(N, 1);
+    gsl_vector_view yr_col = gsl_matrix_column(yr, 0);
+    gsl_vector_memcpy(&yr_col.vector, y);
+    ResidualizeOnCovariates(C, yr, rank);
+    scaleColumnsToUnitNorm(yr);
+  
+    // observed statistic
+    gsl_matrix * GtY = gsl_matrix_alloc(S, batchSize);
+    vector<double> maxs;
+    gsl_matrix_view GtY_obs = gsl_matrix_submatrix(GtY, 0, 0, S, 1);
+    gsl_blas_dgemm(CblasTrans, CblasNoTrans, 1.0, Gr, yr, 0.0,
+		   &GtY_obs.matrix);
+    maxAbsPerColumn(&GtY_obs.matrix, maxs);
+    maxAbsCorObs = maxs[0];
+  
+    gsl_matrix * Yperm = gsl_matrix_alloc(N, batchSize);
+  
+    nbPermsDone = 0;
+    while(nbPermsDone < nbPerms &&
+	  (nbSuccessesToStop == 0 || nbSuccesses < nbSuccessesToStop)){
+      size_t B = min(batchSize, nbPerms - nbPermsDone);
+    
+      int nbSlices = 1;
+#ifdef _OPENMP
+      nbSlices = min((int) B, omp_get_max_threads());
+#pragma omp parallel for
+#endif
+      for(int t = 0; t < nbSlices; ++t){
+	size_t start = (B * t) / nbSlices, end = (B * (t+1)) / nbSlices;
+	RngStream rng;
+	vector<size_t> idx(N);
+	for(size_t b = start; b < end; ++b){
+	  rngStreamInit(rng, seed, nbPermsDone + b);
+	  for(size_t i = 0; i < N; ++i)
+	    idx[i] = i;
+	  rngStreamShuffle(rng, &idx[0], N);
+	  for(size_t i = 0; i < N; ++i)
+	    gsl_matrix_set(Yperm, i, b, gsl_matrix_get(yr, idx[i], 0));
+	}
+      }
+
+      // a multi-threaded BLAS does the whole batch in a single product
+      // outside any parallel region, as calling it from the OpenMP threads
+      // would oversubscribe the cores; the single-threaded gslcblas does
+      // one product per thread instead
+#if defined(UTILS_BLAS_OPENBLAS) || defined(UTILS_BLAS_BLIS)
+      nbSlices = 1;
+#endif
+#ifdef _OPENMP
+#pragma omp parallel for if(nbSlices > 1)
+#endif
+      for(int t = 0; t < nbSlices; ++t){
+	size_t start = (B * t) / nbSlices, end = (B * (t+1)) / nbSlices;
+	gsl_matrix_const_view Yp = gsl_matrix_const_submatrix(Yperm, 0, start,
+							      N, end - start);
+	gsl_matrix_view GtYp = gsl_matrix_submatrix(GtY, 0, start,
+						    S, end - start);
+	gsl_blas_dgemm(CblasTrans, CblasNoTrans, 1.0, Gr, &Yp.matrix, 0.0,
+		       &GtYp.matrix);
+      }
+    
+      gsl_matrix_const_view GtYb = gsl_matrix_const_submatrix(GtY, 0, 0, S, B);
+      maxAbsPerColumn(&GtYb.matrix, maxs);
+      for(size_t b = 0; b < B; ++b)
+	if(maxs[b] >= maxAbsCorObs)
+	  ++nbSuccesses;
+      nbPermsDone += B;
+    }
+  
+    gsl_matrix_free(Gr);
+    gsl_matrix_free(yr);
+    gsl_matrix_free(GtY);
+    gsl_matrix_free(Yperm);
+  
+    return (1 + nbSuccesses) / (double) (1 + nbPermsDone);
+  }
+
+/** \brief Return the name of the BLAS library chosen at compile time.
+ */
+  string mygsl_blas_backend(void)
+  {
+#if defined(UTILS_BLAS_OPENBLAS)
+    return "openblas";
+#elif defined(UTILS_BLAS_BLIS)
+    return "blis";
+#else
+    return "gslcblas";
+#endif
+  }
+
+/** \brief Set the number of threads used by the BLAS library as well as by
+ *  the OpenMP loops, so that both never oversubscribe the cores.
+ *  \note No effect on the BLAS part with the reference gslcblas, which is
+ *  single-threaded.
+ */
+  void mygsl_blas_set_num_threads(const int nbThreads)
+  {
+    if(nbThreads < 1){
+      cerr << "ERROR: number of threads should be >= 1 (not "
+	   << nbThreads << ")" << endl;
+      exit(1);
+    }
+#if defined(UTILS_BLAS_OPENBLAS)
+    openblas_set_num_threads(nbThreads);
+#elif defined(UTILS_BLAS_BLIS)
+    bli_thread_set_num_threads((int64_t) nbThreads);
+#endif
+#ifdef _OPENMP
+    omp_set_num_threads(nbThreads);
+#endif
+  }
+
+  int mygsl_blas_get_num_threads(void)
+  {
+#if defined(UTILS_BLAS_OPENBLAS)
+    return openblas_get_num_threads();
+#elif defined(UTILS_BLAS_BLIS)
+    return (int) bli_thread_get_num_threads();
+#else
+    return 1;
+#endif
   }
 
 } // namespace utils
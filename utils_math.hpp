@@ -15,12 +15,21 @@
  *
  *  You should have received a copy of the GNU General Public License
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  All matrix products go through the CBLAS interface of GSL (gsl_blas_*),
+ *  hence the BLAS library is chosen at link time:
+ *  - reference (default): -lgsl -lgslcblas
+ *  - OpenBLAS: -DUTILS_BLAS_OPENBLAS ... -lgsl -lopenblas
+ *  - BLIS: -DUTILS_BLAS_BLIS ... -lgsl -lblis
+ *  The macro only enables the thread-count control of the chosen library,
+ *  see mygsl_blas_set_num_threads.
  */
 
 #ifndef UTILS_UTILS_MATH_HPP
 #define UTILS_UTILS_MATH_HPP
 
 #include <cstdlib>
+#include <stdint.h>
 
 #include <string>
 #include <limits>
@@ -42,6 +51,33 @@ namespace utils {
 
   size_t getSeed(void);
 
+/** \brief State of a Philox4x32-10 counter-based generator (Salmon et al,
+ *  SC 2011), used as one independent substream of a user seed.
+ *  \note The key holds the seed, the high half of the counter holds the
+ *  substream id and the low half counts the 128-bit blocks drawn, hence
+ *  each substream has 2^64 blocks and no jump-ahead is ever needed.
+ */
+  struct RngStream
+  {
+    uint32_t key[2];
+    uint32_t counter[4];
+    uint32_t block[4];
+    size_t nbUnused;
+  };
+
+  void rngStreamInit(RngStream & rng, const size_t seed,
+		     const size_t substream);
+
+  uint32_t rngStreamNext(RngStream & rng);
+
+  double rngStreamUniform(RngStream & rng);
+
+  void rngStreamUniformBatch(RngStream & rng, double * out, const size_t n);
+
+  void rngStreamNormalBatch(RngStream & rng, double * out, const size_t n);
+
+  void rngStreamShuffle(RngStream & rng, size_t * idx, const size_t n);
+
   double round(double x);
   
   size_t sum_bool(const std::vector<bool> & vec);
@@ -53,6 +89,18 @@ namespace utils {
   double log10_weighted_sum(const double * vec, const double * weights,
 			    const size_t size);
 
+// number of columns up to which the regressions use kernels specialized
+// at compile time, see FitSingleGeneWithSingleSnp
+#define UTILS_MAX_SMALL_P 16
+
+  void FitSingleGeneWithSingleSnpSvd(const gsl_matrix * X,
+				     const gsl_vector * y,
+				     double & pve,
+				     double & sigmahat,
+				     double & betahat_geno,
+				     double & sebetahat_geno,
+				     double & betapval_geno);
+
   void FitSingleGeneWithSingleSnp(const gsl_matrix * X,
 				  const gsl_vector * y,
 				  double & pve,
@@ -61,18 +109,41 @@ namespace utils {
 				  double & sebetahat_geno,
 				  double & betapval_geno);
 
+  void FitSingleGeneWithManySnps(const gsl_matrix * C,
+				 const gsl_vector * y,
+				 const gsl_matrix * G,
+				 gsl_vector * pve,
+				 gsl_vector * sigmahat,
+				 gsl_vector * betahat_geno,
+				 gsl_vector * sebetahat_geno,
+				 gsl_vector * betapval_geno);
+
   double mygsl_vector_sum(const gsl_vector * vec);
 
   void mygsl_vector_pow(gsl_vector * vec, const double exponent);
 
   void mygsl_matrix_pow(gsl_matrix * mat, const double exponent);
 
+  double mygsl_vector_pow_sum(const gsl_vector * vec, const double exponent);
+
+  void mygsl_matrix_scale_columns(gsl_matrix * mat, const gsl_vector * vec,
+				  const double exponent);
+
+  void mygsl_matrix_scale_rows(gsl_matrix * mat, const gsl_vector * vec,
+			       const double exponent);
+
+  void mygsl_matrix_scale_add_diag(gsl_matrix * mat, const double alpha,
+				   const double x);
+
   gsl_matrix * mygsl_matrix_diagalloc(const gsl_vector * vec, const double x);
 
   gsl_matrix * mygsl_matrix_diagalloc(const gsl_matrix * mat, const double x);
 
   void mygsl_linalg_pseudoinverse(const gsl_matrix * X, gsl_matrix * X_ps);
 
+  void mygsl_linalg_invsqrt(const gsl_matrix * A, gsl_matrix * A_invsqrt,
+			    const double tol);
+
   gsl_vector * mygsl_vector_alloc(const gsl_vector * vec);
 
   gsl_matrix * mygsl_matrix_alloc(const gsl_matrix * src);
@@ -87,6 +158,38 @@ namespace utils {
   void mygsl_linalg_outer(const gsl_vector * vec1, const gsl_vector * vec2,
 			  gsl_matrix * mat);
 
+  gsl_matrix * CalcCovariateBasis(const gsl_matrix * C, size_t & rank);
+
+  void ResidualizeOnBasis(const gsl_matrix * U, gsl_matrix * M,
+			  const bool byRows);
+
+  void ResidualizeOnCovariates(const gsl_matrix * C, gsl_matrix * M,
+			       size_t & rank);
+
+  double CalcPvalFromCorrelation(const double r, const size_t df);
+
+  double CalcCorrelationFromPval(const double pval, const size_t df);
+
+  void CalcRowNorms(const gsl_matrix * M, double * norms);
+
+  void ScaleRowsToUnitNorm(gsl_matrix * M, const double * refNorms,
+			   double * norms);
+
+  double PermuteSingleGeneWithManySnps(const gsl_vector * y,
+				       const gsl_matrix * G,
+				       const gsl_matrix * C,
+				       const size_t nbPerms,
+				       const size_t nbSuccessesToStop,
+				       const size_t seed,
+				       size_t & nbPermsDone,
+				       double & maxAbsCorObs);
+
+  std::string mygsl_blas_backend(void);
+
+  void mygsl_blas_set_num_threads(const int nbThreads);
+
+  int mygsl_blas_get_num_threads(void);
+
 } // namespace utils
 
 #endif // UTILS_UTILS_MATH_HPP